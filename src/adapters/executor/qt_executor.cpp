@@ -1,8 +1,53 @@
 #include "qt_executor.h"
-#include <QEventLoop>
+#include "core/metrics.h"
+#include <QElapsedTimer>
+#include <QPointer>
 #include <QTimer>
 #include <QNetworkReply>
 #include <QUrl>
+#include <memory>
+
+namespace {
+
+// Return the manager to the pool once the reply is gone. Streaming replies
+// are re-parented to their StreamSession, so this fires whenever the session
+// is torn down. The guard skips the release if the manager itself is being
+// destroyed (ConnectionPool::clear deletes managers together with children).
+// The release is posted: `destroyed` fires while the reply is still among
+// its manager's children, and a release that deletes the manager (unpooled,
+// or over the limit after a resize) would delete the reply a second time.
+// The pool also learns from the response headers whether the host speaks
+// HTTP/2, which decides how many requests it puts on one manager.
+void releaseWithReply(ConnectionPool& pool, QNetworkReply* reply, QNetworkAccessManager* nam)
+{
+    const QPointer<QNetworkAccessManager> guard(nam);
+    QObject::connect(reply, &QNetworkReply::metaDataChanged, reply, [pool = &pool, reply, guard]() {
+        if (guard) {
+            pool->noteProtocol(guard.data(),
+                               reply->attribute(QNetworkRequest::Http2WasUsedAttribute).toBool());
+        }
+    }, Qt::SingleShotConnection);
+    QObject::connect(reply, &QObject::destroyed, [pool = &pool, guard]() {
+        if (!guard) {
+            return;
+        }
+        QMetaObject::invokeMethod(guard.data(), [pool, guard]() {
+            if (guard) {
+                pool->release(guard.data());
+            }
+        }, Qt::QueuedConnection);
+    });
+}
+
+QMap<QString, QString> responseHeaders(QNetworkReply* reply)
+{
+    QMap<QString, QString> headers;
+    for (const auto& header : reply->rawHeaderList())
+        headers[QString::fromUtf8(header)] = QString::fromUtf8(reply->rawHeader(header));
+    return headers;
+}
+
+}
 
 QtExecutor::QtExecutor(ConnectionPool& pool, const QSslConfiguration& sslConfig)
     : m_pool(pool)
@@ -21,9 +66,33 @@ QNetworkRequest QtExecutor::buildQtRequest(const ProviderRequest& request) const
         req.setHeader(QNetworkRequest::ContentTypeHeader, "application/json");
 
     req.setTransferTimeout(m_requestTimeout);
+    req.setAttribute(QNetworkRequest::Http2AllowedAttribute, m_http2);
     return req;
 }
 
+QNetworkReply* QtExecutor::sendRequest(QNetworkAccessManager* nam,
+                                       const QNetworkRequest& req,
+                                       const ProviderRequest& request) const {
+    const QString method = request.method.trimmed().toUpper();
+    if (method.isEmpty() || method == "POST")
+        return nam->post(req, request.body);
+    if (method == "GET")
+        return nam->get(req);
+    if (method == "PUT")
+        return nam->put(req, request.body);
+    if (method == "DELETE")
+        return nam->deleteResource(req);
+    return nam->sendCustomRequest(req, method.toUtf8(), request.body);
+}
+
+QNetworkReply* QtExecutor::startReply(const ProviderRequest& request) {
+    const QNetworkRequest req = buildQtRequest(request);
+    auto* nam = m_pool.acquire(req.url());
+    QNetworkReply* reply = sendRequest(nam, req, request);
+    releaseWithReply(m_pool, reply, nam);
+    return reply;
+}
+
 std::optional<DomainFailure> QtExecutor::checkConnectionError(QNetworkReply* reply) const {
     if (!reply) return DomainFailure::internal("null reply");
     if (reply->error() == QNetworkReply::NoError) return std::nullopt;
@@ -31,118 +100,143 @@ std::optional<DomainFailure> QtExecutor::checkConnectionError(QNetworkReply* rep
     int status = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
     if (status == 401 || status == 403)
         return DomainFailure::unauthorized(reply->errorString());
-    if (status == 429)
-        return DomainFailure::rateLimited(reply->errorString());
-    if (status >= 500)
-        return DomainFailure::unavailable(reply->errorString());
-    if (reply->error() == QNetworkReply::TimeoutError)
+    if (status == 429 || status >= 500) {
+        DomainFailure failure = status == 429 ? DomainFailure::rateLimited(reply->errorString())
+                                              : DomainFailure::unavailable(reply->errorString());
+        failure.retryAfterMs = DomainFailure::retryAfterFromHeaders(responseHeaders(reply));
+        return failure;
+    }
+    // Replies are only cancelled by the transfer timeout or our own timer
+    if (reply->error() == QNetworkReply::TimeoutError
+        || reply->error() == QNetworkReply::OperationCanceledError)
         return DomainFailure::timeout(reply->errorString());
+    // No response at all: refused, reset, unresolvable, TLS or proxy failure
+    if (status == 0)
+        return DomainFailure::unavailable(reply->errorString());
 
     return DomainFailure::internal(reply->errorString());
 }
 
-Result<ProviderResponse> QtExecutor::execute(const ProviderRequest& request) {
-    auto* nam = m_pool.acquire();
-    QNetworkRequest req = buildQtRequest(request);
+void QtExecutor::execute(const ProviderRequest& request, ExecuteCallback done) {
+    QElapsedTimer sent;
+    sent.start();
+    QNetworkReply* reply = startReply(request);
+
+    auto cancelled = std::make_shared<bool>(false);
+    QMetaObject::Connection cancel;
+    if (request.cancelScope) {
+        cancel = QObject::connect(request.cancelScope.data(), &QObject::destroyed, reply,
+                                  [reply, cancelled]() {
+            *cancelled = true;
+            reply->abort();
+        });
+    }
 
-    const QString method = request.method.trimmed().toUpper();
-    QNetworkReply* reply = nullptr;
-    if (method == "POST")
-        reply = nam->post(req, request.body);
-    else if (method == "GET")
-        reply = nam->get(req);
-    else if (method == "PUT")
-        reply = nam->put(req, request.body);
-    else if (method == "DELETE")
-        reply = nam->deleteResource(req);
-    else
-        reply = nam->sendCustomRequest(req, method.toUtf8(), request.body);
-
-    QEventLoop loop;
-    QObject::connect(reply, &QNetworkReply::finished, &loop, &QEventLoop::quit);
-    QTimer timeoutTimer;
-    timeoutTimer.setSingleShot(true);
-    QObject::connect(&timeoutTimer, &QTimer::timeout, &loop, &QEventLoop::quit);
-    timeoutTimer.start(m_requestTimeout);
-    loop.exec();
-
-    if (reply->isRunning()) {
+    auto timedOut = std::make_shared<bool>(false);
+    auto* timeoutTimer = new QTimer(reply);
+    timeoutTimer->setSingleShot(true);
+    QObject::connect(timeoutTimer, &QTimer::timeout, reply, [reply, timedOut]() {
+        *timedOut = true;
         reply->abort();
-        m_pool.release(nam);
+    });
+    timeoutTimer->start(m_requestTimeout);
+
+    const QString adapterHint = request.adapterHint;
+    QObject::connect(reply, &QNetworkReply::finished, reply,
+                     [this, reply, timeoutTimer, timedOut, cancelled, cancel, adapterHint, sent,
+                      done = std::move(done)]() {
+        timeoutTimer->stop();
+        QObject::disconnect(cancel);
         reply->deleteLater();
-        return std::unexpected(DomainFailure::timeout("request timeout"));
-    }
+        if (*cancelled)
+            return;
+        metrics::registry().upstreamLatency.observe(double(sent.nsecsElapsed()) / 1e9);
 
-    auto err = checkConnectionError(reply);
-    if (err) {
-        m_pool.release(nam);
-        reply->deleteLater();
-        return std::unexpected(*err);
-    }
+        if (*timedOut) {
+            done(std::unexpected(DomainFailure::timeout("request timeout")));
+            return;
+        }
 
-    ProviderResponse resp;
-    resp.statusCode = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
-    resp.body = reply->readAll();
-    resp.adapterHint = request.adapterHint;
-    for (const auto& header : reply->rawHeaderList())
-        resp.headers[QString::fromUtf8(header)] = QString::fromUtf8(reply->rawHeader(header));
+        auto err = checkConnectionError(reply);
+        if (err) {
+            done(std::unexpected(*err));
+            return;
+        }
 
-    reply->deleteLater();
-    m_pool.release(nam);
-    return resp;
+        ProviderResponse resp;
+        resp.statusCode = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+        resp.body = reply->readAll();
+        resp.adapterHint = adapterHint;
+        resp.headers = responseHeaders(reply);
+        done(resp);
+    });
 }
 
-Result<QNetworkReply*> QtExecutor::connectStream(const ProviderRequest& request) {
-    auto* nam = m_pool.acquire();
-    QNetworkRequest req = buildQtRequest(request);
-
-    QNetworkReply* reply = nam->post(req, request.body);
+void QtExecutor::connectStream(const ProviderRequest& request, ConnectStreamCallback done) {
+    QElapsedTimer sent;
+    sent.start();
+    QNetworkReply* reply = startReply(request);
+
+    // The callback fires on whichever comes first: the first body bytes, an
+    // error, completion, or the connection timeout. A per-call context object
+    // owns the temporary connections so they all go away once settled.
+    struct PendingStream {
+        bool settled = false;
+        ConnectStreamCallback done;
+    };
+    auto state = std::make_shared<PendingStream>();
+    state->done = std::move(done);
+
+    auto* context = new QObject(reply);
+    auto* timeoutTimer = new QTimer(context);
+    timeoutTimer->setSingleShot(true);
+
+    QMetaObject::Connection cancel;
+    if (request.cancelScope) {
+        cancel = QObject::connect(request.cancelScope.data(), &QObject::destroyed, context,
+                                  [reply, context, state]() {
+            if (state->settled) return;
+            state->settled = true;
+            context->deleteLater();
+            reply->abort();
+            reply->deleteLater();
+        });
+    }
 
-    QEventLoop loop;
-    bool gotData = false;
-    bool gotError = false;
+    auto finish = [this, reply, context, state, cancel, sent](bool gotError, bool timedOut) {
+        if (state->settled) return;
+        state->settled = true;
+        QObject::disconnect(cancel);
+        context->deleteLater();
+        metrics::registry().upstreamLatency.observe(double(sent.nsecsElapsed()) / 1e9);
+
+        if (gotError) {
+            auto err = checkConnectionError(reply);
+            reply->abort();
+            reply->deleteLater();
+            state->done(std::unexpected(err.value_or(DomainFailure::internal("connection failed"))));
+            return;
+        }
+        if (timedOut) {
+            reply->abort();
+            reply->deleteLater();
+            state->done(std::unexpected(DomainFailure::timeout("connection timeout")));
+            return;
+        }
+        state->done(reply);
+    };
 
-    QObject::connect(reply, &QNetworkReply::readyRead, &loop, [&]() {
-        gotData = true;
-        loop.quit();
+    QObject::connect(reply, &QNetworkReply::readyRead, context, [finish]() {
+        finish(false, false);
     });
-    QObject::connect(reply, &QNetworkReply::errorOccurred, &loop, [&]() {
-        gotError = true;
-        loop.quit();
+    QObject::connect(reply, &QNetworkReply::errorOccurred, context, [finish]() {
+        finish(true, false);
     });
-    QObject::connect(reply, &QNetworkReply::finished, &loop, &QEventLoop::quit);
-
-    QTimer timeoutTimer;
-    timeoutTimer.setSingleShot(true);
-    QObject::connect(&timeoutTimer, &QTimer::timeout, &loop, [&]() {
-        loop.quit();
+    QObject::connect(reply, &QNetworkReply::finished, context, [finish, reply]() {
+        finish(reply->error() != QNetworkReply::NoError, false);
     });
-    timeoutTimer.start(m_connectionTimeout);
-    loop.exec();
-
-    if (gotError) {
-        auto err = checkConnectionError(reply);
-        reply->abort();
-        reply->deleteLater();
-        m_pool.release(nam);
-        return std::unexpected(err.value_or(DomainFailure::internal("connection failed")));
-    }
-
-    if (!gotData && reply->isRunning()) {
-        reply->abort();
-        reply->deleteLater();
-        m_pool.release(nam);
-        return std::unexpected(DomainFailure::timeout("connection timeout"));
-    }
-
-    m_streamManagers.insert(reply, nam);
-    QObject::connect(reply, &QObject::destroyed, [this, reply]() {
-        auto it = m_streamManagers.find(reply);
-        if (it != m_streamManagers.end()) {
-            m_pool.release(it.value());
-            m_streamManagers.erase(it);
-        }
+    QObject::connect(timeoutTimer, &QTimer::timeout, context, [finish]() {
+        finish(false, true);
     });
-
-    return reply;
+    timeoutTimer->start(m_connectionTimeout);
 }
@@ -7,20 +7,25 @@ class QtExecutor : public IExecutor {
 public:
     explicit QtExecutor(ConnectionPool& pool, const QSslConfiguration& sslConfig);
 
-    Result<ProviderResponse> execute(const ProviderRequest& request) override;
-    Result<QNetworkReply*> connectStream(const ProviderRequest& request) override;
+    void execute(const ProviderRequest& request, ExecuteCallback done) override;
+    void connectStream(const ProviderRequest& request, ConnectStreamCallback done) override;
 
     void setRequestTimeout(int ms) { m_requestTimeout = ms; }
     void setConnectionTimeout(int ms) { m_connectionTimeout = ms; }
+    // Offer HTTP/2 through ALPN; hosts that decline are served over HTTP/1.1
+    void setHttp2Enabled(bool enabled) { m_http2 = enabled; }
 
 private:
     ConnectionPool& m_pool;
     QSslConfiguration m_sslConfig;
     int m_requestTimeout = 120000;
     int m_connectionTimeout = 30000;
-
-    QMap<QNetworkReply*, QNetworkAccessManager*> m_streamManagers;
+    bool m_http2 = true;
 
     QNetworkRequest buildQtRequest(const ProviderRequest& request) const;
+    QNetworkReply* sendRequest(QNetworkAccessManager* nam,
+                               const QNetworkRequest& req,
+                               const ProviderRequest& request) const;
+    QNetworkReply* startReply(const ProviderRequest& request);
     std::optional<DomainFailure> checkConnectionError(QNetworkReply* reply) const;
 };
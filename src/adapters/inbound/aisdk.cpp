@@ -14,6 +14,13 @@ Result<SemanticRequest> AiSdkAdapter::decodeRequest(
     return m_openaiHelper.decodeRequest(body, metadata);
 }
 
+Result<SemanticRequest> AiSdkAdapter::decodeParsedRequest(
+    const QJsonObject& root,
+    const QMap<QString, QString>& metadata)
+{
+    return m_openaiHelper.decodeParsedRequest(root, metadata);
+}
+
 Result<QByteArray> AiSdkAdapter::encodeResponse(const SemanticResponse& response)
 {
     return m_openaiHelper.encodeResponse(response);
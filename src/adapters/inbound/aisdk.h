@@ -10,6 +10,9 @@ public:
     Result<SemanticRequest> decodeRequest(
         const QByteArray& body,
         const QMap<QString, QString>& metadata) override;
+    Result<SemanticRequest> decodeParsedRequest(
+        const QJsonObject& root,
+        const QMap<QString, QString>& metadata) override;
     Result<QByteArray> encodeResponse(
         const SemanticResponse& response) override;
     Result<QByteArray> encodeStreamFrame(
@@ -118,15 +118,17 @@ Result<SemanticRequest> AnthropicAdapter::decodeRequest(
     const QByteArray& body,
     const QMap<QString, QString>& metadata)
 {
-    QJsonParseError parseErr;
-    const QJsonDocument doc = QJsonDocument::fromJson(body, &parseErr);
-    if (parseErr.error != QJsonParseError::NoError || !doc.isObject()) {
-        return std::unexpected(DomainFailure::invalidInput(
-            QStringLiteral("invalid_json"),
-            QStringLiteral("Request body is not valid JSON: %1").arg(parseErr.errorString())));
+    const auto root = parseRequestObject(body);
+    if (!root) {
+        return std::unexpected(root.error());
     }
+    return decodeParsedRequest(*root, metadata);
+}
 
-    const QJsonObject root = doc.object();
+Result<SemanticRequest> AnthropicAdapter::decodeParsedRequest(
+    const QJsonObject& root,
+    const QMap<QString, QString>& metadata)
+{
     SemanticRequest req;
     req.envelope.requestId = QUuid::createUuid().toString(QUuid::WithoutBraces);
     req.target.logicalModel = root[QStringLiteral("model")].toString();
@@ -44,22 +44,24 @@ Result<SemanticRequest> AntigravityAdapter::decodeRequest(
     const QByteArray& body,
     const QMap<QString, QString>& metadata)
 {
-    QJsonParseError parseErr;
-    const QJsonDocument doc = QJsonDocument::fromJson(body, &parseErr);
-    if (parseErr.error != QJsonParseError::NoError || !doc.isObject()) {
-        return std::unexpected(DomainFailure::invalidInput(
-            QStringLiteral("invalid_json"),
-            QStringLiteral("Request body is not valid JSON: %1").arg(parseErr.errorString())));
+    const auto root = parseRequestObject(body);
+    if (!root) {
+        return std::unexpected(root.error());
     }
+    return decodeParsedRequest(*root, metadata);
+}
 
-    const QJsonObject root = doc.object();
+Result<SemanticRequest> AntigravityAdapter::decodeParsedRequest(
+    const QJsonObject& root,
+    const QMap<QString, QString>& metadata)
+{
     IInboundAdapter* delegate = delegateFromRequest(root);
     if (!delegate) {
         return std::unexpected(DomainFailure::internal(
             QStringLiteral("Antigravity delegate is not configured")));
     }
 
-    auto result = delegate->decodeRequest(body, metadata);
+    auto result = delegate->decodeParsedRequest(root, metadata);
     if (result.has_value()) {
         result->metadata[QStringLiteral("_client")] = QStringLiteral("antigravity");
         result->metadata[QStringLiteral("_antigravity_delegate")] =
@@ -21,6 +21,17 @@ Result<SemanticRequest> ClaudeCodeAdapter::decodeRequest(
     return result;
 }
 
+Result<SemanticRequest> ClaudeCodeAdapter::decodeParsedRequest(
+    const QJsonObject& root,
+    const QMap<QString, QString>& metadata)
+{
+    auto result = m_delegate->decodeParsedRequest(root, metadata);
+    if (result.has_value()) {
+        result->metadata[QStringLiteral("_client")] = QStringLiteral("claudecode");
+    }
+    return result;
+}
+
 Result<QByteArray> ClaudeCodeAdapter::encodeResponse(const SemanticResponse& response)
 {
     return m_delegate->encodeResponse(response);
@@ -72,21 +72,25 @@ Result<SemanticRequest> GeminiAdapter::decodeRequest(
     const QByteArray& body,
     const QMap<QString, QString>& metadata)
 {
-    QJsonParseError parseErr;
-    const QJsonDocument doc = QJsonDocument::fromJson(body, &parseErr);
-    if (parseErr.error != QJsonParseError::NoError || !doc.isObject()) {
-        return std::unexpected(DomainFailure::invalidInput(
-            QStringLiteral("invalid_json"),
-            QStringLiteral("Request body is not valid JSON: %1").arg(parseErr.errorString())));
+    const auto root = parseRequestObject(body);
+    if (!root) {
+        return std::unexpected(root.error());
     }
+    return decodeParsedRequest(*root, metadata);
+}
 
-    const QJsonObject root = doc.object();
+Result<SemanticRequest> GeminiAdapter::decodeParsedRequest(
+    const QJsonObject& root,
+    const QMap<QString, QString>& metadata)
+{
     SemanticRequest req;
     req.envelope.requestId = QUuid::createUuid().toString(QUuid::WithoutBraces);
 
-    // Model comes from metadata or URL typically, but check root too
+    // Gemini names the model in the URL (route.model); a body field wins
     if (root.contains(QStringLiteral("model")))
         req.target.logicalModel = root[QStringLiteral("model")].toString();
+    else
+        req.target.logicalModel = metadata.value(QStringLiteral("route.model"));
 
     // System instruction
     if (root.contains(QStringLiteral("systemInstruction"))) {
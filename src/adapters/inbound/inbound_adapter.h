@@ -3,3 +3,17 @@
 #include <QJsonDocument>
 #include <QJsonObject>
 #include <QJsonArray>
+
+// Parses a request body that must be a JSON object, failing the way every
+// inbound adapter reports malformed input
+inline Result<QJsonObject> parseRequestObject(const QByteArray& body)
+{
+    QJsonParseError parseErr;
+    const QJsonDocument doc = QJsonDocument::fromJson(body, &parseErr);
+    if (parseErr.error != QJsonParseError::NoError || !doc.isObject()) {
+        return std::unexpected(DomainFailure::invalidInput(
+            QStringLiteral("invalid_json"),
+            QStringLiteral("Request body is not valid JSON: %1").arg(parseErr.errorString())));
+    }
+    return doc.object();
+}
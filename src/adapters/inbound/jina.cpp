@@ -21,6 +21,17 @@ Result<SemanticRequest> JinaAdapter::decodeRequest(
     return result;
 }
 
+Result<SemanticRequest> JinaAdapter::decodeParsedRequest(
+    const QJsonObject& root,
+    const QMap<QString, QString>& metadata)
+{
+    auto result = m_delegate->decodeParsedRequest(root, metadata);
+    if (result.has_value()) {
+        result->metadata[QStringLiteral("_client")] = QStringLiteral("jina");
+    }
+    return result;
+}
+
 Result<QByteArray> JinaAdapter::encodeResponse(const SemanticResponse& response)
 {
     return m_delegate->encodeResponse(response);
@@ -69,6 +69,26 @@ IInboundAdapter* InboundMultiRouter::findAdapterFromFailure(const DomainFailure&
 Result<SemanticRequest> InboundMultiRouter::decodeRequest(
     const QByteArray& body,
     const QMap<QString, QString>& metadata)
+{
+    return decodeWith(metadata, [&body](IInboundAdapter* adapter,
+                                        const QMap<QString, QString>& enrichedMeta) {
+        return adapter->decodeRequest(body, enrichedMeta);
+    });
+}
+
+Result<SemanticRequest> InboundMultiRouter::decodeParsedRequest(
+    const QJsonObject& root,
+    const QMap<QString, QString>& metadata)
+{
+    return decodeWith(metadata, [&root](IInboundAdapter* adapter,
+                                        const QMap<QString, QString>& enrichedMeta) {
+        return adapter->decodeParsedRequest(root, enrichedMeta);
+    });
+}
+
+Result<SemanticRequest> InboundMultiRouter::decodeWith(
+    const QMap<QString, QString>& metadata,
+    const DecodeFn& decode)
 {
     const QString format = metadata.value(QStringLiteral("inbound.format"));
     if (format.isEmpty()) {
@@ -93,7 +113,7 @@ Result<SemanticRequest> InboundMultiRouter::decodeRequest(
     QMap<QString, QString> enrichedMeta = metadata;
     enrichedMeta.insert(QStringLiteral("_inbound_protocol"), normalizedFormat);
 
-    auto result = adapter->decodeRequest(body, enrichedMeta);
+    auto result = decode(adapter, enrichedMeta);
     if (result.has_value()) {
         result->metadata.insert(QStringLiteral("_inbound_protocol"), normalizedFormat);
     }
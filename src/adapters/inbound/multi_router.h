@@ -16,6 +16,9 @@ public:
     Result<SemanticRequest> decodeRequest(
         const QByteArray& body,
         const QMap<QString, QString>& metadata) override;
+    Result<SemanticRequest> decodeParsedRequest(
+        const QJsonObject& root,
+        const QMap<QString, QString>& metadata) override;
     Result<QByteArray> encodeResponse(
         const SemanticResponse& response) override;
     Result<QByteArray> encodeStreamFrame(
@@ -24,6 +27,12 @@ public:
         const DomainFailure& failure) override;
 
 private:
+    using DecodeFn = std::function<Result<SemanticRequest>(
+        IInboundAdapter*, const QMap<QString, QString>&)>;
+
+    // Resolves the adapter for metadata["inbound.format"] and decodes with it
+    Result<SemanticRequest> decodeWith(const QMap<QString, QString>& metadata,
+                                       const DecodeFn& decode);
     IInboundAdapter* findAdapter(const QString& name) const;
     IInboundAdapter* findAdapterFromResponse(const SemanticResponse& response) const;
     IInboundAdapter* findAdapterFromFrame(const StreamFrame& frame) const;
@@ -272,6 +272,12 @@ DomainFailure AnthropicOutbound::mapFailure(int httpStatus, const QByteArray& bo
     return failure;
 }
 
+bool AnthropicOutbound::supportsPrefill(const SemanticRequest&)
+{
+    // A final assistant message is continued as the start of the reply
+    return true;
+}
+
 // ---------------------------------------------------------------------------
 // Private helpers
 // ---------------------------------------------------------------------------
@@ -12,6 +12,7 @@ public:
     Result<SemanticResponse> parseResponse(const ProviderResponse& response) override;
     Result<StreamFrame> parseChunk(const ProviderChunk& chunk) override;
     DomainFailure mapFailure(int httpStatus, const QByteArray& body) override;
+    bool supportsPrefill(const SemanticRequest& request) override;
 
 private:
     QJsonArray buildMessages(const QList<InteractionItem>& items, QString& systemOut) const;
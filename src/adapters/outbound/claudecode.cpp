@@ -29,3 +29,8 @@ DomainFailure ClaudeCodeOutbound::mapFailure(int httpStatus, const QByteArray& b
 {
     return m_delegate->mapFailure(httpStatus, body);
 }
+
+bool ClaudeCodeOutbound::supportsPrefill(const SemanticRequest& request)
+{
+    return m_delegate->supportsPrefill(request);
+}
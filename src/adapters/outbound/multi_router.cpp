@@ -84,6 +84,12 @@ DomainFailure OutboundMultiRouter::mapFailure(int httpStatus, const QByteArray&
     return DomainFailure::internal(QStringLiteral("HTTP %1").arg(httpStatus));
 }
 
+bool OutboundMultiRouter::supportsPrefill(const SemanticRequest& request)
+{
+    IOutboundAdapter* adapter = resolve(request);
+    return adapter && adapter->supportsPrefill(request);
+}
+
 IOutboundAdapter* OutboundMultiRouter::resolveByAdapterHint(const QString& adapterHint)
 {
     if (adapterHint.isEmpty()) {
@@ -18,6 +18,7 @@ public:
     Result<SemanticResponse> parseResponse(const ProviderResponse& response) override;
     Result<StreamFrame> parseChunk(const ProviderChunk& chunk) override;
     DomainFailure mapFailure(int httpStatus, const QByteArray& body) override;
+    bool supportsPrefill(const SemanticRequest& request) override;
 
 private:
     QMap<QString, IOutboundAdapter*> m_adapters;
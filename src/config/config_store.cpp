@@ -50,6 +50,29 @@ bool jsonBoolEither(const QJsonObject& obj, const char* snakeKey, const char* ca
     return value.isUndefined() ? fallback : value.toBool(fallback);
 }
 
+QJsonObject routeToJson(const RouteConfig& route)
+{
+    QJsonObject obj;
+    obj["method"] = route.method;
+    obj["path_pattern"] = route.pathPattern;
+    obj["inbound_protocol"] = route.inboundProtocol;
+    if (!route.targetGroup.isEmpty())
+        obj["target_group"] = route.targetGroup;
+    return obj;
+}
+
+RouteConfig jsonToRoute(const QJsonObject& obj)
+{
+    RouteConfig route;
+    const QString method = obj["method"].toString();
+    if (!method.isEmpty())
+        route.method = method;
+    route.pathPattern = jsonStringEither(obj, "path_pattern", "pathPattern");
+    route.inboundProtocol = jsonStringEither(obj, "inbound_protocol", "inboundProtocol");
+    route.targetGroup = jsonStringEither(obj, "target_group", "targetGroup");
+    return route;
+}
+
 bool mapContainsEither(const QVariantMap& map, const char* snakeKey, const char* camelKey)
 {
     return map.contains(QString::fromUtf8(snakeKey)) || map.contains(QString::fromUtf8(camelKey));
@@ -181,6 +204,11 @@ bool ConfigStore::load(const QString& path) {
 
     m_config.currentGroupIndex = jsonIntEither(root, "current_group_index", "currentGroupIndex", 0);
 
+    // routes (optional; the built-in routes always apply)
+    m_config.routes.clear();
+    for (const auto& rv : root["routes"].toArray())
+        m_config.routes.append(jsonToRoute(rv.toObject()));
+
     // runtime
     QJsonObject rt = root["runtime"].toObject();
     m_config.runtime.debugMode = jsonBoolEither(rt, "debug_mode", "debugMode", false);
@@ -193,6 +221,33 @@ bool ConfigStore::load(const QString& path) {
     m_config.runtime.enableHttp2 = jsonBoolEither(rt, "enable_http2", "enableHttp2", true);
     m_config.runtime.enableConnectionPool = jsonBoolEither(rt, "enable_connection_pool", "enableConnectionPool", true);
     m_config.runtime.connectionTimeout = jsonIntEither(rt, "connection_timeout", "connectionTimeout", 30000);
+    m_config.runtime.workerThreads = jsonIntEither(rt, "worker_threads", "workerThreads", 0);
+    m_config.runtime.maxRequestBodyMb = jsonIntEither(rt, "max_request_body_mb", "maxRequestBodyMb", 64);
+    m_config.runtime.sseWriteMode = static_cast<SseWriteMode>(jsonIntEither(rt, "sse_write_mode", "sseWriteMode", 0));
+    m_config.runtime.sseCoalesceMs = jsonIntEither(rt, "sse_coalesce_ms", "sseCoalesceMs", 10);
+    // OpenSSL does not keep a session longer than 7200 s
+    m_config.runtime.tlsSessionLifetimeSec = clampInt(jsonIntEither(rt, "tls_session_lifetime_sec", "tlsSessionLifetimeSec", 3600), 0, 7200);
+    m_config.runtime.modelListCacheTtlSec = jsonIntEither(rt, "model_list_cache_ttl_sec", "modelListCacheTtlSec", 60);
+    m_config.runtime.poolIdleTimeoutSec = jsonIntEither(rt, "pool_idle_timeout_sec", "poolIdleTimeoutSec", 300);
+    m_config.runtime.keepWarmSec = jsonIntEither(rt, "keep_warm_sec", "keepWarmSec", 0);
+    m_config.runtime.plainHttpPort = jsonIntEither(rt, "plain_http_port", "plainHttpPort", 0);
+    m_config.runtime.unixSocketPath = jsonStringEither(rt, "unix_socket_path", "unixSocketPath");
+    m_config.runtime.balanceBaseUrls = jsonBoolEither(rt, "balance_base_urls", "balanceBaseUrls", false);
+    m_config.runtime.hedgePercentile = jsonIntEither(rt, "hedge_percentile", "hedgePercentile", 0);
+    m_config.runtime.hedgeMinDelayMs = jsonIntEither(rt, "hedge_min_delay_ms", "hedgeMinDelayMs", 1000);
+    m_config.runtime.circuitFailureThreshold = jsonIntEither(rt, "circuit_failure_threshold", "circuitFailureThreshold", 5);
+    m_config.runtime.circuitOpenMs = jsonIntEither(rt, "circuit_open_ms", "circuitOpenMs", 30000);
+    m_config.runtime.retryBaseDelayMs = jsonIntEither(rt, "retry_base_delay_ms", "retryBaseDelayMs", 250);
+    m_config.runtime.retryBudgetPercent = jsonIntEither(rt, "retry_budget_percent", "retryBudgetPercent", 10);
+    m_config.runtime.adaptiveConcurrency = jsonBoolEither(rt, "adaptive_concurrency", "adaptiveConcurrency", false);
+    m_config.runtime.concurrencyInitialLimit = jsonIntEither(rt, "concurrency_initial_limit", "concurrencyInitialLimit", 20);
+    m_config.runtime.concurrencyQueueSize = jsonIntEither(rt, "concurrency_queue_size", "concurrencyQueueSize", 100);
+    m_config.runtime.concurrencyQueueTimeoutMs = jsonIntEither(rt, "concurrency_queue_timeout_ms", "concurrencyQueueTimeoutMs", 10000);
+    m_config.runtime.streamFailover = jsonBoolEither(rt, "stream_failover", "streamFailover", false);
+    m_config.runtime.coalesceRequests = jsonBoolEither(rt, "coalesce_requests", "coalesceRequests", false);
+    m_config.runtime.upstreamDnsServers.clear();
+    for (const auto& server : jsonArrayEither(rt, "upstream_dns_servers", "upstreamDnsServers"))
+        m_config.runtime.upstreamDnsServers.append(server.toString());
 
     emit configChanged();
     return true;
@@ -219,6 +274,12 @@ bool ConfigStore::save() {
         groups.append(groupToJson(grp));
     root["groups"] = groups;
     root["current_group_index"] = m_config.currentGroupIndex;
+    if (!m_config.routes.isEmpty()) {
+        QJsonArray routes;
+        for (const auto& route : m_config.routes)
+            routes.append(routeToJson(route));
+        root["routes"] = routes;
+    }
 
     QJsonObject rt;
     rt["debug_mode"] = m_config.runtime.debugMode;
@@ -231,6 +292,31 @@ bool ConfigStore::save() {
     rt["enable_http2"] = m_config.runtime.enableHttp2;
     rt["enable_connection_pool"] = m_config.runtime.enableConnectionPool;
     rt["connection_timeout"] = m_config.runtime.connectionTimeout;
+    rt["worker_threads"] = m_config.runtime.workerThreads;
+    rt["max_request_body_mb"] = m_config.runtime.maxRequestBodyMb;
+    rt["sse_write_mode"] = static_cast<int>(m_config.runtime.sseWriteMode);
+    rt["sse_coalesce_ms"] = m_config.runtime.sseCoalesceMs;
+    rt["tls_session_lifetime_sec"] = m_config.runtime.tlsSessionLifetimeSec;
+    rt["model_list_cache_ttl_sec"] = m_config.runtime.modelListCacheTtlSec;
+    rt["pool_idle_timeout_sec"] = m_config.runtime.poolIdleTimeoutSec;
+    rt["keep_warm_sec"] = m_config.runtime.keepWarmSec;
+    rt["plain_http_port"] = m_config.runtime.plainHttpPort;
+    rt["unix_socket_path"] = m_config.runtime.unixSocketPath;
+    rt["balance_base_urls"] = m_config.runtime.balanceBaseUrls;
+    rt["hedge_percentile"] = m_config.runtime.hedgePercentile;
+    rt["hedge_min_delay_ms"] = m_config.runtime.hedgeMinDelayMs;
+    rt["circuit_failure_threshold"] = m_config.runtime.circuitFailureThreshold;
+    rt["circuit_open_ms"] = m_config.runtime.circuitOpenMs;
+    rt["retry_base_delay_ms"] = m_config.runtime.retryBaseDelayMs;
+    rt["retry_budget_percent"] = m_config.runtime.retryBudgetPercent;
+    rt["adaptive_concurrency"] = m_config.runtime.adaptiveConcurrency;
+    rt["concurrency_initial_limit"] = m_config.runtime.concurrencyInitialLimit;
+    rt["concurrency_queue_size"] = m_config.runtime.concurrencyQueueSize;
+    rt["concurrency_queue_timeout_ms"] = m_config.runtime.concurrencyQueueTimeoutMs;
+    rt["stream_failover"] = m_config.runtime.streamFailover;
+    rt["coalesce_requests"] = m_config.runtime.coalesceRequests;
+    if (!m_config.runtime.upstreamDnsServers.isEmpty())
+        rt["upstream_dns_servers"] = QJsonArray::fromStringList(m_config.runtime.upstreamDnsServers);
     root["runtime"] = rt;
 
     QFile file(m_filePath);
@@ -258,6 +344,8 @@ QVariantList ConfigStore::configGroups() const {
         map["middleRoute"] = grp.middleRoute;
         map["max_retry_attempts"] = grp.maxRetryAttempts;
         map["maxRetryAttempts"] = grp.maxRetryAttempts;
+        map["rpm"] = grp.rpm;
+        map["tpm"] = grp.tpm;
         map["base_url_candidates"] = QVariant(grp.baseUrlCandidates);
         map["baseUrlCandidates"] = QVariant(grp.baseUrlCandidates);
         QVariantMap headerMap;
@@ -284,6 +372,10 @@ void ConfigStore::addGroup(const QVariantMap& group) {
         g.middleRoute = mapValueEither(group, "middle_route", "middleRoute").toString();
     if (mapContainsEither(group, "max_retry_attempts", "maxRetryAttempts"))
         g.maxRetryAttempts = mapValueEither(group, "max_retry_attempts", "maxRetryAttempts").toInt();
+    if (group.contains("rpm"))
+        g.rpm = qMax(0, group.value("rpm").toInt());
+    if (group.contains("tpm"))
+        g.tpm = qMax(0, group.value("tpm").toInt());
     if (mapContainsEither(group, "base_url_candidates", "baseUrlCandidates"))
         g.baseUrlCandidates = mapValueEither(group, "base_url_candidates", "baseUrlCandidates").toStringList();
     if (mapContainsEither(group, "custom_headers", "customHeaders")) {
@@ -318,6 +410,10 @@ void ConfigStore::updateGroup(int index, const QVariantMap& group) {
         g.middleRoute = mapValueEither(group, "middle_route", "middleRoute").toString();
     if (mapContainsEither(group, "max_retry_attempts", "maxRetryAttempts"))
         g.maxRetryAttempts = mapValueEither(group, "max_retry_attempts", "maxRetryAttempts").toInt();
+    if (group.contains("rpm"))
+        g.rpm = qMax(0, group.value("rpm").toInt());
+    if (group.contains("tpm"))
+        g.tpm = qMax(0, group.value("tpm").toInt());
     if (mapContainsEither(group, "base_url_candidates", "baseUrlCandidates"))
         g.baseUrlCandidates = mapValueEither(group, "base_url_candidates", "baseUrlCandidates").toStringList();
     if (mapContainsEither(group, "custom_headers", "customHeaders")) {
@@ -401,6 +497,54 @@ QVariantMap ConfigStore::runtimeOptions() const {
     map["enableConnectionPool"] = m_config.runtime.enableConnectionPool;
     map["connection_timeout"] = m_config.runtime.connectionTimeout;
     map["connectionTimeout"] = m_config.runtime.connectionTimeout;
+    map["worker_threads"] = m_config.runtime.workerThreads;
+    map["workerThreads"] = m_config.runtime.workerThreads;
+    map["max_request_body_mb"] = m_config.runtime.maxRequestBodyMb;
+    map["maxRequestBodyMb"] = m_config.runtime.maxRequestBodyMb;
+    map["sse_write_mode"] = static_cast<int>(m_config.runtime.sseWriteMode);
+    map["sseWriteMode"] = static_cast<int>(m_config.runtime.sseWriteMode);
+    map["sse_coalesce_ms"] = m_config.runtime.sseCoalesceMs;
+    map["sseCoalesceMs"] = m_config.runtime.sseCoalesceMs;
+    map["tls_session_lifetime_sec"] = m_config.runtime.tlsSessionLifetimeSec;
+    map["tlsSessionLifetimeSec"] = m_config.runtime.tlsSessionLifetimeSec;
+    map["model_list_cache_ttl_sec"] = m_config.runtime.modelListCacheTtlSec;
+    map["modelListCacheTtlSec"] = m_config.runtime.modelListCacheTtlSec;
+    map["pool_idle_timeout_sec"] = m_config.runtime.poolIdleTimeoutSec;
+    map["poolIdleTimeoutSec"] = m_config.runtime.poolIdleTimeoutSec;
+    map["keep_warm_sec"] = m_config.runtime.keepWarmSec;
+    map["keepWarmSec"] = m_config.runtime.keepWarmSec;
+    map["plain_http_port"] = m_config.runtime.plainHttpPort;
+    map["plainHttpPort"] = m_config.runtime.plainHttpPort;
+    map["unix_socket_path"] = m_config.runtime.unixSocketPath;
+    map["unixSocketPath"] = m_config.runtime.unixSocketPath;
+    map["balance_base_urls"] = m_config.runtime.balanceBaseUrls;
+    map["balanceBaseUrls"] = m_config.runtime.balanceBaseUrls;
+    map["hedge_percentile"] = m_config.runtime.hedgePercentile;
+    map["hedgePercentile"] = m_config.runtime.hedgePercentile;
+    map["hedge_min_delay_ms"] = m_config.runtime.hedgeMinDelayMs;
+    map["hedgeMinDelayMs"] = m_config.runtime.hedgeMinDelayMs;
+    map["circuit_failure_threshold"] = m_config.runtime.circuitFailureThreshold;
+    map["circuitFailureThreshold"] = m_config.runtime.circuitFailureThreshold;
+    map["circuit_open_ms"] = m_config.runtime.circuitOpenMs;
+    map["circuitOpenMs"] = m_config.runtime.circuitOpenMs;
+    map["retry_base_delay_ms"] = m_config.runtime.retryBaseDelayMs;
+    map["retryBaseDelayMs"] = m_config.runtime.retryBaseDelayMs;
+    map["retry_budget_percent"] = m_config.runtime.retryBudgetPercent;
+    map["retryBudgetPercent"] = m_config.runtime.retryBudgetPercent;
+    map["adaptive_concurrency"] = m_config.runtime.adaptiveConcurrency;
+    map["adaptiveConcurrency"] = m_config.runtime.adaptiveConcurrency;
+    map["concurrency_initial_limit"] = m_config.runtime.concurrencyInitialLimit;
+    map["concurrencyInitialLimit"] = m_config.runtime.concurrencyInitialLimit;
+    map["concurrency_queue_size"] = m_config.runtime.concurrencyQueueSize;
+    map["concurrencyQueueSize"] = m_config.runtime.concurrencyQueueSize;
+    map["concurrency_queue_timeout_ms"] = m_config.runtime.concurrencyQueueTimeoutMs;
+    map["concurrencyQueueTimeoutMs"] = m_config.runtime.concurrencyQueueTimeoutMs;
+    map["stream_failover"] = m_config.runtime.streamFailover;
+    map["streamFailover"] = m_config.runtime.streamFailover;
+    map["coalesce_requests"] = m_config.runtime.coalesceRequests;
+    map["coalesceRequests"] = m_config.runtime.coalesceRequests;
+    map["upstream_dns_servers"] = m_config.runtime.upstreamDnsServers;
+    map["upstreamDnsServers"] = m_config.runtime.upstreamDnsServers;
     return map;
 }
 
@@ -429,6 +573,64 @@ void ConfigStore::setRuntimeOptions(const QVariantMap& opts) {
         m_config.runtime.enableConnectionPool = mapValueEither(opts, "enable_connection_pool", "enableConnectionPool").toBool();
     if (mapContainsEither(opts, "connection_timeout", "connectionTimeout"))
         m_config.runtime.connectionTimeout = clampInt(mapValueEither(opts, "connection_timeout", "connectionTimeout").toInt(), 500, 300000);
+    if (mapContainsEither(opts, "worker_threads", "workerThreads"))
+        m_config.runtime.workerThreads = clampInt(mapValueEither(opts, "worker_threads", "workerThreads").toInt(), 0, 64);
+    if (mapContainsEither(opts, "max_request_body_mb", "maxRequestBodyMb"))
+        m_config.runtime.maxRequestBodyMb = clampInt(mapValueEither(opts, "max_request_body_mb", "maxRequestBodyMb").toInt(), 1, 1024);
+    if (mapContainsEither(opts, "sse_write_mode", "sseWriteMode"))
+        m_config.runtime.sseWriteMode = static_cast<SseWriteMode>(clampInt(mapValueEither(opts, "sse_write_mode", "sseWriteMode").toInt(),
+                                                                            static_cast<int>(SseWriteMode::Latency),
+                                                                            static_cast<int>(SseWriteMode::Throughput)));
+    if (mapContainsEither(opts, "sse_coalesce_ms", "sseCoalesceMs"))
+        m_config.runtime.sseCoalesceMs = clampInt(mapValueEither(opts, "sse_coalesce_ms", "sseCoalesceMs").toInt(), 5, 20);
+    if (mapContainsEither(opts, "tls_session_lifetime_sec", "tlsSessionLifetimeSec"))
+        m_config.runtime.tlsSessionLifetimeSec = clampInt(mapValueEither(opts, "tls_session_lifetime_sec", "tlsSessionLifetimeSec").toInt(), 0, 7200);
+    if (mapContainsEither(opts, "model_list_cache_ttl_sec", "modelListCacheTtlSec"))
+        m_config.runtime.modelListCacheTtlSec = clampInt(mapValueEither(opts, "model_list_cache_ttl_sec", "modelListCacheTtlSec").toInt(), 0, 3600);
+    if (mapContainsEither(opts, "pool_idle_timeout_sec", "poolIdleTimeoutSec"))
+        m_config.runtime.poolIdleTimeoutSec = clampInt(mapValueEither(opts, "pool_idle_timeout_sec", "poolIdleTimeoutSec").toInt(), 0, 3600);
+    if (mapContainsEither(opts, "keep_warm_sec", "keepWarmSec"))
+        m_config.runtime.keepWarmSec = clampInt(mapValueEither(opts, "keep_warm_sec", "keepWarmSec").toInt(), 0, 600);
+    if (mapContainsEither(opts, "plain_http_port", "plainHttpPort"))
+        m_config.runtime.plainHttpPort = clampInt(mapValueEither(opts, "plain_http_port", "plainHttpPort").toInt(), 0, 65535);
+    if (mapContainsEither(opts, "unix_socket_path", "unixSocketPath"))
+        m_config.runtime.unixSocketPath = mapValueEither(opts, "unix_socket_path", "unixSocketPath").toString().trimmed();
+    if (mapContainsEither(opts, "balance_base_urls", "balanceBaseUrls"))
+        m_config.runtime.balanceBaseUrls = mapValueEither(opts, "balance_base_urls", "balanceBaseUrls").toBool();
+    if (mapContainsEither(opts, "hedge_percentile", "hedgePercentile")) {
+        const int percentile = mapValueEither(opts, "hedge_percentile", "hedgePercentile").toInt();
+        m_config.runtime.hedgePercentile = percentile <= 0 ? 0 : clampInt(percentile, 50, 99);
+    }
+    if (mapContainsEither(opts, "hedge_min_delay_ms", "hedgeMinDelayMs"))
+        m_config.runtime.hedgeMinDelayMs = clampInt(mapValueEither(opts, "hedge_min_delay_ms", "hedgeMinDelayMs").toInt(), 50, 60000);
+    if (mapContainsEither(opts, "circuit_failure_threshold", "circuitFailureThreshold"))
+        m_config.runtime.circuitFailureThreshold = clampInt(mapValueEither(opts, "circuit_failure_threshold", "circuitFailureThreshold").toInt(), 0, 100);
+    if (mapContainsEither(opts, "circuit_open_ms", "circuitOpenMs"))
+        m_config.runtime.circuitOpenMs = clampInt(mapValueEither(opts, "circuit_open_ms", "circuitOpenMs").toInt(), 1000, 600000);
+    if (mapContainsEither(opts, "retry_base_delay_ms", "retryBaseDelayMs"))
+        m_config.runtime.retryBaseDelayMs = clampInt(mapValueEither(opts, "retry_base_delay_ms", "retryBaseDelayMs").toInt(), 0, 10000);
+    if (mapContainsEither(opts, "retry_budget_percent", "retryBudgetPercent"))
+        m_config.runtime.retryBudgetPercent = clampInt(mapValueEither(opts, "retry_budget_percent", "retryBudgetPercent").toInt(), 0, 100);
+    if (mapContainsEither(opts, "adaptive_concurrency", "adaptiveConcurrency"))
+        m_config.runtime.adaptiveConcurrency = mapValueEither(opts, "adaptive_concurrency", "adaptiveConcurrency").toBool();
+    if (mapContainsEither(opts, "concurrency_initial_limit", "concurrencyInitialLimit"))
+        m_config.runtime.concurrencyInitialLimit = clampInt(mapValueEither(opts, "concurrency_initial_limit", "concurrencyInitialLimit").toInt(), 1, 1000);
+    if (mapContainsEither(opts, "concurrency_queue_size", "concurrencyQueueSize"))
+        m_config.runtime.concurrencyQueueSize = clampInt(mapValueEither(opts, "concurrency_queue_size", "concurrencyQueueSize").toInt(), 0, 10000);
+    if (mapContainsEither(opts, "concurrency_queue_timeout_ms", "concurrencyQueueTimeoutMs"))
+        m_config.runtime.concurrencyQueueTimeoutMs = clampInt(mapValueEither(opts, "concurrency_queue_timeout_ms", "concurrencyQueueTimeoutMs").toInt(), 100, 120000);
+    if (mapContainsEither(opts, "stream_failover", "streamFailover"))
+        m_config.runtime.streamFailover = mapValueEither(opts, "stream_failover", "streamFailover").toBool();
+    if (mapContainsEither(opts, "coalesce_requests", "coalesceRequests"))
+        m_config.runtime.coalesceRequests = mapValueEither(opts, "coalesce_requests", "coalesceRequests").toBool();
+    if (mapContainsEither(opts, "upstream_dns_servers", "upstreamDnsServers")) {
+        QStringList servers;
+        for (const QString& server : mapValueEither(opts, "upstream_dns_servers", "upstreamDnsServers").toStringList()) {
+            if (!server.trimmed().isEmpty())
+                servers.append(server.trimmed());
+        }
+        m_config.runtime.upstreamDnsServers = servers;
+    }
     save();
     emit configChanged();
 }
@@ -495,6 +697,10 @@ QJsonObject ConfigStore::groupToJson(const ConfigGroup& g) const {
     obj["api_key"] = encryptApiKey(g.apiKey);
     obj["middle_route"] = g.middleRoute;
     obj["max_retry_attempts"] = g.maxRetryAttempts;
+    if (g.rpm > 0)
+        obj["rpm"] = g.rpm;
+    if (g.tpm > 0)
+        obj["tpm"] = g.tpm;
     QJsonObject headers;
     for (auto it = g.customHeaders.cbegin(); it != g.customHeaders.cend(); ++it)
         headers[it.key()] = it.value();
@@ -521,6 +727,8 @@ ConfigGroup ConfigStore::jsonToGroup(const QJsonObject& obj) const {
         g.middleRoute = middleRoute.isUndefined() ? QStringLiteral("/v1") : middleRoute.toString(QStringLiteral("/v1"));
     }
     g.maxRetryAttempts = jsonIntEither(obj, "max_retry_attempts", "maxRetryAttempts", 3);
+    g.rpm = qMax(0, obj["rpm"].toInt());
+    g.tpm = qMax(0, obj["tpm"].toInt());
     QJsonObject headers = jsonValueEither(obj, "custom_headers", "customHeaders").toObject();
     for (auto it = headers.constBegin(); it != headers.constEnd(); ++it)
         g.customHeaders[it.key()] = it.value().toString();
@@ -15,6 +15,8 @@ struct ConfigGroup {
     QString apiKey;
     QString middleRoute = "/v1";
     int maxRetryAttempts = 3;
+    int rpm = 0;                   // requests per minute sent upstream (0 = no limit)
+    int tpm = 0;                   // tokens per minute, prompt and completion (0 = no limit)
     QMap<QString, QString> customHeaders;
     QString hijackDomainOverride;  // if non-empty, overrides auto-derived hijack domain
 
@@ -23,10 +25,16 @@ struct ConfigGroup {
     }
 };
 
+// How streamed HTTP/1.1 responses are written to clients: each event at
+// once, or coalesced over a short window into fewer, larger TLS records.
+enum class SseWriteMode : quint8 {
+    Latency = 0, Throughput = 1
+};
+
 struct RuntimeOptions {
     bool debugMode = false;
     bool disableSslStrict = false;
-    bool enableHttp2 = true;
+    bool enableHttp2 = true;       // h2 upstream, and offered to clients through ALPN
     bool enableConnectionPool = true;
     StreamMode upstreamStreamMode = StreamMode::FollowClient;
     StreamMode downstreamStreamMode = StreamMode::FollowClient;
@@ -34,6 +42,42 @@ struct RuntimeOptions {
     int connectionPoolSize = 10;
     int requestTimeout = 120000;
     int connectionTimeout = 30000;
+    int workerThreads = 0;         // connection worker threads (0 = one per core, max 8)
+    int maxRequestBodyMb = 64;     // largest accepted request body, chunked or not
+    SseWriteMode sseWriteMode = SseWriteMode::Latency;
+    int sseCoalesceMs = 10;        // throughput-mode coalescing window (5-20 ms)
+    int tlsSessionLifetimeSec = 3600;  // downstream TLS session resumption (0 = off)
+    int modelListCacheTtlSec = 60;     // GET /v1/models cache lifetime (0 = off)
+    int poolIdleTimeoutSec = 300;  // close upstream connections unused this long (0 = never)
+    int keepWarmSec = 0;           // re-open upstream connections idle this long (0 = off)
+    int plainHttpPort = 0;         // HTTP without TLS on 127.0.0.1 (0 = off)
+    QString unixSocketPath;        // HTTP on a Unix domain socket (empty = off; not on Windows)
+    bool balanceBaseUrls = false;  // start each request at the best base URL, not the primary
+    int hedgePercentile = 0;       // hedge to the next base URL past this latency percentile (0 = off)
+    int hedgeMinDelayMs = 1000;    // never hedge sooner than this
+    int circuitFailureThreshold = 5;  // consecutive failures that open a base URL's breaker (0 = off)
+    int circuitOpenMs = 30000;        // how long an open breaker skips the URL before a probe
+    int retryBaseDelayMs = 250;       // retries wait up to this times 2^attempt, or Retry-After
+    int retryBudgetPercent = 10;      // retries allowed per 100 requests over 10 s (0 = no limit)
+    bool adaptiveConcurrency = false;    // AIMD limit on requests in flight per adapter and origin
+    int concurrencyInitialLimit = 20;    // starting limit before it adapts
+    int concurrencyQueueSize = 100;      // requests that may wait for a slot (0 = reject at once)
+    int concurrencyQueueTimeoutMs = 10000;  // longest wait for a slot
+    bool streamFailover = false;     // continue a stream that breaks off at the next base URL
+    bool coalesceRequests = false;   // identical deterministic requests in flight share one upstream call
+    QStringList upstreamDnsServers;  // resolve upstream hosts with these, not the OS (empty = OS)
+};
+
+// A request route from the config file. Patterns are matched per path
+// segment: literals, parameters such as "{model}" or "{model}:{action}"
+// (passed on as "route.<name>" metadata), and a trailing "*" for any rest.
+// A config route with the same method and pattern as a built-in one
+// replaces it.
+struct RouteConfig {
+    QString method = "POST";       // "*" matches any method
+    QString pathPattern;
+    QString inboundProtocol;
+    QString targetGroup;           // config group name (empty = current group)
 };
 
 struct GlobalConfig {
@@ -46,6 +90,7 @@ struct ProxyConfig {
     GlobalConfig global;
     QList<ConfigGroup> groups;
     int currentGroupIndex = 0;
+    QList<RouteConfig> routes;
     RuntimeOptions runtime;
     QString certPath;
     QString keyPath;
@@ -57,6 +102,14 @@ struct ProxyConfig {
         return empty;
     }
 
+    const ConfigGroup* findGroup(const QString& name) const {
+        for (const ConfigGroup& group : groups) {
+            if (group.name == name)
+                return &group;
+        }
+        return nullptr;
+    }
+
     bool isValid() const {
         return !groups.isEmpty() && currentGroup().isValid();
     }
@@ -3,6 +3,7 @@
 #include <QDir>
 #include <QTextStream>
 #include <QDebug>
+#include <QMutexLocker>
 
 LogManager& LogManager::instance() {
     static LogManager s_instance;
@@ -38,28 +39,34 @@ void LogManager::log(Level level, const QString& category, const QString& messag
     QString formatted = QString("[%1] [%2] [%3] %4")
         .arg(timestamp, levelNames[level], category, message);
 
-    // file output
-    if (m_logFile.isOpen()) {
-        QTextStream stream(&m_logFile);
-        stream << formatted << "\n";
-        stream.flush();
-    }
-
-    // buffer for UI
     QVariantMap entry;
     entry["level"] = static_cast<int>(level);
     entry["timestamp"] = timestamp;
     entry["category"] = category;
     entry["message"] = message;
-    m_buffer.append(entry);
-    while (m_buffer.size() > m_maxBuffer)
-        m_buffer.removeFirst();
+
+    {
+        QMutexLocker locker(&m_mutex);
+
+        // file output
+        if (m_logFile.isOpen()) {
+            QTextStream stream(&m_logFile);
+            stream << formatted << "\n";
+            stream.flush();
+        }
+
+        // buffer for UI
+        m_buffer.append(entry);
+        while (m_buffer.size() > m_maxBuffer)
+            m_buffer.removeFirst();
+    }
 
     // signal
     emit logEntry(static_cast<int>(level), timestamp, category, message);
 }
 
 QVariantList LogManager::recentLogs(int count) const {
+    QMutexLocker locker(&m_mutex);
     QVariantList result;
     int start = qMax(0, m_buffer.size() - count);
     for (int i = start; i < m_buffer.size(); ++i)
@@ -68,6 +75,7 @@ QVariantList LogManager::recentLogs(int count) const {
 }
 
 void LogManager::clearLogs() {
+    QMutexLocker locker(&m_mutex);
     m_buffer.clear();
 }
 
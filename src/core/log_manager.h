@@ -3,6 +3,7 @@
 #include <QFile>
 #include <QVariantMap>
 #include <QList>
+#include <QMutex>
 
 class LogManager : public QObject {
     Q_OBJECT
@@ -36,6 +37,8 @@ private:
     QFile m_logFile;
     QList<QVariantMap> m_buffer;
     int m_maxBuffer = 2000;
+    // Proxy workers log from their own threads
+    mutable QMutex m_mutex;
 };
 
 #define LOG_DEBUG(msg) LogManager::instance().debug(msg)
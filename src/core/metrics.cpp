@@ -0,0 +1,250 @@
+#include "metrics.h"
+#include <QLocale>
+#include <QMutexLocker>
+#include <algorithm>
+
+namespace metrics {
+
+namespace {
+
+void appendNumber(QByteArray& out, double value)
+{
+    out += QByteArray::number(value, 'g', QLocale::FloatingPointShortest);
+}
+
+void appendLabelValue(QByteArray& out, const QString& value)
+{
+    for (const char c : value.toUtf8()) {
+        switch (c) {
+        case '\\': out += "\\\\"; break;
+        case '"': out += "\\\""; break;
+        case '\n': out += "\\n"; break;
+        default: out += c;
+        }
+    }
+}
+
+void appendHeader(QByteArray& out, const char* name, const char* type, const char* help)
+{
+    out += "# HELP ";
+    out += name;
+    out += ' ';
+    out += help;
+    out += "\n# TYPE ";
+    out += name;
+    out += ' ';
+    out += type;
+    out += '\n';
+}
+
+}
+
+Metric::Metric(const char* name, const char* help)
+    : m_name(name)
+    , m_help(help)
+{
+}
+
+void Metric::renderHeader(QByteArray& out, const char* type) const
+{
+    appendHeader(out, m_name, type, m_help);
+}
+
+void Counter::render(QByteArray& out) const
+{
+    renderHeader(out, "counter");
+    out += name();
+    out += ' ';
+    out += QByteArray::number(value());
+    out += '\n';
+}
+
+void Gauge::render(QByteArray& out) const
+{
+    renderHeader(out, "gauge");
+    out += name();
+    out += ' ';
+    out += QByteArray::number(value());
+    out += '\n';
+}
+
+Histogram::Histogram(const char* name, const char* help, std::initializer_list<double> bounds)
+    : Metric(name, help)
+{
+    Q_ASSERT(bounds.size() <= kMaxBuckets);
+    Q_ASSERT(std::is_sorted(bounds.begin(), bounds.end()));
+    for (const double bound : bounds) {
+        if (m_boundCount == kMaxBuckets)
+            break;
+        m_bounds[m_boundCount++] = bound;
+    }
+}
+
+void Histogram::observe(double value)
+{
+    if (!(value >= 0))
+        value = 0;
+    int bucket = 0;
+    while (bucket < m_boundCount && value > m_bounds[bucket])
+        ++bucket;
+    m_buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+    m_sumMicros.fetch_add(quint64(value * 1e6 + 0.5), std::memory_order_relaxed);
+}
+
+quint64 Histogram::count() const
+{
+    quint64 total = 0;
+    for (int i = 0; i <= m_boundCount; ++i)
+        total += m_buckets[i].load(std::memory_order_relaxed);
+    return total;
+}
+
+void Histogram::render(QByteArray& out) const
+{
+    renderHeader(out, "histogram");
+    // Buckets are read one by one while others record, so the cumulative
+    // counts can be off by the observations made meanwhile; _count is taken
+    // from the same reads to stay consistent with +Inf
+    quint64 cumulative = 0;
+    for (int i = 0; i <= m_boundCount; ++i) {
+        cumulative += m_buckets[i].load(std::memory_order_relaxed);
+        out += name();
+        out += "_bucket{le=\"";
+        if (i < m_boundCount)
+            appendNumber(out, m_bounds[i]);
+        else
+            out += "+Inf";
+        out += "\"} ";
+        out += QByteArray::number(cumulative);
+        out += '\n';
+    }
+    out += name();
+    out += "_sum ";
+    appendNumber(out, sum());
+    out += '\n';
+    out += name();
+    out += "_count ";
+    out += QByteArray::number(cumulative);
+    out += '\n';
+}
+
+template<typename T>
+LabeledFamily<T>::LabeledFamily(const char* name, const char* help, const char* type,
+                                QStringList labelNames)
+    : Metric(name, help)
+    , m_type(type)
+    , m_labelNames(std::move(labelNames))
+{
+}
+
+template<typename T>
+std::atomic<T>& LabeledFamily<T>::at(const QStringList& labelValues)
+{
+    QMutexLocker lock(&m_mutex);
+    std::shared_ptr<Series>& series = m_series[labelValues];
+    if (!series) {
+        series = std::make_shared<Series>();
+        series->labels += '{';
+        for (qsizetype i = 0; i < m_labelNames.size(); ++i) {
+            if (i > 0)
+                series->labels += ',';
+            series->labels += m_labelNames[i].toUtf8();
+            series->labels += "=\"";
+            appendLabelValue(series->labels, labelValues.value(i));
+            series->labels += '"';
+        }
+        series->labels += '}';
+    }
+    return series->value;
+}
+
+template<typename T>
+T LabeledFamily<T>::value(const QStringList& labelValues) const
+{
+    QMutexLocker lock(&m_mutex);
+    const auto series = m_series.value(labelValues);
+    return series ? series->value.load(std::memory_order_relaxed) : 0;
+}
+
+template<typename T>
+void LabeledFamily<T>::render(QByteArray& out) const
+{
+    renderHeader(out, m_type);
+    QList<std::shared_ptr<Series>> series;
+    {
+        QMutexLocker lock(&m_mutex);
+        series = m_series.values();
+    }
+    // Stable output for scrapers and diffs
+    std::sort(series.begin(), series.end(), [](const auto& a, const auto& b) {
+        return a->labels < b->labels;
+    });
+    for (const auto& s : series) {
+        out += name();
+        out += s->labels;
+        out += ' ';
+        out += QByteArray::number(s->value.load(std::memory_order_relaxed));
+        out += '\n';
+    }
+}
+
+template class LabeledFamily<quint64>;
+template class LabeledFamily<qint64>;
+
+Registry& Registry::instance()
+{
+    static Registry s_instance;
+    return s_instance;
+}
+
+int Registry::addCollector(Collector collector)
+{
+    QMutexLocker lock(&m_collectorMutex);
+    const int id = m_nextCollectorId++;
+    m_collectors.append({id, std::move(collector)});
+    return id;
+}
+
+void Registry::removeCollector(int id)
+{
+    // Collectors run under the same mutex, so none is mid-call once we hold it
+    QMutexLocker lock(&m_collectorMutex);
+    m_collectors.removeIf([id](const auto& entry) { return entry.first == id; });
+}
+
+QByteArray Registry::render() const
+{
+    QByteArray out;
+    out.reserve(8 * 1024);
+    const Metric* const own[] = {
+        &requests, &upstreamRetries, &upstreamRetriesDenied, &upstreamRetryDelay,
+        &upstreamStreamFailovers, &coalescedRequests, &rateLimitDelays,
+        &rateLimitWait, &upstreamLatency,
+        &timeToFirstToken, &interTokenGap, &tokensPerSecond, &poolActive, &poolIdle,
+        &upstreamStreams, &upstreamManagers, &upstreamPoolLookups, &upstreamPoolEvictions,
+        &upstreamWarmups, &upstreamWarmHits, &upstreamColdStarts, &upstreamHedges,
+        &upstreamHedgeWins, &upstreamCircuitTransitions, &upstreamCircuitState,
+        &upstreamConcurrencyLimit, &upstreamQueueDepth, &upstreamQueueWait,
+        &upstreamQueueRejections, &upstreamDnsSeconds, &upstreamDnsFailures, &upstreamConnectSeconds, &requestBytes,
+        &responseBytes,
+    };
+    for (const Metric* metric : own)
+        metric->render(out);
+
+    QMutexLocker lock(&m_collectorMutex);
+    for (const auto& entry : m_collectors)
+        entry.second(out);
+    return out;
+}
+
+void appendSample(QByteArray& out, const char* name, const char* type, const char* help,
+                  double value)
+{
+    appendHeader(out, name, type, help);
+    out += name;
+    out += ' ';
+    appendNumber(out, value);
+    out += '\n';
+}
+
+}
@@ -0,0 +1,276 @@
+#pragma once
+#include <QByteArray>
+#include <QHash>
+#include <QList>
+#include <QMutex>
+#include <QString>
+#include <QStringList>
+#include <array>
+#include <atomic>
+#include <functional>
+#include <initializer_list>
+#include <memory>
+
+// Process-wide metrics, rendered in the Prometheus text format for
+// GET /metrics on the proxy listener.
+//
+// Recording is a relaxed atomic add on an object that exists for the life of
+// the process, so the streaming path never takes a lock. Labelled counters
+// take a mutex to find the counter for a label set; callers on hot paths
+// look it up once and keep the reference.
+namespace metrics {
+
+class Metric {
+public:
+    Metric(const char* name, const char* help);
+    virtual ~Metric() = default;
+    Metric(const Metric&) = delete;
+    Metric& operator=(const Metric&) = delete;
+
+    const char* name() const { return m_name; }
+    virtual void render(QByteArray& out) const = 0;
+
+protected:
+    void renderHeader(QByteArray& out, const char* type) const;
+
+private:
+    const char* m_name;
+    const char* m_help;
+};
+
+class Counter : public Metric {
+public:
+    using Metric::Metric;
+    void add(quint64 n = 1) { m_value.fetch_add(n, std::memory_order_relaxed); }
+    quint64 value() const { return m_value.load(std::memory_order_relaxed); }
+    void render(QByteArray& out) const override;
+
+private:
+    std::atomic<quint64> m_value{0};
+};
+
+class Gauge : public Metric {
+public:
+    using Metric::Metric;
+    void add(qint64 n = 1) { m_value.fetch_add(n, std::memory_order_relaxed); }
+    void sub(qint64 n = 1) { m_value.fetch_sub(n, std::memory_order_relaxed); }
+    qint64 value() const { return m_value.load(std::memory_order_relaxed); }
+    void render(QByteArray& out) const override;
+
+private:
+    std::atomic<qint64> m_value{0};
+};
+
+// Fixed buckets given as upper bounds in ascending order. The sum is kept in
+// millionths of the unit, which is exact enough for seconds and rates.
+class Histogram : public Metric {
+public:
+    static constexpr int kMaxBuckets = 16;
+
+    Histogram(const char* name, const char* help, std::initializer_list<double> bounds);
+    void observe(double value);
+    quint64 count() const;
+    double sum() const { return double(m_sumMicros.load(std::memory_order_relaxed)) / 1e6; }
+    void render(QByteArray& out) const override;
+
+private:
+    std::array<double, kMaxBuckets> m_bounds{};
+    int m_boundCount = 0;
+    // Per bucket, not cumulative; the last one is +Inf
+    std::array<std::atomic<quint64>, kMaxBuckets + 1> m_buckets{};
+    std::atomic<quint64> m_sumMicros{0};
+};
+
+// One series per set of label values, in the order of the names. The value
+// for a label set is created on first use and stays valid for the life of
+// the process, so callers on hot paths look it up once and keep it.
+template<typename T>
+class LabeledFamily : public Metric {
+public:
+    LabeledFamily(const char* name, const char* help, const char* type, QStringList labelNames);
+    std::atomic<T>& at(const QStringList& labelValues);
+    T value(const QStringList& labelValues) const;
+    void render(QByteArray& out) const override;
+
+private:
+    struct Series {
+        QByteArray labels;  // rendered {a="x",b="y"}
+        std::atomic<T> value{0};
+    };
+
+    const char* m_type;
+    QStringList m_labelNames;
+    mutable QMutex m_mutex;
+    QHash<QStringList, std::shared_ptr<Series>> m_series;
+};
+
+extern template class LabeledFamily<quint64>;
+extern template class LabeledFamily<qint64>;
+
+class LabeledCounter : public LabeledFamily<quint64> {
+public:
+    LabeledCounter(const char* name, const char* help, QStringList labelNames)
+        : LabeledFamily(name, help, "counter", std::move(labelNames))
+    {
+    }
+    void add(const QStringList& labelValues, quint64 n = 1)
+    {
+        at(labelValues).fetch_add(n, std::memory_order_relaxed);
+    }
+};
+
+class LabeledGauge : public LabeledFamily<qint64> {
+public:
+    LabeledGauge(const char* name, const char* help, QStringList labelNames)
+        : LabeledFamily(name, help, "gauge", std::move(labelNames))
+    {
+    }
+};
+
+// The metrics the proxy records. Sources:
+//  - ProxyWorker: requests, request/response bytes
+//  - Processor: upstream retries and their delays, hedges, local rate limit waits,
+//    mid-stream failovers
+//  - RequestCoalescer: requests answered by an identical one in flight
+//  - Policy: retries refused by the retry budget
+//  - QtExecutor: upstream latency
+//  - StreamSession: time to first token, inter-token gap, tokens per second
+//  - ConnectionPool: active/idle upstream managers, per-host streams and lookups, warm hits
+//  - UpstreamRelay: DNS resolution and connect times, DNS failures
+//  - CircuitBreaker: breaker states and transitions per base URL
+//  - ConcurrencyLimiter: concurrency limits, queue depths, waits and rejections
+//  - ProxyServer: per-worker stats, through a collector
+class Registry {
+public:
+    static Registry& instance();
+
+    LabeledCounter requests{"shanghaoqi_requests_total",
+                            "Requests routed to the pipeline",
+                            {QStringLiteral("inbound"), QStringLiteral("outbound")}};
+    Counter upstreamRetries{"shanghaoqi_upstream_retries_total",
+                            "Upstream attempts repeated after a retryable failure"};
+    Counter upstreamRetriesDenied{"shanghaoqi_upstream_retries_denied_total",
+                                  "Retryable failures not retried because the retry budget was spent"};
+    Histogram upstreamRetryDelay{"shanghaoqi_upstream_retry_delay_seconds",
+                                 "Wait before an upstream retry (backoff or Retry-After)",
+                                 {0.01, 0.05, 0.1, 0.25, 0.5, 1, 2, 5, 10, 30, 60}};
+    LabeledCounter upstreamStreamFailovers{"shanghaoqi_upstream_stream_failovers_total",
+                                           "Streams continued on another base URL after failing "
+                                           "mid-stream, by mode (prefill, regenerate)",
+                                           {QStringLiteral("mode")}};
+    Counter coalescedRequests{"shanghaoqi_coalesced_requests_total",
+                              "Non-streaming requests answered by an identical request already in "
+                              "flight"};
+    LabeledCounter rateLimitDelays{"shanghaoqi_rate_limit_delays_total",
+                                   "Upstream attempts held back by a config group's local RPM/TPM "
+                                   "limits",
+                                   {QStringLiteral("group")}};
+    Histogram rateLimitWait{"shanghaoqi_rate_limit_wait_seconds",
+                            "Wait imposed by the local RPM/TPM limits on held-back attempts",
+                            {0.05, 0.1, 0.25, 0.5, 1, 2, 5, 10, 20, 30, 60}};
+    Histogram upstreamLatency{"shanghaoqi_upstream_latency_seconds",
+                              "Upstream response time; time to response headers for streams",
+                              {0.05, 0.1, 0.25, 0.5, 1, 2, 5, 10, 30, 60, 120}};
+    Histogram timeToFirstToken{"shanghaoqi_time_to_first_token_seconds",
+                               "Upstream request sent to first streamed delta",
+                               {0.1, 0.25, 0.5, 1, 2, 3, 5, 10, 20, 60}};
+    Histogram interTokenGap{"shanghaoqi_inter_token_gap_seconds",
+                            "Time between consecutive streamed deltas",
+                            {0.001, 0.005, 0.01, 0.02, 0.05, 0.1, 0.25, 0.5, 1, 5}};
+    Histogram tokensPerSecond{"shanghaoqi_stream_tokens_per_second",
+                              "Output rate of finished streams (usage tokens, or deltas "
+                              "when the provider reports no usage)",
+                              {5, 10, 20, 30, 50, 75, 100, 150, 200, 400}};
+    Gauge poolActive{"shanghaoqi_upstream_pool_active",
+                     "Upstream network managers in use"};
+    Gauge poolIdle{"shanghaoqi_upstream_pool_idle",
+                   "Upstream network managers kept idle for reuse"};
+    LabeledGauge upstreamStreams{"shanghaoqi_upstream_streams",
+                                 "Upstream requests in flight per host",
+                                 {QStringLiteral("host")}};
+    LabeledGauge upstreamManagers{"shanghaoqi_upstream_managers",
+                                  "Network managers bound to each upstream host; each holds "
+                                  "one HTTP/2 connection or up to six HTTP/1.1 connections",
+                                  {QStringLiteral("host")}};
+    LabeledCounter upstreamPoolLookups{"shanghaoqi_upstream_pool_lookups_total",
+                                       "Upstream requests by whether a manager bound to the host "
+                                       "was reused (hit) or had to be opened (miss)",
+                                       {QStringLiteral("host"), QStringLiteral("result")}};
+    Counter upstreamPoolEvictions{"shanghaoqi_upstream_pool_evictions_total",
+                                  "Idle upstream managers closed by the idle limits or the idle reaper"};
+    Counter upstreamWarmups{"shanghaoqi_upstream_warmups_total",
+                            "Upstream connections opened ahead of requests (start and keep-warm)"};
+    Counter upstreamWarmHits{"shanghaoqi_upstream_warm_hits_total",
+                             "Upstream requests sent on a connection that was open or recently used"};
+    Counter upstreamColdStarts{"shanghaoqi_upstream_cold_starts_total",
+                               "Upstream requests that had to connect first (DNS, TCP, TLS)"};
+    LabeledCounter upstreamHedges{"shanghaoqi_upstream_hedges_total",
+                                  "Requests also sent to another base URL because the first was slow, "
+                                  "by the base URL hedged to",
+                                  {QStringLiteral("candidate")}};
+    LabeledCounter upstreamHedgeWins{"shanghaoqi_upstream_hedge_wins_total",
+                                     "Hedged requests by the base URL whose response was used",
+                                     {QStringLiteral("candidate")}};
+    LabeledCounter upstreamCircuitTransitions{"shanghaoqi_upstream_circuit_transitions_total",
+                                              "Circuit breaker transitions per base URL, by the "
+                                              "state entered",
+                                              {QStringLiteral("endpoint"), QStringLiteral("state")}};
+    LabeledGauge upstreamCircuitState{"shanghaoqi_upstream_circuit_state",
+                                      "Circuit breaker state per base URL: 0 closed, 1 open, "
+                                      "2 half-open",
+                                      {QStringLiteral("endpoint")}};
+    LabeledGauge upstreamConcurrencyLimit{"shanghaoqi_upstream_concurrency_limit",
+                                          "Adaptive limit on requests in flight per outbound "
+                                          "adapter and upstream origin",
+                                          {QStringLiteral("adapter"), QStringLiteral("endpoint")}};
+    LabeledGauge upstreamQueueDepth{"shanghaoqi_upstream_queue_depth",
+                                    "Requests waiting for a concurrency slot per outbound adapter "
+                                    "and upstream origin",
+                                    {QStringLiteral("adapter"), QStringLiteral("endpoint")}};
+    Histogram upstreamQueueWait{"shanghaoqi_upstream_queue_wait_seconds",
+                                "Time queued requests waited for a concurrency slot, timeouts "
+                                "included",
+                                {0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1, 2, 5, 10, 30}};
+    LabeledCounter upstreamQueueRejections{"shanghaoqi_upstream_queue_rejections_total",
+                                           "Requests turned away by the concurrency queue, by "
+                                           "reason (full, timeout)",
+                                           {QStringLiteral("adapter"), QStringLiteral("endpoint"),
+                                            QStringLiteral("reason")}};
+    Histogram upstreamDnsSeconds{"shanghaoqi_upstream_dns_seconds",
+                                 "Upstream host name resolution by the built-in resolver, "
+                                 "cache hits included",
+                                 {0.0005, 0.001, 0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1, 2}};
+    Counter upstreamDnsFailures{"shanghaoqi_upstream_dns_failures_total",
+                                "Upstream host names the built-in resolver could not resolve"};
+    Histogram upstreamConnectSeconds{"shanghaoqi_upstream_connect_seconds",
+                                     "TCP connect to an upstream through the relay, after resolution",
+                                     {0.001, 0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1, 2, 5}};
+    Counter requestBytes{"shanghaoqi_request_body_bytes_total",
+                         "Request body bytes received from clients"};
+    Counter responseBytes{"shanghaoqi_response_bytes_total",
+                          "Response bytes written to clients, before TLS"};
+
+    // Collectors append text for values owned elsewhere; they run while the
+    // registry renders, on the rendering thread.
+    using Collector = std::function<void(QByteArray& out)>;
+    int addCollector(Collector collector);
+    // After this returns the collector is not running and will not run again
+    void removeCollector(int id);
+
+    QByteArray render() const;
+
+private:
+    Registry() = default;
+
+    mutable QMutex m_collectorMutex;
+    QList<std::pair<int, Collector>> m_collectors;
+    int m_nextCollectorId = 1;
+};
+
+inline Registry& registry() { return Registry::instance(); }
+
+// Appends one sample line, for collectors
+void appendSample(QByteArray& out, const char* name, const char* type, const char* help,
+                  double value);
+
+}
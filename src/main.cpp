@@ -1,7 +1,6 @@
 ﻿#include <QApplication>
 #include <QDir>
 #include <QStandardPaths>
-#include <QSslConfiguration>
 
 #include "platform/platform_factory.h"
 #include "adapters/inbound/multi_router.h"
@@ -25,9 +24,13 @@
 #include "adapters/outbound/claudecode.h"
 #include "adapters/outbound/antigravity.h"
 #include "adapters/outbound/openai_compat.h"
-#include "adapters/executor/qt_executor.h"
 #include "adapters/capability/static_resolver.h"
 #include "pipeline/pipeline.h"
+#include "semantic/circuit_breaker.h"
+#include "semantic/concurrency_limiter.h"
+#include "semantic/endpoint_balancer.h"
+#include "semantic/rate_limiter.h"
+#include "semantic/request_coalescer.h"
 #include "pipeline/middlewares/auth_middleware.h"
 #include "pipeline/middlewares/model_mapping_middleware.h"
 #include "pipeline/middlewares/stream_mode_middleware.h"
@@ -74,20 +77,8 @@ int main(int argc, char* argv[])
 
     auto proxyConf = configStore.proxyConfig();
 
-    // --- 4. Connection pool + Executor ---
+    // --- 4. Proxy server (one connection pool + executor per worker thread) ---
     auto& proxyServer = *new ProxyServer(&app);
-    ConnectionPool& connPool = proxyServer.connectionPool();
-
-    QSslConfiguration sslConfig = QSslConfiguration::defaultConfiguration();
-    sslConfig.setPeerVerifyMode(proxyConf.runtime.disableSslStrict
-                                    ? QSslSocket::VerifyNone
-                                    : QSslSocket::AutoVerifyPeer);
-    sslConfig.setProtocol(proxyConf.runtime.enableHttp2
-                              ? QSsl::TlsV1_2OrLater
-                              : QSsl::TlsV1_2);
-    QtExecutor executor(connPool, sslConfig);
-    executor.setRequestTimeout(proxyConf.runtime.requestTimeout);
-    executor.setConnectionTimeout(proxyConf.runtime.connectionTimeout);
 
     // --- 5. Inbound adapters ---
     auto inOAI  = std::make_unique<OpenAIChatAdapter>();
@@ -160,32 +151,76 @@ int main(int argc, char* argv[])
     auto capResolver = std::make_unique<StaticCapabilityResolver>();
 
     // --- 8. Pipeline ---
+    // Adapters and policy are shared read-only across worker threads; each
+    // worker gets its own Pipeline, Processor and middleware chain, built from
+    // the config the server was (re)started with.
     auto* rawInRouter  = inRouter.get();
     auto* rawOutRouter = outRouter.get();
     auto* rawCap       = capResolver.get();
 
-    Pipeline pipeline(rawInRouter, rawOutRouter, &executor, rawCap, &app);
-
     Policy runtimePolicy;
     runtimePolicy.setDefaultMaxAttempts(qMax(1, proxyConf.currentGroup().maxRetryAttempts));
-    pipeline.setPolicy(&runtimePolicy);
-
-    pipeline.addMiddleware(std::make_unique<AuthMiddleware>(
-        proxyConf.global.authKey));
-
-    pipeline.addMiddleware(std::make_unique<ModelMappingMiddleware>(
-        proxyConf.currentGroup().name,
-        proxyConf.currentGroup().modelId));
-
-    pipeline.addMiddleware(std::make_unique<StreamModeMiddleware>(
-        proxyConf.runtime.upstreamStreamMode,
-        proxyConf.runtime.downstreamStreamMode));
-
-    pipeline.addMiddleware(std::make_unique<DebugMiddleware>(
-        proxyConf.runtime.debugMode));
+    CircuitBreaker circuitBreaker;
+    runtimePolicy.setCircuitBreaker(&circuitBreaker);
+    ConcurrencyLimiter concurrencyLimiter;
+    RateLimiter rateLimiter;
+    RequestCoalescer requestCoalescer;
+
+    // Base URL statistics outlive proxy restarts in memory, and app
+    // restarts on disk
+    const QString endpointStatsPath = dataDir + QStringLiteral("/endpoint_stats.json");
+    EndpointBalancer endpointBalancer;
+    endpointBalancer.load(endpointStatsPath);
 
     // --- 9. Proxy server ---
-    proxyServer.setPipeline(&pipeline);
+    proxyServer.setPipelineFactory([=, &runtimePolicy, &circuitBreaker, &endpointBalancer,
+                                    &concurrencyLimiter, &rateLimiter, &requestCoalescer](
+                                       IExecutor* executor, const ProxyConfig& config, QObject* parent) {
+        circuitBreaker.setThresholds(config.runtime.circuitFailureThreshold, config.runtime.circuitOpenMs);
+        runtimePolicy.setBackoff(config.runtime.retryBaseDelayMs);
+        runtimePolicy.retryBudget().setPercent(config.runtime.retryBudgetPercent);
+        auto* pipeline = new Pipeline(rawInRouter, rawOutRouter, executor, rawCap, parent);
+        pipeline->setPolicy(&runtimePolicy);
+        pipeline->setHedging(config.runtime.hedgePercentile, config.runtime.hedgeMinDelayMs);
+        if (config.runtime.balanceBaseUrls) {
+            pipeline->setBalancer(&endpointBalancer);
+        }
+        if (config.runtime.adaptiveConcurrency) {
+            concurrencyLimiter.setSettings({config.runtime.concurrencyInitialLimit,
+                                            config.runtime.concurrencyQueueSize,
+                                            config.runtime.concurrencyQueueTimeoutMs});
+            pipeline->setConcurrencyLimiter(&concurrencyLimiter);
+        }
+        for (const ConfigGroup& group : config.groups) {
+            rateLimiter.setLimits(group.name, {group.rpm, group.tpm});
+        }
+        pipeline->setRateLimiter(&rateLimiter);
+        pipeline->setStreamFailover(config.runtime.streamFailover);
+        if (config.runtime.coalesceRequests) {
+            pipeline->setCoalescer(&requestCoalescer);
+        }
+
+        pipeline->addMiddleware(std::make_unique<AuthMiddleware>(
+            config.global.authKey));
+
+        pipeline->addMiddleware(std::make_unique<ModelMappingMiddleware>(
+            config.currentGroup().name,
+            config.currentGroup().modelId));
+
+        pipeline->addMiddleware(std::make_unique<StreamModeMiddleware>(
+            config.runtime.upstreamStreamMode,
+            config.runtime.downstreamStreamMode));
+
+        pipeline->addMiddleware(std::make_unique<DebugMiddleware>(
+            config.runtime.debugMode));
+        return pipeline;
+    });
+    // Workers must be gone before the adapters and policy above go out of scope
+    QObject::connect(&app, &QCoreApplication::aboutToQuit,
+                     &proxyServer, &ProxyServer::stop);
+    QObject::connect(&app, &QCoreApplication::aboutToQuit, &app, [&endpointBalancer, endpointStatsPath]() {
+        endpointBalancer.save(endpointStatsPath);
+    });
 
     // --- 10. Bootstrap ---
     Bootstrap bootstrap(&app);
@@ -1,6 +1,9 @@
 #include "pipeline.h"
+#include "semantic/concurrency_limiter.h"
 #include "semantic/processor.h"
+#include "semantic/request_coalescer.h"
 #include "semantic/stream_session.h"
+#include <QPointer>
 
 // ========== PipelineStreamSession ==========
 
@@ -18,6 +21,10 @@ PipelineStreamSession::PipelineStreamSession(
     , m_inboundDelegate(inboundDelegate)
     , m_middlewares(middlewares)
 {
+    // The pipeline session owns its upstream so deleting it releases the
+    // upstream reply (and its pooled connection manager) as well.
+    m_upstream->setParent(this);
+
     connect(m_upstream, &StreamSession::frameReady,
             this, &PipelineStreamSession::onUpstreamFrame);
     connect(m_upstream, &StreamSession::finished,
@@ -30,6 +37,10 @@ void PipelineStreamSession::abort() {
     if (m_upstream) m_upstream->abort();
 }
 
+void PipelineStreamSession::setPaused(bool paused) {
+    if (m_upstream) m_upstream->setPaused(paused);
+}
+
 void PipelineStreamSession::onUpstreamFrame(const StreamFrame& frame) {
     StreamFrame f = frame;
     if (!m_inboundProtocol.isEmpty()) {
@@ -80,6 +91,13 @@ Pipeline::Pipeline(IInboundAdapter* inbound,
     m_processor->capabilities = capabilities;
 }
 
+Pipeline::~Pipeline()
+{
+    if (m_coalescer) {
+        m_coalescer->forget(this);
+    }
+}
+
 void Pipeline::addMiddleware(std::unique_ptr<IPipelineMiddleware> mw) {
     m_middlewares.push_back(std::move(mw));
 }
@@ -92,8 +110,35 @@ void Pipeline::setPolicy(Policy* policy)
     m_processor->setPolicy(policy);
 }
 
-Result<QByteArray> Pipeline::process(const QByteArray& requestBody,
-                                     const QMap<QString, QString>& metadata) {
+void Pipeline::setHedging(int percentile, int minDelayMs)
+{
+    m_processor->setHedging(percentile, minDelayMs);
+}
+
+void Pipeline::setBalancer(EndpointBalancer* balancer)
+{
+    m_processor->setBalancer(balancer);
+}
+
+void Pipeline::setConcurrencyLimiter(ConcurrencyLimiter* limiter)
+{
+    m_processor->setExecutor(new LimitedExecutor(m_processor->executor, limiter, this));
+}
+
+void Pipeline::setRateLimiter(RateLimiter* limiter)
+{
+    m_processor->setRateLimiter(limiter);
+}
+
+void Pipeline::setStreamFailover(bool enabled)
+{
+    m_processor->setStreamFailover(enabled);
+}
+
+Result<SemanticRequest> Pipeline::decodeAndForward(
+        const QByteArray& requestBody,
+        const QMap<QString, QString>& metadata,
+        InboundContext& inbound) {
     auto decoded = m_inbound->decodeRequest(requestBody, metadata);
     if (!decoded) return std::unexpected(decoded.error());
 
@@ -106,71 +151,110 @@ Result<QByteArray> Pipeline::process(const QByteArray& requestBody,
         req = *r;
     }
 
-    const QString inboundProtocol =
+    inbound.protocol =
         req.metadata.value(QStringLiteral("_inbound_protocol"),
                            metadata.value(QStringLiteral("inbound.format")));
-    const QString inboundDelegate =
-        inboundProtocol == QStringLiteral("codex")
+    inbound.delegate =
+        inbound.protocol == QStringLiteral("codex")
             ? req.metadata.value(QStringLiteral("_codex_delegate"))
-            : (inboundProtocol == QStringLiteral("antigravity")
+            : (inbound.protocol == QStringLiteral("antigravity")
                    ? req.metadata.value(QStringLiteral("_antigravity_delegate"))
                    : QString());
+    return req;
+}
 
-    auto resp = m_processor->process(std::move(req));
-    if (!resp) return std::unexpected(resp.error());
-
-    // Reverse through middlewares
-    SemanticResponse response = *resp;
-    if (!inboundProtocol.isEmpty()) {
-        response.extensions.set(QStringLiteral("inbound_protocol"), inboundProtocol);
-    }
-    if (inboundProtocol == QStringLiteral("codex") && !inboundDelegate.isEmpty()) {
-        response.extensions.set(QStringLiteral("codex_delegate"), inboundDelegate);
-    } else if (inboundProtocol == QStringLiteral("antigravity") && !inboundDelegate.isEmpty()) {
-        response.extensions.set(QStringLiteral("antigravity_delegate"), inboundDelegate);
-    }
-    auto reversed = reversedMiddlewares();
-    for (auto* mw : reversed) {
-        auto r = mw->onResponse(std::move(response));
-        if (!r) return std::unexpected(r.error());
-        response = *r;
+void Pipeline::process(const QByteArray& requestBody,
+                       const QMap<QString, QString>& metadata,
+                       PipelineCallback done) {
+    InboundContext inbound;
+    auto req = decodeAndForward(requestBody, metadata, inbound);
+    if (!req) {
+        done(std::unexpected(req.error()));
+        return;
     }
 
-    return m_inbound->encodeResponse(response);
-}
+    QPointer<Pipeline> self(this);
+    auto respond = [self, inbound, done](Result<SemanticResponse> resp) {
+        if (!resp) {
+            done(std::unexpected(resp.error()));
+            return;
+        }
+        if (!self) {
+            done(std::unexpected(DomainFailure::internal(
+                QStringLiteral("pipeline destroyed before response"))));
+            return;
+        }
 
-Result<PipelineStreamSession*> Pipeline::processStream(
-        const QByteArray& requestBody,
-        const QMap<QString, QString>& metadata) {
-    auto decoded = m_inbound->decodeRequest(requestBody, metadata);
-    if (!decoded) return std::unexpected(decoded.error());
+        // Reverse through middlewares
+        SemanticResponse response = std::move(*resp);
+        if (!inbound.protocol.isEmpty()) {
+            response.extensions.set(QStringLiteral("inbound_protocol"), inbound.protocol);
+        }
+        if (inbound.protocol == QStringLiteral("codex") && !inbound.delegate.isEmpty()) {
+            response.extensions.set(QStringLiteral("codex_delegate"), inbound.delegate);
+        } else if (inbound.protocol == QStringLiteral("antigravity") && !inbound.delegate.isEmpty()) {
+            response.extensions.set(QStringLiteral("antigravity_delegate"), inbound.delegate);
+        }
+        auto reversed = self->reversedMiddlewares();
+        for (auto* mw : reversed) {
+            auto r = mw->onResponse(std::move(response));
+            if (!r) {
+                done(std::unexpected(r.error()));
+                return;
+            }
+            response = *r;
+        }
 
-    SemanticRequest req = *decoded;
+        done(self->m_inbound->encodeResponse(response));
+    };
 
-    // Forward through middlewares in order
-    for (auto& mw : m_middlewares) {
-        auto r = mw->onRequest(std::move(req));
-        if (!r) return std::unexpected(r.error());
-        req = *r;
+    quint64 flight = 0;
+    if (m_coalescer) {
+        const QByteArray key = RequestCoalescer::keyOf(*req);
+        if (!key.isEmpty()) {
+            flight = m_coalescer->join(key, this, respond);
+            if (flight == 0) {
+                return;
+            }
+        }
     }
+    m_processor->process(std::move(*req), [coalescer = m_coalescer, flight, respond](Result<SemanticResponse> resp) {
+        if (flight != 0) {
+            coalescer->complete(flight, resp);
+        }
+        respond(std::move(resp));
+    });
+}
 
-    const QString inboundProtocol =
-        req.metadata.value(QStringLiteral("_inbound_protocol"),
-                           metadata.value(QStringLiteral("inbound.format")));
-    const QString inboundDelegate =
-        inboundProtocol == QStringLiteral("codex")
-            ? req.metadata.value(QStringLiteral("_codex_delegate"))
-            : (inboundProtocol == QStringLiteral("antigravity")
-                   ? req.metadata.value(QStringLiteral("_antigravity_delegate"))
-                   : QString());
+void Pipeline::processStream(const QByteArray& requestBody,
+                             const QMap<QString, QString>& metadata,
+                             PipelineStreamCallback done) {
+    InboundContext inbound;
+    auto req = decodeAndForward(requestBody, metadata, inbound);
+    if (!req) {
+        done(std::unexpected(req.error()));
+        return;
+    }
 
-    auto session = m_processor->processStream(std::move(req));
-    if (!session) return std::unexpected(session.error());
+    QPointer<Pipeline> self(this);
+    m_processor->processStream(std::move(*req), [self, inbound, done](Result<StreamSession*> session) {
+        if (!session) {
+            done(std::unexpected(session.error()));
+            return;
+        }
+        if (!self) {
+            (*session)->abort();
+            (*session)->deleteLater();
+            done(std::unexpected(DomainFailure::internal(
+                QStringLiteral("pipeline destroyed before stream connected"))));
+            return;
+        }
 
-    auto reversed = reversedMiddlewares();
-    auto* pipeSession = new PipelineStreamSession(
-        *session, m_inbound, inboundProtocol, inboundDelegate, reversed, this);
-    return pipeSession;
+        auto* pipeSession = new PipelineStreamSession(
+            *session, self->m_inbound, inbound.protocol, inbound.delegate,
+            self->reversedMiddlewares(), self.data());
+        done(pipeSession);
+    });
 }
 
 QList<IPipelineMiddleware*> Pipeline::reversedMiddlewares() const {
@@ -4,9 +4,14 @@
 #include "semantic/policy.h"
 #include <QObject>
 #include <QList>
+#include <functional>
 #include <memory>
 #include <vector>
 
+class ConcurrencyLimiter;
+class EndpointBalancer;
+class RateLimiter;
+class RequestCoalescer;
 class Processor;
 class StreamSession;
 
@@ -20,6 +25,8 @@ public:
                           const QList<IPipelineMiddleware*>& middlewares,
                           QObject* parent = nullptr);
     void abort();
+    // Stops frames (and upstream reads) while the client catches up
+    void setPaused(bool paused);
 
 signals:
     void encodedFrameReady(const QByteArray& sseData);
@@ -39,6 +46,9 @@ private:
     QList<IPipelineMiddleware*> m_middlewares;
 };
 
+using PipelineCallback = std::function<void(Result<QByteArray>)>;
+using PipelineStreamCallback = std::function<void(Result<PipelineStreamSession*>)>;
+
 class Pipeline : public QObject {
     Q_OBJECT
 public:
@@ -47,22 +57,48 @@ public:
              IExecutor* executor,
              ICapabilityResolver* capabilities,
              QObject* parent = nullptr);
+    ~Pipeline() override;
 
     void addMiddleware(std::unique_ptr<IPipelineMiddleware> mw);
 
-    Result<QByteArray> process(const QByteArray& requestBody,
-                               const QMap<QString, QString>& metadata);
+    // Both entry points return immediately; `done` is invoked exactly once
+    // from the event loop with the encoded body or the live stream session.
+    void process(const QByteArray& requestBody,
+                 const QMap<QString, QString>& metadata,
+                 PipelineCallback done);
 
-    Result<PipelineStreamSession*> processStream(
-        const QByteArray& requestBody,
-        const QMap<QString, QString>& metadata);
+    void processStream(const QByteArray& requestBody,
+                       const QMap<QString, QString>& metadata,
+                       PipelineStreamCallback done);
 
     void setPolicy(Policy* policy);
+    // See Processor::setHedging
+    void setHedging(int percentile, int minDelayMs);
+    // See Processor::setBalancer
+    void setBalancer(EndpointBalancer* balancer);
+    // Sends upstream requests through the limiter (see LimitedExecutor)
+    void setConcurrencyLimiter(ConcurrencyLimiter* limiter);
+    // See Processor::setRateLimiter
+    void setRateLimiter(RateLimiter* limiter);
+    // See Processor::setStreamFailover
+    void setStreamFailover(bool enabled);
+    // Answers identical non-streaming requests in flight together; each
+    // gets the shared response encoded for its own inbound protocol
+    void setCoalescer(RequestCoalescer* coalescer) { m_coalescer = coalescer; }
 
 private:
     IInboundAdapter* m_inbound;
     Processor* m_processor;
+    RequestCoalescer* m_coalescer = nullptr;
     std::vector<std::unique_ptr<IPipelineMiddleware>> m_middlewares;
 
+    struct InboundContext {
+        QString protocol;
+        QString delegate;
+    };
+
+    Result<SemanticRequest> decodeAndForward(const QByteArray& requestBody,
+                                             const QMap<QString, QString>& metadata,
+                                             InboundContext& inbound);
     QList<IPipelineMiddleware*> reversedMiddlewares() const;
 };
@@ -1,60 +1,123 @@
 #include "connection_pool.h"
 #include "core/log_manager.h"
+#include "core/metrics.h"
 #include <QMutexLocker>
+#include <algorithm>
+#include <limits>
 
 ConnectionPool::ConnectionPool(int maxSize)
     : m_maxSize(maxSize)
 {
+    m_clock.start();
 }
 
 ConnectionPool::~ConnectionPool()
 {
     QMutexLocker locker(&m_mutex);
-    for (QNetworkAccessManager* nam : m_idle) {
+    for (QNetworkAccessManager* nam : m_managers.keys()) {
+        dropManager(nam);
+    }
+    for (QNetworkAccessManager* nam : std::as_const(m_unpooled)) {
         delete nam;
     }
-    m_idle.clear();
+    m_unpooled.clear();
+    publishCounts();
+}
 
-    for (QNetworkAccessManager* nam : m_active) {
-        delete nam;
+QString ConnectionPool::hostKey(const QUrl& url)
+{
+    const QString scheme = url.scheme().toLower();
+    const int port = url.port(scheme == QLatin1String("https") ? 443 : 80);
+    return scheme + QLatin1String("://") + url.host().toLower()
+           + QLatin1Char(':') + QString::number(port);
+}
+
+ConnectionPool::Host& ConnectionPool::hostFor(const QString& key)
+{
+    Host& host = m_hosts[key];
+    if (!host.streamGauge) {
+        auto& registry = metrics::registry();
+        host.streamGauge = &registry.upstreamStreams.at({key});
+        host.managerGauge = &registry.upstreamManagers.at({key});
+        host.hitCounter = &registry.upstreamPoolLookups.at({key, QStringLiteral("hit")});
+        host.missCounter = &registry.upstreamPoolLookups.at({key, QStringLiteral("miss")});
     }
-    m_active.clear();
+    return host;
+}
+
+QNetworkAccessManager* ConnectionPool::leastLoaded(const Host& host) const
+{
+    QNetworkAccessManager* chosen = nullptr;
+    int fewest = std::numeric_limits<int>::max();
+    for (QNetworkAccessManager* nam : host.managers) {
+        const int streams = m_managers.value(nam).streams;
+        if (streams < fewest) {
+            chosen = nam;
+            fewest = streams;
+        }
+    }
+    return chosen;
+}
+
+QNetworkAccessManager* ConnectionPool::openManager(Host& host, const QString& key)
+{
+    auto* nam = new QNetworkAccessManager;
+    nam->setProxy(m_proxy);
+    host.managers.append(nam);
+    m_managers.insert(nam, Manager{key});
+    host.managerGauge->fetch_add(1, std::memory_order_relaxed);
+    LOG_DEBUG(QStringLiteral("ConnectionPool: new connection to %1 (%2 for this host)")
+                  .arg(key)
+                  .arg(host.managers.size()));
+    return nam;
 }
 
-QNetworkAccessManager* ConnectionPool::acquire()
+QNetworkAccessManager* ConnectionPool::acquire(const QUrl& url)
 {
     QMutexLocker locker(&m_mutex);
+    auto& registry = metrics::registry();
 
     if (!m_enabled) {
         auto* nam = new QNetworkAccessManager;
-        m_active.insert(nam);
+        nam->setProxy(m_proxy);
+        m_unpooled.insert(nam);
+        registry.upstreamColdStarts.add();
+        publishCounts();
         return nam;
     }
 
-    // Prefer returning an idle connection to avoid creating new TCP/TLS sessions
-    if (!m_idle.isEmpty()) {
-        QNetworkAccessManager* nam = m_idle.dequeue();
-        m_active.insert(nam);
-        LOG_DEBUG(QStringLiteral("ConnectionPool: reused idle connection (active=%1, idle=%2)")
-                      .arg(m_active.size())
-                      .arg(m_idle.size()));
-        return nam;
-    }
+    const QString key = hostKey(url);
+    Host& host = hostFor(key);
 
-    // No idle connections: create a new one
-    if (m_active.size() >= m_maxSize) {
-        LOG_WARNING(QStringLiteral("ConnectionPool: max pool size %1 exceeded, "
-                                   "creating overflow connection (active=%2)")
-                        .arg(m_maxSize)
-                        .arg(m_active.size()));
+    // The least loaded manager of this host, so streams pack onto the
+    // connections already open
+    QNetworkAccessManager* chosen = leastLoaded(host);
+    const int capacity = host.http2 ? kHttp2StreamsPerManager : kHttp1RequestsPerManager;
+    if (!chosen || (m_managers.value(chosen).streams >= capacity
+                    && host.managers.size() < m_maxSize)) {
+        chosen = openManager(host, key);
+        ++host.misses;
+        host.missCounter->fetch_add(1, std::memory_order_relaxed);
+    } else {
+        ++host.hits;
+        host.hitCounter->fetch_add(1, std::memory_order_relaxed);
     }
 
-    auto* nam = new QNetworkAccessManager;
-    m_active.insert(nam);
-    LOG_DEBUG(QStringLiteral("ConnectionPool: created new connection (active=%1, idle=%2)")
-                  .arg(m_active.size())
-                  .arg(m_idle.size()));
-    return nam;
+    Manager& manager = m_managers[chosen];
+    const qint64 now = m_clock.elapsed();
+    const bool warm = manager.streams > 0
+                      || (manager.lastActiveMs >= 0 && now - manager.lastActiveMs <= kWarmIdleMs);
+    (warm ? registry.upstreamWarmHits : registry.upstreamColdStarts).add();
+    manager.lastActiveMs = now;
+
+    if (manager.streams++ == 0) {
+        ++m_activeManagers;
+    }
+    ++host.streams;
+    host.peakStreams = qMax(host.peakStreams, host.streams);
+    host.streamGauge->fetch_add(1, std::memory_order_relaxed);
+    publishCounts();
+    return chosen;
 }
 
 void ConnectionPool::release(QNetworkAccessManager* nam)
@@ -64,46 +127,213 @@ void ConnectionPool::release(QNetworkAccessManager* nam)
         return;
     }
 
-    if (!m_active.remove(nam)) {
-        LOG_WARNING(QStringLiteral("ConnectionPool: release called on untracked NAM, deleting"));
+    if (m_unpooled.remove(nam)) {
         delete nam;
+        publishCounts();
         return;
     }
 
-    if (!m_enabled) {
+    const auto it = m_managers.find(nam);
+    if (it == m_managers.end()) {
+        LOG_WARNING(QStringLiteral("ConnectionPool: release called on untracked NAM, deleting"));
         delete nam;
         return;
     }
+    if (it->streams == 0) {
+        return;
+    }
 
-    // If we are over capacity, destroy instead of returning to idle pool
-    int totalAfterReturn = m_idle.size() + m_active.size() + 1;
-    if (totalAfterReturn > m_maxSize) {
-        LOG_DEBUG(QStringLiteral("ConnectionPool: discarding overflow connection "
-                                 "(total would be %1, max=%2)")
-                      .arg(totalAfterReturn)
-                      .arg(m_maxSize));
-        delete nam;
+    Host& host = m_hosts[it->host];
+    --host.streams;
+    host.streamGauge->fetch_sub(1, std::memory_order_relaxed);
+    it->lastActiveMs = m_clock.elapsed();
+    if (--it->streams == 0) {
+        --m_activeManagers;
+        // Over the limit after a resize: close rather than keep idle
+        if (host.managers.size() > m_maxSize) {
+            dropManager(nam);
+        } else {
+            enforceIdleLimits(host);
+        }
+    }
+    publishCounts();
+}
+
+void ConnectionPool::noteProtocol(QNetworkAccessManager* nam, bool http2)
+{
+    QMutexLocker locker(&m_mutex);
+    const auto it = m_managers.constFind(nam);
+    if (it == m_managers.cend()) {
+        return;
+    }
+    Host& host = m_hosts[it->host];
+    if (host.http2 != http2) {
+        host.http2 = http2;
+        LOG_DEBUG(QStringLiteral("ConnectionPool: %1 speaks %2")
+                      .arg(it->host,
+                           http2 ? QStringLiteral("HTTP/2") : QStringLiteral("HTTP/1.1")));
+    }
+}
+
+bool ConnectionPool::warm(const QUrl& url, const QSslConfiguration& sslConfig, qint64 idleForMs)
+{
+    QMutexLocker locker(&m_mutex);
+    if (!m_enabled || url.host().isEmpty()) {
+        return false;
+    }
+
+    const QString key = hostKey(url);
+    Host& host = hostFor(key);
+    QNetworkAccessManager* nam = leastLoaded(host);
+    if (!nam) {
+        nam = openManager(host, key);
+        publishCounts();
+    }
+
+    Manager& manager = m_managers[nam];
+    const qint64 now = m_clock.elapsed();
+    if (idleForMs > 0 && (manager.streams > 0
+                          || (manager.lastActiveMs >= 0 && now - manager.lastActiveMs < idleForMs))) {
+        return false;
+    }
+
+    const QString scheme = url.scheme().toLower();
+    if (scheme == QLatin1String("https")) {
+        nam->connectToHostEncrypted(url.host(), quint16(url.port(443)), sslConfig);
+    } else if (scheme == QLatin1String("http")) {
+        nam->connectToHost(url.host(), quint16(url.port(80)));
     } else {
-        m_idle.enqueue(nam);
-        LOG_DEBUG(QStringLiteral("ConnectionPool: returned connection to idle pool "
-                                 "(active=%1, idle=%2)")
-                      .arg(m_active.size())
-                      .arg(m_idle.size()));
+        return false;
     }
+    manager.lastActiveMs = now;
+    metrics::registry().upstreamWarmups.add();
+    enforceIdleLimits(host);
+    publishCounts();
+    return true;
 }
 
-void ConnectionPool::clear()
+void ConnectionPool::setIdleLimits(int perHost, int total)
 {
     QMutexLocker locker(&m_mutex);
-    for (QNetworkAccessManager* nam : m_idle) {
-        delete nam;
+    m_maxIdlePerHost = qMax(1, perHost);
+    m_maxIdle = qMax(1, total);
+    for (const Host& host : std::as_const(m_hosts)) {
+        enforceIdleLimits(host);
     }
-    m_idle.clear();
+    publishCounts();
+}
+
+void ConnectionPool::setProxy(const QNetworkProxy& proxy)
+{
+    QMutexLocker locker(&m_mutex);
+    m_proxy = proxy;
+}
+
+int ConnectionPool::reapIdle(qint64 idleForMs)
+{
+    QMutexLocker locker(&m_mutex);
+    const qint64 now = m_clock.elapsed();
+    QList<QNetworkAccessManager*> expired;
+    for (auto it = m_managers.cbegin(); it != m_managers.cend(); ++it) {
+        if (it->streams == 0 && now - it->lastActiveMs >= idleForMs) {
+            expired.append(it.key());
+        }
+    }
+    for (QNetworkAccessManager* nam : std::as_const(expired)) {
+        evict(nam);
+    }
+    if (!expired.isEmpty()) {
+        publishCounts();
+        LOG_DEBUG(QStringLiteral("ConnectionPool: closed %1 idle connection(s)")
+                      .arg(expired.size()));
+    }
+    return int(expired.size());
+}
 
-    for (QNetworkAccessManager* nam : m_active) {
+void ConnectionPool::dropManager(QNetworkAccessManager* nam)
+{
+    const Manager manager = m_managers.take(nam);
+    Host& host = m_hosts[manager.host];
+    host.managers.removeOne(nam);
+    host.managerGauge->fetch_sub(1, std::memory_order_relaxed);
+    if (manager.streams > 0) {
+        // Its replies go down with it
+        host.streams -= manager.streams;
+        host.streamGauge->fetch_sub(manager.streams, std::memory_order_relaxed);
+        --m_activeManagers;
+    }
+    delete nam;
+}
+
+QNetworkAccessManager* ConnectionPool::leastRecentlyUsedIdle(const Host* host) const
+{
+    QNetworkAccessManager* oldest = nullptr;
+    qint64 oldestMs = std::numeric_limits<qint64>::max();
+    auto consider = [&](QNetworkAccessManager* nam, const Manager& manager) {
+        if (manager.streams == 0 && manager.lastActiveMs < oldestMs) {
+            oldest = nam;
+            oldestMs = manager.lastActiveMs;
+        }
+    };
+    if (host) {
+        for (QNetworkAccessManager* nam : host->managers) {
+            consider(nam, m_managers.value(nam));
+        }
+    } else {
+        for (auto it = m_managers.cbegin(); it != m_managers.cend(); ++it) {
+            consider(it.key(), *it);
+        }
+    }
+    return oldest;
+}
+
+void ConnectionPool::evict(QNetworkAccessManager* nam)
+{
+    ++m_hosts[m_managers.value(nam).host].evictions;
+    metrics::registry().upstreamPoolEvictions.add();
+    dropManager(nam);
+}
+
+void ConnectionPool::enforceIdleLimits(const Host& host)
+{
+    auto idleOf = [this](const Host& h) {
+        return std::count_if(h.managers.cbegin(), h.managers.cend(),
+                             [this](QNetworkAccessManager* nam) {
+                                 return m_managers.value(nam).streams == 0;
+                             });
+    };
+    while (idleOf(host) > m_maxIdlePerHost) {
+        evict(leastRecentlyUsedIdle(&host));
+    }
+    while (m_managers.size() - m_activeManagers > m_maxIdle) {
+        evict(leastRecentlyUsedIdle(nullptr));
+    }
+}
+
+void ConnectionPool::dropIdleManagers(Host& host, qsizetype keep)
+{
+    const QList<QNetworkAccessManager*> managers = host.managers;
+    for (QNetworkAccessManager* nam : managers) {
+        if (host.managers.size() <= keep) {
+            break;
+        }
+        if (m_managers.value(nam).streams == 0) {
+            dropManager(nam);
+        }
+    }
+}
+
+void ConnectionPool::clear()
+{
+    QMutexLocker locker(&m_mutex);
+    for (QNetworkAccessManager* nam : m_managers.keys()) {
+        dropManager(nam);
+    }
+    for (QNetworkAccessManager* nam : std::as_const(m_unpooled)) {
         delete nam;
     }
-    m_active.clear();
+    m_unpooled.clear();
+    publishCounts();
 
     LOG_DEBUG(QStringLiteral("ConnectionPool: all connections cleared"));
 }
@@ -113,14 +343,15 @@ void ConnectionPool::resize(int maxSize)
     QMutexLocker locker(&m_mutex);
     m_maxSize = maxSize;
 
-    // Shrink idle pool if new max is smaller
-    while (m_idle.size() + m_active.size() > m_maxSize && !m_idle.isEmpty()) {
-        delete m_idle.dequeue();
+    // Busy managers over the new limit close when their last request ends
+    for (Host& host : m_hosts) {
+        dropIdleManagers(host, m_maxSize);
     }
-    LOG_DEBUG(QStringLiteral("ConnectionPool: resized to max=%1 (active=%2, idle=%3)")
+    publishCounts();
+    LOG_DEBUG(QStringLiteral("ConnectionPool: resized to %1 per host (active=%2, idle=%3)")
                   .arg(m_maxSize)
-                  .arg(m_active.size())
-                  .arg(m_idle.size()));
+                  .arg(m_activeManagers)
+                  .arg(m_managers.size() - m_activeManagers));
 }
 
 void ConnectionPool::setEnabled(bool enabled)
@@ -128,9 +359,10 @@ void ConnectionPool::setEnabled(bool enabled)
     QMutexLocker locker(&m_mutex);
     m_enabled = enabled;
     if (!m_enabled) {
-        while (!m_idle.isEmpty()) {
-            delete m_idle.dequeue();
+        for (Host& host : m_hosts) {
+            dropIdleManagers(host, 0);
         }
+        publishCounts();
     }
 }
 
@@ -143,11 +375,33 @@ bool ConnectionPool::isEnabled() const
 int ConnectionPool::activeCount() const
 {
     QMutexLocker locker(&m_mutex);
-    return m_active.size();
+    return m_activeManagers + m_unpooled.size();
 }
 
 int ConnectionPool::idleCount() const
 {
     QMutexLocker locker(&m_mutex);
-    return m_idle.size();
+    return m_managers.size() - m_activeManagers;
+}
+
+QList<ConnectionPool::HostStats> ConnectionPool::hostStats() const
+{
+    QMutexLocker locker(&m_mutex);
+    QList<HostStats> stats;
+    for (auto it = m_hosts.cbegin(); it != m_hosts.cend(); ++it) {
+        stats.append({it.key(), int(it->managers.size()), it->streams, it->peakStreams,
+                      it->http2, it->hits, it->misses, it->evictions});
+    }
+    return stats;
+}
+
+void ConnectionPool::publishCounts()
+{
+    auto& registry = metrics::registry();
+    const qsizetype active = m_activeManagers + m_unpooled.size();
+    const qsizetype idle = m_managers.size() - m_activeManagers;
+    registry.poolActive.add(active - m_publishedActive);
+    registry.poolIdle.add(idle - m_publishedIdle);
+    m_publishedActive = active;
+    m_publishedIdle = idle;
 }
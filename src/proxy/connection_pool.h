@@ -1,27 +1,128 @@
 #pragma once
 #include <QNetworkAccessManager>
-#include <QQueue>
+#include <QNetworkProxy>
+#include <QHash>
+#include <QList>
 #include <QSet>
 #include <QMutex>
+#include <QElapsedTimer>
+#include <QSslConfiguration>
+#include <QUrl>
+#include <atomic>
 
+// Upstream network managers, bound to the host they serve.
+//
+// A QNetworkAccessManager keeps its own connections per host: one HTTP/2
+// connection that multiplexes every request to that host, or up to six
+// HTTP/1.1 connections. Requests to a host therefore go to a manager already
+// bound to it, and another manager (another connection) is only opened once
+// each one carries kHttp2StreamsPerManager streams, or
+// kHttp1RequestsPerManager requests while the host has not been seen to
+// speak HTTP/2. maxSize caps the managers, i.e. HTTP/2 connections, per
+// host; past it requests share the least loaded one and Qt queues them.
+//
+// Idle managers stay bound to their host so the next request finds a warm
+// connection, and warm() opens one before the first request needs it.
+// Requests that land on a manager used within kWarmIdleMs count as warm hits.
+// Idle managers are bounded per host and in total, closing the least
+// recently used one past either limit, and reapIdle() closes those left
+// unused for too long.
 class ConnectionPool {
 public:
+    static constexpr int kHttp2StreamsPerManager = 100;
+    static constexpr int kHttp1RequestsPerManager = 6;
+    static constexpr int kDefaultMaxIdlePerHost = 2;
+    static constexpr int kDefaultMaxIdle = 32;
+    // Providers commonly close connections after 60-120 s without traffic;
+    // a manager idle for longer is assumed to have to reconnect.
+    static constexpr qint64 kWarmIdleMs = 60 * 1000;
+
+    struct HostStats {
+        QString host;          // scheme://host:port
+        int managers = 0;
+        int streams = 0;       // requests in flight
+        int peakStreams = 0;
+        bool http2 = false;    // last reply from the host came over HTTP/2
+        quint64 hits = 0;      // requests given a manager already bound to the host
+        quint64 misses = 0;    // requests that had to open one
+        quint64 evictions = 0; // idle managers closed by the limits or the reaper
+    };
+
     explicit ConnectionPool(int maxSize = 10);
     ~ConnectionPool();
 
-    QNetworkAccessManager* acquire();
+    QNetworkAccessManager* acquire(const QUrl& url);
     void release(QNetworkAccessManager* nam);
+    // Records the protocol a reply from this manager's host was served over
+    void noteProtocol(QNetworkAccessManager* nam, bool http2);
+    // Opens the connection (DNS, TCP, TLS) the next request to this host
+    // will use, unless its manager has been busy within the last idleForMs.
+    // Returns whether a connection was started. Qt keeps connections that
+    // are already open, so warming a host that still has one costs nothing.
+    bool warm(const QUrl& url, const QSslConfiguration& sslConfig, qint64 idleForMs = 0);
+    void setIdleLimits(int perHost, int total);
+    // Proxy for managers opened from now on; the default follows the
+    // application proxy
+    void setProxy(const QNetworkProxy& proxy);
+    // Closes idle managers unused for at least idleForMs; returns how many
+    int reapIdle(qint64 idleForMs);
     void clear();
     void resize(int maxSize);
     void setEnabled(bool enabled);
     bool isEnabled() const;
+    // Managers with requests in flight, and without
     int activeCount() const;
     int idleCount() const;
+    QList<HostStats> hostStats() const;
+
+    static QString hostKey(const QUrl& url);
 
 private:
+    struct Manager {
+        QString host;
+        int streams = 0;
+        qint64 lastActiveMs = -1;  // on m_clock; -1 before the first request
+    };
+
+    struct Host {
+        QList<QNetworkAccessManager*> managers;
+        int streams = 0;
+        int peakStreams = 0;
+        bool http2 = false;
+        quint64 hits = 0;
+        quint64 misses = 0;
+        quint64 evictions = 0;
+        // Process-wide per-host series, shared with other workers' pools
+        std::atomic<qint64>* streamGauge = nullptr;
+        std::atomic<qint64>* managerGauge = nullptr;
+        std::atomic<quint64>* hitCounter = nullptr;
+        std::atomic<quint64>* missCounter = nullptr;
+    };
+
+    Host& hostFor(const QString& key);
+    QNetworkAccessManager* leastLoaded(const Host& host) const;
+    QNetworkAccessManager* openManager(Host& host, const QString& key);
+    void dropManager(QNetworkAccessManager* nam);
+    void dropIdleManagers(Host& host, qsizetype keep);
+    // Idle manager used longest ago, of one host or (nullptr) of all
+    QNetworkAccessManager* leastRecentlyUsedIdle(const Host* host) const;
+    void evict(QNetworkAccessManager* nam);
+    void enforceIdleLimits(const Host& host);
+    // Moves the process-wide pool gauges by this pool's change since the last
+    // call; called with the mutex held after every change
+    void publishCounts();
+
     int m_maxSize;
+    int m_maxIdlePerHost = kDefaultMaxIdlePerHost;
+    int m_maxIdle = kDefaultMaxIdle;
     bool m_enabled = true;
-    QQueue<QNetworkAccessManager*> m_idle;
-    QSet<QNetworkAccessManager*> m_active;
+    QNetworkProxy m_proxy;
+    QHash<QString, Host> m_hosts;
+    QHash<QNetworkAccessManager*, Manager> m_managers;
+    QSet<QNetworkAccessManager*> m_unpooled;  // one request each while disabled
+    int m_activeManagers = 0;
+    QElapsedTimer m_clock;
     mutable QMutex m_mutex;
+    qsizetype m_publishedActive = 0;
+    qsizetype m_publishedIdle = 0;
 };
@@ -0,0 +1,374 @@
+#include "dns_resolver.h"
+#include <QNetworkDatagram>
+#include <QRandomGenerator>
+#include <QTimer>
+#include <QUdpSocket>
+#include <QUrl>
+#include <QtEndian>
+
+namespace {
+
+constexpr quint16 kClassIN = 1;
+constexpr quint16 kFlagResponse = 0x8000;
+constexpr quint16 kFlagRecursionDesired = 0x0100;
+constexpr quint16 kRcodeNameError = 3;
+
+void appendUInt16(QByteArray& out, quint16 value)
+{
+    out += char(value >> 8);
+    out += char(value & 0xff);
+}
+
+// Skips a possibly compressed name; false if it runs past the end
+bool skipName(const uchar* data, qsizetype size, qsizetype& pos)
+{
+    while (pos < size) {
+        const uchar length = data[pos];
+        if (length == 0) {
+            ++pos;
+            return true;
+        }
+        if ((length & 0xc0) == 0xc0) {
+            pos += 2;
+            return pos <= size;
+        }
+        if (length & 0xc0)
+            return false;
+        pos += 1 + length;
+    }
+    return false;
+}
+
+QList<QHostAddress> interleave(const QList<QHostAddress>& v6, const QList<QHostAddress>& v4)
+{
+    QList<QHostAddress> out;
+    out.reserve(v6.size() + v4.size());
+    for (qsizetype i = 0; i < qMax(v6.size(), v4.size()); ++i) {
+        if (i < v6.size())
+            out.append(v6[i]);
+        if (i < v4.size())
+            out.append(v4[i]);
+    }
+    return out;
+}
+
+}
+
+struct DnsResolver::Lookup {
+    QString host;
+    QList<Callback> waiters;
+    QElapsedTimer started;
+    int server = 0;
+    QUdpSocket* socket = nullptr;  // per server attempt
+    QTimer* timer = nullptr;       // child of the socket
+    quint16 idA = 0;
+    quint16 idAAAA = 0;
+    bool gotA = false;
+    bool gotAAAA = false;
+    QList<QHostAddress> v4;
+    QList<QHostAddress> v6;
+    quint32 ttl = kMaxTtlSec;
+    bool finished = false;
+};
+
+DnsResolver::DnsResolver(QList<Server> servers, QObject* parent)
+    : QObject(parent)
+    , m_servers(std::move(servers))
+{
+    m_clock.start();
+}
+
+// Pending callbacks are dropped; their sockets go with this object
+DnsResolver::~DnsResolver() = default;
+
+QList<DnsResolver::Server> DnsResolver::parseServers(const QStringList& specs, QStringList* invalid)
+{
+    QList<Server> servers;
+    for (const QString& spec : specs) {
+        const QString text = spec.trimmed();
+        if (text.isEmpty())
+            continue;
+
+        QString host = text;
+        QString port;
+        if (text.startsWith(QLatin1Char('['))) {
+            const qsizetype end = text.indexOf(QLatin1Char(']'));
+            const QString rest = end < 0 ? QString() : text.mid(end + 1);
+            host = end < 0 ? QString() : text.mid(1, end - 1);
+            if (rest.startsWith(QLatin1Char(':')))
+                port = rest.mid(1);
+            else if (!rest.isEmpty())
+                host.clear();
+        } else if (text.count(QLatin1Char(':')) == 1) {
+            host = text.section(QLatin1Char(':'), 0, 0);
+            port = text.section(QLatin1Char(':'), 1);
+        }
+
+        Server server;
+        bool ok = server.address.setAddress(host);
+        if (ok && !port.isNull()) {
+            server.port = port.toUShort(&ok);
+            ok = ok && server.port != 0;
+        }
+        if (ok)
+            servers.append(server);
+        else if (invalid)
+            invalid->append(text);
+    }
+    return servers;
+}
+
+void DnsResolver::resolve(const QString& host, Callback done)
+{
+    QString name = host.trimmed().toLower();
+    if (name.endsWith(QLatin1Char('.')))
+        name.chop(1);
+
+    Resolution resolution;
+    QHostAddress literal;
+    if (literal.setAddress(name)) {
+        resolution.addresses = {literal};
+        done(resolution);
+        return;
+    }
+    if (m_servers.isEmpty() || name.isEmpty()) {
+        resolution.error = QStringLiteral("%1: no DNS server configured").arg(name);
+        done(resolution);
+        return;
+    }
+
+    const auto cached = m_cache.constFind(name);
+    if (cached != m_cache.cend()) {
+        if (cached->expiresMs > m_clock.elapsed()) {
+            resolution.addresses = cached->addresses;
+            resolution.fromCache = true;
+            done(resolution);
+            return;
+        }
+        m_cache.erase(cached);
+    }
+
+    if (const std::shared_ptr<Lookup> pending = m_lookups.value(name)) {
+        pending->waiters.append(std::move(done));
+        return;
+    }
+
+    auto lookup = std::make_shared<Lookup>();
+    lookup->host = name;
+    lookup->waiters.append(std::move(done));
+    lookup->started.start();
+    m_lookups.insert(name, lookup);
+    sendQueries(lookup);
+}
+
+void DnsResolver::sendQueries(const std::shared_ptr<Lookup>& lookup)
+{
+    if (lookup->socket) {
+        lookup->timer->stop();
+        lookup->socket->deleteLater();
+    }
+
+    // A fresh socket per attempt gets a fresh source port, and replies to
+    // the previous server are no longer read
+    auto* socket = new QUdpSocket(this);
+    auto* timer = new QTimer(socket);
+    timer->setSingleShot(true);
+    lookup->socket = socket;
+    lookup->timer = timer;
+    lookup->idA = quint16(QRandomGenerator::global()->bounded(0x10000));
+    lookup->idAAAA = lookup->idA ^ 0x8000;
+    lookup->gotA = false;
+    lookup->gotAAAA = false;
+    lookup->v4.clear();
+    lookup->v6.clear();
+    lookup->ttl = kMaxTtlSec;
+
+    connect(socket, &QUdpSocket::readyRead, socket, [this, lookup]() {
+        onDatagrams(lookup);
+    });
+    connect(timer, &QTimer::timeout, socket, [this, lookup]() {
+        // One family answered: connect with what there is
+        if (!lookup->v4.isEmpty() || !lookup->v6.isEmpty())
+            finish(lookup, QString());
+        else
+            nextServer(lookup, QStringLiteral("timed out"));
+    });
+
+    const Server& server = m_servers[lookup->server];
+    const QByteArray queryA = encodeQuery(lookup->idA, lookup->host, kTypeA);
+    const QByteArray queryAAAA = encodeQuery(lookup->idAAAA, lookup->host, kTypeAAAA);
+    if (queryA.isEmpty()) {
+        finish(lookup, QStringLiteral("invalid host name"));
+        return;
+    }
+    if (socket->writeDatagram(queryA, server.address, server.port) < 0
+        || socket->writeDatagram(queryAAAA, server.address, server.port) < 0) {
+        nextServer(lookup, socket->errorString());
+        return;
+    }
+    timer->start(m_timeoutMs);
+}
+
+void DnsResolver::onDatagrams(const std::shared_ptr<Lookup>& lookup)
+{
+    QUdpSocket* socket = lookup->socket;
+    const Server& server = m_servers[lookup->server];
+    while (socket && socket->hasPendingDatagrams()) {
+        const QNetworkDatagram datagram = socket->receiveDatagram();
+        if (!datagram.senderAddress().isEqual(server.address, QHostAddress::TolerantConversion)
+            || datagram.senderPort() != server.port) {
+            continue;
+        }
+        const QByteArray data = datagram.data();
+        if (data.size() < 2)
+            continue;
+        const quint16 id = qFromBigEndian<quint16>(data.constData());
+        bool* got = id == lookup->idA ? &lookup->gotA
+                  : id == lookup->idAAAA ? &lookup->gotAAAA
+                  : nullptr;
+        if (!got || *got)
+            continue;
+
+        QList<QHostAddress> addresses;
+        switch (decodeReply(data, &addresses, &lookup->ttl)) {
+        case Reply::Answer:
+        case Reply::NameError:
+            *got = true;
+            for (const QHostAddress& address : std::as_const(addresses)) {
+                if (address.protocol() == QAbstractSocket::IPv6Protocol)
+                    lookup->v6.append(address);
+                else
+                    lookup->v4.append(address);
+            }
+            break;
+        case Reply::ServerError:
+            nextServer(lookup, QStringLiteral("server failure"));
+            return;
+        case Reply::Malformed:
+            break;
+        }
+    }
+
+    if (lookup->gotA && lookup->gotAAAA) {
+        finish(lookup, lookup->v4.isEmpty() && lookup->v6.isEmpty()
+                           ? QStringLiteral("no addresses")
+                           : QString());
+    }
+}
+
+void DnsResolver::nextServer(const std::shared_ptr<Lookup>& lookup, const QString& reason)
+{
+    if (++lookup->server >= m_servers.size()) {
+        finish(lookup, reason);
+        return;
+    }
+    sendQueries(lookup);
+}
+
+void DnsResolver::finish(const std::shared_ptr<Lookup>& lookup, const QString& error)
+{
+    if (lookup->finished)
+        return;
+    lookup->finished = true;
+    m_lookups.remove(lookup->host);
+    if (lookup->socket) {
+        lookup->timer->stop();
+        lookup->socket->disconnect();
+        lookup->socket->deleteLater();
+        lookup->socket = nullptr;
+        lookup->timer = nullptr;
+    }
+
+    Resolution resolution;
+    resolution.elapsedUs = lookup->started.nsecsElapsed() / 1000;
+    if (error.isEmpty()) {
+        resolution.addresses = interleave(lookup->v6, lookup->v4);
+        const quint32 ttl = qBound(kMinTtlSec, lookup->ttl, kMaxTtlSec);
+        m_cache.insert(lookup->host, {resolution.addresses, m_clock.elapsed() + qint64(ttl) * 1000});
+    } else {
+        resolution.error = QStringLiteral("%1: %2").arg(lookup->host, error);
+    }
+
+    const QList<Callback> waiters = std::move(lookup->waiters);
+    for (const Callback& waiter : waiters)
+        waiter(resolution);
+}
+
+QByteArray DnsResolver::encodeQuery(quint16 id, const QString& host, quint16 type)
+{
+    QByteArray name = QUrl::toAce(host);
+    if (name.isEmpty())
+        return {};
+
+    QByteArray out;
+    out.reserve(18 + name.size());
+    appendUInt16(out, id);
+    appendUInt16(out, kFlagRecursionDesired);
+    appendUInt16(out, 1);  // one question
+    appendUInt16(out, 0);
+    appendUInt16(out, 0);
+    appendUInt16(out, 0);
+    for (const QByteArray& label : name.split('.')) {
+        if (label.isEmpty() || label.size() > 63)
+            return {};
+        out += char(label.size());
+        out += label;
+    }
+    out += '\0';
+    appendUInt16(out, type);
+    appendUInt16(out, kClassIN);
+    return out;
+}
+
+DnsResolver::Reply DnsResolver::decodeReply(const QByteArray& datagram,
+                                            QList<QHostAddress>* addresses, quint32* ttl)
+{
+    const auto* data = reinterpret_cast<const uchar*>(datagram.constData());
+    const qsizetype size = datagram.size();
+    if (size < 12)
+        return Reply::Malformed;
+
+    const quint16 flags = qFromBigEndian<quint16>(data + 2);
+    if (!(flags & kFlagResponse))
+        return Reply::Malformed;
+    const quint16 rcode = flags & 0x0f;
+    if (rcode == kRcodeNameError)
+        return Reply::NameError;
+    if (rcode != 0)
+        return Reply::ServerError;
+
+    const quint16 questions = qFromBigEndian<quint16>(data + 4);
+    const quint16 answers = qFromBigEndian<quint16>(data + 6);
+    qsizetype pos = 12;
+    for (quint16 i = 0; i < questions; ++i) {
+        if (!skipName(data, size, pos))
+            return Reply::Malformed;
+        pos += 4;
+    }
+    // CNAMEs come before the records they point to; only addresses matter
+    for (quint16 i = 0; i < answers; ++i) {
+        if (!skipName(data, size, pos) || pos + 10 > size)
+            return Reply::Malformed;
+        const quint16 type = qFromBigEndian<quint16>(data + pos);
+        const quint16 recordClass = qFromBigEndian<quint16>(data + pos + 2);
+        const quint32 recordTtl = qFromBigEndian<quint32>(data + pos + 4);
+        const quint16 length = qFromBigEndian<quint16>(data + pos + 8);
+        pos += 10;
+        if (pos + length > size)
+            return Reply::Malformed;
+
+        if (recordClass == kClassIN) {
+            QHostAddress address;
+            if (type == kTypeA && length == 4)
+                address.setAddress(qFromBigEndian<quint32>(data + pos));
+            else if (type == kTypeAAAA && length == 16)
+                address.setAddress(data + pos);
+            if (!address.isNull()) {
+                addresses->append(address);
+                *ttl = qMin(*ttl, recordTtl);
+            }
+        }
+        pos += length;
+    }
+    return Reply::Answer;
+}
@@ -0,0 +1,87 @@
+#pragma once
+#include <QElapsedTimer>
+#include <QHash>
+#include <QHostAddress>
+#include <QList>
+#include <QObject>
+#include <QString>
+#include <QStringList>
+#include <functional>
+#include <memory>
+
+// Resolves upstream host names by asking the configured DNS servers
+// directly over UDP.
+//
+// The system resolver reads the hosts file first, and that is where the
+// proxy points the hijacked domains at itself, so an upstream on one of
+// those domains would resolve to 127.0.0.1. Queries here never consult the
+// hosts file. A and AAAA records are asked for together; answers are cached
+// for their TTL, and concurrent lookups of one name share the queries. A
+// server that does not answer within the timeout, or answers with an error,
+// is skipped for the next one.
+//
+// Lives on one thread; callbacks run on it.
+class DnsResolver : public QObject {
+public:
+    struct Server {
+        QHostAddress address;
+        quint16 port = 53;
+    };
+
+    struct Resolution {
+        // Ordered for connection attempts: IPv6 and IPv4 interleaved,
+        // IPv6 first (RFC 8305)
+        QList<QHostAddress> addresses;
+        QString error;          // empty on success
+        bool fromCache = false;
+        qint64 elapsedUs = 0;   // 0 from the cache
+    };
+    using Callback = std::function<void(const Resolution&)>;
+
+    static constexpr int kDefaultTimeoutMs = 1000;
+    static constexpr quint32 kMinTtlSec = 1;
+    static constexpr quint32 kMaxTtlSec = 3600;
+
+    explicit DnsResolver(QList<Server> servers, QObject* parent = nullptr);
+    ~DnsResolver() override;
+
+    // "1.1.1.1", "1.1.1.1:53", "2606:4700:4700::1111" or "[2606:4700:4700::1111]:53";
+    // entries that are none of these are returned in `invalid`
+    static QList<Server> parseServers(const QStringList& specs, QStringList* invalid = nullptr);
+
+    // Per server, for both queries
+    void setTimeout(int ms) { m_timeoutMs = qMax(1, ms); }
+    // IP literals resolve to themselves without a query. The callback may
+    // run before resolve() returns.
+    void resolve(const QString& host, Callback done);
+    void clearCache() { m_cache.clear(); }
+
+    // DNS wire format, exposed for tests
+    static QByteArray encodeQuery(quint16 id, const QString& host, quint16 type);
+    enum class Reply { Answer, NameError, ServerError, Malformed };
+    // Appends the A/AAAA addresses in an answer to `addresses` and lowers
+    // `ttl` to the smallest record TTL
+    static Reply decodeReply(const QByteArray& datagram, QList<QHostAddress>* addresses,
+                             quint32* ttl);
+
+    static constexpr quint16 kTypeA = 1;
+    static constexpr quint16 kTypeAAAA = 28;
+
+private:
+    struct CacheEntry {
+        QList<QHostAddress> addresses;
+        qint64 expiresMs = 0;  // on m_clock
+    };
+    struct Lookup;
+
+    void sendQueries(const std::shared_ptr<Lookup>& lookup);
+    void onDatagrams(const std::shared_ptr<Lookup>& lookup);
+    void nextServer(const std::shared_ptr<Lookup>& lookup, const QString& reason);
+    void finish(const std::shared_ptr<Lookup>& lookup, const QString& error);
+
+    QList<Server> m_servers;
+    int m_timeoutMs = kDefaultTimeoutMs;
+    QHash<QString, CacheEntry> m_cache;
+    QHash<QString, std::shared_ptr<Lookup>> m_lookups;
+    QElapsedTimer m_clock;
+};
@@ -0,0 +1,470 @@
+#include "hpack.h"
+
+#include <array>
+#include <vector>
+
+namespace {
+
+// ========================================================================
+// Tables (RFC 7541 appendices A and B)
+// ========================================================================
+
+struct StaticEntry {
+    const char* name;
+    const char* value;
+};
+
+constexpr StaticEntry kStaticTable[] = {
+    {":authority", ""},
+    {":method", "GET"},
+    {":method", "POST"},
+    {":path", "/"},
+    {":path", "/index.html"},
+    {":scheme", "http"},
+    {":scheme", "https"},
+    {":status", "200"},
+    {":status", "204"},
+    {":status", "206"},
+    {":status", "304"},
+    {":status", "400"},
+    {":status", "404"},
+    {":status", "500"},
+    {"accept-charset", ""},
+    {"accept-encoding", "gzip, deflate"},
+    {"accept-language", ""},
+    {"accept-ranges", ""},
+    {"accept", ""},
+    {"access-control-allow-origin", ""},
+    {"age", ""},
+    {"allow", ""},
+    {"authorization", ""},
+    {"cache-control", ""},
+    {"content-disposition", ""},
+    {"content-encoding", ""},
+    {"content-language", ""},
+    {"content-length", ""},
+    {"content-location", ""},
+    {"content-range", ""},
+    {"content-type", ""},
+    {"cookie", ""},
+    {"date", ""},
+    {"etag", ""},
+    {"expect", ""},
+    {"expires", ""},
+    {"from", ""},
+    {"host", ""},
+    {"if-match", ""},
+    {"if-modified-since", ""},
+    {"if-none-match", ""},
+    {"if-range", ""},
+    {"if-unmodified-since", ""},
+    {"last-modified", ""},
+    {"link", ""},
+    {"location", ""},
+    {"max-forwards", ""},
+    {"proxy-authenticate", ""},
+    {"proxy-authorization", ""},
+    {"range", ""},
+    {"referer", ""},
+    {"refresh", ""},
+    {"retry-after", ""},
+    {"server", ""},
+    {"set-cookie", ""},
+    {"strict-transport-security", ""},
+    {"transfer-encoding", ""},
+    {"user-agent", ""},
+    {"vary", ""},
+    {"via", ""},
+    {"www-authenticate", ""},
+};
+constexpr quint64 kStaticTableSize = sizeof(kStaticTable) / sizeof(kStaticTable[0]);
+
+struct HuffmanCode {
+    quint32 code;
+    quint8 length;
+};
+
+constexpr HuffmanCode kHuffmanCodes[256] = {
+    {0x1ff8, 13}, {0x7fffd8, 23}, {0xfffffe2, 28}, {0xfffffe3, 28},
+    {0xfffffe4, 28}, {0xfffffe5, 28}, {0xfffffe6, 28}, {0xfffffe7, 28},
+    {0xfffffe8, 28}, {0xffffea, 24}, {0x3ffffffc, 30}, {0xfffffe9, 28},
+    {0xfffffea, 28}, {0x3ffffffd, 30}, {0xfffffeb, 28}, {0xfffffec, 28},
+    {0xfffffed, 28}, {0xfffffee, 28}, {0xfffffef, 28}, {0xffffff0, 28},
+    {0xffffff1, 28}, {0xffffff2, 28}, {0x3ffffffe, 30}, {0xffffff3, 28},
+    {0xffffff4, 28}, {0xffffff5, 28}, {0xffffff6, 28}, {0xffffff7, 28},
+    {0xffffff8, 28}, {0xffffff9, 28}, {0xffffffa, 28}, {0xffffffb, 28},
+    {0x14, 6}, {0x3f8, 10}, {0x3f9, 10}, {0xffa, 12},
+    {0x1ff9, 13}, {0x15, 6}, {0xf8, 8}, {0x7fa, 11},
+    {0x3fa, 10}, {0x3fb, 10}, {0xf9, 8}, {0x7fb, 11},
+    {0xfa, 8}, {0x16, 6}, {0x17, 6}, {0x18, 6},
+    {0x0, 5}, {0x1, 5}, {0x2, 5}, {0x19, 6},
+    {0x1a, 6}, {0x1b, 6}, {0x1c, 6}, {0x1d, 6},
+    {0x1e, 6}, {0x1f, 6}, {0x5c, 7}, {0xfb, 8},
+    {0x7ffc, 15}, {0x20, 6}, {0xffb, 12}, {0x3fc, 10},
+    {0x1ffa, 13}, {0x21, 6}, {0x5d, 7}, {0x5e, 7},
+    {0x5f, 7}, {0x60, 7}, {0x61, 7}, {0x62, 7},
+    {0x63, 7}, {0x64, 7}, {0x65, 7}, {0x66, 7},
+    {0x67, 7}, {0x68, 7}, {0x69, 7}, {0x6a, 7},
+    {0x6b, 7}, {0x6c, 7}, {0x6d, 7}, {0x6e, 7},
+    {0x6f, 7}, {0x70, 7}, {0x71, 7}, {0x72, 7},
+    {0xfc, 8}, {0x73, 7}, {0xfd, 8}, {0x1ffb, 13},
+    {0x7fff0, 19}, {0x1ffc, 13}, {0x3ffc, 14}, {0x22, 6},
+    {0x7ffd, 15}, {0x3, 5}, {0x23, 6}, {0x4, 5},
+    {0x24, 6}, {0x5, 5}, {0x25, 6}, {0x26, 6},
+    {0x27, 6}, {0x6, 5}, {0x74, 7}, {0x75, 7},
+    {0x28, 6}, {0x29, 6}, {0x2a, 6}, {0x7, 5},
+    {0x2b, 6}, {0x76, 7}, {0x2c, 6}, {0x8, 5},
+    {0x9, 5}, {0x2d, 6}, {0x77, 7}, {0x78, 7},
+    {0x79, 7}, {0x7a, 7}, {0x7b, 7}, {0x7ffe, 15},
+    {0x7fc, 11}, {0x3ffd, 14}, {0x1ffd, 13}, {0xffffffc, 28},
+    {0xfffe6, 20}, {0x3fffd2, 22}, {0xfffe7, 20}, {0xfffe8, 20},
+    {0x3fffd3, 22}, {0x3fffd4, 22}, {0x3fffd5, 22}, {0x7fffd9, 23},
+    {0x3fffd6, 22}, {0x7fffda, 23}, {0x7fffdb, 23}, {0x7fffdc, 23},
+    {0x7fffdd, 23}, {0x7fffde, 23}, {0xffffeb, 24}, {0x7fffdf, 23},
+    {0xffffec, 24}, {0xffffed, 24}, {0x3fffd7, 22}, {0x7fffe0, 23},
+    {0xffffee, 24}, {0x7fffe1, 23}, {0x7fffe2, 23}, {0x7fffe3, 23},
+    {0x7fffe4, 23}, {0x1fffdc, 21}, {0x3fffd8, 22}, {0x7fffe5, 23},
+    {0x3fffd9, 22}, {0x7fffe6, 23}, {0x7fffe7, 23}, {0xffffef, 24},
+    {0x3fffda, 22}, {0x1fffdd, 21}, {0xfffe9, 20}, {0x3fffdb, 22},
+    {0x3fffdc, 22}, {0x7fffe8, 23}, {0x7fffe9, 23}, {0x1fffde, 21},
+    {0x7fffea, 23}, {0x3fffdd, 22}, {0x3fffde, 22}, {0xfffff0, 24},
+    {0x1fffdf, 21}, {0x3fffdf, 22}, {0x7fffeb, 23}, {0x7fffec, 23},
+    {0x1fffe0, 21}, {0x1fffe1, 21}, {0x3fffe0, 22}, {0x1fffe2, 21},
+    {0x7fffed, 23}, {0x3fffe1, 22}, {0x7fffee, 23}, {0x7fffef, 23},
+    {0xfffea, 20}, {0x3fffe2, 22}, {0x3fffe3, 22}, {0x3fffe4, 22},
+    {0x7ffff0, 23}, {0x3fffe5, 22}, {0x3fffe6, 22}, {0x7ffff1, 23},
+    {0x3ffffe0, 26}, {0x3ffffe1, 26}, {0xfffeb, 20}, {0x7fff1, 19},
+    {0x3fffe7, 22}, {0x7ffff2, 23}, {0x3fffe8, 22}, {0x1ffffec, 25},
+    {0x3ffffe2, 26}, {0x3ffffe3, 26}, {0x3ffffe4, 26}, {0x7ffffde, 27},
+    {0x7ffffdf, 27}, {0x3ffffe5, 26}, {0xfffff1, 24}, {0x1ffffed, 25},
+    {0x7fff2, 19}, {0x1fffe3, 21}, {0x3ffffe6, 26}, {0x7ffffe0, 27},
+    {0x7ffffe1, 27}, {0x3ffffe7, 26}, {0x7ffffe2, 27}, {0xfffff2, 24},
+    {0x1fffe4, 21}, {0x1fffe5, 21}, {0x3ffffe8, 26}, {0x3ffffe9, 26},
+    {0xffffffd, 28}, {0x7ffffe3, 27}, {0x7ffffe4, 27}, {0x7ffffe5, 27},
+    {0xfffec, 20}, {0xfffff3, 24}, {0xfffed, 20}, {0x1fffe6, 21},
+    {0x3fffe9, 22}, {0x1fffe7, 21}, {0x1fffe8, 21}, {0x7ffff3, 23},
+    {0x3fffea, 22}, {0x3fffeb, 22}, {0x1ffffee, 25}, {0x1ffffef, 25},
+    {0xfffff4, 24}, {0xfffff5, 24}, {0x3ffffea, 26}, {0x7ffff4, 23},
+    {0x3ffffeb, 26}, {0x7ffffe6, 27}, {0x3ffffec, 26}, {0x3ffffed, 26},
+    {0x7ffffe7, 27}, {0x7ffffe8, 27}, {0x7ffffe9, 27}, {0x7ffffea, 27},
+    {0x7ffffeb, 27}, {0xffffffe, 28}, {0x7ffffec, 27}, {0x7ffffed, 27},
+    {0x7ffffee, 27}, {0x7ffffef, 27}, {0x7fffff0, 27}, {0x3ffffee, 26},
+};
+
+// Binary decoding tree built once from kHuffmanCodes. Leaves carry the
+// symbol; EOS (256) is a leaf as well so that it can be rejected.
+class HuffmanTree {
+public:
+    static constexpr int kEos = 256;
+
+    HuffmanTree()
+    {
+        m_nodes.push_back({});
+        for (int symbol = 0; symbol < 256; ++symbol) {
+            add(kHuffmanCodes[symbol].code, kHuffmanCodes[symbol].length, symbol);
+        }
+        add(0x3fffffff, 30, kEos);
+    }
+
+    struct Node {
+        std::array<int, 2> child{0, 0};
+        int symbol = -1;
+    };
+
+    const Node& node(int index) const { return m_nodes[static_cast<size_t>(index)]; }
+
+private:
+    void add(quint32 code, int length, int symbol)
+    {
+        int current = 0;
+        for (int bit = length - 1; bit >= 0; --bit) {
+            const int branch = (code >> bit) & 1;
+            if (m_nodes[static_cast<size_t>(current)].child[branch] == 0) {
+                m_nodes[static_cast<size_t>(current)].child[branch] = static_cast<int>(m_nodes.size());
+                m_nodes.push_back({});
+            }
+            current = m_nodes[static_cast<size_t>(current)].child[branch];
+        }
+        m_nodes[static_cast<size_t>(current)].symbol = symbol;
+    }
+
+    std::vector<Node> m_nodes;
+};
+
+const HuffmanTree& huffmanTree()
+{
+    static const HuffmanTree tree;
+    return tree;
+}
+
+// ========================================================================
+// Primitive encodings (RFC 7541 section 5)
+// ========================================================================
+
+bool decodeInteger(const uchar*& p, const uchar* end, int prefixBits, quint64& value)
+{
+    if (p >= end) {
+        return false;
+    }
+    const quint64 mask = (quint64(1) << prefixBits) - 1;
+    value = *p++ & mask;
+    if (value < mask) {
+        return true;
+    }
+    int shift = 0;
+    while (p < end) {
+        const uchar byte = *p++;
+        if (shift > 56) {
+            return false;
+        }
+        value += quint64(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) {
+            return true;
+        }
+        shift += 7;
+    }
+    return false;
+}
+
+bool decodeString(const uchar*& p, const uchar* end, QByteArray& out)
+{
+    if (p >= end) {
+        return false;
+    }
+    const bool huffman = (*p & 0x80) != 0;
+    quint64 length = 0;
+    if (!decodeInteger(p, end, 7, length) || length > quint64(end - p)) {
+        return false;
+    }
+    const QByteArrayView raw(reinterpret_cast<const char*>(p), static_cast<qsizetype>(length));
+    p += length;
+    if (huffman) {
+        out.clear();
+        return hpack::huffmanDecode(raw, out);
+    }
+    out = raw.toByteArray();
+    return true;
+}
+
+void encodeInteger(QByteArray& out, uchar flags, int prefixBits, quint64 value)
+{
+    const quint64 mask = (quint64(1) << prefixBits) - 1;
+    if (value < mask) {
+        out.append(static_cast<char>(flags | value));
+        return;
+    }
+    out.append(static_cast<char>(flags | mask));
+    value -= mask;
+    while (value >= 0x80) {
+        out.append(static_cast<char>((value & 0x7f) | 0x80));
+        value >>= 7;
+    }
+    out.append(static_cast<char>(value));
+}
+
+void encodeString(QByteArray& out, QByteArrayView value)
+{
+    encodeInteger(out, 0x00, 7, static_cast<quint64>(value.size()));
+    out.append(value);
+}
+
+constexpr qsizetype kEntryOverhead = 32;
+
+qsizetype entrySize(const HpackHeader& header)
+{
+    return header.name.size() + header.value.size() + kEntryOverhead;
+}
+
+}
+
+// ========================================================================
+// Huffman
+// ========================================================================
+
+bool hpack::huffmanDecode(QByteArrayView data, QByteArray& out)
+{
+    const HuffmanTree& tree = huffmanTree();
+    out.reserve(out.size() + data.size() * 8 / 5);
+
+    int current = 0;
+    int pendingBits = 0;        // bits walked since the last emitted symbol
+    bool pendingAllOnes = true;
+    for (const char c : data) {
+        const uchar byte = static_cast<uchar>(c);
+        for (int bit = 7; bit >= 0; --bit) {
+            const int branch = (byte >> bit) & 1;
+            current = tree.node(current).child[branch];
+            if (current == 0) {
+                return false;
+            }
+            ++pendingBits;
+            pendingAllOnes = pendingAllOnes && branch == 1;
+
+            const int symbol = tree.node(current).symbol;
+            if (symbol >= 0) {
+                if (symbol == HuffmanTree::kEos) {
+                    return false;
+                }
+                out.append(static_cast<char>(symbol));
+                current = 0;
+                pendingBits = 0;
+                pendingAllOnes = true;
+            }
+        }
+    }
+    // Padding is the most significant bits of EOS: fewer than 8, all ones
+    return pendingBits < 8 && pendingAllOnes;
+}
+
+// ========================================================================
+// HpackDecoder
+// ========================================================================
+
+HpackDecoder::HpackDecoder(quint32 maxTableSize)
+    : m_tableLimit(maxTableSize)
+    , m_protocolLimit(maxTableSize)
+{
+}
+
+bool HpackDecoder::lookup(quint64 index, HpackHeader& out) const
+{
+    if (index == 0) {
+        return false;
+    }
+    if (index <= kStaticTableSize) {
+        const StaticEntry& entry = kStaticTable[index - 1];
+        out.name = QByteArray::fromRawData(entry.name, static_cast<qsizetype>(qstrlen(entry.name)));
+        out.value = QByteArray::fromRawData(entry.value, static_cast<qsizetype>(qstrlen(entry.value)));
+        return true;
+    }
+    const quint64 dynamicIndex = index - kStaticTableSize - 1;
+    if (dynamicIndex >= m_table.size()) {
+        return false;
+    }
+    out = m_table[static_cast<size_t>(dynamicIndex)];
+    return true;
+}
+
+void HpackDecoder::evictTo(qsizetype limit)
+{
+    while (m_tableSize > limit && !m_table.empty()) {
+        m_tableSize -= entrySize(m_table.back());
+        m_table.pop_back();
+    }
+}
+
+void HpackDecoder::insert(const HpackHeader& header)
+{
+    const qsizetype size = entrySize(header);
+    if (size > m_tableLimit) {
+        // An entry larger than the table empties it (RFC 7541 4.4)
+        evictTo(0);
+        return;
+    }
+    evictTo(m_tableLimit - size);
+    // Deep copies: static-table names are raw views into read-only data
+    m_table.push_front({QByteArray(header.name.constData(), header.name.size()),
+                        QByteArray(header.value.constData(), header.value.size())});
+    m_tableSize += size;
+}
+
+bool HpackDecoder::decode(QByteArrayView block, HpackHeaderList& out)
+{
+    const uchar* p = reinterpret_cast<const uchar*>(block.data());
+    const uchar* const end = p + block.size();
+    qsizetype listSize = 0;
+    bool fieldSeen = false;
+    m_headerListTooLarge = false;
+
+    while (p < end) {
+        const uchar first = *p;
+        HpackHeader header;
+
+        if (first & 0x80) {
+            // Indexed header field
+            quint64 index = 0;
+            if (!decodeInteger(p, end, 7, index) || !lookup(index, header)) {
+                return false;
+            }
+        } else if ((first & 0xe0) == 0x20) {
+            // Dynamic table size update, only before the first field
+            quint64 size = 0;
+            if (fieldSeen || !decodeInteger(p, end, 5, size)
+                || size > quint64(m_protocolLimit)) {
+                return false;
+            }
+            m_tableLimit = static_cast<qsizetype>(size);
+            evictTo(m_tableLimit);
+            continue;
+        } else {
+            // Literal: with incremental indexing (01), never indexed (0001)
+            // or without indexing (0000)
+            const bool indexed = (first & 0xc0) == 0x40;
+            const int prefixBits = indexed ? 6 : 4;
+            quint64 nameIndex = 0;
+            if (!decodeInteger(p, end, prefixBits, nameIndex)) {
+                return false;
+            }
+            if (nameIndex != 0) {
+                HpackHeader named;
+                if (!lookup(nameIndex, named)) {
+                    return false;
+                }
+                header.name = named.name;
+            } else if (!decodeString(p, end, header.name)) {
+                return false;
+            }
+            if (!decodeString(p, end, header.value)) {
+                return false;
+            }
+            if (indexed) {
+                insert(header);
+            }
+        }
+
+        fieldSeen = true;
+        listSize += entrySize(header);
+        if (listSize > m_maxHeaderListSize) {
+            // Still a valid block; the table was kept in sync, so only this
+            // request is refused.
+            m_headerListTooLarge = true;
+            continue;
+        }
+        out.append(std::move(header));
+    }
+    return true;
+}
+
+// ========================================================================
+// HpackEncoder
+// ========================================================================
+
+void HpackEncoder::encode(const HpackHeaderList& headers, QByteArray& out) const
+{
+    for (const HpackHeader& header : headers) {
+        quint64 nameIndex = 0;
+        quint64 fullIndex = 0;
+        for (quint64 i = 0; i < kStaticTableSize && fullIndex == 0; ++i) {
+            if (header.name != kStaticTable[i].name) {
+                continue;
+            }
+            if (nameIndex == 0) {
+                nameIndex = i + 1;
+            }
+            if (header.value == kStaticTable[i].value) {
+                fullIndex = i + 1;
+            }
+        }
+
+        if (fullIndex != 0) {
+            encodeInteger(out, 0x80, 7, fullIndex);
+            continue;
+        }
+        // Literal without indexing: nothing is added to the peer's table
+        encodeInteger(out, 0x00, 4, nameIndex);
+        if (nameIndex == 0) {
+            encodeString(out, header.name);
+        }
+        encodeString(out, header.value);
+    }
+}
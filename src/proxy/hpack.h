@@ -0,0 +1,57 @@
+#pragma once
+#include <QByteArray>
+#include <QByteArrayView>
+#include <QList>
+#include <deque>
+
+// HPACK header compression (RFC 7541) for the HTTP/2 listener.
+
+struct HpackHeader {
+    QByteArray name;
+    QByteArray value;
+};
+using HpackHeaderList = QList<HpackHeader>;
+
+// Decodes header blocks received from one peer. The dynamic table persists
+// across blocks, so a decoder belongs to exactly one connection.
+class HpackDecoder {
+public:
+    explicit HpackDecoder(quint32 maxTableSize = 4096);
+
+    // Decodes one complete header block (HEADERS plus any CONTINUATION
+    // payloads). Returns false on a compression error, after which the
+    // connection has to be closed because the table state is lost.
+    bool decode(QByteArrayView block, HpackHeaderList& out);
+
+    // Upper bound on the decoded list, counted as in SETTINGS_MAX_HEADER_LIST_SIZE
+    void setMaxHeaderListSize(qsizetype size) { m_maxHeaderListSize = size; }
+    bool headerListTooLarge() const { return m_headerListTooLarge; }
+
+    qsizetype dynamicTableSize() const { return m_tableSize; }
+
+private:
+    bool lookup(quint64 index, HpackHeader& out) const;
+    void insert(const HpackHeader& header);
+    void evictTo(qsizetype limit);
+
+    std::deque<HpackHeader> m_table;   // newest first
+    qsizetype m_tableSize = 0;
+    qsizetype m_tableLimit;            // current limit, set by the peer
+    qsizetype m_protocolLimit;         // what we advertised
+    qsizetype m_maxHeaderListSize = 64 * 1024;
+    bool m_headerListTooLarge = false;
+};
+
+// Encodes response headers. Only the static table is used, so the peer's
+// dynamic table never has to be tracked and every block stands alone.
+class HpackEncoder {
+public:
+    void encode(const HpackHeaderList& headers, QByteArray& out) const;
+};
+
+namespace hpack {
+
+// Huffman-decodes a string literal; false on invalid padding or EOS
+bool huffmanDecode(QByteArrayView data, QByteArray& out);
+
+}
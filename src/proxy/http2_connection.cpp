@@ -0,0 +1,788 @@
+#include "http2_connection.h"
+#include "core/log_manager.h"
+
+#include <QIODevice>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <algorithm>
+#include <utility>
+
+namespace {
+
+constexpr QByteArrayView kClientPreface = "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n";
+constexpr qsizetype kFrameHeaderSize = 9;
+constexpr quint32 kDefaultMaxFrameSize = 16384;
+constexpr qint64 kMaxWindow = 0x7fffffff;
+constexpr qint64 kInitialWindow = 65535;
+
+enum FrameType : quint8 {
+    Data = 0x0,
+    Headers = 0x1,
+    Priority = 0x2,
+    RstStream = 0x3,
+    Settings = 0x4,
+    PushPromise = 0x5,
+    Ping = 0x6,
+    GoAway = 0x7,
+    WindowUpdate = 0x8,
+    Continuation = 0x9
+};
+
+enum FrameFlag : quint8 {
+    EndStream = 0x1,
+    Ack = 0x1,
+    EndHeaders = 0x4,
+    Padded = 0x8,
+    PriorityFlag = 0x20
+};
+
+enum SettingId : quint16 {
+    HeaderTableSize = 0x1,
+    EnablePush = 0x2,
+    MaxConcurrentStreams = 0x3,
+    InitialWindowSize = 0x4,
+    MaxFrameSize = 0x5,
+    MaxHeaderListSize = 0x6
+};
+
+quint32 readUInt32(const char* p)
+{
+    const auto* u = reinterpret_cast<const uchar*>(p);
+    return (quint32(u[0]) << 24) | (quint32(u[1]) << 16) | (quint32(u[2]) << 8) | quint32(u[3]);
+}
+
+void appendUInt32(QByteArray& out, quint32 value)
+{
+    out.append(static_cast<char>(value >> 24));
+    out.append(static_cast<char>(value >> 16));
+    out.append(static_cast<char>(value >> 8));
+    out.append(static_cast<char>(value));
+}
+
+void appendSetting(QByteArray& out, quint16 id, quint32 value)
+{
+    out.append(static_cast<char>(id >> 8));
+    out.append(static_cast<char>(id));
+    appendUInt32(out, value);
+}
+
+// Strips the pad length byte and trailing padding of a PADDED frame
+bool stripPadding(quint8 flags, QByteArrayView& payload)
+{
+    if (!(flags & Padded)) {
+        return true;
+    }
+    if (payload.isEmpty()) {
+        return false;
+    }
+    const qsizetype padLength = static_cast<uchar>(payload.front());
+    payload = payload.sliced(1);
+    if (padLength > payload.size()) {
+        return false;
+    }
+    payload.chop(padLength);
+    return true;
+}
+
+bool hasUppercase(QByteArrayView name)
+{
+    for (const char c : name) {
+        if (c >= 'A' && c <= 'Z') {
+            return true;
+        }
+    }
+    return false;
+}
+
+}
+
+// ========================================================================
+// Http2Request
+// ========================================================================
+
+QByteArrayView Http2Request::header(QByteArrayView name) const
+{
+    for (const HpackHeader& field : headers) {
+        if (QByteArrayView(field.name).compare(name, Qt::CaseInsensitive) == 0) {
+            // Empty values still count as present
+            return field.value.isEmpty() ? QByteArrayView("") : QByteArrayView(field.value);
+        }
+    }
+    return {};
+}
+
+// ========================================================================
+// Construction / preface
+// ========================================================================
+
+Http2Connection::Http2Connection(QIODevice* output,
+                                 const Http2Limits& limits,
+                                 QObject* parent)
+    : QObject(parent)
+    , m_output(output)
+    , m_limits(limits)
+{
+    m_decoder.setMaxHeaderListSize(m_limits.maxHeaderBytes);
+}
+
+void Http2Connection::start()
+{
+    QByteArray settings;
+    appendSetting(settings, MaxConcurrentStreams, m_limits.maxConcurrentStreams);
+    appendSetting(settings, InitialWindowSize, m_limits.receiveWindow);
+    appendSetting(settings, MaxHeaderListSize, static_cast<quint32>(m_limits.maxHeaderBytes));
+    appendSetting(settings, EnablePush, 0);
+    writeFrame(Settings, 0, 0, settings);
+
+    // The connection window only grows through WINDOW_UPDATE
+    if (m_limits.receiveWindow > kInitialWindow) {
+        sendWindowUpdate(0, static_cast<quint32>(m_limits.receiveWindow - kInitialWindow));
+    }
+}
+
+// ========================================================================
+// receive
+// ========================================================================
+
+void Http2Connection::receive(QByteArrayView data)
+{
+    if (m_failed) {
+        return;
+    }
+    m_input.append(data);
+
+    qsizetype pos = 0;
+    if (!m_prefaceReceived) {
+        const qsizetype available = qMin(m_input.size(), kClientPreface.size());
+        if (!kClientPreface.startsWith(QByteArrayView(m_input).first(available))) {
+            connectionError(ProtocolError, "invalid connection preface");
+            return;
+        }
+        if (available < kClientPreface.size()) {
+            return;
+        }
+        m_prefaceReceived = true;
+        pos = kClientPreface.size();
+    }
+
+    while (m_input.size() - pos >= kFrameHeaderSize) {
+        const auto* header = reinterpret_cast<const uchar*>(m_input.constData() + pos);
+        const qsizetype length = (qsizetype(header[0]) << 16) | (qsizetype(header[1]) << 8) | header[2];
+        const quint8 type = header[3];
+        const quint8 flags = header[4];
+        const quint32 streamId = readUInt32(m_input.constData() + pos + 5) & 0x7fffffff;
+
+        // We never raise SETTINGS_MAX_FRAME_SIZE above the default
+        if (length > qsizetype(kDefaultMaxFrameSize)) {
+            connectionError(FrameSizeError, "frame exceeds the maximum frame size");
+            return;
+        }
+        if (m_input.size() - pos - kFrameHeaderSize < length) {
+            break;
+        }
+
+        const QByteArrayView payload(m_input.constData() + pos + kFrameHeaderSize, length);
+        pos += kFrameHeaderSize + length;
+        if (!processFrame(type, flags, streamId, payload)) {
+            return;
+        }
+    }
+    m_input.remove(0, pos);
+}
+
+bool Http2Connection::processFrame(quint8 type, quint8 flags, quint32 streamId,
+                                   QByteArrayView payload)
+{
+    if (!m_settingsReceived && type != Settings) {
+        return connectionError(ProtocolError, "first frame is not SETTINGS");
+    }
+    if (m_headerStreamId != 0 && type != Continuation) {
+        return connectionError(ProtocolError, "header block interrupted");
+    }
+
+    switch (type) {
+    case Data:
+        return onData(flags, streamId, payload);
+    case Headers:
+        return onHeaders(flags, streamId, payload);
+    case Continuation:
+        return onContinuation(flags, streamId, payload);
+    case Settings:
+        return onSettings(flags, streamId, payload);
+    case WindowUpdate:
+        return onWindowUpdate(streamId, payload);
+    case RstStream:
+        return onRstStream(streamId, payload);
+    case Ping:
+        if (streamId != 0) {
+            return connectionError(ProtocolError, "PING on a stream");
+        }
+        if (payload.size() != 8) {
+            return connectionError(FrameSizeError, "PING payload is not 8 bytes");
+        }
+        if (!(flags & Ack)) {
+            writeFrame(Ping, Ack, 0, payload);
+        }
+        return true;
+    case Priority:
+        // Scheduling is round-robin; priority hints are not used
+        if (streamId == 0) {
+            return connectionError(ProtocolError, "PRIORITY on stream 0");
+        }
+        return payload.size() == 5 ? true : streamError(streamId, FrameSizeError);
+    case GoAway:
+        if (streamId != 0) {
+            return connectionError(ProtocolError, "GOAWAY on a stream");
+        }
+        // Streams already open are still answered
+        m_goingAway = true;
+        return true;
+    case PushPromise:
+        return connectionError(ProtocolError, "client sent PUSH_PROMISE");
+    default:
+        // Unknown frame types are ignored (RFC 9113 4.1)
+        return true;
+    }
+}
+
+// ========================================================================
+// HEADERS / CONTINUATION
+// ========================================================================
+
+bool Http2Connection::onHeaders(quint8 flags, quint32 streamId, QByteArrayView payload)
+{
+    if (streamId == 0) {
+        return connectionError(ProtocolError, "HEADERS on stream 0");
+    }
+    if (!stripPadding(flags, payload)) {
+        return connectionError(ProtocolError, "invalid HEADERS padding");
+    }
+    if (flags & PriorityFlag) {
+        if (payload.size() < 5) {
+            return connectionError(FrameSizeError, "truncated HEADERS priority");
+        }
+        payload = payload.sliced(5);
+    }
+
+    m_headerOpensStream = false;
+    if (!m_streams.contains(streamId)) {
+        if (streamId > m_lastStreamId) {
+            if ((streamId & 1) == 0) {
+                return connectionError(ProtocolError, "client opened an even stream");
+            }
+            m_lastStreamId = streamId;
+            m_headerOpensStream = true;
+        }
+        // Otherwise trailers for a stream already closed here; the block is
+        // still decoded to keep the HPACK table in sync.
+    }
+
+    m_headerStreamId = streamId;
+    m_headerFlags = flags;
+    m_headerBlock = payload.toByteArray();
+    if (m_headerBlock.size() > m_limits.maxHeaderBytes) {
+        return connectionError(EnhanceYourCalm, "header block too large");
+    }
+    return (flags & EndHeaders) ? finishHeaderBlock() : true;
+}
+
+bool Http2Connection::onContinuation(quint8 flags, quint32 streamId, QByteArrayView payload)
+{
+    if (m_headerStreamId == 0 || streamId != m_headerStreamId) {
+        return connectionError(ProtocolError, "unexpected CONTINUATION");
+    }
+    m_headerBlock.append(payload);
+    if (m_headerBlock.size() > m_limits.maxHeaderBytes) {
+        return connectionError(EnhanceYourCalm, "header block too large");
+    }
+    return (flags & EndHeaders) ? finishHeaderBlock() : true;
+}
+
+bool Http2Connection::finishHeaderBlock()
+{
+    const quint32 streamId = std::exchange(m_headerStreamId, 0);
+    const bool endStream = (m_headerFlags & EndStream) != 0;
+
+    HpackHeaderList fields;
+    const bool decoded = m_decoder.decode(m_headerBlock, fields);
+    m_headerBlock.clear();
+    if (!decoded) {
+        return connectionError(CompressionError, "header block could not be decoded");
+    }
+
+    if (m_headerOpensStream) {
+        return openStream(streamId, fields, endStream);
+    }
+
+    auto it = m_streams.find(streamId);
+    if (it == m_streams.end()) {
+        return true;
+    }
+    // A second block on an open stream is a trailer section and must end it
+    if (it->remoteClosed) {
+        return streamError(streamId, StreamClosed);
+    }
+    if (!endStream) {
+        return streamError(streamId, ProtocolError);
+    }
+    it->remoteClosed = true;
+    completeRequest(streamId);
+    return true;
+}
+
+bool Http2Connection::openStream(quint32 streamId, const HpackHeaderList& fields, bool endStream)
+{
+    if (m_goingAway || quint32(m_streams.size()) >= m_limits.maxConcurrentStreams) {
+        return streamError(streamId, RefusedStream);
+    }
+
+    Stream stream;
+    stream.sendWindow = m_peerInitialWindow;
+    stream.remoteClosed = endStream;
+    Http2Request& request = stream.request;
+    request.streamId = streamId;
+
+    bool regularSeen = false;
+    bool hasScheme = false;
+    for (const HpackHeader& field : fields) {
+        if (field.name.startsWith(':')) {
+            if (regularSeen) {
+                return streamError(streamId, ProtocolError);
+            }
+            if (field.name == ":method") {
+                request.method = field.value;
+            } else if (field.name == ":path") {
+                request.path = field.value;
+            } else if (field.name == ":authority") {
+                request.authority = field.value;
+            } else if (field.name == ":scheme") {
+                hasScheme = true;
+            } else {
+                return streamError(streamId, ProtocolError);
+            }
+            continue;
+        }
+        regularSeen = true;
+        if (hasUppercase(field.name)) {
+            return streamError(streamId, ProtocolError);
+        }
+        request.headers.append(field);
+    }
+    if (request.method.isEmpty() || request.path.isEmpty() || !hasScheme) {
+        return streamError(streamId, ProtocolError);
+    }
+
+    m_streams.insert(streamId, stream);
+    if (m_decoder.headerListTooLarge()) {
+        rejectStream(streamId, 431, "request headers too large");
+        return true;
+    }
+    if (endStream) {
+        completeRequest(streamId);
+    }
+    return true;
+}
+
+// ========================================================================
+// DATA
+// ========================================================================
+
+bool Http2Connection::onData(quint8 flags, quint32 streamId, QByteArrayView payload)
+{
+    if (streamId == 0) {
+        return connectionError(ProtocolError, "DATA on stream 0");
+    }
+
+    // The body is buffered as it arrives, so both windows are replenished
+    // straight away; memory is bounded by maxBodyBytes instead.
+    const qsizetype flowControlled = payload.size();
+    if (flowControlled > qsizetype(m_limits.receiveWindow)) {
+        return connectionError(FlowControlError, "DATA exceeds the receive window");
+    }
+    if (!stripPadding(flags, payload)) {
+        return connectionError(ProtocolError, "invalid DATA padding");
+    }
+    if (flowControlled > 0) {
+        sendWindowUpdate(0, static_cast<quint32>(flowControlled));
+    }
+
+    auto it = m_streams.find(streamId);
+    if (it == m_streams.end()) {
+        if (streamId > m_lastStreamId) {
+            return connectionError(ProtocolError, "DATA on an idle stream");
+        }
+        // In flight when the stream was reset or answered early
+        return true;
+    }
+    if (it->remoteClosed) {
+        return streamError(streamId, StreamClosed);
+    }
+
+    if (it->request.body.size() + payload.size() > m_limits.maxBodyBytes) {
+        rejectStream(streamId, 413, "request body too large");
+        return true;
+    }
+    it->request.body.append(payload);
+
+    if (flags & EndStream) {
+        it->remoteClosed = true;
+        completeRequest(streamId);
+    } else if (flowControlled > 0) {
+        sendWindowUpdate(streamId, static_cast<quint32>(flowControlled));
+    }
+    return true;
+}
+
+void Http2Connection::completeRequest(quint32 streamId)
+{
+    auto it = m_streams.find(streamId);
+    if (it == m_streams.end()) {
+        return;
+    }
+    // The receiver may answer synchronously and close the stream, so the
+    // request is moved out before the signal is emitted.
+    const Http2Request request = std::move(it->request);
+    emit requestReceived(request);
+}
+
+void Http2Connection::rejectStream(quint32 streamId, int status, const QByteArray& message)
+{
+    LOG_WARNING(QStringLiteral("Http2Connection: rejecting stream %1 - %2")
+                    .arg(streamId)
+                    .arg(QString::fromUtf8(message)));
+    QJsonObject errObj;
+    errObj[QStringLiteral("error")] = QString::fromUtf8(message);
+    sendResponse(streamId, status, {{"content-type", "application/json"}},
+                 QJsonDocument(errObj).toJson(QJsonDocument::Compact));
+}
+
+// ========================================================================
+// SETTINGS / WINDOW_UPDATE / RST_STREAM
+// ========================================================================
+
+bool Http2Connection::onSettings(quint8 flags, quint32 streamId, QByteArrayView payload)
+{
+    if (streamId != 0) {
+        return connectionError(ProtocolError, "SETTINGS on a stream");
+    }
+    if (flags & Ack) {
+        return payload.isEmpty() ? true
+                                 : connectionError(FrameSizeError, "SETTINGS ack with payload");
+    }
+    if (payload.size() % 6 != 0) {
+        return connectionError(FrameSizeError, "SETTINGS payload not a multiple of 6");
+    }
+
+    for (qsizetype offset = 0; offset < payload.size(); offset += 6) {
+        const auto* entry = reinterpret_cast<const uchar*>(payload.data() + offset);
+        const quint16 id = static_cast<quint16>((entry[0] << 8) | entry[1]);
+        const quint32 value = readUInt32(payload.data() + offset + 2);
+
+        switch (id) {
+        case EnablePush:
+            if (value > 1) {
+                return connectionError(ProtocolError, "invalid SETTINGS_ENABLE_PUSH");
+            }
+            break;
+        case InitialWindowSize: {
+            if (value > kMaxWindow) {
+                return connectionError(FlowControlError, "invalid SETTINGS_INITIAL_WINDOW_SIZE");
+            }
+            // Applies retroactively to every open stream (RFC 9113 6.9.2)
+            const qint64 delta = qint64(value) - m_peerInitialWindow;
+            for (Stream& stream : m_streams) {
+                stream.sendWindow += delta;
+                if (stream.sendWindow > kMaxWindow) {
+                    return connectionError(FlowControlError, "stream window overflow");
+                }
+            }
+            m_peerInitialWindow = value;
+            break;
+        }
+        case MaxFrameSize:
+            if (value < kDefaultMaxFrameSize || value > 0xffffff) {
+                return connectionError(ProtocolError, "invalid SETTINGS_MAX_FRAME_SIZE");
+            }
+            m_peerMaxFrameSize = value;
+            break;
+        default:
+            // HEADER_TABLE_SIZE does not matter: responses use only the
+            // static table. Unknown settings are ignored.
+            break;
+        }
+    }
+
+    m_settingsReceived = true;
+    writeFrame(Settings, Ack, 0, {});
+    flushPending();
+    return true;
+}
+
+bool Http2Connection::onWindowUpdate(quint32 streamId, QByteArrayView payload)
+{
+    if (payload.size() != 4) {
+        return connectionError(FrameSizeError, "WINDOW_UPDATE payload is not 4 bytes");
+    }
+    const quint32 increment = readUInt32(payload.data()) & 0x7fffffff;
+
+    if (streamId == 0) {
+        if (increment == 0) {
+            return connectionError(ProtocolError, "zero WINDOW_UPDATE increment");
+        }
+        m_connectionSendWindow += increment;
+        if (m_connectionSendWindow > kMaxWindow) {
+            return connectionError(FlowControlError, "connection window overflow");
+        }
+    } else {
+        auto it = m_streams.find(streamId);
+        if (it == m_streams.end()) {
+            return true;
+        }
+        if (increment == 0) {
+            return streamError(streamId, ProtocolError);
+        }
+        it->sendWindow += increment;
+        if (it->sendWindow > kMaxWindow) {
+            return streamError(streamId, FlowControlError);
+        }
+    }
+    flushPending();
+    return true;
+}
+
+bool Http2Connection::onRstStream(quint32 streamId, QByteArrayView payload)
+{
+    if (streamId == 0 || streamId > m_lastStreamId) {
+        return connectionError(ProtocolError, "RST_STREAM on an idle stream");
+    }
+    if (payload.size() != 4) {
+        return connectionError(FrameSizeError, "RST_STREAM payload is not 4 bytes");
+    }
+    if (m_streams.contains(streamId)) {
+        closeStream(streamId);
+        emit streamReset(streamId);
+    }
+    return true;
+}
+
+// ========================================================================
+// Response side
+// ========================================================================
+
+void Http2Connection::sendHeaders(quint32 streamId, int status,
+                                  const HpackHeaderList& headers, bool endStream)
+{
+    auto it = m_streams.find(streamId);
+    if (m_failed || it == m_streams.end() || it->responseStarted) {
+        return;
+    }
+    it->responseStarted = true;
+
+    HpackHeaderList fields;
+    fields.reserve(headers.size() + 1);
+    fields.append({":status", QByteArray::number(status)});
+    fields.append(headers);
+    QByteArray block;
+    m_encoder.encode(fields, block);
+
+    // Blocks larger than a frame continue in CONTINUATION frames
+    const QByteArrayView view(block);
+    qsizetype offset = 0;
+    do {
+        const qsizetype size = qMin<qsizetype>(view.size() - offset, m_peerMaxFrameSize);
+        quint8 flags = (offset + size == view.size()) ? EndHeaders : 0;
+        if (offset == 0 && endStream) {
+            flags |= EndStream;
+        }
+        writeFrame(offset == 0 ? Headers : Continuation, flags, streamId, view.sliced(offset, size));
+        offset += size;
+    } while (offset < view.size());
+
+    if (endStream) {
+        endStreamLocally(streamId);
+    }
+}
+
+void Http2Connection::sendData(quint32 streamId, const QByteArray& data, bool endStream)
+{
+    auto it = m_streams.find(streamId);
+    if (m_failed || it == m_streams.end() || !it->responseStarted || it->endQueued) {
+        return;
+    }
+    it->pending.append(data);
+    it->endQueued = endStream;
+    if (!m_sendOrder.contains(streamId)) {
+        m_sendOrder.append(streamId);
+    }
+    flushPending();
+}
+
+void Http2Connection::sendResponse(quint32 streamId, int status,
+                                   const HpackHeaderList& headers, const QByteArray& body)
+{
+    HpackHeaderList fields = headers;
+    fields.append({"content-length", QByteArray::number(body.size())});
+    sendHeaders(streamId, status, fields, body.isEmpty());
+    if (!body.isEmpty()) {
+        sendData(streamId, body, true);
+    }
+}
+
+qint64 Http2Connection::pendingBytes(quint32 streamId) const
+{
+    const auto it = m_streams.constFind(streamId);
+    return it == m_streams.cend() ? 0 : it->pending.size() - it->pendingOffset;
+}
+
+void Http2Connection::flushPending()
+{
+    // One frame per stream per pass, so concurrent streams interleave
+    bool progressed = true;
+    while (progressed && !m_sendOrder.isEmpty() && !m_failed) {
+        progressed = false;
+        for (qsizetype i = 0; i < m_sendOrder.size();) {
+            const quint32 streamId = m_sendOrder.at(i);
+            auto it = m_streams.find(streamId);
+            if (it == m_streams.end()) {
+                m_sendOrder.removeAt(i);
+                continue;
+            }
+
+            const qint64 remaining = it->pending.size() - it->pendingOffset;
+            // A SETTINGS change can leave a window negative
+            const qint64 size = std::max<qint64>(0, std::min({remaining, it->sendWindow,
+                                                              m_connectionSendWindow,
+                                                              qint64(m_peerMaxFrameSize)}));
+            const bool last = it->endQueued && size == remaining;
+            if (size == 0 && !last) {
+                ++i;  // waiting for WINDOW_UPDATE
+                continue;
+            }
+
+            writeFrame(Data, last ? EndStream : 0, streamId,
+                       QByteArrayView(it->pending).sliced(it->pendingOffset, size));
+            it->sendWindow -= size;
+            m_connectionSendWindow -= size;
+            it->pendingOffset += size;
+            if (it->pendingOffset == it->pending.size()) {
+                it->pending.clear();
+                it->pendingOffset = 0;
+            }
+            progressed = true;
+
+            if (last) {
+                m_sendOrder.removeAt(i);
+                endStreamLocally(streamId);
+            } else if (it->pending.isEmpty()) {
+                m_sendOrder.removeAt(i);
+            } else {
+                ++i;
+            }
+        }
+    }
+}
+
+void Http2Connection::endStreamLocally(quint32 streamId)
+{
+    auto it = m_streams.find(streamId);
+    if (it == m_streams.end()) {
+        return;
+    }
+    // Answered before the upload finished: stop the rest of it (RFC 9113 8.1)
+    if (!it->remoteClosed) {
+        QByteArray payload;
+        appendUInt32(payload, NoError);
+        writeFrame(RstStream, 0, streamId, payload);
+    }
+    closeStream(streamId);
+}
+
+void Http2Connection::resetStream(quint32 streamId, ErrorCode code)
+{
+    if (m_failed || !m_streams.contains(streamId)) {
+        return;
+    }
+    QByteArray payload;
+    appendUInt32(payload, code);
+    writeFrame(RstStream, 0, streamId, payload);
+    closeStream(streamId);
+}
+
+void Http2Connection::goAway(ErrorCode code)
+{
+    if (m_failed || m_goingAway) {
+        return;
+    }
+    m_goingAway = true;
+    QByteArray payload;
+    appendUInt32(payload, m_lastStreamId);
+    appendUInt32(payload, code);
+    writeFrame(GoAway, 0, 0, payload);
+}
+
+// ========================================================================
+// Helpers
+// ========================================================================
+
+void Http2Connection::writeFrame(quint8 type, quint8 flags, quint32 streamId,
+                                 QByteArrayView payload)
+{
+    QByteArray frame;
+    frame.reserve(kFrameHeaderSize + payload.size());
+    const quint32 length = static_cast<quint32>(payload.size());
+    frame.append(static_cast<char>(length >> 16));
+    frame.append(static_cast<char>(length >> 8));
+    frame.append(static_cast<char>(length));
+    frame.append(static_cast<char>(type));
+    frame.append(static_cast<char>(flags));
+    appendUInt32(frame, streamId & 0x7fffffff);
+    frame.append(payload);
+    m_output->write(frame);
+}
+
+void Http2Connection::sendWindowUpdate(quint32 streamId, quint32 increment)
+{
+    QByteArray payload;
+    appendUInt32(payload, increment & 0x7fffffff);
+    writeFrame(WindowUpdate, 0, streamId, payload);
+}
+
+void Http2Connection::closeStream(quint32 streamId)
+{
+    // m_sendOrder drops the id lazily in flushPending()
+    m_streams.remove(streamId);
+}
+
+bool Http2Connection::streamError(quint32 streamId, ErrorCode code)
+{
+    QByteArray payload;
+    appendUInt32(payload, code);
+    writeFrame(RstStream, 0, streamId, payload);
+    if (m_streams.contains(streamId)) {
+        closeStream(streamId);
+        emit streamReset(streamId);
+    }
+    return true;
+}
+
+bool Http2Connection::connectionError(ErrorCode code, const char* reason)
+{
+    if (m_failed) {
+        return false;
+    }
+    LOG_WARNING(QStringLiteral("Http2Connection: connection error %1 - %2")
+                    .arg(quint32(code))
+                    .arg(QString::fromLatin1(reason)));
+
+    QByteArray payload;
+    appendUInt32(payload, m_lastStreamId);
+    appendUInt32(payload, code);
+    writeFrame(GoAway, 0, 0, payload);
+
+    m_failed = true;
+    m_streams.clear();
+    m_sendOrder.clear();
+    m_input.clear();
+    emit failed();
+    return false;
+}
@@ -0,0 +1,140 @@
+#pragma once
+#include "hpack.h"
+#include <QByteArray>
+#include <QByteArrayView>
+#include <QList>
+#include <QMap>
+#include <QObject>
+
+class QIODevice;
+
+// One request received on an HTTP/2 stream. Header names are lowercase;
+// pseudo-headers are split out into their own fields.
+struct Http2Request {
+    quint32 streamId = 0;
+    QByteArray method;
+    QByteArray path;
+    QByteArray authority;
+    HpackHeaderList headers;
+    QByteArray body;
+
+    // Case-insensitive lookup; returns a null view when the header is absent.
+    QByteArrayView header(QByteArrayView name) const;
+};
+
+struct Http2Limits {
+    quint32 maxConcurrentStreams = 100;
+    // Per-stream and connection receive window advertised to the client
+    quint32 receiveWindow = 1024 * 1024;
+    qsizetype maxHeaderBytes = 64 * 1024;
+    qint64 maxBodyBytes = 64 * 1024 * 1024;
+};
+
+// Server side of an HTTP/2 connection (RFC 9113) after ALPN selected "h2".
+//
+// Bytes read from the socket are handed to receive(); frames are written to
+// the output device. Every stream has its own send window, and queued DATA
+// is interleaved across streams one frame at a time, so a slow or blocked
+// stream does not hold back the others sharing the connection.
+class Http2Connection : public QObject {
+    Q_OBJECT
+public:
+    enum ErrorCode : quint32 {
+        NoError = 0x0,
+        ProtocolError = 0x1,
+        InternalError = 0x2,
+        FlowControlError = 0x3,
+        StreamClosed = 0x5,
+        FrameSizeError = 0x6,
+        RefusedStream = 0x7,
+        Cancel = 0x8,
+        CompressionError = 0x9,
+        EnhanceYourCalm = 0xb
+    };
+
+    explicit Http2Connection(QIODevice* output,
+                             const Http2Limits& limits = {},
+                             QObject* parent = nullptr);
+
+    // Sends the server connection preface
+    void start();
+    void receive(QByteArrayView data);
+
+    // Response side. Headers must use lowercase names.
+    void sendHeaders(quint32 streamId, int status, const HpackHeaderList& headers, bool endStream);
+    void sendData(quint32 streamId, const QByteArray& data, bool endStream);
+    void sendResponse(quint32 streamId, int status, const HpackHeaderList& headers,
+                      const QByteArray& body);
+    void resetStream(quint32 streamId, ErrorCode code);
+    // Tells the client to open no new streams; open ones may still finish
+    void goAway(ErrorCode code = NoError);
+
+    bool isStreamOpen(quint32 streamId) const { return m_streams.contains(streamId); }
+    qsizetype openStreamCount() const { return m_streams.size(); }
+    // DATA bytes waiting for flow-control credit
+    qint64 pendingBytes(quint32 streamId) const;
+    bool hasFailed() const { return m_failed; }
+
+signals:
+    void requestReceived(const Http2Request& request);
+    // The client reset the stream, or it was refused; its response is dropped
+    void streamReset(quint32 streamId);
+    // Connection error: GOAWAY has been sent and the transport should close
+    void failed();
+
+private:
+    struct Stream {
+        Http2Request request;
+        bool remoteClosed = false;   // END_STREAM received
+        bool responseStarted = false;
+        bool endQueued = false;      // END_STREAM goes out with the last queued byte
+        qint64 sendWindow = 0;
+        QByteArray pending;          // DATA payload waiting for window
+        qsizetype pendingOffset = 0; // bytes of pending already sent
+    };
+
+    bool processFrame(quint8 type, quint8 flags, quint32 streamId, QByteArrayView payload);
+    bool onHeaders(quint8 flags, quint32 streamId, QByteArrayView payload);
+    bool onContinuation(quint8 flags, quint32 streamId, QByteArrayView payload);
+    bool onData(quint8 flags, quint32 streamId, QByteArrayView payload);
+    bool onSettings(quint8 flags, quint32 streamId, QByteArrayView payload);
+    bool onWindowUpdate(quint32 streamId, QByteArrayView payload);
+    bool onRstStream(quint32 streamId, QByteArrayView payload);
+    bool finishHeaderBlock();
+    bool openStream(quint32 streamId, const HpackHeaderList& fields, bool endStream);
+    void completeRequest(quint32 streamId);
+    void rejectStream(quint32 streamId, int status, const QByteArray& message);
+
+    void writeFrame(quint8 type, quint8 flags, quint32 streamId, QByteArrayView payload);
+    void sendWindowUpdate(quint32 streamId, quint32 increment);
+    void flushPending();
+    void endStreamLocally(quint32 streamId);
+    void closeStream(quint32 streamId);
+    bool connectionError(ErrorCode code, const char* reason);
+    bool streamError(quint32 streamId, ErrorCode code);
+
+    QIODevice* m_output;
+    Http2Limits m_limits;
+    HpackDecoder m_decoder;
+    HpackEncoder m_encoder;
+
+    QByteArray m_input;
+    bool m_prefaceReceived = false;
+    bool m_settingsReceived = false;
+    bool m_failed = false;
+    bool m_goingAway = false;
+
+    QMap<quint32, Stream> m_streams;
+    QList<quint32> m_sendOrder;       // streams with pending DATA, round-robin
+    quint32 m_lastStreamId = 0;
+
+    // Header block being assembled from HEADERS + CONTINUATION
+    quint32 m_headerStreamId = 0;
+    quint8 m_headerFlags = 0;
+    bool m_headerOpensStream = false;
+    QByteArray m_headerBlock;
+
+    qint64 m_connectionSendWindow = 65535;
+    qint64 m_peerInitialWindow = 65535;
+    quint32 m_peerMaxFrameSize = 16384;
+};
@@ -0,0 +1,564 @@
+#include "http_request_parser.h"
+#include <QIODevice>
+#include <cstring>
+
+namespace {
+
+constexpr qsizetype kHeaderReadChunk = 16 * 1024;
+constexpr qsizetype kChunkReadChunk = 4 * 1024;
+constexpr qsizetype kMaxChunkSizeLine = 1024;
+
+bool isOws(char c)
+{
+    return c == ' ' || c == '\t';
+}
+
+// Strict decimal parse; rejects signs, whitespace and overflow.
+bool parseContentLength(QByteArrayView text, qint64& out)
+{
+    if (text.isEmpty() || text.size() > 18) {
+        return false;
+    }
+    qint64 value = 0;
+    for (char c : text) {
+        if (c < '0' || c > '9') {
+            return false;
+        }
+        value = value * 10 + (c - '0');
+    }
+    out = value;
+    return true;
+}
+
+// Hex chunk-size, ignoring any chunk extensions after ';'.
+bool parseChunkSize(QByteArrayView line, qint64& out)
+{
+    const qsizetype semicolon = line.indexOf(';');
+    if (semicolon >= 0) {
+        line = line.first(semicolon);
+    }
+    while (!line.isEmpty() && isOws(line.back())) {
+        line.chop(1);
+    }
+    if (line.isEmpty() || line.size() > 15) {
+        return false;
+    }
+    qint64 value = 0;
+    for (char c : line) {
+        int digit;
+        if (c >= '0' && c <= '9') digit = c - '0';
+        else if (c >= 'a' && c <= 'f') digit = c - 'a' + 10;
+        else if (c >= 'A' && c <= 'F') digit = c - 'A' + 10;
+        else return false;
+        value = value * 16 + digit;
+    }
+    out = value;
+    return true;
+}
+
+}
+
+HttpRequestParser::HttpRequestParser()
+    : HttpRequestParser(HttpRequestLimits{})
+{
+}
+
+HttpRequestParser::HttpRequestParser(const HttpRequestLimits& limits)
+    : m_limits(limits)
+{
+}
+
+QByteArrayView HttpRequestParser::view(const Span& span) const
+{
+    if (span.size == 0) {
+        return {};
+    }
+    return QByteArrayView(m_buffer.constData() + span.offset, span.size);
+}
+
+HttpRequestParser::Status HttpRequestParser::status() const
+{
+    switch (m_phase) {
+    case Phase::Done:   return Status::Complete;
+    case Phase::Failed: return Status::Error;
+    default:            return Status::NeedMore;
+    }
+}
+
+bool HttpRequestParser::hasBufferedData() const
+{
+    return m_buffer.size() > m_consumed;
+}
+
+bool HttpRequestParser::headersComplete() const
+{
+    return m_phase != Phase::Headers && m_phase != Phase::Failed;
+}
+
+bool HttpRequestParser::expectsContinue() const
+{
+    if (m_phase == Phase::Headers || m_phase == Phase::Done || m_phase == Phase::Failed) {
+        return false;
+    }
+    return header("expect").compare("100-continue", Qt::CaseInsensitive) == 0;
+}
+
+// ========================================================================
+// feed / readFrom
+// ========================================================================
+
+HttpRequestParser::Status HttpRequestParser::feed(QByteArrayView data)
+{
+    switch (m_phase) {
+    case Phase::Headers:
+        m_buffer.append(data);
+        return scanHeaders();
+
+    case Phase::Body: {
+        const qint64 take = qMin<qint64>(m_contentLength - m_bodyFilled, data.size());
+        std::memcpy(m_body.data() + m_bodyFilled, data.data(), static_cast<size_t>(take));
+        m_bodyFilled += take;
+        if (take < data.size()) {
+            // Start of a pipelined request; m_buffer has nothing unconsumed yet
+            m_buffer.append(data.sliced(take));
+        }
+        if (m_bodyFilled == m_contentLength) {
+            m_phase = Phase::Done;
+        }
+        return status();
+    }
+
+    case Phase::ChunkSize:
+    case Phase::ChunkData:
+    case Phase::ChunkDataEnd:
+    case Phase::Trailers: {
+        const qsizetype used = consumeChunked(data.data(), data.size());
+        if (m_phase == Phase::Done && used < data.size()) {
+            m_buffer.append(data.sliced(used));
+        }
+        return status();
+    }
+
+    case Phase::Done:
+        m_buffer.append(data);
+        return Status::Complete;
+
+    case Phase::Failed:
+        return Status::Error;
+    }
+    return Status::Error;
+}
+
+HttpRequestParser::Status HttpRequestParser::readFrom(QIODevice* device)
+{
+    // Bytes left over from a previous request are parsed before reading
+    if (m_phase == Phase::Headers && m_scanPos < m_buffer.size()) {
+        const Status s = scanHeaders();
+        if (s != Status::NeedMore) {
+            return s;
+        }
+    }
+
+    while (m_phase != Phase::Done && m_phase != Phase::Failed) {
+        if (m_phase == Phase::Headers) {
+            // Read in modest chunks so at most one chunk of body is copied
+            // out of the header buffer; the rest is read in place below.
+            const qint64 available = device->bytesAvailable();
+            if (available <= 0) {
+                return Status::NeedMore;
+            }
+            const qsizetype chunk = static_cast<qsizetype>(qMin<qint64>(available, kHeaderReadChunk));
+            const qsizetype oldSize = m_buffer.size();
+            m_buffer.resize(oldSize + chunk);
+            const qint64 n = device->read(m_buffer.data() + oldSize, chunk);
+            m_buffer.resize(oldSize + qMax<qint64>(0, n));
+            if (n <= 0) {
+                return Status::NeedMore;
+            }
+            const Status s = scanHeaders();
+            if (s != Status::NeedMore) {
+                return s;
+            }
+            continue;
+        }
+
+        if (m_phase == Phase::Body) {
+            const qint64 remaining = m_contentLength - m_bodyFilled;
+            const qint64 n = device->read(m_body.data() + m_bodyFilled, remaining);
+            if (n <= 0) {
+                return Status::NeedMore;
+            }
+            m_bodyFilled += n;
+            if (m_bodyFilled == m_contentLength) {
+                m_phase = Phase::Done;
+            }
+            continue;
+        }
+
+        if (m_phase == Phase::ChunkData) {
+            // Chunk payload goes from the device straight into the body
+            const qint64 available = device->bytesAvailable();
+            const qint64 want = qMin(available, m_chunkRemaining);
+            if (want <= 0) {
+                return Status::NeedMore;
+            }
+            m_body.resize(m_bodyFilled + want);
+            const qint64 n = device->read(m_body.data() + m_bodyFilled, want);
+            m_bodyFilled += qMax<qint64>(0, n);
+            m_body.resize(m_bodyFilled);
+            if (n <= 0) {
+                return Status::NeedMore;
+            }
+            m_chunkRemaining -= n;
+            if (m_chunkRemaining == 0) {
+                m_phase = Phase::ChunkDataEnd;
+            }
+            continue;
+        }
+
+        // Chunk-size lines, chunk CRLFs and trailers: small reads, parsed by
+        // the same state machine as feed(); bytes past the request are kept.
+        char scratch[kChunkReadChunk];
+        const qint64 n = device->read(scratch, kChunkReadChunk);
+        if (n <= 0) {
+            return Status::NeedMore;
+        }
+        const qsizetype used = consumeChunked(scratch, static_cast<qsizetype>(n));
+        if (m_phase == Phase::Done && used < n) {
+            m_buffer.append(scratch + used, static_cast<qsizetype>(n) - used);
+        }
+    }
+    return status();
+}
+
+// ========================================================================
+// reset
+// ========================================================================
+
+void HttpRequestParser::reset()
+{
+    const qsizetype leftover = (m_phase == Phase::Failed) ? 0 : m_buffer.size() - m_consumed;
+    if (leftover > 0 && m_consumed > 0) {
+        std::memmove(m_buffer.data(), m_buffer.constData() + m_consumed,
+                     static_cast<size_t>(leftover));
+    }
+    m_buffer.resize(qMax<qsizetype>(0, leftover));
+
+    m_phase = Phase::Headers;
+    m_scanPos = 0;
+    m_consumed = 0;
+    m_method = {};
+    m_target = {};
+    m_version = {};
+    m_headers.clear();
+    m_contentLength = 0;
+    m_body = QByteArray();
+    m_bodyFilled = 0;
+    m_chunked = false;
+    m_chunkRemaining = 0;
+    m_chunkLine.clear();
+    m_trailerBytes = 0;
+    m_errorStatus = 0;
+    m_errorMessage.clear();
+}
+
+// ========================================================================
+// header lookup
+// ========================================================================
+
+QByteArrayView HttpRequestParser::header(QByteArrayView name) const
+{
+    for (const HeaderSpan& h : m_headers) {
+        const QByteArrayView candidate = view(h.name);
+        if (candidate.compare(name, Qt::CaseInsensitive) == 0) {
+            const QByteArrayView value = view(h.value);
+            // Present-but-empty headers still return a non-null view
+            return value.isNull() ? QByteArrayView("", 0) : value;
+        }
+    }
+    return {};
+}
+
+bool HttpRequestParser::hasHeader(QByteArrayView name) const
+{
+    return !header(name).isNull();
+}
+
+// ========================================================================
+// parsing
+// ========================================================================
+
+HttpRequestParser::Status HttpRequestParser::fail(int httpStatus, const QString& message)
+{
+    m_phase = Phase::Failed;
+    m_errorStatus = httpStatus;
+    m_errorMessage = message;
+    return Status::Error;
+}
+
+HttpRequestParser::Status HttpRequestParser::scanHeaders()
+{
+    // Tolerate stray CRLFs between pipelined requests (RFC 9112 2.2)
+    if (m_scanPos == 0) {
+        qsizetype skip = 0;
+        while (skip + 1 < m_buffer.size()
+               && m_buffer.at(skip) == '\r' && m_buffer.at(skip + 1) == '\n') {
+            skip += 2;
+        }
+        if (skip > 0) {
+            m_buffer.remove(0, skip);
+        }
+    }
+
+    const qsizetype terminator = m_buffer.indexOf("\r\n\r\n", m_scanPos);
+    if (terminator < 0) {
+        if (m_buffer.size() > m_limits.maxHeaderBytes) {
+            return fail(431, QStringLiteral("request headers too large"));
+        }
+        // The terminator may straddle this read and the next one
+        m_scanPos = qMax<qsizetype>(0, m_buffer.size() - 3);
+        return Status::NeedMore;
+    }
+
+    const qsizetype headerEnd = terminator + 4;
+    if (headerEnd > m_limits.maxHeaderBytes) {
+        return fail(431, QStringLiteral("request headers too large"));
+    }
+
+    const Status parsed = parseHeaderBlock(terminator + 2);
+    if (parsed == Status::Error) {
+        return parsed;
+    }
+    m_consumed = headerEnd;
+    return startBody();
+}
+
+HttpRequestParser::Status HttpRequestParser::parseHeaderBlock(qsizetype blockEnd)
+{
+    const char* data = m_buffer.constData();
+
+    // ---- Request line: METHOD SP TARGET SP VERSION CRLF ----
+    const qsizetype lineEnd = m_buffer.indexOf("\r\n");
+    const char* sp1 = static_cast<const char*>(std::memchr(data, ' ', static_cast<size_t>(lineEnd)));
+    if (!sp1 || sp1 == data) {
+        return fail(400, QStringLiteral("malformed request line"));
+    }
+    const qsizetype methodEnd = sp1 - data;
+    const char* sp2 = static_cast<const char*>(
+        std::memchr(sp1 + 1, ' ', static_cast<size_t>(lineEnd - methodEnd - 1)));
+    if (!sp2 || sp2 == sp1 + 1) {
+        return fail(400, QStringLiteral("malformed request line"));
+    }
+    const qsizetype targetEnd = sp2 - data;
+
+    m_method = {0, methodEnd};
+    m_target = {methodEnd + 1, targetEnd - methodEnd - 1};
+    m_version = {targetEnd + 1, lineEnd - targetEnd - 1};
+    if (!view(m_version).startsWith("HTTP/1.")) {
+        return fail(400, QStringLiteral("unsupported HTTP version"));
+    }
+
+    // ---- Header fields ----
+    m_headers.clear();
+    bool sawContentLength = false;
+    qsizetype pos = lineEnd + 2;
+    while (pos < blockEnd) {
+        const qsizetype end = m_buffer.indexOf("\r\n", pos);
+        const char* lineStart = data + pos;
+        const char* colon = static_cast<const char*>(
+            std::memchr(lineStart, ':', static_cast<size_t>(end - pos)));
+        if (!colon || colon == lineStart || isOws(*(colon - 1))) {
+            return fail(400, QStringLiteral("malformed header field"));
+        }
+        if (m_headers.size() >= m_limits.maxHeaderCount) {
+            return fail(431, QStringLiteral("too many request headers"));
+        }
+
+        qsizetype valueStart = (colon - data) + 1;
+        qsizetype valueEnd = end;
+        while (valueStart < valueEnd && isOws(data[valueStart])) ++valueStart;
+        while (valueEnd > valueStart && isOws(data[valueEnd - 1])) --valueEnd;
+
+        HeaderSpan h;
+        h.name = {pos, (colon - data) - pos};
+        h.value = {valueStart, valueEnd - valueStart};
+        m_headers.append(h);
+
+        const QByteArrayView name = view(h.name);
+        if (name.compare("content-length", Qt::CaseInsensitive) == 0) {
+            qint64 length = 0;
+            if (!parseContentLength(view(h.value), length)
+                || (sawContentLength && length != m_contentLength)) {
+                return fail(400, QStringLiteral("invalid Content-Length"));
+            }
+            sawContentLength = true;
+            m_contentLength = length;
+        } else if (name.compare("transfer-encoding", Qt::CaseInsensitive) == 0) {
+            // Only "chunked" on its own; other codings are not decoded here
+            if (view(h.value).compare("chunked", Qt::CaseInsensitive) != 0) {
+                return fail(501, QStringLiteral("unsupported transfer coding"));
+            }
+            m_chunked = true;
+        }
+
+        pos = end + 2;
+    }
+
+    // Both framings at once is a request smuggling vector (RFC 9112 6.3)
+    if (m_chunked && sawContentLength) {
+        return fail(400, QStringLiteral("both Content-Length and Transfer-Encoding present"));
+    }
+    if (m_contentLength > m_limits.maxBodyBytes) {
+        return fail(413, QStringLiteral("request body too large"));
+    }
+    return Status::NeedMore;
+}
+
+HttpRequestParser::Status HttpRequestParser::startBody()
+{
+    if (m_chunked) {
+        m_phase = Phase::ChunkSize;
+        const qsizetype buffered = m_buffer.size() - m_consumed;
+        if (buffered > 0) {
+            m_consumed += consumeChunked(m_buffer.constData() + m_consumed, buffered);
+        }
+        return status();
+    }
+
+    if (m_contentLength == 0) {
+        m_phase = Phase::Done;
+        return Status::Complete;
+    }
+
+    m_body = QByteArray(static_cast<qsizetype>(m_contentLength), Qt::Uninitialized);
+    m_bodyFilled = 0;
+    m_phase = Phase::Body;
+
+    // Body bytes that arrived together with the headers
+    const qint64 buffered = m_buffer.size() - m_consumed;
+    const qint64 take = qMin(buffered, m_contentLength);
+    if (take > 0) {
+        std::memcpy(m_body.data(), m_buffer.constData() + m_consumed, static_cast<size_t>(take));
+        m_bodyFilled = take;
+        m_consumed += take;
+    }
+    if (m_bodyFilled == m_contentLength) {
+        m_phase = Phase::Done;
+    }
+    return status();
+}
+
+// ========================================================================
+// chunked transfer coding
+// ========================================================================
+
+void HttpRequestParser::reserveBody(qint64 size)
+{
+    // Geometric growth keeps many small chunks linear overall
+    if (size > m_body.capacity()) {
+        m_body.reserve(static_cast<qsizetype>(qMax(size, qint64(m_body.capacity()) * 2)));
+    }
+}
+
+qsizetype HttpRequestParser::consumeChunked(const char* data, qsizetype size)
+{
+    qsizetype pos = 0;
+    while (pos < size) {
+        switch (m_phase) {
+        case Phase::ChunkData: {
+            const qsizetype take = static_cast<qsizetype>(qMin<qint64>(m_chunkRemaining, size - pos));
+            m_body.append(data + pos, take);
+            m_bodyFilled += take;
+            m_chunkRemaining -= take;
+            pos += take;
+            if (m_chunkRemaining == 0) {
+                m_phase = Phase::ChunkDataEnd;
+            }
+            break;
+        }
+
+        case Phase::ChunkSize:
+        case Phase::ChunkDataEnd:
+        case Phase::Trailers: {
+            const char* newline = static_cast<const char*>(
+                std::memchr(data + pos, '\n', static_cast<size_t>(size - pos)));
+            const qsizetype take = newline ? (newline - (data + pos)) + 1 : size - pos;
+            m_chunkLine.append(data + pos, take);
+            pos += take;
+
+            const qsizetype lineLimit =
+                (m_phase == Phase::Trailers) ? m_limits.maxHeaderBytes : kMaxChunkSizeLine;
+            if (m_chunkLine.size() > lineLimit) {
+                fail(m_phase == Phase::Trailers ? 431 : 400,
+                     QStringLiteral("chunk framing line too long"));
+                return pos;
+            }
+            if (!newline) {
+                return pos;
+            }
+
+            QByteArrayView line(m_chunkLine);
+            line.chop(1);
+            if (line.endsWith('\r')) {
+                line.chop(1);
+            }
+            processChunkLine(line);
+            m_chunkLine.clear();
+            break;
+        }
+
+        default:
+            return pos;
+        }
+    }
+    return pos;
+}
+
+void HttpRequestParser::processChunkLine(QByteArrayView line)
+{
+    switch (m_phase) {
+    case Phase::ChunkSize: {
+        qint64 chunkSize = 0;
+        if (!parseChunkSize(line, chunkSize)) {
+            fail(400, QStringLiteral("invalid chunk size"));
+            return;
+        }
+        if (chunkSize == 0) {
+            m_phase = Phase::Trailers;
+            return;
+        }
+        if (m_bodyFilled + chunkSize > m_limits.maxBodyBytes) {
+            fail(413, QStringLiteral("request body too large"));
+            return;
+        }
+        reserveBody(m_bodyFilled + chunkSize);
+        m_chunkRemaining = chunkSize;
+        m_phase = Phase::ChunkData;
+        return;
+    }
+
+    case Phase::ChunkDataEnd:
+        if (!line.isEmpty()) {
+            fail(400, QStringLiteral("missing CRLF after chunk data"));
+            return;
+        }
+        m_phase = Phase::ChunkSize;
+        return;
+
+    case Phase::Trailers:
+        if (line.isEmpty()) {
+            m_contentLength = m_bodyFilled;
+            m_phase = Phase::Done;
+            return;
+        }
+        // Trailer fields are accepted but not exposed
+        m_trailerBytes += line.size();
+        if (m_trailerBytes > m_limits.maxHeaderBytes) {
+            fail(431, QStringLiteral("request trailers too large"));
+        }
+        return;
+
+    default:
+        return;
+    }
+}
@@ -0,0 +1,120 @@
+#pragma once
+#include <QByteArray>
+#include <QByteArrayView>
+#include <QList>
+#include <QString>
+#include <utility>
+
+class QIODevice;
+
+struct HttpRequestLimits {
+    qsizetype maxHeaderBytes = 64 * 1024;
+    int maxHeaderCount = 128;
+    qint64 maxBodyBytes = 64 * 1024 * 1024;
+};
+
+// Incremental HTTP/1.1 request parser for one connection.
+//
+// Header bytes accumulate in a receive buffer whose terminator search resumes
+// where the previous read stopped; the request line and headers are exposed as
+// views into that buffer (valid until reset()). The body is written straight
+// into a buffer preallocated from Content-Length, or de-chunked into it as
+// chunks arrive for Transfer-Encoding: chunked. Bytes that arrive after the
+// current request are kept for the next one.
+class HttpRequestParser {
+public:
+    enum class Status { NeedMore, Complete, Error };
+
+    HttpRequestParser();
+    explicit HttpRequestParser(const HttpRequestLimits& limits);
+
+    // Appends received bytes and advances the parse.
+    Status feed(QByteArrayView data);
+    // Reads what the device has buffered; body bytes land directly in body().
+    Status readFrom(QIODevice* device);
+    // Drops the completed request, keeping any bytes that followed it.
+    void reset();
+
+    Status status() const;
+    bool hasBufferedData() const;
+    int errorStatus() const { return m_errorStatus; }
+    const QString& errorMessage() const { return m_errorMessage; }
+
+    QByteArrayView method() const { return view(m_method); }
+    QByteArrayView target() const { return view(m_target); }
+    QByteArrayView version() const { return view(m_version); }
+
+    qsizetype headerCount() const { return m_headers.size(); }
+    QByteArrayView headerName(qsizetype index) const { return view(m_headers.at(index).name); }
+    QByteArrayView headerValue(qsizetype index) const { return view(m_headers.at(index).value); }
+    // Case-insensitive lookup; returns a null view when the header is absent.
+    QByteArrayView header(QByteArrayView name) const;
+    bool hasHeader(QByteArrayView name) const;
+
+    // Headers are parsed and the body is still arriving
+    bool headersComplete() const;
+    // The client waits for "100 Continue" before sending the body
+    bool expectsContinue() const;
+    bool isChunked() const { return m_chunked; }
+
+    // Declared length, or the decoded length once a chunked body is complete
+    qint64 contentLength() const { return m_contentLength; }
+    const QByteArray& body() const { return m_body; }
+    // Hands the completed body over so the parser no longer keeps it alive
+    QByteArray takeBody() { return std::exchange(m_body, QByteArray()); }
+
+private:
+    enum class Phase {
+        Headers,
+        Body,          // Content-Length body
+        ChunkSize,     // chunk-size [; ext] CRLF
+        ChunkData,
+        ChunkDataEnd,  // CRLF after chunk data
+        Trailers,
+        Done,
+        Failed
+    };
+
+    // Offsets rather than pointers so the parser stays copyable
+    struct Span {
+        qsizetype offset = 0;
+        qsizetype size = 0;
+    };
+    struct HeaderSpan {
+        Span name;
+        Span value;
+    };
+
+    Status scanHeaders();
+    Status parseHeaderBlock(qsizetype blockEnd);
+    Status startBody();
+    qsizetype consumeChunked(const char* data, qsizetype size);
+    void processChunkLine(QByteArrayView line);
+    void reserveBody(qint64 size);
+    Status fail(int httpStatus, const QString& message);
+    QByteArrayView view(const Span& span) const;
+
+    HttpRequestLimits m_limits;
+    Phase m_phase = Phase::Headers;
+
+    QByteArray m_buffer;        // header bytes plus anything read past them
+    qsizetype m_scanPos = 0;    // where the next terminator search starts
+    qsizetype m_consumed = 0;   // bytes of m_buffer that belong to this request
+
+    Span m_method;
+    Span m_target;
+    Span m_version;
+    QList<HeaderSpan> m_headers;
+
+    qint64 m_contentLength = 0;
+    QByteArray m_body;
+    qint64 m_bodyFilled = 0;
+
+    bool m_chunked = false;
+    qint64 m_chunkRemaining = 0;
+    QByteArray m_chunkLine;     // partial chunk-size / trailer line
+    qsizetype m_trailerBytes = 0;
+
+    int m_errorStatus = 0;
+    QString m_errorMessage;
+};
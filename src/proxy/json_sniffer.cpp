@@ -0,0 +1,121 @@
+#include "json_sniffer.h"
+
+namespace {
+
+const char* skipSpace(const char* p, const char* end)
+{
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r'))
+        ++p;
+    return p;
+}
+
+// p is at the opening quote; returns the position after the closing one
+const char* skipString(const char* p, const char* end)
+{
+    for (++p; p < end; ++p) {
+        if (*p == '\\')
+            ++p;
+        else if (*p == '"')
+            return p + 1;
+    }
+    return nullptr;
+}
+
+const char* skipValue(const char* p, const char* end)
+{
+    if (p >= end)
+        return nullptr;
+    if (*p == '"')
+        return skipString(p, end);
+
+    if (*p == '{' || *p == '[') {
+        int depth = 0;
+        while (p < end) {
+            switch (*p) {
+            case '"':
+                p = skipString(p, end);
+                if (!p)
+                    return nullptr;
+                continue;
+            case '{':
+            case '[':
+                ++depth;
+                break;
+            case '}':
+            case ']':
+                if (--depth == 0)
+                    return p + 1;
+                break;
+            default:
+                break;
+            }
+            ++p;
+        }
+        return nullptr;
+    }
+
+    // Number, true, false or null
+    while (p < end && *p != ',' && *p != '}' && *p != ']' &&
+           *p != ' ' && *p != '\t' && *p != '\n' && *p != '\r')
+        ++p;
+    return p;
+}
+
+}
+
+namespace json_sniffer {
+
+std::optional<bool> topLevelBool(QByteArrayView json, QByteArrayView key)
+{
+    const char* p = json.data();
+    const char* const end = p + json.size();
+
+    p = skipSpace(p, end);
+    if (p == end || *p != '{')
+        return std::nullopt;
+    ++p;
+
+    std::optional<bool> found;
+    for (;;) {
+        p = skipSpace(p, end);
+        if (p != end && *p == '}')
+            return found;
+        if (p == end || *p != '"')
+            return std::nullopt;
+
+        const char* keyBegin = p + 1;
+        p = skipString(p, end);
+        if (!p)
+            return std::nullopt;
+        // Keys are compared as written; an escaped spelling of the key is
+        // not recognized
+        const QByteArrayView name(keyBegin, p - 1 - keyBegin);
+
+        p = skipSpace(p, end);
+        if (p == end || *p != ':')
+            return std::nullopt;
+        p = skipSpace(p + 1, end);
+
+        if (name == key) {
+            const QByteArrayView rest(p, end - p);
+            if (rest.startsWith("true"))
+                found = true;
+            else if (rest.startsWith("false"))
+                found = false;
+            else
+                found.reset();
+        }
+
+        p = skipValue(p, end);
+        if (!p)
+            return std::nullopt;
+        p = skipSpace(p, end);
+        if (p != end && *p == '}')
+            return found;
+        if (p == end || *p != ',')
+            return std::nullopt;
+        ++p;
+    }
+}
+
+}
@@ -0,0 +1,17 @@
+#pragma once
+#include <QByteArrayView>
+#include <optional>
+
+// Reads single top-level fields of a JSON object without parsing the whole
+// document. Nested values are skipped by scanning for their closing bracket,
+// so nothing is allocated and the cost is a single pass over the body.
+// The input is not validated beyond what the scan needs; a body the sniffer
+// accepts may still be rejected by the real parser later.
+namespace json_sniffer {
+
+// Value of a top-level boolean field; nullopt when the body is not an
+// object, the field is absent or is not a boolean. A duplicated field reads
+// as its last occurrence, as QJsonDocument keeps it.
+std::optional<bool> topLevelBool(QByteArrayView json, QByteArrayView key);
+
+}
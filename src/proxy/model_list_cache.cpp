@@ -0,0 +1,66 @@
+#include "model_list_cache.h"
+
+ModelListCache::ModelListCache(qint64 ttlMs)
+    : m_ttlMs(ttlMs)
+{
+}
+
+ModelListCache::State ModelListCache::lookup(const QString& key, Response* out) const
+{
+    const auto it = m_entries.constFind(key);
+    if (it == m_entries.cend() || !isEnabled() || it->age.elapsed() > m_ttlMs + kMaxStaleMs) {
+        ++m_misses;
+        return State::Missing;
+    }
+
+    ++m_hits;
+    if (out) {
+        *out = it->response;
+    }
+    return it->age.elapsed() > m_ttlMs ? State::Stale : State::Fresh;
+}
+
+bool ModelListCache::join(const QString& key, Waiter waiter)
+{
+    auto it = m_inFlight.find(key);
+    const bool first = it == m_inFlight.end();
+    if (first) {
+        it = m_inFlight.insert(key, {});
+        ++m_fetches;
+    }
+    if (waiter) {
+        it->append(std::move(waiter));
+    }
+    return first;
+}
+
+void ModelListCache::complete(const QString& key, const Response& response)
+{
+    if (isEnabled() && response.status >= 200 && response.status < 300) {
+        if (!m_entries.contains(key) && m_entries.size() >= kMaxEntries) {
+            evictOldest();
+        }
+        Entry& entry = m_entries[key];
+        entry.response = response;
+        entry.age.start();
+    }
+
+    // Waiters may start new requests; take them out first
+    const QList<Waiter> waiters = m_inFlight.take(key);
+    for (const Waiter& waiter : waiters) {
+        waiter(response);
+    }
+}
+
+void ModelListCache::evictOldest()
+{
+    auto oldest = m_entries.begin();
+    for (auto it = m_entries.begin(); it != m_entries.end(); ++it) {
+        if (it->age.elapsed() > oldest->age.elapsed()) {
+            oldest = it;
+        }
+    }
+    if (oldest != m_entries.end()) {
+        m_entries.erase(oldest);
+    }
+}
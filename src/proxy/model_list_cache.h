@@ -0,0 +1,72 @@
+#pragma once
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QList>
+#include <QString>
+#include <functional>
+
+// Upstream model lists for GET /v1/models, per upstream and credential.
+//
+// A list is fresh for the TTL. After that it is stale: it is still served,
+// and the first request to see it starts a refresh in the background. Lists
+// stale for longer than kMaxStaleMs are dropped. Requests that find nothing
+// wait for a single fetch shared by every request for the same key.
+//
+// Both response shapes are serialized when a list is stored, so a hit hands
+// out an implicitly shared body without touching JSON.
+//
+// Not thread-safe; each worker keeps its own cache.
+class ModelListCache {
+public:
+    static constexpr qint64 kMaxStaleMs = 60LL * 60 * 1000;
+    static constexpr qsizetype kMaxEntries = 64;
+
+    struct Response {
+        int status = 0;
+        QByteArray openAiBody;
+        QByteArray anthropicBody;
+
+        const QByteArray& body(bool anthropicSchema) const
+        {
+            return anthropicSchema ? anthropicBody : openAiBody;
+        }
+    };
+
+    enum class State { Missing, Fresh, Stale };
+    using Waiter = std::function<void(const Response&)>;
+
+    // ttlMs <= 0 disables caching; concurrent fetches are still shared
+    explicit ModelListCache(qint64 ttlMs);
+
+    bool isEnabled() const { return m_ttlMs > 0; }
+
+    State lookup(const QString& key, Response* out) const;
+
+    // Queues `waiter` (may be null for a background refresh) for the fetch of
+    // `key`. Returns true when no fetch is running and the caller must start
+    // one, then report it through complete().
+    bool join(const QString& key, Waiter waiter);
+    // Stores a 2xx response and answers everyone who joined the fetch. A
+    // failed refresh keeps the stale list.
+    void complete(const QString& key, const Response& response);
+
+    qint64 hits() const { return m_hits; }
+    qint64 misses() const { return m_misses; }
+    qint64 fetches() const { return m_fetches; }
+
+private:
+    struct Entry {
+        Response response;
+        QElapsedTimer age;
+    };
+
+    void evictOldest();
+
+    qint64 m_ttlMs;
+    QHash<QString, Entry> m_entries;
+    QHash<QString, QList<Waiter>> m_inFlight;
+    mutable qint64 m_hits = 0;
+    mutable qint64 m_misses = 0;
+    qint64 m_fetches = 0;
+};
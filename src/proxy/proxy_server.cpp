@@ -1,203 +1,62 @@
 #include "proxy_server.h"
-#include "sse_writer.h"
 #include "core/log_manager.h"
-#include "config/model_list_request_builder.h"
-#include "config/provider_routing.h"
+#include "core/metrics.h"
 
 #include <QSslConfiguration>
 #include <QSslKey>
 #include <QSslCertificate>
 #include <QFile>
-#include <QJsonDocument>
-#include <QJsonObject>
-#include <QJsonArray>
-#include <QDateTime>
+#include <QLocalServer>
 #include <QTcpServer>
-#include <QUrl>
-#include "adapters/executor/qt_executor.h"
+#include <QThread>
+#include <functional>
 
 namespace {
 
-QString normalizeModelId(const QJsonObject& modelObj)
-{
-    QString modelId = modelObj.value(QStringLiteral("id")).toString();
-    if (modelId.isEmpty()) {
-        modelId = modelObj.value(QStringLiteral("name")).toString();
-    }
-    if (modelId.startsWith(QStringLiteral("models/"))) {
-        modelId = modelId.mid(7);
+// Accepted descriptors are not wrapped in a socket here: the socket has to
+// be created on the worker thread that is going to own it.
+class DescriptorServer : public QTcpServer {
+public:
+    explicit DescriptorServer(std::function<void(qintptr)> onIncoming, QObject* parent)
+        : QTcpServer(parent)
+        , m_onIncoming(std::move(onIncoming))
+    {
     }
-    return modelId;
-}
 
-QByteArray normalizeModelListBody(const QByteArray& rawBody,
-                                  bool preferAnthropicSchema)
-{
-    QJsonParseError parseError;
-    const QJsonDocument doc = QJsonDocument::fromJson(rawBody, &parseError);
-    if (parseError.error != QJsonParseError::NoError || !doc.isObject()) {
-        return rawBody;
+protected:
+    void incomingConnection(qintptr socketDescriptor) override
+    {
+        m_onIncoming(socketDescriptor);
     }
 
-    const QJsonObject root = doc.object();
-    QJsonArray normalizedData;
-    QStringList seenIds;
-
-    auto appendModelsFromArray = [&](const QJsonArray& source) {
-        for (const QJsonValue& item : source) {
-            if (item.isString()) {
-                const QString id = item.toString().trimmed();
-                if (id.isEmpty() || seenIds.contains(id)) {
-                    continue;
-                }
-                seenIds.append(id);
-
-                QJsonObject model;
-                model[QStringLiteral("id")] = id;
-                model[QStringLiteral("object")] = QStringLiteral("model");
-                normalizedData.append(model);
-                continue;
-            }
-
-            if (!item.isObject()) {
-                continue;
-            }
-
-            QJsonObject model = item.toObject();
-            const QString id = normalizeModelId(model);
-            if (id.isEmpty() || seenIds.contains(id)) {
-                continue;
-            }
-
-            seenIds.append(id);
-            model[QStringLiteral("id")] = id;
-            if (!model.contains(QStringLiteral("object"))) {
-                model[QStringLiteral("object")] = QStringLiteral("model");
-            }
-            normalizedData.append(model);
-        }
-    };
-
-    appendModelsFromArray(root.value(QStringLiteral("data")).toArray());
+private:
+    std::function<void(qintptr)> m_onIncoming;
+};
 
-    if (normalizedData.isEmpty()) {
-        appendModelsFromArray(root.value(QStringLiteral("models")).toArray());
+// The same for Unix domain sockets. On Windows QLocalServer uses named pipes,
+// which have no descriptor to hand over, so the listener is Unix-only.
+class LocalDescriptorServer : public QLocalServer {
+public:
+    explicit LocalDescriptorServer(std::function<void(qintptr)> onIncoming, QObject* parent)
+        : QLocalServer(parent)
+        , m_onIncoming(std::move(onIncoming))
+    {
     }
 
-    if (normalizedData.isEmpty() && root.contains(QStringLiteral("result"))) {
-        const QJsonObject resultObj = root.value(QStringLiteral("result")).toObject();
-        appendModelsFromArray(resultObj.value(QStringLiteral("models")).toArray());
+protected:
+    void incomingConnection(quintptr socketDescriptor) override
+    {
+        m_onIncoming(qintptr(socketDescriptor));
     }
 
-    if (normalizedData.isEmpty()) {
-        return rawBody;
-    }
-
-    if (preferAnthropicSchema) {
-        QJsonArray anthropicData;
-
-        auto supportsAnthropic = [](const QJsonObject& model) {
-            const QJsonValue value = model.value(QStringLiteral("supported_endpoint_types"));
-            if (!value.isArray()) {
-                return true;
-            }
-            const QJsonArray types = value.toArray();
-            if (types.isEmpty()) {
-                return true;
-            }
-            for (const QJsonValue& item : types) {
-                if (item.toString().compare(QStringLiteral("anthropic"), Qt::CaseInsensitive) == 0) {
-                    return true;
-                }
-            }
-            return false;
-        };
-
-        auto appendAnthropicModel = [&](const QJsonObject& model) {
-            QJsonObject out;
-            const QString id = normalizeModelId(model);
-            if (id.isEmpty()) {
-                return;
-            }
-
-            out[QStringLiteral("type")] = QStringLiteral("model");
-            out[QStringLiteral("id")] = id;
-
-            QString displayName = model.value(QStringLiteral("display_name")).toString();
-            if (displayName.isEmpty()) {
-                displayName = id;
-            }
-            out[QStringLiteral("display_name")] = displayName;
-
-            QString createdAt = model.value(QStringLiteral("created_at")).toString();
-            if (createdAt.isEmpty()) {
-                const qint64 createdEpoch = model.value(QStringLiteral("created")).toVariant().toLongLong();
-                if (createdEpoch > 0) {
-                    createdAt = QDateTime::fromSecsSinceEpoch(createdEpoch, Qt::UTC)
-                                    .toString(Qt::ISODate);
-                }
-            }
-            if (!createdAt.isEmpty()) {
-                out[QStringLiteral("created_at")] = createdAt;
-            }
-
-            anthropicData.append(out);
-        };
-
-        for (const QJsonValue& item : normalizedData) {
-            const QJsonObject model = item.toObject();
-            if (!supportsAnthropic(model)) {
-                continue;
-            }
-            appendAnthropicModel(model);
-        }
-
-        if (anthropicData.isEmpty()) {
-            for (const QJsonValue& item : normalizedData) {
-                appendAnthropicModel(item.toObject());
-            }
-        }
-
-        QJsonObject normalizedRoot;
-        normalizedRoot[QStringLiteral("data")] = anthropicData;
-        normalizedRoot[QStringLiteral("has_more")] = false;
-        if (!anthropicData.isEmpty()) {
-            const QString firstId = anthropicData.first().toObject().value(QStringLiteral("id")).toString();
-            const QString lastId = anthropicData.last().toObject().value(QStringLiteral("id")).toString();
-            if (!firstId.isEmpty()) {
-                normalizedRoot[QStringLiteral("first_id")] = firstId;
-            }
-            if (!lastId.isEmpty()) {
-                normalizedRoot[QStringLiteral("last_id")] = lastId;
-            }
-        }
-        return QJsonDocument(normalizedRoot).toJson(QJsonDocument::Compact);
-    }
+private:
+    std::function<void(qintptr)> m_onIncoming;
+};
 
-    QJsonObject normalizedRoot;
-    normalizedRoot[QStringLiteral("object")] = QStringLiteral("list");
-    normalizedRoot[QStringLiteral("data")] = normalizedData;
-    return QJsonDocument(normalizedRoot).toJson(QJsonDocument::Compact);
-}
+constexpr int kMaxAutoWorkerThreads = 8;
 
 }
 
-// ---------------------------------------------------------------------------
-// Forward-declared types from the pipeline module.
-// Pipeline exposes:
-//   Result<QByteArray>               process(const QByteArray& body,
-//                                            const QMap<QString,QString>& meta);
-//   Result<PipelineStreamSession*>   processStream(const QByteArray& body,
-//                                                  const QMap<QString,QString>& meta);
-//
-// PipelineStreamSession (QObject) exposes:
-//   signals:  encodedFrameReady(const QByteArray&)
-//             finished()
-//             error(const DomainFailure&)
-//   slots:    abort()
-// ---------------------------------------------------------------------------
-#include "pipeline/pipeline.h"
-
 // ========================================================================
 // Construction / destruction
 // ========================================================================
@@ -205,7 +64,6 @@ QByteArray normalizeModelListBody(const QByteArray& rawBody,
 ProxyServer::ProxyServer(QObject* parent)
     : QObject(parent)
 {
-    m_router.registerDefaults();
 }
 
 ProxyServer::~ProxyServer()
@@ -214,16 +72,16 @@ ProxyServer::~ProxyServer()
 }
 
 // ========================================================================
-// setPipeline
+// setPipelineFactory
 // ========================================================================
 
-void ProxyServer::setPipeline(Pipeline* pipeline)
+void ProxyServer::setPipelineFactory(PipelineFactory factory)
 {
-    m_pipeline = pipeline;
+    m_pipelineFactory = std::move(factory);
 }
 
 // ========================================================================
-// isPortInUse
+// isPortInUse / resolveWorkerThreads / listeningPort
 // ========================================================================
 
 bool ProxyServer::isPortInUse(int port)
@@ -234,6 +92,29 @@ bool ProxyServer::isPortInUse(int port)
     return !available;
 }
 
+int ProxyServer::resolveWorkerThreads(int configured)
+{
+    if (configured > 0) {
+        return configured;
+    }
+    return qBound(1, QThread::idealThreadCount(), kMaxAutoWorkerThreads);
+}
+
+quint16 ProxyServer::listeningPort() const
+{
+    return m_server ? m_server->serverPort() : 0;
+}
+
+quint16 ProxyServer::plainListeningPort() const
+{
+    return m_plainServer ? m_plainServer->serverPort() : 0;
+}
+
+QString ProxyServer::unixSocketPath() const
+{
+    return m_unixServer ? m_unixServer->fullServerName() : QString();
+}
+
 // ========================================================================
 // start
 // ========================================================================
@@ -244,16 +125,6 @@ bool ProxyServer::start(const ProxyConfig& config)
         stop();
     }
 
-    m_config = config;
-    m_connectionPool.clear();
-    const bool useConnectionPool = config.runtime.enableConnectionPool;
-    m_connectionPool.setEnabled(useConnectionPool);
-    if (useConnectionPool) {
-        m_connectionPool.resize(qMax(1, config.runtime.connectionPoolSize));
-    } else {
-        m_connectionPool.resize(1);
-    }
-
     // ---- Load SSL certificate ----
     QFile certFile(config.certPath);
     if (!certFile.open(QIODevice::ReadOnly)) {
@@ -286,6 +157,14 @@ bool ProxyServer::start(const ProxyConfig& config)
     sslConfig.setLocalCertificate(cert);
     sslConfig.setPrivateKey(key);
     sslConfig.setPeerVerifyMode(QSslSocket::VerifyNone);
+    // Clients that offer h2 multiplex their requests over one connection
+    // instead of opening (and handshaking) one connection per request
+    if (config.runtime.enableHttp2) {
+        sslConfig.setAllowedNextProtocols({QSslConfiguration::ALPNProtocolHTTP2,
+                                           QSslConfiguration::NextProtocolHttp1_1});
+    } else {
+        sslConfig.setAllowedNextProtocols({QSslConfiguration::NextProtocolHttp1_1});
+    }
 
     // ---- Create and start server ----
     quint16 port = static_cast<quint16>(config.runtime.proxyPort);
@@ -294,11 +173,9 @@ bool ProxyServer::start(const ProxyConfig& config)
         return false;
     }
 
-    m_server = new QSslServer(this);
-    m_server->setSslConfiguration(sslConfig);
-
-    connect(m_server, &QSslServer::pendingConnectionAvailable,
-            this, &ProxyServer::onNewConnection);
+    m_server = new DescriptorServer([this](qintptr descriptor) {
+        dispatchConnection(descriptor, ClientTransport::Tls);
+    }, this);
 
     if (!m_server->listen(QHostAddress::Any, port)) {
         LOG_ERROR(QStringLiteral("ProxyServer: failed to listen on port %1 - %2")
@@ -308,535 +185,240 @@ bool ProxyServer::start(const ProxyConfig& config)
         m_server = nullptr;
         return false;
     }
+    if (!startLocalListeners(config.runtime)) {
+        closeListeners();
+        return false;
+    }
 
-    LOG_INFO(QStringLiteral("ProxyServer: HTTPS proxy started on port %1").arg(port));
+    // ---- Spawn workers ----
+    const int threadCount = resolveWorkerThreads(config.runtime.workerThreads);
+    for (int i = 0; i < threadCount; ++i) {
+        WorkerSlot slot;
+        slot.thread = new QThread(this);
+        slot.thread->setObjectName(QStringLiteral("ProxyWorker-%1").arg(i));
+        slot.worker = new ProxyWorker(config, sslConfig, m_pipelineFactory);
+        slot.worker->moveToThread(slot.thread);
+        connect(slot.thread, &QThread::finished, slot.worker, &QObject::deleteLater);
+        slot.thread->start();
+        QMetaObject::invokeMethod(slot.worker, &ProxyWorker::initialize, Qt::QueuedConnection);
+        m_workers.append(slot);
+    }
+    m_nextWorker = 0;
+    addMetricsCollector();
+
+    LOG_INFO(QStringLiteral("ProxyServer: HTTPS proxy started on port %1 with %2 worker thread(s)")
+                 .arg(m_server->serverPort())
+                 .arg(threadCount));
     emit statusChanged(true);
     return true;
 }
 
 // ========================================================================
-// stop
+// Local listeners
 // ========================================================================
 
-void ProxyServer::stop()
+bool ProxyServer::startLocalListeners(const RuntimeOptions& runtime)
 {
-    if (!m_server) {
-        return;
-    }
-
-    // Abort all active streaming sessions
-    for (auto it = m_activeSessions.begin(); it != m_activeSessions.end(); ++it) {
-        PipelineStreamSession* session = it.value();
-        if (session) {
-            session->abort();
+    // Plain HTTP is only offered to this machine
+    if (runtime.plainHttpPort > 0) {
+        m_plainServer = new DescriptorServer([this](qintptr descriptor) {
+            dispatchConnection(descriptor, ClientTransport::Plain);
+        }, this);
+        if (!m_plainServer->listen(QHostAddress::LocalHost,
+                                   static_cast<quint16>(runtime.plainHttpPort))) {
+            LOG_ERROR(QStringLiteral("ProxyServer: failed to listen on 127.0.0.1:%1 - %2")
+                          .arg(runtime.plainHttpPort)
+                          .arg(m_plainServer->errorString()));
+            return false;
         }
+        LOG_INFO(QStringLiteral("ProxyServer: plain HTTP listener on 127.0.0.1:%1")
+                     .arg(m_plainServer->serverPort()));
+    }
+
+    if (!runtime.unixSocketPath.isEmpty()) {
+#ifdef Q_OS_UNIX
+        m_unixServer = new LocalDescriptorServer([this](qintptr descriptor) {
+            dispatchConnection(descriptor, ClientTransport::Unix);
+        }, this);
+        m_unixServer->setSocketOptions(QLocalServer::UserAccessOption);
+        // A socket file left behind by a crash would make listen() fail
+        QLocalServer::removeServer(runtime.unixSocketPath);
+        if (!m_unixServer->listen(runtime.unixSocketPath)) {
+            LOG_ERROR(QStringLiteral("ProxyServer: failed to listen on %1 - %2")
+                          .arg(runtime.unixSocketPath, m_unixServer->errorString()));
+            return false;
+        }
+        LOG_INFO(QStringLiteral("ProxyServer: Unix socket listener on %1")
+                     .arg(m_unixServer->fullServerName()));
+#else
+        LOG_WARNING(QStringLiteral("ProxyServer: Unix socket listeners are not supported "
+                                   "on this platform, ignoring %1")
+                        .arg(runtime.unixSocketPath));
+#endif
     }
-    m_activeSessions.clear();
-
-    // Disconnect and schedule deletion for every tracked socket
-    for (auto it = m_pendingData.begin(); it != m_pendingData.end(); ++it) {
-        QSslSocket* socket = it.key();
-        socket->disconnectFromHost();
-    }
-    m_pendingData.clear();
-
-    m_server->close();
-    delete m_server;
-    m_server = nullptr;
-
-    m_connectionPool.clear();
-
-    LOG_INFO(QStringLiteral("ProxyServer: proxy server stopped"));
-    emit statusChanged(false);
-}
-
-// ========================================================================
-// isRunning
-// ========================================================================
-
-bool ProxyServer::isRunning() const
-{
-    return m_server && m_server->isListening();
+    return true;
 }
 
-// ========================================================================
-// onNewConnection
-// ========================================================================
-
-void ProxyServer::onNewConnection()
+void ProxyServer::closeListeners()
 {
-    while (m_server->hasPendingConnections()) {
-        QSslSocket* socket =
-            qobject_cast<QSslSocket*>(m_server->nextPendingConnection());
-        if (!socket) {
-            continue;
-        }
-
-        connect(socket, &QSslSocket::readyRead,
-                this, &ProxyServer::onSocketReadyRead);
-        connect(socket, &QSslSocket::disconnected,
-                this, &ProxyServer::onSocketDisconnected);
-        connect(socket, &QSslSocket::sslErrors,
-                this, [socket](const QList<QSslError>&) {
-                    socket->ignoreSslErrors();
-                });
-
-        LOG_DEBUG(QStringLiteral("ProxyServer: new TLS connection from %1:%2")
-                      .arg(socket->peerAddress().toString())
-                      .arg(socket->peerPort()));
-    }
+    // Deleting a listening server closes it; QLocalServer also removes its
+    // socket file
+    delete m_server;
+    m_server = nullptr;
+    delete m_plainServer;
+    m_plainServer = nullptr;
+    delete m_unixServer;
+    m_unixServer = nullptr;
 }
 
 // ========================================================================
-// onSocketReadyRead
+// stop
 // ========================================================================
 
-void ProxyServer::onSocketReadyRead()
+void ProxyServer::stop()
 {
-    auto* socket = qobject_cast<QSslSocket*>(sender());
-    if (!socket) {
+    if (!m_server) {
         return;
     }
 
-    m_pendingData[socket] += socket->readAll();
-    QByteArray& buffer = m_pendingData[socket];
-
-    while (true) {
-        const int headerEnd = buffer.indexOf("\r\n\r\n");
-        if (headerEnd < 0) {
-            return;
-        }
-
-        int contentLength = 0;
-        bool hasChunkedTransfer = false;
-        const QString headerBlock = QString::fromUtf8(buffer.left(headerEnd));
-        const QStringList headerLines = headerBlock.split(QStringLiteral("\r\n"));
-        for (const QString& line : headerLines) {
-            if (line.startsWith(QStringLiteral("Content-Length:"), Qt::CaseInsensitive)) {
-                contentLength = line.mid(15).trimmed().toInt();
-            }
-            if (line.startsWith(QStringLiteral("Transfer-Encoding:"), Qt::CaseInsensitive)
-                && line.contains(QStringLiteral("chunked"), Qt::CaseInsensitive)) {
-                hasChunkedTransfer = true;
-            }
-        }
-
-        if (hasChunkedTransfer) {
-            QJsonObject errObj;
-            errObj[QStringLiteral("error")] = QStringLiteral("chunked request bodies are not supported");
-            sendHttpResponse(socket, 501,
-                             QJsonDocument(errObj).toJson(QJsonDocument::Compact));
-            buffer.clear();
-            return;
-        }
-
-        const int bodyStart = headerEnd + 4;
-        const int totalRequired = bodyStart + contentLength;
-        if (buffer.size() < totalRequired) {
-            return;
-        }
-
-        const QByteArray requestData = buffer.left(totalRequired);
-        buffer.remove(0, totalRequired);
-
-        const HttpRequest req = parseHttpRequest(requestData);
-        handleRequest(socket, req);
+    closeListeners();
 
-        if (socket->state() != QAbstractSocket::ConnectedState) {
-            return;
-        }
+    // Scrapes on worker threads may be reading worker stats; this waits for them
+    metrics::registry().removeCollector(m_metricsCollector);
+    m_metricsCollector = 0;
 
-        if (buffer.isEmpty()) {
-            return;
-        }
-    }
-}
-
-// ========================================================================
-// onSocketDisconnected
-// ========================================================================
-
-void ProxyServer::onSocketDisconnected()
-{
-    auto* socket = qobject_cast<QSslSocket*>(sender());
-    if (!socket) {
-        return;
+    // Each worker tears down its own sockets and network managers on its
+    // thread; the worker object itself is deleted once the thread finishes.
+    const auto workers = m_workers;
+    m_workers.clear();
+    for (const WorkerSlot& slot : workers) {
+        QMetaObject::invokeMethod(slot.worker, &ProxyWorker::shutdown,
+                                  Qt::BlockingQueuedConnection);
+        slot.thread->quit();
     }
-
-    m_pendingData.remove(socket);
-
-    PipelineStreamSession* session = m_activeSessions.take(socket);
-    if (session) {
-        session->abort();
+    for (const WorkerSlot& slot : workers) {
+        slot.thread->wait();
+        delete slot.thread;
     }
 
-    LOG_DEBUG(QStringLiteral("ProxyServer: client disconnected"));
+    LOG_INFO(QStringLiteral("ProxyServer: proxy server stopped"));
+    emit statusChanged(false);
 }
 
 // ========================================================================
-// parseHttpRequest
+// isRunning
 // ========================================================================
 
-ProxyServer::HttpRequest ProxyServer::parseHttpRequest(const QByteArray& data)
+bool ProxyServer::isRunning() const
 {
-    HttpRequest req;
-
-    int headerEnd = data.indexOf("\r\n\r\n");
-    if (headerEnd < 0) {
-        return req;
-    }
-
-    QString headerBlock = QString::fromUtf8(data.left(headerEnd));
-    QStringList lines = headerBlock.split(QStringLiteral("\r\n"));
-
-    // Parse the request line: "METHOD PATH HTTP/1.1"
-    if (!lines.isEmpty()) {
-        QStringList parts = lines[0].split(QLatin1Char(' '));
-        if (parts.size() >= 3) {
-            req.method      = parts[0].trimmed().toUpper();
-            req.path        = parts[1];
-            req.httpVersion = parts[2];
-        }
-    }
-
-    // Parse headers
-    for (int i = 1; i < lines.size(); ++i) {
-        int colon = lines[i].indexOf(QLatin1Char(':'));
-        if (colon > 0) {
-            QString key   = lines[i].left(colon).trimmed().toLower();
-            QString value = lines[i].mid(colon + 1).trimmed();
-            req.headers[key] = value;
-        }
-    }
-
-    // Extract body
-    req.body = data.mid(headerEnd + 4);
-    req.contentLength = req.body.size();
-    req.complete = true;
-
-    return req;
+    return m_server && m_server->isListening();
 }
 
 // ========================================================================
-// handleRequest
+// Stats
 // ========================================================================
 
-void ProxyServer::handleRequest(QSslSocket* socket, const HttpRequest& request)
+StreamThrottleStats ProxyServer::throttleStats() const
 {
-    LOG_INFO(QStringLiteral("ProxyServer: %1 %2").arg(request.method, request.path));
-
-    if (request.method == QStringLiteral("GET")
-        && request.path == QStringLiteral("/v1/models")) {
-        if (handleModelsRequest(socket, request)) {
-            return;
-        }
-    }
-
-    // ---- Route lookup ----
-    auto routeOpt = m_router.match(request.method, request.path);
-    if (!routeOpt) {
-        QJsonObject errObj;
-        errObj[QStringLiteral("error")] = QStringLiteral("route not found");
-        errObj[QStringLiteral("path")]  = request.path;
-        sendHttpResponse(socket, 404,
-                         QJsonDocument(errObj).toJson(QJsonDocument::Compact));
-        return;
-    }
-
-    if (!m_pipeline) {
-        QJsonObject errObj;
-        errObj[QStringLiteral("error")] = QStringLiteral("pipeline not configured");
-        sendHttpResponse(socket, 503,
-                         QJsonDocument(errObj).toJson(QJsonDocument::Compact));
-        return;
-    }
-
-    const Route& route = *routeOpt;
-    QMap<QString, QString> metadata = buildMetadata(request, route);
-
-    // ---- Detect streaming request ----
-    QJsonParseError parseErr;
-    QJsonDocument bodyDoc = QJsonDocument::fromJson(request.body, &parseErr);
-    bool isStream = false;
-    if (parseErr.error == QJsonParseError::NoError && bodyDoc.isObject()) {
-        isStream = bodyDoc.object().value(QStringLiteral("stream")).toBool(false);
-    }
-
-    if (!isStream && request.path.contains(QStringLiteral("/models/"), Qt::CaseInsensitive)) {
-        isStream = true;
-    }
-
-    // ---- Dispatch to pipeline ----
-    if (isStream) {
-        auto result = m_pipeline->processStream(request.body, metadata);
-        if (!result) {
-            DomainFailure failure = result.error();
-            sendHttpResponse(socket, failure.httpStatus(),
-                             QJsonDocument(failure.toJson()).toJson(QJsonDocument::Compact));
-            return;
-        }
-        sendStreamResponse(socket, *result);
-    } else {
-        auto result = m_pipeline->process(request.body, metadata);
-        if (!result) {
-            DomainFailure failure = result.error();
-            sendHttpResponse(socket, failure.httpStatus(),
-                             QJsonDocument(failure.toJson()).toJson(QJsonDocument::Compact));
-            return;
-        }
-        sendHttpResponse(socket, 200, *result);
+    StreamThrottleStats total;
+    for (const WorkerSlot& slot : m_workers) {
+        const StreamThrottleStats stats = slot.worker->throttleStats();
+        total.throttleCount += stats.throttleCount;
+        total.throttledMs += stats.throttledMs;
     }
+    return total;
 }
 
-bool ProxyServer::handleModelsRequest(QSslSocket* socket, const HttpRequest& request)
+TlsHandshakeStats ProxyServer::handshakeStats() const
 {
-    const ConfigGroup& group = m_config.currentGroup();
-    if (group.baseUrl.isEmpty()) {
-        return false;
-    }
-
-    const bool preferDownstreamAnthropic =
-        request.headers.contains(QStringLiteral("anthropic-version"))
-        || request.headers.contains(QStringLiteral("x-api-key"));
-    model_list_request_builder::DownstreamHeaders incomingHeaders;
-    incomingHeaders.authorization = request.headers.value(QStringLiteral("authorization")).trimmed();
-    incomingHeaders.xApiKey = request.headers.value(QStringLiteral("x-api-key")).trimmed();
-    incomingHeaders.xGoogApiKey = request.headers.value(QStringLiteral("x-goog-api-key")).trimmed();
-    incomingHeaders.anthropicVersion = request.headers.value(QStringLiteral("anthropic-version")).trimmed();
-    incomingHeaders.anthropicBeta = request.headers.value(QStringLiteral("anthropic-beta")).trimmed();
-
-    const model_list_request_builder::Context requestContext =
-        model_list_request_builder::buildContext(group, incomingHeaders, m_config.global.authKey);
-    if (!requestContext.isValid()) {
-        sendHttpResponse(socket, 400,
-                         QJsonDocument(DomainFailure::invalidInput(
-                                           QStringLiteral("invalid_model_list_url"),
-                                           QStringLiteral("model list URL is invalid"))
-                                           .toJson())
-                             .toJson(QJsonDocument::Compact));
-        return true;
-    }
-
-    using provider_routing::ModelListProvider;
-    const ModelListProvider provider = requestContext.provider;
-    const QStringList authModes = requestContext.authModes;
-
-    QSslConfiguration sslConfig = QSslConfiguration::defaultConfiguration();
-    sslConfig.setPeerVerifyMode(m_config.runtime.disableSslStrict
-                                    ? QSslSocket::VerifyNone
-                                    : QSslSocket::AutoVerifyPeer);
-    sslConfig.setProtocol(m_config.runtime.enableHttp2
-                              ? QSsl::TlsV1_2OrLater
-                              : QSsl::TlsV1_2);
-    QtExecutor executor(m_connectionPool, sslConfig);
-    executor.setRequestTimeout(m_config.runtime.requestTimeout);
-    executor.setConnectionTimeout(m_config.runtime.connectionTimeout);
-
-    Result<ProviderResponse> result = std::unexpected(DomainFailure::internal(
-        QStringLiteral("models request was not attempted")));
-
-    for (int i = 0; i < authModes.size(); ++i) {
-        const QString authMode = authModes.at(i);
-        ProviderRequest attemptReq = model_list_request_builder::makeProviderRequest(
-            requestContext, authMode);
-        LOG_DEBUG(QStringLiteral("ProxyServer: /v1/models trying auth=%1 key_source=%2 url=%3")
-                      .arg(authMode, requestContext.keySource, attemptReq.url));
-
-        result = executor.execute(attemptReq);
-        if (result.has_value()) {
-            break;
-        }
-
-        const DomainFailure failure = result.error();
-        const int failureStatus = failure.httpStatus();
-        LOG_WARNING(QStringLiteral("ProxyServer: /v1/models auth=%1 failed status=%2 msg=%3")
-                        .arg(authMode)
-                        .arg(failureStatus)
-                        .arg(failure.message));
-
-        const bool isAuthFailure = (failureStatus == 401 || failureStatus == 403);
-        const bool canRetry = (i + 1) < authModes.size();
-        if (!(isAuthFailure && canRetry)) {
-            sendHttpResponse(socket,
-                             failure.httpStatus(),
-                             QJsonDocument(failure.toJson()).toJson(QJsonDocument::Compact));
-            return true;
-        }
-    }
-
-    if (!result.has_value()) {
-        const DomainFailure failure = result.error();
-        sendHttpResponse(socket,
-                         failure.httpStatus(),
-                         QJsonDocument(failure.toJson()).toJson(QJsonDocument::Compact));
-        return true;
-    }
-
-    const ProviderResponse response = result.value();
-    int status = response.statusCode;
-    if (status <= 0) {
-        status = 502;
-    }
-
-    LOG_DEBUG(QStringLiteral("ProxyServer: /v1/models upstream status=%1 bytes=%2")
-                  .arg(status)
-                  .arg(response.body.size()));
-    if (status < 200 || status >= 300) {
-        const QString bodyPreview = QString::fromUtf8(response.body.left(512));
-        LOG_WARNING(QStringLiteral("ProxyServer: /v1/models upstream error body: %1")
-                        .arg(bodyPreview));
-    }
-
-    QByteArray responseBody = response.body;
-    if (status >= 200 && status < 300) {
-        const bool preferAnthropicSchema =
-            (provider == ModelListProvider::Anthropic) || preferDownstreamAnthropic;
-        responseBody = normalizeModelListBody(response.body, preferAnthropicSchema);
-    }
-
-    sendHttpResponse(socket, status, responseBody,
-                     QStringLiteral("application/json; charset=utf-8"));
-    return true;
+    TlsHandshakeStats total;
+    for (const WorkerSlot& slot : m_workers) {
+        const TlsHandshakeStats stats = slot.worker->handshakeStats();
+        total.fullHandshakes += stats.fullHandshakes;
+        total.resumedHandshakes += stats.resumedHandshakes;
+        total.fullHandshakeUs += stats.fullHandshakeUs;
+        total.resumedHandshakeUs += stats.resumedHandshakeUs;
+    }
+    return total;
 }
 
-// ========================================================================
-// sendHttpResponse
-// ========================================================================
-
-void ProxyServer::sendHttpResponse(QSslSocket* socket, int status,
-                                   const QByteArray& body,
-                                   const QString& contentType)
+// Worker stats for /metrics. Scrapes run on worker threads, so the collector
+// keeps its own copy of the worker list instead of reading m_workers; every
+// value it reads is atomic. Counters restart with each run, which scrapers
+// treat as a counter reset.
+void ProxyServer::addMetricsCollector()
 {
-    if (!socket || socket->state() != QAbstractSocket::ConnectedState) {
-        return;
-    }
-
-    static const QMap<int, QString> statusTexts = {
-        {200, QStringLiteral("OK")},
-        {400, QStringLiteral("Bad Request")},
-        {401, QStringLiteral("Unauthorized")},
-        {403, QStringLiteral("Forbidden")},
-        {404, QStringLiteral("Not Found")},
-        {429, QStringLiteral("Too Many Requests")},
-        {500, QStringLiteral("Internal Server Error")},
-        {501, QStringLiteral("Not Implemented")},
-        {503, QStringLiteral("Service Unavailable")},
-        {504, QStringLiteral("Gateway Timeout")}
-    };
-
-    QString statusText = statusTexts.value(status, QStringLiteral("Unknown"));
-
-    QByteArray response;
-    response.append(QStringLiteral("HTTP/1.1 %1 %2\r\n")
-                        .arg(status)
-                        .arg(statusText)
-                        .toUtf8());
-    response.append(QStringLiteral("Content-Type: %1\r\n")
-                        .arg(contentType)
-                        .toUtf8());
-    response.append(QStringLiteral("Content-Length: %1\r\n")
-                        .arg(body.size())
-                        .toUtf8());
-    response.append("Access-Control-Allow-Origin: *\r\n");
-    response.append("Connection: keep-alive\r\n");
-    response.append("\r\n");
-    response.append(body);
-
-    socket->write(response);
-    socket->flush();
-}
-
-// ========================================================================
-// sendStreamResponse
-// ========================================================================
+    QList<const ProxyWorker*> workers;
+    for (const WorkerSlot& slot : std::as_const(m_workers)) {
+        workers.append(slot.worker);
+    }
+    m_metricsCollector = metrics::registry().addCollector([workers](QByteArray& out) {
+        StreamThrottleStats throttle;
+        TlsHandshakeStats handshakes;
+        quint64 connections = 0;
+        for (const ProxyWorker* worker : workers) {
+            const StreamThrottleStats t = worker->throttleStats();
+            throttle.throttleCount += t.throttleCount;
+            throttle.throttledMs += t.throttledMs;
+            const TlsHandshakeStats h = worker->handshakeStats();
+            handshakes.fullHandshakes += h.fullHandshakes;
+            handshakes.resumedHandshakes += h.resumedHandshakes;
+            handshakes.fullHandshakeUs += h.fullHandshakeUs;
+            handshakes.resumedHandshakeUs += h.resumedHandshakeUs;
+            connections += quint64(worker->connectionCount());
+        }
 
-void ProxyServer::sendStreamResponse(QSslSocket* socket,
-                                     PipelineStreamSession* session)
-{
-    m_activeSessions[socket] = session;
-
-    // Write the HTTP response header with chunked transfer encoding
-    SseWriter::writeStreamHeader(socket);
-
-    // Forward each encoded frame from the pipeline as an SSE chunk
-    connect(session, &PipelineStreamSession::encodedFrameReady,
-            this, [socket](const QByteArray& data) {
-                SseWriter::sendChunk(socket, data);
-            });
-
-    // On normal completion, send the SSE [DONE] sentinel and terminate
-    connect(session, &PipelineStreamSession::finished,
-            this, [this, socket, session]() {
-                SseWriter::sendDone(socket);
-                SseWriter::sendTerminator(socket);
-                if (m_activeSessions.value(socket) == session) {
-                    m_activeSessions.remove(socket);
-                }
-            });
-
-    // On error, send the failure as a final SSE event, then terminate
-    connect(session, &PipelineStreamSession::error,
-            this, [this, socket, session](const DomainFailure& failure) {
-                QByteArray errJson =
-                    QJsonDocument(failure.toJson()).toJson(QJsonDocument::Compact);
-                SseWriter::sendChunk(socket, errJson);
-                SseWriter::sendDone(socket);
-                SseWriter::sendTerminator(socket);
-                if (m_activeSessions.value(socket) == session) {
-                    m_activeSessions.remove(socket);
-                }
-            });
-
-    // If the client disconnects mid-stream, abort the pipeline session
-    connect(socket, &QSslSocket::disconnected,
-            session, &PipelineStreamSession::abort);
+        metrics::appendSample(out, "shanghaoqi_client_connections", "gauge",
+                              "Open client connections", double(connections));
+        metrics::appendSample(out, "shanghaoqi_stream_throttles_total", "counter",
+                              "Streams paused for a slow client", double(throttle.throttleCount));
+        metrics::appendSample(out, "shanghaoqi_stream_throttled_seconds_total", "counter",
+                              "Time streams spent paused for a slow client",
+                              double(throttle.throttledMs) / 1e3);
+        metrics::appendSample(out, "shanghaoqi_tls_full_handshakes_total", "counter",
+                              "Downstream TLS handshakes without resumption",
+                              double(handshakes.fullHandshakes));
+        metrics::appendSample(out, "shanghaoqi_tls_resumed_handshakes_total", "counter",
+                              "Downstream TLS handshakes that resumed a session",
+                              double(handshakes.resumedHandshakes));
+        metrics::appendSample(out, "shanghaoqi_tls_full_handshake_seconds_total", "counter",
+                              "Time spent in full downstream TLS handshakes",
+                              double(handshakes.fullHandshakeUs) / 1e6);
+        metrics::appendSample(out, "shanghaoqi_tls_resumed_handshake_seconds_total", "counter",
+                              "Time spent in resumed downstream TLS handshakes",
+                              double(handshakes.resumedHandshakeUs) / 1e6);
+    });
 }
 
 // ========================================================================
-// buildMetadata
+// dispatchConnection
 // ========================================================================
 
-QMap<QString, QString> ProxyServer::buildMetadata(
-    const HttpRequest& request,
-    const Route& route) const
+void ProxyServer::dispatchConnection(qintptr socketDescriptor, ClientTransport transport)
 {
-    const ConfigGroup& group = m_config.currentGroup();
-
-    QMap<QString, QString> meta;
-    meta[QStringLiteral("inbound.format")]    = route.inboundProtocol;
-    meta[QStringLiteral("provider")]          = route.provider.isEmpty()
-                                                    ? group.provider
-                                                    : route.provider;
-    meta[QStringLiteral("provider_base_url")] = group.baseUrl;
-    meta[QStringLiteral("provider_api_key")]  = group.apiKey;
-    meta[QStringLiteral("api_key")]           = group.apiKey;
-    meta[QStringLiteral("model_id")]          = group.modelId;
-    meta[QStringLiteral("middle_route")]      = group.middleRoute;
-    meta[QStringLiteral("mapped_model_id")]   = m_config.global.mappedModelId;
-    if (!group.baseUrlCandidates.isEmpty()) {
-        meta[QStringLiteral("provider_base_url_candidates")] =
-            group.baseUrlCandidates.join(QLatin1Char(','));
-    }
-    if (!group.outboundAdapter.isEmpty()) {
-        meta[QStringLiteral("provider_adapter")] = group.outboundAdapter;
-    }
-
-    // Propagate the client's auth token so the pipeline can validate it
-    // against the configured global auth key
-    QString authHeader = request.headers.value(QStringLiteral("authorization"));
-    if (authHeader.isEmpty()) {
-        authHeader = request.headers.value(QStringLiteral("x-api-key"));
+    if (m_workers.isEmpty()) {
+        return;
     }
-    meta[QStringLiteral("auth_key")] = authHeader;
 
-    // Carry the original request path so adapters can reconstruct URLs
-    meta[QStringLiteral("request_path")] = request.path;
-
-    // Copy custom headers from the config group
-    for (auto it = group.customHeaders.cbegin();
-         it != group.customHeaders.cend(); ++it) {
-        meta[QStringLiteral("custom_header.%1").arg(it.key())] = it.value();
+    // Least-connections, so long-lived streams do not pile up on one thread.
+    // The load counts connections still queued for a worker, and the scan
+    // starts one past the last choice, so ties rotate through the workers.
+    const int count = m_workers.size();
+    int chosen = m_nextWorker % count;
+    int fewest = m_workers[chosen].worker->dispatchLoad();
+    for (int i = 1; i < count && fewest > 0; ++i) {
+        const int index = (m_nextWorker + i) % count;
+        const int load = m_workers[index].worker->dispatchLoad();
+        if (load < fewest) {
+            chosen = index;
+            fewest = load;
+        }
     }
+    m_nextWorker = (chosen + 1) % count;
 
-    return meta;
+    ProxyWorker* worker = m_workers[chosen].worker;
+    worker->connectionDispatched();
+    QMetaObject::invokeMethod(worker, [worker, socketDescriptor, transport]() {
+        worker->addConnection(socketDescriptor, transport);
+    }, Qt::QueuedConnection);
 }
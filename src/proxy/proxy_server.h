@@ -1,15 +1,19 @@
 #pragma once
-#include "connection_pool.h"
-#include "request_router.h"
+#include "proxy_worker.h"
 #include "config/config_types.h"
 #include <QObject>
-#include <QSslServer>
-#include <QSslSocket>
-#include <QMap>
-
-class Pipeline;
-class PipelineStreamSession;
-
+#include <QList>
+
+class QLocalServer;
+class QTcpServer;
+class QThread;
+
+// Accepts TLS clients and hands each socket descriptor to one of N worker
+// threads. Workers run their own event loop and serve their connections end
+// to end, so the accepting (GUI) thread only pays for accept().
+//
+// Optional local listeners without TLS (plain HTTP on 127.0.0.1, and a Unix
+// domain socket) feed the same workers, for clients that take a base URL.
 class ProxyServer : public QObject {
     Q_OBJECT
 public:
@@ -19,42 +23,37 @@ public:
     bool start(const ProxyConfig& config);
     void stop();
     bool isRunning() const;
-    void setPipeline(Pipeline* pipeline);
-    ConnectionPool& connectionPool() { return m_connectionPool; }
+    // Called once per worker (on that worker's thread) each time the server starts.
+    void setPipelineFactory(PipelineFactory factory);
+    int workerCount() const { return m_workers.size(); }
+    // Summed over the workers of the current run
+    StreamThrottleStats throttleStats() const;
+    TlsHandshakeStats handshakeStats() const;
+    quint16 listeningPort() const;
+    quint16 plainListeningPort() const;
+    QString unixSocketPath() const;
     static bool isPortInUse(int port);
+    static int resolveWorkerThreads(int configured);
 
 signals:
     void statusChanged(bool running);
 
-private slots:
-    void onNewConnection();
-    void onSocketReadyRead();
-    void onSocketDisconnected();
-
 private:
-    struct HttpRequest {
-        QString method, path, httpVersion;
-        QMap<QString, QString> headers;
-        QByteArray body;
-        bool complete = false;
-        int contentLength = 0;
+    struct WorkerSlot {
+        QThread* thread = nullptr;
+        ProxyWorker* worker = nullptr;
     };
 
-    HttpRequest parseHttpRequest(const QByteArray& data);
-    void handleRequest(QSslSocket* socket, const HttpRequest& request);
-    bool handleModelsRequest(QSslSocket* socket, const HttpRequest& request);
-    void sendHttpResponse(QSslSocket* socket, int status,
-                          const QByteArray& body,
-                          const QString& contentType = QStringLiteral("application/json"));
-    void sendStreamResponse(QSslSocket* socket, PipelineStreamSession* session);
-    QMap<QString, QString> buildMetadata(const HttpRequest& request,
-                                         const Route& route) const;
-
-    QSslServer* m_server = nullptr;
-    ConnectionPool m_connectionPool;
-    RequestRouter m_router;
-    Pipeline* m_pipeline = nullptr;
-    ProxyConfig m_config;
-    QMap<QSslSocket*, QByteArray> m_pendingData;
-    QMap<QSslSocket*, PipelineStreamSession*> m_activeSessions;
+    bool startLocalListeners(const RuntimeOptions& runtime);
+    void closeListeners();
+    void dispatchConnection(qintptr socketDescriptor, ClientTransport transport);
+    void addMetricsCollector();
+
+    QTcpServer* m_server = nullptr;
+    QTcpServer* m_plainServer = nullptr;
+    QLocalServer* m_unixServer = nullptr;
+    PipelineFactory m_pipelineFactory;
+    QList<WorkerSlot> m_workers;
+    int m_nextWorker = 0;
+    int m_metricsCollector = 0;
 };
@@ -0,0 +1,1251 @@
+#include "proxy_worker.h"
+#include "connection_pool.h"
+#include "dns_resolver.h"
+#include "json_sniffer.h"
+#include "sse_writer.h"
+#include "upstream_relay.h"
+#include "core/log_manager.h"
+#include "core/metrics.h"
+#include "config/model_list_request_builder.h"
+#include "config/provider_routing.h"
+
+#include <QSslConfiguration>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QJsonArray>
+#include <QDateTime>
+#include <QPointer>
+#include <QSet>
+#include <QTimer>
+#include <QUrl>
+#include "adapters/executor/qt_executor.h"
+#include "pipeline/pipeline.h"
+
+namespace {
+
+// Header values are already trimmed by both protocol parsers
+QString headerText(const std::function<QByteArrayView(QByteArrayView)>& header,
+                   QByteArrayView name)
+{
+    return QString::fromUtf8(header(name));
+}
+
+QString normalizeModelId(const QJsonObject& modelObj)
+{
+    QString modelId = modelObj.value(QStringLiteral("id")).toString();
+    if (modelId.isEmpty()) {
+        modelId = modelObj.value(QStringLiteral("name")).toString();
+    }
+    if (modelId.startsWith(QStringLiteral("models/"))) {
+        modelId = modelId.mid(7);
+    }
+    return modelId;
+}
+
+QByteArray normalizeModelListBody(const QByteArray& rawBody,
+                                  bool preferAnthropicSchema)
+{
+    QJsonParseError parseError;
+    const QJsonDocument doc = QJsonDocument::fromJson(rawBody, &parseError);
+    if (parseError.error != QJsonParseError::NoError || !doc.isObject()) {
+        return rawBody;
+    }
+
+    const QJsonObject root = doc.object();
+    QJsonArray normalizedData;
+    QStringList seenIds;
+
+    auto appendModelsFromArray = [&](const QJsonArray& source) {
+        for (const QJsonValue& item : source) {
+            if (item.isString()) {
+                const QString id = item.toString().trimmed();
+                if (id.isEmpty() || seenIds.contains(id)) {
+                    continue;
+                }
+                seenIds.append(id);
+
+                QJsonObject model;
+                model[QStringLiteral("id")] = id;
+                model[QStringLiteral("object")] = QStringLiteral("model");
+                normalizedData.append(model);
+                continue;
+            }
+
+            if (!item.isObject()) {
+                continue;
+            }
+
+            QJsonObject model = item.toObject();
+            const QString id = normalizeModelId(model);
+            if (id.isEmpty() || seenIds.contains(id)) {
+                continue;
+            }
+
+            seenIds.append(id);
+            model[QStringLiteral("id")] = id;
+            if (!model.contains(QStringLiteral("object"))) {
+                model[QStringLiteral("object")] = QStringLiteral("model");
+            }
+            normalizedData.append(model);
+        }
+    };
+
+    appendModelsFromArray(root.value(QStringLiteral("data")).toArray());
+
+    if (normalizedData.isEmpty()) {
+        appendModelsFromArray(root.value(QStringLiteral("models")).toArray());
+    }
+
+    if (normalizedData.isEmpty() && root.contains(QStringLiteral("result"))) {
+        const QJsonObject resultObj = root.value(QStringLiteral("result")).toObject();
+        appendModelsFromArray(resultObj.value(QStringLiteral("models")).toArray());
+    }
+
+    if (normalizedData.isEmpty()) {
+        return rawBody;
+    }
+
+    if (preferAnthropicSchema) {
+        QJsonArray anthropicData;
+
+        auto supportsAnthropic = [](const QJsonObject& model) {
+            const QJsonValue value = model.value(QStringLiteral("supported_endpoint_types"));
+            if (!value.isArray()) {
+                return true;
+            }
+            const QJsonArray types = value.toArray();
+            if (types.isEmpty()) {
+                return true;
+            }
+            for (const QJsonValue& item : types) {
+                if (item.toString().compare(QStringLiteral("anthropic"), Qt::CaseInsensitive) == 0) {
+                    return true;
+                }
+            }
+            return false;
+        };
+
+        auto appendAnthropicModel = [&](const QJsonObject& model) {
+            QJsonObject out;
+            const QString id = normalizeModelId(model);
+            if (id.isEmpty()) {
+                return;
+            }
+
+            out[QStringLiteral("type")] = QStringLiteral("model");
+            out[QStringLiteral("id")] = id;
+
+            QString displayName = model.value(QStringLiteral("display_name")).toString();
+            if (displayName.isEmpty()) {
+                displayName = id;
+            }
+            out[QStringLiteral("display_name")] = displayName;
+
+            QString createdAt = model.value(QStringLiteral("created_at")).toString();
+            if (createdAt.isEmpty()) {
+                const qint64 createdEpoch = model.value(QStringLiteral("created")).toVariant().toLongLong();
+                if (createdEpoch > 0) {
+                    createdAt = QDateTime::fromSecsSinceEpoch(createdEpoch, Qt::UTC)
+                                    .toString(Qt::ISODate);
+                }
+            }
+            if (!createdAt.isEmpty()) {
+                out[QStringLiteral("created_at")] = createdAt;
+            }
+
+            anthropicData.append(out);
+        };
+
+        for (const QJsonValue& item : normalizedData) {
+            const QJsonObject model = item.toObject();
+            if (!supportsAnthropic(model)) {
+                continue;
+            }
+            appendAnthropicModel(model);
+        }
+
+        if (anthropicData.isEmpty()) {
+            for (const QJsonValue& item : normalizedData) {
+                appendAnthropicModel(item.toObject());
+            }
+        }
+
+        QJsonObject normalizedRoot;
+        normalizedRoot[QStringLiteral("data")] = anthropicData;
+        normalizedRoot[QStringLiteral("has_more")] = false;
+        if (!anthropicData.isEmpty()) {
+            const QString firstId = anthropicData.first().toObject().value(QStringLiteral("id")).toString();
+            const QString lastId = anthropicData.last().toObject().value(QStringLiteral("id")).toString();
+            if (!firstId.isEmpty()) {
+                normalizedRoot[QStringLiteral("first_id")] = firstId;
+            }
+            if (!lastId.isEmpty()) {
+                normalizedRoot[QStringLiteral("last_id")] = lastId;
+            }
+        }
+        return QJsonDocument(normalizedRoot).toJson(QJsonDocument::Compact);
+    }
+
+    QJsonObject normalizedRoot;
+    normalizedRoot[QStringLiteral("object")] = QStringLiteral("list");
+    normalizedRoot[QStringLiteral("data")] = normalizedData;
+    return QJsonDocument(normalizedRoot).toJson(QJsonDocument::Compact);
+}
+
+}
+
+// ========================================================================
+// Construction / destruction
+// ========================================================================
+
+ProxyWorker::ProxyWorker(const ProxyConfig& config,
+                         const QSslConfiguration& serverSsl,
+                         PipelineFactory pipelineFactory,
+                         QObject* parent)
+    : QObject(parent)
+    , m_config(config)
+    , m_serverSsl(serverSsl)
+    , m_pipelineFactory(std::move(pipelineFactory))
+    , m_tlsSessions(config.runtime.tlsSessionLifetimeSec)
+    , m_certificateBytes(serverSsl.localCertificate().toDer().size())
+    , m_modelLists(qint64(config.runtime.modelListCacheTtlSec) * 1000)
+{
+    m_router.registerDefaults();
+    for (const RouteConfig& route : config.routes) {
+        if (!route.targetGroup.isEmpty() && !config.findGroup(route.targetGroup)) {
+            LOG_WARNING(QStringLiteral("ProxyWorker: route %1 targets unknown group %2, "
+                                       "requests will use the current group")
+                            .arg(route.pathPattern, route.targetGroup));
+        }
+        m_router.addRoute({route.pathPattern, route.inboundProtocol, QString(),
+                           route.method, route.targetGroup});
+    }
+    m_requestLimits.maxBodyBytes = qint64(qMax(1, config.runtime.maxRequestBodyMb)) * 1024 * 1024;
+    m_http2Limits.maxBodyBytes = m_requestLimits.maxBodyBytes;
+    m_http2Limits.maxHeaderBytes = m_requestLimits.maxHeaderBytes;
+}
+
+ProxyWorker::~ProxyWorker()
+{
+    shutdown();
+}
+
+// ========================================================================
+// initialize
+// ========================================================================
+
+void ProxyWorker::initialize()
+{
+    // Network managers are thread-affine, so the pool and everything that
+    // uses it are created here rather than in the constructor.
+    m_connectionPool = std::make_unique<ConnectionPool>();
+    const bool useConnectionPool = m_config.runtime.enableConnectionPool;
+    m_connectionPool->setEnabled(useConnectionPool);
+    m_connectionPool->resize(useConnectionPool ? qMax(1, m_config.runtime.connectionPoolSize) : 1);
+
+    // The hosts file sends the hijacked domains to this proxy, so an
+    // upstream on one of them needs a resolver that does not read it
+    if (!m_config.runtime.upstreamDnsServers.isEmpty()) {
+        QStringList invalid;
+        QList<DnsResolver::Server> servers =
+            DnsResolver::parseServers(m_config.runtime.upstreamDnsServers, &invalid);
+        for (const QString& entry : std::as_const(invalid))
+            LOG_WARNING(QStringLiteral("ProxyWorker: ignoring upstream DNS server '%1'").arg(entry));
+        if (!servers.isEmpty()) {
+            m_resolver = std::make_unique<DnsResolver>(std::move(servers));
+            m_relay = std::make_unique<UpstreamRelay>(*m_resolver, m_config.runtime.connectionTimeout);
+            if (m_relay->listen()) {
+                m_connectionPool->setProxy(m_relay->proxy());
+            } else {
+                m_relay.reset();
+                m_resolver.reset();
+            }
+        }
+    }
+
+    QSslConfiguration upstreamSsl = QSslConfiguration::defaultConfiguration();
+    upstreamSsl.setPeerVerifyMode(m_config.runtime.disableSslStrict
+                                      ? QSslSocket::VerifyNone
+                                      : QSslSocket::AutoVerifyPeer);
+    upstreamSsl.setProtocol(QSsl::TlsV1_2OrLater);
+    m_executor = std::make_unique<QtExecutor>(*m_connectionPool, upstreamSsl);
+    m_executor->setRequestTimeout(m_config.runtime.requestTimeout);
+    m_executor->setConnectionTimeout(m_config.runtime.connectionTimeout);
+    m_executor->setHttp2Enabled(m_config.runtime.enableHttp2);
+
+    if (m_pipelineFactory) {
+        m_pipeline = m_pipelineFactory(m_executor.get(), m_config, this);
+    }
+
+    // Unpooled managers serve one request each, so there is nothing to warm
+    if (useConnectionPool) {
+        // A pre-connect offering h2 shares Qt's connection with requests
+        // that allow HTTP/2, so it has to offer the same protocols
+        m_warmSsl = upstreamSsl;
+        if (m_config.runtime.enableHttp2) {
+            m_warmSsl.setAllowedNextProtocols({QSslConfiguration::ALPNProtocolHTTP2,
+                                               QSslConfiguration::NextProtocolHttp1_1});
+        } else {
+            m_warmSsl.setAllowedNextProtocols({QSslConfiguration::NextProtocolHttp1_1});
+        }
+        warmUpstreams(0);
+
+        if (m_config.runtime.keepWarmSec > 0) {
+            // Checked at half the idle limit, so a connection is re-opened
+            // between 1x and 1.5x the limit after its last use
+            const qint64 idleMs = qint64(m_config.runtime.keepWarmSec) * 1000;
+            m_keepWarmTimer = new QTimer(this);
+            connect(m_keepWarmTimer, &QTimer::timeout, this, [this, idleMs]() {
+                warmUpstreams(idleMs);
+            });
+            m_keepWarmTimer->start(int(qMax<qint64>(1000, idleMs / 2)));
+        }
+
+        // Kept-warm managers count as used at every pass and are never reaped
+        if (m_config.runtime.poolIdleTimeoutSec > 0) {
+            const qint64 idleMs = qint64(m_config.runtime.poolIdleTimeoutSec) * 1000;
+            m_reapTimer = new QTimer(this);
+            connect(m_reapTimer, &QTimer::timeout, this, [this, idleMs]() {
+                m_connectionPool->reapIdle(idleMs);
+            });
+            m_reapTimer->start(int(qMax<qint64>(1000, idleMs / 2)));
+        }
+    }
+}
+
+// ========================================================================
+// warmUpstreams
+// ========================================================================
+
+void ProxyWorker::warmUpstreams(qint64 idleForMs)
+{
+    if (!m_connectionPool) {
+        return;
+    }
+
+    QSet<QString> seen;
+    int started = 0;
+    for (const ConfigGroup& group : std::as_const(m_config.groups)) {
+        QStringList urls{group.baseUrl};
+        urls += group.baseUrlCandidates;
+        for (const QString& text : std::as_const(urls)) {
+            const QUrl url(text.trimmed());
+            if (!url.isValid() || url.host().isEmpty()) {
+                continue;
+            }
+            const QString key = ConnectionPool::hostKey(url);
+            if (seen.contains(key)) {
+                continue;
+            }
+            seen.insert(key);
+            if (m_connectionPool->warm(url, m_warmSsl, idleForMs)) {
+                ++started;
+            }
+        }
+    }
+    if (started > 0) {
+        LOG_DEBUG(QStringLiteral("ProxyWorker: warming %1 upstream connection(s)").arg(started));
+    }
+}
+
+// ========================================================================
+// addConnection
+// ========================================================================
+
+void ProxyWorker::addConnection(qintptr socketDescriptor, ClientTransport transport)
+{
+    // Unix sockets are adopted too: Qt's socket engine runs any stream
+    // descriptor, and without startServerEncryption() QSslSocket is a plain
+    // socket, so every connection shares the code below.
+    m_pendingConnections.fetch_sub(1, std::memory_order_relaxed);
+    auto* socket = new QSslSocket(this);
+    if (!socket->setSocketDescriptor(socketDescriptor)) {
+        LOG_WARNING(QStringLiteral("ProxyWorker: failed to adopt socket - %1")
+                        .arg(socket->errorString()));
+        delete socket;
+        return;
+    }
+
+    ConnectionState state;
+    state.parser = HttpRequestParser(m_requestLimits);
+    state.transport = transport;
+    m_connections.insert(socket, state);
+    m_connectionCount.fetch_add(1, std::memory_order_relaxed);
+
+    connect(socket, &QSslSocket::encrypted,
+            this, &ProxyWorker::onSocketEncrypted);
+    connect(socket, &QSslSocket::readyRead,
+            this, &ProxyWorker::onSocketReadyRead);
+    connect(socket, &QSslSocket::disconnected,
+            this, &ProxyWorker::onSocketDisconnected);
+    // bytesWritten fires when plaintext is encrypted, encryptedBytesWritten
+    // when the kernel accepted it; either may bring a stream under its mark.
+    connect(socket, &QSslSocket::bytesWritten,
+            this, &ProxyWorker::onSocketBytesWritten);
+    connect(socket, &QSslSocket::encryptedBytesWritten,
+            this, &ProxyWorker::onSocketBytesWritten);
+    connect(socket, &QSslSocket::bytesWritten,
+            this, [](qint64 written) {
+                metrics::registry().responseBytes.add(quint64(written));
+            });
+    connect(socket, &QSslSocket::encryptedBytesWritten,
+            this, [this, socket](qint64 written) {
+                if (socket->isEncrypted()) {
+                    return;
+                }
+                const auto it = m_connections.find(socket);
+                if (it != m_connections.end()) {
+                    it->handshakeBytes += written;
+                }
+            });
+    connect(socket, &QSslSocket::sslErrors,
+            this, [socket](const QList<QSslError>&) {
+                socket->ignoreSslErrors();
+            });
+
+    if (transport != ClientTransport::Tls) {
+        LOG_DEBUG(QStringLiteral("ProxyWorker: new %1 connection")
+                      .arg(transport == ClientTransport::Unix ? QStringLiteral("Unix socket")
+                                                              : QStringLiteral("plain HTTP")));
+        return;
+    }
+
+    socket->setSslConfiguration(m_serverSsl);
+    m_tlsSessions.prepare(socket);
+    m_connections[socket].handshakeTimer.start();
+    socket->startServerEncryption();
+
+    LOG_DEBUG(QStringLiteral("ProxyWorker: new TLS connection from %1:%2")
+                  .arg(socket->peerAddress().toString())
+                  .arg(socket->peerPort()));
+}
+
+// ========================================================================
+// shutdown
+// ========================================================================
+
+void ProxyWorker::shutdown()
+{
+    // Abort all active streaming sessions
+    for (const SessionKey& key : m_throttledSessions.keys()) {
+        endThrottle(key);
+    }
+    const auto sessions = m_activeSessions;
+    m_activeSessions.clear();
+    for (PipelineStreamSession* session : sessions) {
+        if (session) {
+            session->abort();
+            delete session;
+        }
+    }
+
+    // In-flight callbacks hold QPointer guards and drop their result once
+    // the socket is gone.
+    const auto sockets = m_connections.keys();
+    m_connections.clear();
+    m_connectionCount.store(0, std::memory_order_relaxed);
+    for (QSslSocket* socket : sockets) {
+        socket->disconnect(this);
+        socket->abort();
+        delete socket;
+    }
+
+    delete m_keepWarmTimer;
+    m_keepWarmTimer = nullptr;
+    delete m_reapTimer;
+    m_reapTimer = nullptr;
+    delete m_pipeline;
+    m_pipeline = nullptr;
+    m_executor.reset();
+    if (m_connectionPool) {
+        m_connectionPool->clear();
+        m_connectionPool.reset();
+    }
+    m_relay.reset();
+    m_resolver.reset();
+}
+
+// ========================================================================
+// onSocketEncrypted
+// ========================================================================
+
+void ProxyWorker::onSocketEncrypted()
+{
+    auto* socket = qobject_cast<QSslSocket*>(sender());
+    auto it = m_connections.find(socket);
+    if (it == m_connections.end()) {
+        return;
+    }
+
+    // Qt does not report whether OpenSSL resumed the session, so look at
+    // what we sent: a full handshake has to carry the certificate, while a
+    // resumed one is a few hundred bytes. Half the certificate still leaves
+    // room for certificate compression.
+    const quint64 elapsedUs = quint64(it->handshakeTimer.nsecsElapsed() / 1000);
+    if (it->handshakeBytes < m_certificateBytes / 2) {
+        m_resumedHandshakes.fetch_add(1, std::memory_order_relaxed);
+        m_resumedHandshakeUs.fetch_add(elapsedUs, std::memory_order_relaxed);
+    } else {
+        m_fullHandshakes.fetch_add(1, std::memory_order_relaxed);
+        m_fullHandshakeUs.fetch_add(elapsedUs, std::memory_order_relaxed);
+    }
+    m_tlsSessions.handshakeCompleted(socket);
+
+    if (socket->sslConfiguration().nextNegotiatedProtocol()
+        != QSslConfiguration::ALPNProtocolHTTP2) {
+        return;
+    }
+
+    auto* http2 = new Http2Connection(socket, m_http2Limits, socket);
+    it->http2 = http2;
+    connect(http2, &Http2Connection::requestReceived,
+            this, [this, socket](const Http2Request& request) {
+                handleHttp2Request(socket, request);
+            });
+    connect(http2, &Http2Connection::streamReset,
+            this, [this, socket](quint32 streamId) {
+                abortSession({socket, streamId});
+            });
+    connect(http2, &Http2Connection::failed,
+            socket, &QSslSocket::disconnectFromHost);
+    http2->start();
+
+    LOG_DEBUG(QStringLiteral("ProxyWorker: negotiated h2 with %1")
+                  .arg(socket->peerAddress().toString()));
+}
+
+// ========================================================================
+// onSocketReadyRead
+// ========================================================================
+
+void ProxyWorker::onSocketReadyRead()
+{
+    auto* socket = qobject_cast<QSslSocket*>(sender());
+    if (!socket) {
+        return;
+    }
+    if (Http2Connection* http2 = http2For(socket)) {
+        http2->receive(socket->readAll());
+        return;
+    }
+    // While a request is in flight the bytes stay in the socket; the parser
+    // reads them once finishRequest() lets the next request through.
+    processPendingRequests(socket);
+}
+
+Http2Connection* ProxyWorker::http2For(QSslSocket* socket) const
+{
+    const auto it = m_connections.constFind(socket);
+    return it == m_connections.cend() ? nullptr : it->http2;
+}
+
+bool ProxyWorker::isLocalClient(QSslSocket* socket) const
+{
+    const auto it = m_connections.constFind(socket);
+    if (it != m_connections.cend() && it->transport == ClientTransport::Unix) {
+        return true;
+    }
+    return socket && socket->peerAddress().isLoopback();
+}
+
+SseWriter* ProxyWorker::sseWriterFor(QSslSocket* socket)
+{
+    const auto it = m_connections.find(socket);
+    if (it == m_connections.end()) {
+        return nullptr;
+    }
+    if (!it->sse) {
+        it->sse = new SseWriter(socket, m_config.runtime.sseWriteMode,
+                                m_config.runtime.sseCoalesceMs, socket);
+    }
+    return it->sse;
+}
+
+// ========================================================================
+// processPendingRequests
+// ========================================================================
+
+void ProxyWorker::processPendingRequests(QSslSocket* socket)
+{
+    auto it = m_connections.find(socket);
+    if (it == m_connections.end() || it->busy) {
+        return;
+    }
+
+    HttpRequestParser& parser = it->parser;
+    switch (parser.readFrom(socket)) {
+    case HttpRequestParser::Status::NeedMore:
+        // Clients such as curl hold large uploads back until told to go on
+        if (parser.expectsContinue() && !it->continueSent) {
+            it->continueSent = true;
+            socket->write("HTTP/1.1 100 Continue\r\n\r\n");
+        }
+        return;
+    case HttpRequestParser::Status::Error:
+        it->busy = true;
+        rejectRequest(socket, parser);
+        return;
+    case HttpRequestParser::Status::Complete:
+        break;
+    }
+
+    // The next request is picked up by finishRequest(). The body is moved
+    // out so it is freed once decoded rather than when the response ends.
+    it->busy = true;
+    const RequestView view{parser.method(), parser.target(),
+                           [&parser](QByteArrayView name) { return parser.header(name); }};
+    handleRequest(Exchange{socket, 0}, view, parser.takeBody());
+}
+
+void ProxyWorker::handleHttp2Request(QSslSocket* socket, const Http2Request& request)
+{
+    const RequestView view{request.method, request.path,
+                           [&request](QByteArrayView name) { return request.header(name); }};
+    handleRequest(Exchange{socket, request.streamId}, view, request.body);
+}
+
+// ========================================================================
+// rejectRequest
+// ========================================================================
+
+void ProxyWorker::rejectRequest(QSslSocket* socket, const HttpRequestParser& parser)
+{
+    LOG_WARNING(QStringLiteral("ProxyWorker: rejecting request - %1")
+                    .arg(parser.errorMessage()));
+
+    // The stream cannot be resynchronised after a framing error
+    QJsonObject errObj;
+    errObj[QStringLiteral("error")] = parser.errorMessage();
+    sendHttpResponse(socket, parser.errorStatus(),
+                     QJsonDocument(errObj).toJson(QJsonDocument::Compact));
+    socket->disconnectFromHost();
+}
+
+// ========================================================================
+// finishRequest
+// ========================================================================
+
+void ProxyWorker::finishRequest(QSslSocket* socket)
+{
+    auto it = m_connections.find(socket);
+    if (it == m_connections.end()) {
+        return;
+    }
+    it->busy = false;
+    it->continueSent = false;
+    it->parser.reset();
+
+    if ((it->parser.hasBufferedData() || socket->bytesAvailable() > 0)
+        && socket->state() == QAbstractSocket::ConnectedState) {
+        QPointer<QSslSocket> guard(socket);
+        QMetaObject::invokeMethod(this, [this, guard]() {
+            if (guard) {
+                processPendingRequests(guard.data());
+            }
+        }, Qt::QueuedConnection);
+    }
+}
+
+// ========================================================================
+// onSocketDisconnected
+// ========================================================================
+
+void ProxyWorker::onSocketDisconnected()
+{
+    auto* socket = qobject_cast<QSslSocket*>(sender());
+    if (!socket) {
+        return;
+    }
+
+    if (m_connections.remove(socket) > 0) {
+        m_connectionCount.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+    // Every stream of an HTTP/2 connection may have a session
+    auto it = m_activeSessions.lowerBound({socket, 0});
+    while (it != m_activeSessions.end() && it.key().first == socket) {
+        PipelineStreamSession* session = it.value();
+        endThrottle(it.key());
+        it = m_activeSessions.erase(it);
+        if (session) {
+            session->abort();
+            session->deleteLater();
+        }
+    }
+    socket->deleteLater();
+
+    LOG_DEBUG(QStringLiteral("ProxyWorker: client disconnected"));
+}
+
+void ProxyWorker::abortSession(const SessionKey& key)
+{
+    PipelineStreamSession* session = m_activeSessions.take(key);
+    endThrottle(key);
+    if (session) {
+        session->abort();
+        session->deleteLater();
+    }
+}
+
+// ========================================================================
+// handleRequest
+// ========================================================================
+
+void ProxyWorker::handleRequest(const Exchange& exchange, const RequestView& request,
+                                QByteArray body)
+{
+    const QString method = QString::fromLatin1(request.method).toUpper();
+    const QString path = QString::fromUtf8(request.target);
+    LOG_INFO(QStringLiteral("ProxyWorker: %1 %2").arg(method, path));
+    metrics::registry().requestBytes.add(quint64(body.size()));
+
+    // Scrapes come from the same machine; anyone else gets the usual 404
+    if (method == QStringLiteral("GET") && path == QStringLiteral("/metrics")
+        && isLocalClient(exchange.socket.data())) {
+        respond(exchange, 200, metrics::registry().render(),
+                QStringLiteral("text/plain; version=0.0.4; charset=utf-8"));
+        return;
+    }
+
+    if (method == QStringLiteral("GET")
+        && path == QStringLiteral("/v1/models")) {
+        if (handleModelsRequest(exchange, request)) {
+            return;
+        }
+    }
+
+    // ---- Route lookup ----
+    const std::optional<RouteMatch> routeMatch = m_router.lookup(request.method, request.target);
+    if (!routeMatch) {
+        QJsonObject errObj;
+        errObj[QStringLiteral("error")] = QStringLiteral("route not found");
+        errObj[QStringLiteral("path")]  = path;
+        respond(exchange, 404, QJsonDocument(errObj).toJson(QJsonDocument::Compact));
+        return;
+    }
+
+    if (!m_pipeline) {
+        QJsonObject errObj;
+        errObj[QStringLiteral("error")] = QStringLiteral("pipeline not configured");
+        respond(exchange, 503, QJsonDocument(errObj).toJson(QJsonDocument::Compact));
+        return;
+    }
+
+    QMap<QString, QString> metadata = buildMetadata(request, path, *routeMatch);
+    metrics::registry().requests.add({routeMatch->route->inboundProtocol,
+                                      metadata.value(QStringLiteral("provider_adapter"),
+                                                     metadata.value(QStringLiteral("provider")))});
+
+    // ---- Detect streaming request ----
+    // Sniffed, not parsed: the inbound adapter parses the body once later
+    bool isStream = json_sniffer::topLevelBool(body, "stream").value_or(false);
+
+    // Gemini-style routes carry it in the path ("{model}:streamGenerateContent")
+    if (!isStream) {
+        const auto action = metadata.constFind(QStringLiteral("route.action"));
+        isStream = action != metadata.cend()
+                       ? action->startsWith(QStringLiteral("stream"), Qt::CaseInsensitive)
+                       : path.contains(QStringLiteral("/models/"), Qt::CaseInsensitive);
+    }
+
+    // ---- Dispatch to pipeline ----
+    // The pipeline answers asynchronously; the socket may be gone by then,
+    // which the exchange's QPointer reports.
+    if (isStream) {
+        m_pipeline->processStream(body, metadata,
+                                  [this, exchange](Result<PipelineStreamSession*> result) {
+            if (!exchange.socket) {
+                if (result) {
+                    (*result)->abort();
+                    (*result)->deleteLater();
+                }
+                return;
+            }
+            if (!result) {
+                const DomainFailure failure = result.error();
+                respond(exchange, failure.httpStatus(),
+                        QJsonDocument(failure.toJson()).toJson(QJsonDocument::Compact));
+                return;
+            }
+            sendStreamResponse(exchange, *result);
+        });
+    } else {
+        m_pipeline->process(body, metadata,
+                            [this, exchange](Result<QByteArray> result) {
+            if (!exchange.socket) {
+                return;
+            }
+            if (!result) {
+                const DomainFailure failure = result.error();
+                respond(exchange, failure.httpStatus(),
+                        QJsonDocument(failure.toJson()).toJson(QJsonDocument::Compact));
+                return;
+            }
+            respond(exchange, 200, *result);
+        });
+    }
+}
+
+struct ProxyWorker::ModelsFetchState {
+    model_list_request_builder::Context context;
+    QString cacheKey;
+    int modeIndex = 0;
+};
+
+bool ProxyWorker::handleModelsRequest(const Exchange& exchange, const RequestView& request)
+{
+    const ConfigGroup& group = m_config.currentGroup();
+    if (group.baseUrl.isEmpty() || !m_executor) {
+        return false;
+    }
+
+    const bool preferDownstreamAnthropic =
+        request.hasHeader("anthropic-version") || request.hasHeader("x-api-key");
+    model_list_request_builder::DownstreamHeaders incomingHeaders;
+    incomingHeaders.authorization = headerText(request.header, "authorization");
+    incomingHeaders.xApiKey = headerText(request.header, "x-api-key");
+    incomingHeaders.xGoogApiKey = headerText(request.header, "x-goog-api-key");
+    incomingHeaders.anthropicVersion = headerText(request.header, "anthropic-version");
+    incomingHeaders.anthropicBeta = headerText(request.header, "anthropic-beta");
+
+    const model_list_request_builder::Context requestContext =
+        model_list_request_builder::buildContext(group, incomingHeaders, m_config.global.authKey);
+    if (!requestContext.isValid()) {
+        respond(exchange, 400,
+                QJsonDocument(DomainFailure::invalidInput(
+                                  QStringLiteral("invalid_model_list_url"),
+                                  QStringLiteral("model list URL is invalid"))
+                                  .toJson())
+                    .toJson(QJsonDocument::Compact));
+        return true;
+    }
+
+    const bool preferAnthropicSchema =
+        (requestContext.provider == provider_routing::ModelListProvider::Anthropic)
+        || preferDownstreamAnthropic;
+
+    // The list depends on the upstream and on whose key asks for it
+    const QString cacheKey = requestContext.upstreamUrl.toString()
+                             + QLatin1Char('\n') + requestContext.effectiveApiKey;
+
+    ModelListCache::Response cached;
+    const ModelListCache::State cacheState = m_modelLists.lookup(cacheKey, &cached);
+    if (cacheState != ModelListCache::State::Missing) {
+        respond(exchange, cached.status, cached.body(preferAnthropicSchema),
+                QStringLiteral("application/json; charset=utf-8"));
+        if (cacheState == ModelListCache::State::Stale && m_modelLists.join(cacheKey, nullptr)) {
+            LOG_DEBUG(QStringLiteral("ProxyWorker: /v1/models serving stale list, refreshing"));
+            startModelsFetch(requestContext, cacheKey);
+        }
+        return true;
+    }
+
+    const bool startFetch = m_modelLists.join(
+        cacheKey, [this, exchange, preferAnthropicSchema](const ModelListCache::Response& response) {
+            if (!exchange.socket) {
+                return;
+            }
+            respond(exchange, response.status, response.body(preferAnthropicSchema),
+                    QStringLiteral("application/json; charset=utf-8"));
+        });
+    if (startFetch) {
+        startModelsFetch(requestContext, cacheKey);
+    }
+    return true;
+}
+
+void ProxyWorker::startModelsFetch(const model_list_request_builder::Context& context,
+                                   const QString& cacheKey)
+{
+    auto state = std::make_shared<ModelsFetchState>();
+    state->context = context;
+    state->cacheKey = cacheKey;
+    runModelsAttempt(state);
+}
+
+void ProxyWorker::finishModelsFetch(const QString& cacheKey, int status, const QByteArray& body)
+{
+    ModelListCache::Response response;
+    response.status = status;
+    if (status >= 200 && status < 300) {
+        response.openAiBody = normalizeModelListBody(body, false);
+        response.anthropicBody = normalizeModelListBody(body, true);
+    } else {
+        response.openAiBody = body;
+        response.anthropicBody = body;
+    }
+    m_modelLists.complete(cacheKey, response);
+}
+
+void ProxyWorker::runModelsAttempt(std::shared_ptr<ModelsFetchState> state)
+{
+    const QStringList& authModes = state->context.authModes;
+    if (state->modeIndex >= authModes.size() || !m_executor) {
+        const DomainFailure failure = DomainFailure::internal(
+            QStringLiteral("models request was not attempted"));
+        finishModelsFetch(state->cacheKey, failure.httpStatus(),
+                          QJsonDocument(failure.toJson()).toJson(QJsonDocument::Compact));
+        return;
+    }
+
+    const QString authMode = authModes.at(state->modeIndex);
+    ProviderRequest attemptReq = model_list_request_builder::makeProviderRequest(
+        state->context, authMode);
+    LOG_DEBUG(QStringLiteral("ProxyWorker: /v1/models trying auth=%1 key_source=%2 url=%3")
+                  .arg(authMode, state->context.keySource, attemptReq.url));
+
+    // Runs to completion even if the requesting client left: other clients
+    // may be waiting for the same fetch, and the result is cached
+    m_executor->execute(attemptReq,
+                        [this, state, authMode](Result<ProviderResponse> result) {
+        if (!result.has_value()) {
+            const DomainFailure failure = result.error();
+            const int failureStatus = failure.httpStatus();
+            LOG_WARNING(QStringLiteral("ProxyWorker: /v1/models auth=%1 failed status=%2 msg=%3")
+                            .arg(authMode)
+                            .arg(failureStatus)
+                            .arg(failure.message));
+
+            const bool isAuthFailure = (failureStatus == 401 || failureStatus == 403);
+            const bool canRetry = (state->modeIndex + 1) < state->context.authModes.size();
+            if (isAuthFailure && canRetry) {
+                ++state->modeIndex;
+                runModelsAttempt(state);
+                return;
+            }
+            finishModelsFetch(state->cacheKey, failure.httpStatus(),
+                              QJsonDocument(failure.toJson()).toJson(QJsonDocument::Compact));
+            return;
+        }
+
+        const ProviderResponse& response = result.value();
+        int status = response.statusCode;
+        if (status <= 0) {
+            status = 502;
+        }
+
+        LOG_DEBUG(QStringLiteral("ProxyWorker: /v1/models upstream status=%1 bytes=%2")
+                      .arg(status)
+                      .arg(response.body.size()));
+        if (status < 200 || status >= 300) {
+            const QString bodyPreview = QString::fromUtf8(response.body.left(512));
+            LOG_WARNING(QStringLiteral("ProxyWorker: /v1/models upstream error body: %1")
+                            .arg(bodyPreview));
+        }
+
+        finishModelsFetch(state->cacheKey, status, response.body);
+    });
+}
+
+// ========================================================================
+// respond / sendHttpResponse
+// ========================================================================
+
+void ProxyWorker::respond(const Exchange& exchange, int status,
+                          const QByteArray& body,
+                          const QString& contentType)
+{
+    QSslSocket* socket = exchange.socket.data();
+    if (!socket) {
+        return;
+    }
+    if (exchange.streamId != 0) {
+        if (Http2Connection* http2 = http2For(socket)) {
+            http2->sendResponse(exchange.streamId, status,
+                                {{"content-type", contentType.toUtf8()},
+                                 {"access-control-allow-origin", "*"}},
+                                body);
+        }
+        return;
+    }
+    sendHttpResponse(socket, status, body, contentType);
+    finishRequest(socket);
+}
+
+void ProxyWorker::sendHttpResponse(QSslSocket* socket, int status,
+                                   const QByteArray& body,
+                                   const QString& contentType)
+{
+    if (!socket || socket->state() != QAbstractSocket::ConnectedState) {
+        return;
+    }
+
+    static const QMap<int, QString> statusTexts = {
+        {200, QStringLiteral("OK")},
+        {400, QStringLiteral("Bad Request")},
+        {401, QStringLiteral("Unauthorized")},
+        {403, QStringLiteral("Forbidden")},
+        {404, QStringLiteral("Not Found")},
+        {413, QStringLiteral("Payload Too Large")},
+        {429, QStringLiteral("Too Many Requests")},
+        {431, QStringLiteral("Request Header Fields Too Large")},
+        {500, QStringLiteral("Internal Server Error")},
+        {501, QStringLiteral("Not Implemented")},
+        {503, QStringLiteral("Service Unavailable")},
+        {504, QStringLiteral("Gateway Timeout")}
+    };
+
+    QString statusText = statusTexts.value(status, QStringLiteral("Unknown"));
+
+    QByteArray response;
+    response.append(QStringLiteral("HTTP/1.1 %1 %2\r\n")
+                        .arg(status)
+                        .arg(statusText)
+                        .toUtf8());
+    response.append(QStringLiteral("Content-Type: %1\r\n")
+                        .arg(contentType)
+                        .toUtf8());
+    response.append(QStringLiteral("Content-Length: %1\r\n")
+                        .arg(body.size())
+                        .toUtf8());
+    response.append("Access-Control-Allow-Origin: *\r\n");
+    response.append("Connection: keep-alive\r\n");
+    response.append("\r\n");
+    response.append(body);
+
+    socket->write(response);
+    socket->flush();
+}
+
+// ========================================================================
+// sendStreamResponse
+// ========================================================================
+
+void ProxyWorker::sendStreamResponse(const Exchange& exchange,
+                                     PipelineStreamSession* session)
+{
+    QSslSocket* socket = exchange.socket.data();
+    const SessionKey key{socket, exchange.streamId};
+    m_activeSessions[key] = session;
+
+    if (exchange.streamId != 0) {
+        if (Http2Connection* http2 = http2For(socket)) {
+            http2->sendHeaders(exchange.streamId, 200,
+                               {{"content-type", "text/event-stream"},
+                                {"cache-control", "no-cache"}},
+                               false);
+        }
+    } else {
+        // Write the HTTP response header with chunked transfer encoding
+        if (SseWriter* sse = sseWriterFor(socket)) {
+            sse->writeStreamHeader();
+        }
+    }
+
+    auto endSession = [this, exchange, key, session]() {
+        if (!exchange.socket) {
+            return;
+        }
+        if (m_activeSessions.value(key) == session) {
+            m_activeSessions.remove(key);
+            endThrottle(key);
+            session->deleteLater();
+        }
+        if (exchange.streamId == 0) {
+            finishRequest(exchange.socket.data());
+        }
+    };
+
+    // Forward each encoded frame from the pipeline as an SSE event
+    connect(session, &PipelineStreamSession::encodedFrameReady,
+            this, [this, exchange](const QByteArray& data) {
+                sendStreamEvent(exchange, data);
+            });
+
+    // On normal completion, send the SSE [DONE] sentinel and terminate
+    connect(session, &PipelineStreamSession::finished,
+            this, [this, exchange, endSession]() {
+                if (!exchange.socket) {
+                    return;
+                }
+                endStreamResponse(exchange);
+                endSession();
+            });
+
+    // On error, send the failure as a final SSE event, then terminate
+    connect(session, &PipelineStreamSession::error,
+            this, [this, exchange, endSession](const DomainFailure& failure) {
+                if (!exchange.socket) {
+                    return;
+                }
+                sendStreamEvent(exchange,
+                                QJsonDocument(failure.toJson()).toJson(QJsonDocument::Compact));
+                endStreamResponse(exchange);
+                endSession();
+            });
+}
+
+void ProxyWorker::sendStreamEvent(const Exchange& exchange, const QByteArray& data)
+{
+    QSslSocket* socket = exchange.socket.data();
+    if (!socket) {
+        return;
+    }
+    if (exchange.streamId == 0) {
+        if (SseWriter* sse = sseWriterFor(socket)) {
+            sse->sendEvent(data);
+        }
+    } else if (Http2Connection* http2 = http2For(socket)) {
+        http2->sendData(exchange.streamId, SseWriter::formatEvent(data), false);
+    }
+    throttleIfBacklogged(exchange);
+}
+
+// ========================================================================
+// Stream backpressure
+// ========================================================================
+
+qint64 ProxyWorker::streamBacklog(QSslSocket* socket, quint32 streamId) const
+{
+    // Flushed plaintext moves to the encrypted buffer, so both count
+    qint64 backlog = socket->bytesToWrite() + socket->encryptedBytesToWrite();
+    const auto it = m_connections.constFind(socket);
+    if (it == m_connections.cend()) {
+        return backlog;
+    }
+    if (streamId != 0 && it->http2) {
+        backlog += it->http2->pendingBytes(streamId);
+    } else if (streamId == 0 && it->sse) {
+        backlog += it->sse->bufferedBytes();
+    }
+    return backlog;
+}
+
+void ProxyWorker::throttleIfBacklogged(const Exchange& exchange)
+{
+    QSslSocket* socket = exchange.socket.data();
+    const SessionKey key{socket, exchange.streamId};
+    if (m_throttledSessions.contains(key)
+        || streamBacklog(socket, exchange.streamId) <= kStreamHighWatermark) {
+        return;
+    }
+    PipelineStreamSession* session = m_activeSessions.value(key);
+    if (!session) {
+        return;
+    }
+
+    session->setPaused(true);
+    QElapsedTimer since;
+    since.start();
+    m_throttledSessions.insert(key, since);
+    m_throttleCount.fetch_add(1, std::memory_order_relaxed);
+}
+
+void ProxyWorker::onSocketBytesWritten()
+{
+    auto* socket = qobject_cast<QSslSocket*>(sender());
+    if (!socket || m_throttledSessions.isEmpty()) {
+        return;
+    }
+
+    QList<SessionKey> drained;
+    for (auto it = std::as_const(m_throttledSessions).lowerBound({socket, 0});
+         it != m_throttledSessions.cend() && it.key().first == socket; ++it) {
+        if (streamBacklog(socket, it.key().second) <= kStreamLowWatermark) {
+            drained.append(it.key());
+        }
+    }
+    for (const SessionKey& key : drained) {
+        endThrottle(key);
+        if (PipelineStreamSession* session = m_activeSessions.value(key)) {
+            session->setPaused(false);
+        }
+    }
+}
+
+void ProxyWorker::endThrottle(const SessionKey& key)
+{
+    const auto it = m_throttledSessions.find(key);
+    if (it == m_throttledSessions.end()) {
+        return;
+    }
+    m_throttledMs.fetch_add(quint64(it->elapsed()), std::memory_order_relaxed);
+    m_throttledSessions.erase(it);
+}
+
+StreamThrottleStats ProxyWorker::throttleStats() const
+{
+    return {m_throttleCount.load(std::memory_order_relaxed),
+            m_throttledMs.load(std::memory_order_relaxed)};
+}
+
+TlsHandshakeStats ProxyWorker::handshakeStats() const
+{
+    return {m_fullHandshakes.load(std::memory_order_relaxed),
+            m_resumedHandshakes.load(std::memory_order_relaxed),
+            m_fullHandshakeUs.load(std::memory_order_relaxed),
+            m_resumedHandshakeUs.load(std::memory_order_relaxed)};
+}
+
+void ProxyWorker::endStreamResponse(const Exchange& exchange)
+{
+    QSslSocket* socket = exchange.socket.data();
+    if (!socket) {
+        return;
+    }
+    if (exchange.streamId == 0) {
+        if (SseWriter* sse = sseWriterFor(socket)) {
+            sse->finish();
+        }
+    } else if (Http2Connection* http2 = http2For(socket)) {
+        http2->sendData(exchange.streamId, SseWriter::doneEvent(), true);
+    }
+}
+
+// ========================================================================
+// buildMetadata
+// ========================================================================
+
+QMap<QString, QString> ProxyWorker::buildMetadata(
+    const RequestView& request,
+    const QString& path,
+    const RouteMatch& match) const
+{
+    const Route& route = *match.route;
+    // A route may pin a config group; unknown names fall back to the current one
+    const ConfigGroup* routeGroup = route.group.isEmpty() ? nullptr
+                                                          : m_config.findGroup(route.group);
+    const ConfigGroup& group = routeGroup ? *routeGroup : m_config.currentGroup();
+
+    QMap<QString, QString> meta;
+    meta[QStringLiteral("inbound.format")]    = route.inboundProtocol;
+    meta[QStringLiteral("config_group")]      = group.name;
+    meta[QStringLiteral("provider")]          = route.provider.isEmpty()
+                                                    ? group.provider
+                                                    : route.provider;
+    meta[QStringLiteral("provider_base_url")] = group.baseUrl;
+    meta[QStringLiteral("provider_api_key")]  = group.apiKey;
+    meta[QStringLiteral("api_key")]           = group.apiKey;
+    meta[QStringLiteral("model_id")]          = group.modelId;
+    meta[QStringLiteral("middle_route")]      = group.middleRoute;
+    meta[QStringLiteral("mapped_model_id")]   = m_config.global.mappedModelId;
+    if (!group.baseUrlCandidates.isEmpty()) {
+        meta[QStringLiteral("provider_base_url_candidates")] =
+            group.baseUrlCandidates.join(QLatin1Char(','));
+    }
+    if (!group.outboundAdapter.isEmpty()) {
+        meta[QStringLiteral("provider_adapter")] = group.outboundAdapter;
+    }
+
+    // Propagate the client's auth token so the pipeline can validate it
+    // against the configured global auth key
+    QString authHeader = headerText(request.header, "authorization");
+    if (authHeader.isEmpty()) {
+        authHeader = headerText(request.header, "x-api-key");
+    }
+    meta[QStringLiteral("auth_key")] = authHeader;
+
+    // Carry the original request path so adapters can reconstruct URLs
+    meta[QStringLiteral("request_path")] = path;
+    for (const auto& [name, value] : match.params) {
+        meta[QStringLiteral("route.") + name] = value;
+    }
+
+    // Copy custom headers from the config group
+    for (auto it = group.customHeaders.cbegin();
+         it != group.customHeaders.cend(); ++it) {
+        meta[QStringLiteral("custom_header.%1").arg(it.key())] = it.value();
+    }
+
+    return meta;
+}
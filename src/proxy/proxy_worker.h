@@ -0,0 +1,202 @@
+#pragma once
+#include "http2_connection.h"
+#include "http_request_parser.h"
+#include "model_list_cache.h"
+#include "request_router.h"
+#include "tls_session_cache.h"
+#include "config/config_types.h"
+#include "config/model_list_request_builder.h"
+#include <QElapsedTimer>
+#include <QObject>
+#include <QSslConfiguration>
+#include <QSslSocket>
+#include <QMap>
+#include <QPointer>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <utility>
+
+class ConnectionPool;
+class DnsResolver;
+class IExecutor;
+class Pipeline;
+class PipelineStreamSession;
+class QtExecutor;
+class SseWriter;
+class UpstreamRelay;
+class QTimer;
+
+// Builds the pipeline served by one worker. Invoked on the worker's thread,
+// so everything it creates (and parents to `parent`) lives there too.
+using PipelineFactory =
+    std::function<Pipeline*(IExecutor* executor, const ProxyConfig& config, QObject* parent)>;
+
+// How often streamed responses were paused because the client read slower
+// than the upstream produced, and for how long in total.
+struct StreamThrottleStats {
+    quint64 throttleCount = 0;
+    quint64 throttledMs = 0;
+};
+
+// Downstream TLS handshakes by kind, with their total duration
+struct TlsHandshakeStats {
+    quint64 fullHandshakes = 0;
+    quint64 resumedHandshakes = 0;
+    quint64 fullHandshakeUs = 0;
+    quint64 resumedHandshakeUs = 0;
+};
+
+// How a client reached the proxy. Plain and Unix connections are local
+// clients pointed at the proxy through a base URL; they skip TLS and speak
+// HTTP/1.1 only.
+enum class ClientTransport { Tls, Plain, Unix };
+
+// Serves client connections on the thread it lives on. Each worker owns its
+// sockets, upstream connection pool, executor and pipeline, so nothing on the
+// request path is shared with other workers. Connections that negotiate "h2"
+// through ALPN are served by an Http2Connection; everything else is HTTP/1.1.
+class ProxyWorker : public QObject {
+    Q_OBJECT
+public:
+    ProxyWorker(const ProxyConfig& config,
+                const QSslConfiguration& serverSsl,
+                PipelineFactory pipelineFactory,
+                QObject* parent = nullptr);
+    ~ProxyWorker() override;
+
+    // Number of open client connections; safe to read from any thread.
+    int connectionCount() const { return m_connectionCount.load(std::memory_order_relaxed); }
+    // Open connections plus those handed over but not yet adopted. The
+    // dispatching thread calls connectionDispatched() before queueing
+    // addConnection(), so a burst sees the connections it already placed.
+    int dispatchLoad() const
+    {
+        return m_connectionCount.load(std::memory_order_relaxed)
+               + m_pendingConnections.load(std::memory_order_relaxed);
+    }
+    void connectionDispatched() { m_pendingConnections.fetch_add(1, std::memory_order_relaxed); }
+    // Safe to read from any thread; throttles still in progress are not counted.
+    StreamThrottleStats throttleStats() const;
+    TlsHandshakeStats handshakeStats() const;
+
+    // Output backlog per stream (socket buffer plus, for HTTP/2, DATA waiting
+    // for flow-control credit). Above the high mark the upstream reply is
+    // paused; it resumes once the client has drained below the low mark.
+    static constexpr qint64 kStreamHighWatermark = 256 * 1024;
+    static constexpr qint64 kStreamLowWatermark = 64 * 1024;
+
+public slots:
+    // Must run on the worker thread before the first connection is handed over.
+    void initialize();
+    // Takes ownership of an accepted socket descriptor and, for TLS clients,
+    // starts the handshake on it.
+    void addConnection(qintptr socketDescriptor,
+                       ClientTransport transport = ClientTransport::Tls);
+    // Closes every connection and releases the upstream resources.
+    void shutdown();
+
+private slots:
+    void onSocketEncrypted();
+    void onSocketReadyRead();
+    void onSocketDisconnected();
+    void onSocketBytesWritten();
+
+private:
+    // HTTP/1.1 connections have one request in flight at a time; pipelined
+    // requests stay buffered until the current response has been written.
+    // HTTP/2 connections run their streams concurrently.
+    struct ConnectionState {
+        HttpRequestParser parser;
+        ClientTransport transport = ClientTransport::Tls;
+        bool busy = false;
+        bool continueSent = false;
+        Http2Connection* http2 = nullptr;  // child of the socket
+        SseWriter* sse = nullptr;          // child of the socket, reused per stream
+        QElapsedTimer handshakeTimer;
+        qint64 handshakeBytes = 0;         // our side of the TLS handshake
+    };
+
+    // Where a response goes: the socket, plus the stream for HTTP/2
+    struct Exchange {
+        QPointer<QSslSocket> socket;
+        quint32 streamId = 0;  // 0 for HTTP/1.1
+    };
+    using SessionKey = std::pair<QSslSocket*, quint32>;
+
+    // The parts of a request head that request handling reads, for either
+    // protocol. Only valid during handleRequest().
+    struct RequestView {
+        QByteArrayView method;
+        QByteArrayView target;
+        std::function<QByteArrayView(QByteArrayView)> header;
+
+        bool hasHeader(QByteArrayView name) const { return !header(name).isNull(); }
+    };
+
+    struct ModelsFetchState;
+
+    // Opens connections to every group's upstream hosts that have been idle
+    // for idleForMs (0 = all), so requests skip DNS, TCP and TLS
+    void warmUpstreams(qint64 idleForMs);
+    void processPendingRequests(QSslSocket* socket);
+    void finishRequest(QSslSocket* socket);
+    void rejectRequest(QSslSocket* socket, const HttpRequestParser& parser);
+    void handleHttp2Request(QSslSocket* socket, const Http2Request& request);
+    void abortSession(const SessionKey& key);
+    Http2Connection* http2For(QSslSocket* socket) const;
+    bool isLocalClient(QSslSocket* socket) const;
+    SseWriter* sseWriterFor(QSslSocket* socket);
+    void handleRequest(const Exchange& exchange, const RequestView& request, QByteArray body);
+    bool handleModelsRequest(const Exchange& exchange, const RequestView& request);
+    void startModelsFetch(const model_list_request_builder::Context& context,
+                          const QString& cacheKey);
+    void runModelsAttempt(std::shared_ptr<ModelsFetchState> state);
+    void finishModelsFetch(const QString& cacheKey, int status, const QByteArray& body);
+    void respond(const Exchange& exchange, int status,
+                 const QByteArray& body,
+                 const QString& contentType = QStringLiteral("application/json"));
+    void sendHttpResponse(QSslSocket* socket, int status,
+                          const QByteArray& body,
+                          const QString& contentType = QStringLiteral("application/json"));
+    void sendStreamResponse(const Exchange& exchange, PipelineStreamSession* session);
+    void sendStreamEvent(const Exchange& exchange, const QByteArray& data);
+    void endStreamResponse(const Exchange& exchange);
+    qint64 streamBacklog(QSslSocket* socket, quint32 streamId) const;
+    void throttleIfBacklogged(const Exchange& exchange);
+    void endThrottle(const SessionKey& key);
+    QMap<QString, QString> buildMetadata(const RequestView& request,
+                                         const QString& path,
+                                         const RouteMatch& match) const;
+
+    ProxyConfig m_config;
+    QSslConfiguration m_serverSsl;
+    PipelineFactory m_pipelineFactory;
+    RequestRouter m_router;
+    HttpRequestLimits m_requestLimits;
+    Http2Limits m_http2Limits;
+    TlsSessionCache m_tlsSessions;
+    qint64 m_certificateBytes = 0;
+    ModelListCache m_modelLists;
+
+    std::unique_ptr<DnsResolver> m_resolver;
+    std::unique_ptr<UpstreamRelay> m_relay;  // with upstream DNS servers configured
+    std::unique_ptr<ConnectionPool> m_connectionPool;
+    std::unique_ptr<QtExecutor> m_executor;
+    Pipeline* m_pipeline = nullptr;
+    QSslConfiguration m_warmSsl;        // upstream TLS, with the ALPN requests negotiate
+    QTimer* m_keepWarmTimer = nullptr;
+    QTimer* m_reapTimer = nullptr;
+
+    QMap<QSslSocket*, ConnectionState> m_connections;
+    QMap<SessionKey, PipelineStreamSession*> m_activeSessions;
+    QMap<SessionKey, QElapsedTimer> m_throttledSessions;  // paused on backlog
+    std::atomic<int> m_connectionCount{0};
+    std::atomic<int> m_pendingConnections{0};
+    std::atomic<quint64> m_throttleCount{0};
+    std::atomic<quint64> m_throttledMs{0};
+    std::atomic<quint64> m_fullHandshakes{0};
+    std::atomic<quint64> m_resumedHandshakes{0};
+    std::atomic<quint64> m_fullHandshakeUs{0};
+    std::atomic<quint64> m_resumedHandshakeUs{0};
+};
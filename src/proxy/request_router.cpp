@@ -1,8 +1,21 @@
 #include "request_router.h"
 #include "core/log_manager.h"
+#include <QUrl>
+#include <algorithm>
+
+namespace {
+
+bool isParamNameChar(char c)
+{
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+           (c >= '0' && c <= '9') || c == '_';
+}
+
+}
 
 void RequestRouter::registerDefaults()
 {
+    m_nodes.assign(1, Node());
     m_routes.clear();
 
     // POST /v1/chat/completions -> openai inbound
@@ -17,13 +30,19 @@ void RequestRouter::registerDefaults()
     addRoute({QStringLiteral("/v1/responses"),
               QStringLiteral("openai.responses"), QString()});
 
-    // POST /gemini/v1beta/models/* -> gemini inbound (wildcard)
+    // POST /gemini/v1beta/models/{model}:{action} -> gemini inbound; the
+    // model and action ("generateContent", "streamGenerateContent") become
+    // route.model and route.action metadata
+    addRoute({QStringLiteral("/gemini/v1beta/models/{model}:{action}"),
+              QStringLiteral("gemini"), QString()});
+
+    // POST /gemini/v1beta/models/* -> gemini inbound (anything else under models/)
     addRoute({QStringLiteral("/gemini/v1beta/models/*"),
               QStringLiteral("gemini"), QString()});
 
     // GET /v1/models -> openai inbound
     addRoute({QStringLiteral("/v1/models"),
-              QStringLiteral("openai"), QString()});
+              QStringLiteral("openai"), QString(), QStringLiteral("GET")});
 
     // POST /v1/embeddings -> openai inbound
     addRoute({QStringLiteral("/v1/embeddings"),
@@ -41,52 +60,257 @@ void RequestRouter::registerDefaults()
                  .arg(m_routes.size()));
 }
 
-void RequestRouter::addRoute(const Route& route)
+bool RequestRouter::addRoute(const Route& route)
 {
-    InternalRoute entry;
-    entry.route = route;
+    const int method = route.method.trimmed() == QStringLiteral("*")
+                           ? int(AnyMethod)
+                           : methodSlot(route.method.trimmed().toLatin1());
+    const QByteArray pattern = route.pathPattern.trimmed().toUtf8();
+    if (method < 0 || !pattern.startsWith('/')) {
+        LOG_WARNING(QStringLiteral("RequestRouter: ignoring route %1 %2, unsupported method or path")
+                        .arg(route.method, route.pathPattern));
+        return false;
+    }
 
-    // Determine the HTTP method from well-known path patterns
-    // GET is only used for model listing; everything else is POST
-    if (route.pathPattern == QStringLiteral("/v1/models")) {
-        entry.method = QStringLiteral("GET");
-    } else {
-        entry.method = QStringLiteral("POST");
+    // Validate the whole pattern before creating any nodes
+    const QList<QByteArray> segments = pattern.mid(1).split('/');
+    QList<Template> templates(segments.size());
+    bool rest = false;
+    for (qsizetype i = 0; i < segments.size(); ++i) {
+        const QByteArray& segment = segments.at(i);
+        bool valid = true;
+        if (segment == "*") {
+            valid = i == segments.size() - 1;
+            rest = valid;
+        } else if (segment.contains('{') || segment.contains('}')) {
+            valid = parseTemplate(segment, templates[i]);
+        } else {
+            valid = !segment.contains('*');
+        }
+        if (!valid) {
+            LOG_WARNING(QStringLiteral("RequestRouter: ignoring route %1 %2, malformed segment \"%3\"")
+                            .arg(route.method, route.pathPattern, QString::fromUtf8(segment)));
+            return false;
+        }
     }
 
-    // Handle wildcard paths: "/some/prefix/*"
-    if (route.pathPattern.endsWith(QLatin1Char('*'))) {
-        entry.wildcard = true;
-        entry.pathPrefix = route.pathPattern.left(route.pathPattern.size() - 1);
+    int node = 0;
+    const qsizetype depth = rest ? segments.size() - 1 : segments.size();
+    for (qsizetype i = 0; i < depth; ++i) {
+        node = templates.at(i).names.isEmpty() ? childForLiteral(node, segments.at(i))
+                                               : childForTemplate(node, templates.at(i));
+    }
+
+    int& slot = rest ? m_nodes[node].restRoutes[method] : m_nodes[node].routes[method];
+    if (slot >= 0) {
+        m_routes[slot] = route;
     } else {
-        entry.wildcard = false;
-        entry.pathPrefix = route.pathPattern;
+        slot = int(m_routes.size());
+        m_routes.append(route);
     }
+    return true;
+}
 
-    m_routes.append(entry);
+std::optional<RouteMatch> RequestRouter::lookup(QByteArrayView method, QByteArrayView target) const
+{
+    // Only the path takes part in matching
+    const qsizetype queryStart = target.indexOf('?');
+    if (queryStart >= 0) {
+        target = target.first(queryStart);
+    }
+    const qsizetype fragmentStart = target.indexOf('#');
+    if (fragmentStart >= 0) {
+        target = target.first(fragmentStart);
+    }
+    if (!target.startsWith('/')) {
+        return std::nullopt;
+    }
+
+    Segments segments;
+    qsizetype start = 1;
+    for (;;) {
+        const qsizetype slash = target.indexOf('/', start);
+        if (slash < 0) {
+            segments.append(target.sliced(start));
+            break;
+        }
+        segments.append(target.sliced(start, slash - start));
+        start = slash + 1;
+    }
+
+    Captures captures;
+    const int index = find(0, segments, 0, methodSlot(method), captures);
+    if (index < 0) {
+        return std::nullopt;
+    }
+
+    RouteMatch result;
+    result.route = &m_routes.at(index);
+    result.params.reserve(captures.size());
+    for (const auto& [name, value] : captures) {
+        result.params.append({*name, QUrl::fromPercentEncoding(value.toByteArray())});
+    }
+    return result;
 }
 
 std::optional<Route> RequestRouter::match(const QString& method, const QString& path) const
 {
-    const QString normalizedMethod = method.trimmed().toUpper();
+    const auto found = lookup(method.trimmed().toLatin1(), path.toUtf8());
+    if (!found) {
+        return std::nullopt;
+    }
+    return *found->route;
+}
 
-    for (const InternalRoute& entry : m_routes) {
-        // Method check: entry.method must match, or "*" matches any method
-        if (entry.method != QStringLiteral("*") && entry.method != normalizedMethod) {
+int RequestRouter::methodSlot(QByteArrayView method)
+{
+    static constexpr std::pair<QByteArrayView, MethodSlot> kMethods[] = {
+        {"GET", Get}, {"POST", Post}, {"PUT", Put}, {"PATCH", Patch},
+        {"DELETE", Delete}, {"HEAD", Head}, {"OPTIONS", Options},
+    };
+    for (const auto& [name, slot] : kMethods) {
+        if (method.compare(name, Qt::CaseInsensitive) == 0) {
+            return slot;
+        }
+    }
+    return -1;
+}
+
+bool RequestRouter::parseTemplate(QByteArrayView segment, Template& out)
+{
+    QByteArray literal;
+    qsizetype i = 0;
+    while (i < segment.size()) {
+        const char c = segment.at(i);
+        if (c == '}' || c == '*') {
+            return false;
+        }
+        if (c != '{') {
+            literal.append(c);
+            ++i;
             continue;
         }
 
-        // Path check: wildcard routes use startsWith; exact routes require equality
-        if (entry.wildcard) {
-            if (path.startsWith(entry.pathPrefix)) {
-                return entry.route;
+        const qsizetype close = segment.indexOf('}', i + 1);
+        if (close < 0) {
+            return false;
+        }
+        const QByteArrayView name = segment.sliced(i + 1, close - i - 1);
+        if (name.isEmpty() || !std::all_of(name.begin(), name.end(), isParamNameChar)) {
+            return false;
+        }
+        // "{a}{b}" has no literal to tell where one value ends
+        if (!out.names.isEmpty() && literal.isEmpty()) {
+            return false;
+        }
+        out.literals.append(literal);
+        out.names.append(QString::fromLatin1(name));
+        literal.clear();
+        i = close + 1;
+    }
+    out.literals.append(literal);
+    return !out.names.isEmpty();
+}
+
+bool RequestRouter::matchTemplate(const Template& tmpl, QByteArrayView segment,
+                                  Captures& captures)
+{
+    if (!segment.startsWith(tmpl.literals.first()) || !segment.endsWith(tmpl.literals.last())) {
+        return false;
+    }
+
+    qsizetype pos = tmpl.literals.first().size();
+    const qsizetype end = segment.size() - tmpl.literals.last().size();
+    for (qsizetype i = 0; i < tmpl.names.size(); ++i) {
+        qsizetype valueEnd = end;
+        if (i + 1 < tmpl.names.size()) {
+            // A value ends at the first occurrence of the literal after it
+            valueEnd = segment.first(end).indexOf(tmpl.literals.at(i + 1), pos);
+            if (valueEnd < 0) {
+                return false;
             }
-        } else {
-            if (path == entry.pathPrefix) {
-                return entry.route;
+        }
+        if (valueEnd <= pos) {
+            return false;
+        }
+        captures.append({&tmpl.names.at(i), segment.sliced(pos, valueEnd - pos)});
+        pos = valueEnd + (i + 1 < tmpl.names.size() ? tmpl.literals.at(i + 1).size() : 0);
+    }
+    return true;
+}
+
+int RequestRouter::routeFor(const RouteSlots& slots, int method)
+{
+    if (method >= 0 && slots[method] >= 0) {
+        return slots[method];
+    }
+    return slots[AnyMethod];
+}
+
+int RequestRouter::childForLiteral(int node, const QByteArray& segment)
+{
+    auto& literals = m_nodes[node].literals;
+    auto it = std::lower_bound(literals.begin(), literals.end(), segment,
+                               [](const auto& entry, const QByteArray& key) {
+                                   return entry.first < key;
+                               });
+    if (it != literals.end() && it->first == segment) {
+        return it->second;
+    }
+
+    const int child = int(m_nodes.size());
+    literals.insert(it, {segment, child});
+    m_nodes.emplace_back();
+    return child;
+}
+
+int RequestRouter::childForTemplate(int node, const Template& tmpl)
+{
+    for (const Template& existing : m_nodes[node].templates) {
+        if (existing.sameShape(tmpl)) {
+            return existing.node;
+        }
+    }
+
+    const int child = int(m_nodes.size());
+    Template entry = tmpl;
+    entry.node = child;
+    m_nodes[node].templates.append(entry);
+    m_nodes.emplace_back();
+    return child;
+}
+
+int RequestRouter::find(int node, const Segments& segments, qsizetype depth, int method,
+                        Captures& captures) const
+{
+    const Node& current = m_nodes[node];
+    if (depth == segments.size()) {
+        return routeFor(current.routes, method);
+    }
+
+    const QByteArrayView segment = segments.at(depth);
+    const auto it = std::lower_bound(current.literals.begin(), current.literals.end(), segment,
+                                     [](const auto& entry, QByteArrayView key) {
+                                         return QByteArrayView(entry.first) < key;
+                                     });
+    if (it != current.literals.end() && QByteArrayView(it->first) == segment) {
+        const int found = find(it->second, segments, depth + 1, method, captures);
+        if (found >= 0) {
+            return found;
+        }
+    }
+
+    for (const Template& tmpl : current.templates) {
+        const qsizetype mark = captures.size();
+        if (matchTemplate(tmpl, segment, captures)) {
+            const int found = find(tmpl.node, segments, depth + 1, method, captures);
+            if (found >= 0) {
+                return found;
             }
         }
+        captures.resize(mark);
     }
 
-    return std::nullopt;
+    // "*" takes the remaining segments (at least one, possibly empty)
+    return routeFor(current.restRoutes, method);
 }
@@ -1,26 +1,91 @@
 #pragma once
-#include <QString>
+#include <QByteArray>
+#include <QByteArrayView>
 #include <QList>
+#include <QString>
+#include <QVarLengthArray>
+#include <array>
 #include <optional>
+#include <utility>
+#include <vector>
 
 struct Route {
     QString pathPattern;
     QString inboundProtocol;
     QString provider;
+    QString method = QStringLiteral("POST");  // "*" matches any method
+    QString group;                            // config group name (empty = current group)
+};
+
+// A matched route and the path parameters it captured, in pattern order.
+// `route` stays valid until the next addRoute().
+struct RouteMatch {
+    const Route* route = nullptr;
+    QList<std::pair<QString, QString>> params;
 };
 
+// Routes are compiled into a trie over path segments when they are added.
+// A pattern segment is a literal ("models"), a template with parameters
+// ("{model}", "{model}:{action}", "v{version}"), or a final "*" matching any
+// remainder, including none after a trailing slash. At each segment literal
+// children are tried first, then templates, then "*", backtracking when a
+// branch has no route for the method. The query string is not matched.
 class RequestRouter {
 public:
     void registerDefaults();
-    void addRoute(const Route& route);
+    // Adds the route, replacing one with the same method and pattern.
+    // Returns false (and adds nothing) for a malformed pattern or method.
+    bool addRoute(const Route& route);
+
+    std::optional<RouteMatch> lookup(QByteArrayView method, QByteArrayView target) const;
+    // Route definition only, for callers that do not need the parameters
     std::optional<Route> match(const QString& method, const QString& path) const;
 
+    qsizetype routeCount() const { return m_routes.size(); }
+
 private:
-    struct InternalRoute {
-        QString method = QStringLiteral("POST"); // HTTP method ("POST", "GET", or "*" for any)
-        QString pathPrefix;  // URL path prefix for matching
-        bool wildcard = false; // true if pathPattern ends with "*"
-        Route route;
+    enum MethodSlot { Get, Post, Put, Patch, Delete, Head, Options, AnyMethod, MethodSlotCount };
+    using RouteSlots = std::array<int, MethodSlotCount>;  // index into m_routes, -1 if none
+
+    // Parameters and literals of one template segment. literals[i] precedes
+    // names[i]; the last literal follows the last name.
+    struct Template {
+        QList<QByteArray> literals;
+        QList<QString> names;
+        int node = -1;
+
+        bool sameShape(const Template& other) const
+        {
+            return literals == other.literals && names == other.names;
+        }
     };
-    QList<InternalRoute> m_routes;
+
+    struct Node {
+        std::vector<std::pair<QByteArray, int>> literals;  // sorted by segment
+        QList<Template> templates;
+        RouteSlots routes;      // the pattern ends at this node
+        RouteSlots restRoutes;  // "*" after this node
+
+        Node()
+        {
+            routes.fill(-1);
+            restRoutes.fill(-1);
+        }
+    };
+
+    using Segments = QVarLengthArray<QByteArrayView, 16>;
+    using Captures = QVarLengthArray<std::pair<const QString*, QByteArrayView>, 4>;
+
+    static int methodSlot(QByteArrayView method);
+    static bool parseTemplate(QByteArrayView segment, Template& out);
+    static bool matchTemplate(const Template& tmpl, QByteArrayView segment, Captures& captures);
+    static int routeFor(const RouteSlots& slots, int method);
+
+    int childForLiteral(int node, const QByteArray& segment);
+    int childForTemplate(int node, const Template& tmpl);
+    int find(int node, const Segments& segments, qsizetype depth, int method,
+             Captures& captures) const;
+
+    std::vector<Node> m_nodes{Node()};  // m_nodes[0] is the root
+    QList<Route> m_routes;
 };
@@ -1,85 +1,143 @@
 #include "sse_writer.h"
 #include "core/log_manager.h"
+#include <QAbstractSocket>
 
-void SseWriter::writeStreamHeader(QSslSocket* socket)
+namespace {
+
+// A coalesced buffer this large fills a TLS record; waiting longer would
+// only delay bytes without saving records.
+constexpr qsizetype kMaxRecordPayload = 16 * 1024;
+
+bool isSseFormatted(QByteArrayView data)
 {
-    if (!socket || socket->state() != QAbstractSocket::ConnectedState) {
-        LOG_WARNING(QStringLiteral("SseWriter: cannot write stream header, socket not connected"));
-        return;
+    return data.startsWith("event:") ||
+           data.startsWith("data:") ||
+           data.startsWith("id:") ||
+           data.startsWith("retry:") ||
+           data.startsWith(":");
+}
+
+void appendHex(QByteArray& out, qsizetype value)
+{
+    char digits[2 * sizeof(qsizetype)];
+    int count = 0;
+    do {
+        digits[count++] = "0123456789abcdef"[value & 0xf];
+        value >>= 4;
+    } while (value != 0);
+    while (count > 0)
+        out.append(digits[--count]);
+}
+
+}
+
+SseWriter::SseWriter(QIODevice* socket, SseWriteMode mode, int coalesceMs,
+                     QObject* parent)
+    : QObject(parent)
+    , m_socket(socket)
+    , m_mode(mode)
+{
+    m_coalesceTimer.setSingleShot(true);
+    m_coalesceTimer.setTimerType(Qt::PreciseTimer);
+    m_coalesceTimer.setInterval(qBound(kMinCoalesceMs, coalesceMs, kMaxCoalesceMs));
+    connect(&m_coalesceTimer, &QTimer::timeout, this, &SseWriter::flush);
+
+    if (auto* tcp = qobject_cast<QAbstractSocket*>(socket)) {
+        tcp->setSocketOption(QAbstractSocket::LowDelayOption, 1);
     }
+}
 
-    const QByteArray header =
+void SseWriter::writeStreamHeader()
+{
+    m_buffer.append(
         "HTTP/1.1 200 OK\r\n"
         "Content-Type: text/event-stream\r\n"
         "Cache-Control: no-cache\r\n"
         "Connection: keep-alive\r\n"
         "Transfer-Encoding: chunked\r\n"
-        "\r\n";
-
-    socket->write(header);
-    socket->flush();
+        "\r\n");
+    // The client should see the response start without waiting for a token
+    flush();
 }
 
-QByteArray SseWriter::wrapChunked(const QByteArray& data)
+void SseWriter::appendChunk(QByteArrayView sseData)
 {
     // HTTP/1.1 chunked transfer encoding:
     //   <hex-length>\r\n
     //   <data>\r\n
-    QByteArray chunk;
-    chunk.append(QByteArray::number(data.size(), 16));
-    chunk.append("\r\n");
-    chunk.append(data);
-    chunk.append("\r\n");
-    return chunk;
+    const bool framed = isSseFormatted(sseData);
+    const qsizetype length = framed ? sseData.size() : sseData.size() + 8;
+
+    m_buffer.reserve(m_buffer.size() + length + 20);
+    appendHex(m_buffer, length);
+    m_buffer.append("\r\n");
+    if (!framed)
+        m_buffer.append("data: ");
+    m_buffer.append(sseData);
+    if (!framed)
+        m_buffer.append("\n\n");
+    m_buffer.append("\r\n");
 }
 
-void SseWriter::sendChunk(QSslSocket* socket, const QByteArray& sseData)
+void SseWriter::sendEvent(QByteArrayView sseData)
 {
-    if (!socket || socket->state() != QAbstractSocket::ConnectedState) {
-        LOG_WARNING(QStringLiteral("SseWriter: cannot send chunk, socket not connected"));
-        return;
-    }
+    appendChunk(sseData);
+    ++m_eventCount;
 
-    QByteArray sseFrame;
-    const bool alreadySse =
-        sseData.startsWith("event:") ||
-        sseData.startsWith("data:") ||
-        sseData.startsWith("id:") ||
-        sseData.startsWith("retry:") ||
-        sseData.startsWith(":");
-
-    if (alreadySse) {
-        sseFrame = sseData;
-    } else {
-        sseFrame.append("data: ");
-        sseFrame.append(sseData);
-        sseFrame.append("\n\n");
+    if (m_mode == SseWriteMode::Latency || m_buffer.size() >= kMaxRecordPayload) {
+        flush();
+    } else if (!m_coalesceTimer.isActive()) {
+        m_coalesceTimer.start();
     }
+}
 
-    socket->write(wrapChunked(sseFrame));
-    socket->flush();
+void SseWriter::finish()
+{
+    appendChunk(QByteArrayView("data: [DONE]\n\n"));
+    // The zero-length chunk signals end of chunked transfer
+    m_buffer.append("0\r\n\r\n");
+    flush();
 }
 
-void SseWriter::sendDone(QSslSocket* socket)
+void SseWriter::flush()
 {
-    if (!socket || socket->state() != QAbstractSocket::ConnectedState) {
-        LOG_WARNING(QStringLiteral("SseWriter: cannot send done, socket not connected"));
+    m_coalesceTimer.stop();
+    if (m_buffer.isEmpty()) {
+        return;
+    }
+
+    auto* tcp = qobject_cast<QAbstractSocket*>(m_socket.data());
+    if (!m_socket || (tcp && tcp->state() != QAbstractSocket::ConnectedState)) {
+        LOG_WARNING(QStringLiteral("SseWriter: dropping %1 bytes, socket not connected")
+                        .arg(m_buffer.size()));
+        m_buffer.clear();
         return;
     }
 
-    QByteArray sseFrame = "data: [DONE]\n\n";
-    socket->write(wrapChunked(sseFrame));
-    socket->flush();
+    m_socket->write(m_buffer);
+    m_buffer.clear();
+    ++m_writeCount;
+    if (tcp) {
+        // QSslSocket encrypts on flush, so this write becomes one record now
+        tcp->flush();
+    }
 }
 
-void SseWriter::sendTerminator(QSslSocket* socket)
+QByteArray SseWriter::formatEvent(const QByteArray& sseData)
 {
-    if (!socket || socket->state() != QAbstractSocket::ConnectedState) {
-        LOG_WARNING(QStringLiteral("SseWriter: cannot send terminator, socket not connected"));
-        return;
+    if (isSseFormatted(sseData)) {
+        return sseData;
     }
 
-    // The zero-length chunk signals end of chunked transfer
-    socket->write("0\r\n\r\n");
-    socket->flush();
+    QByteArray sseFrame;
+    sseFrame.reserve(sseData.size() + 8);
+    sseFrame.append("data: ");
+    sseFrame.append(sseData);
+    sseFrame.append("\n\n");
+    return sseFrame;
+}
+
+QByteArray SseWriter::doneEvent()
+{
+    return QByteArrayLiteral("data: [DONE]\n\n");
 }
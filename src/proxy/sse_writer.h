@@ -1,14 +1,56 @@
 #pragma once
-#include <QSslSocket>
+#include "config/config_types.h"
 #include <QByteArray>
+#include <QByteArrayView>
+#include <QIODevice>
+#include <QObject>
+#include <QPointer>
+#include <QTimer>
 
-class SseWriter {
+// Writes streamed (text/event-stream) HTTP/1.1 responses to one client
+// connection. Chunk framing is built in place in a per-connection output
+// buffer, and the buffer reaches the socket according to the write mode:
+//
+//  - Latency: every event is written and flushed as soon as it arrives.
+//  - Throughput: events arriving within the coalescing window share one
+//    write, and so one TLS record, instead of one record per token.
+//
+// Nagle is disabled in both modes; in throughput mode the window bounds the
+// added delay, where Nagle would wait for the peer's (delayed) ACK.
+class SseWriter : public QObject {
+    Q_OBJECT
 public:
-    static void writeStreamHeader(QSslSocket* socket);
-    static void sendChunk(QSslSocket* socket, const QByteArray& sseData);
-    static void sendDone(QSslSocket* socket);
-    static void sendTerminator(QSslSocket* socket);
+    static constexpr int kMinCoalesceMs = 5;
+    static constexpr int kMaxCoalesceMs = 20;
+
+    SseWriter(QIODevice* socket, SseWriteMode mode, int coalesceMs,
+              QObject* parent = nullptr);
+
+    void writeStreamHeader();
+    void sendEvent(QByteArrayView sseData);
+    // [DONE], the terminating zero-length chunk and any coalesced events go
+    // out in a single write; nothing stays buffered after this returns.
+    void finish();
+    void flush();
+
+    SseWriteMode mode() const { return m_mode; }
+    qint64 bufferedBytes() const { return m_buffer.size(); }
+    // Writes handed to the socket (each one becomes a TLS record) and events
+    // sent, since construction
+    qint64 writeCount() const { return m_writeCount; }
+    qint64 eventCount() const { return m_eventCount; }
+
+    // SSE event bytes without transport framing (used for HTTP/2 DATA)
+    static QByteArray formatEvent(const QByteArray& sseData);
+    static QByteArray doneEvent();
 
 private:
-    static QByteArray wrapChunked(const QByteArray& data);
+    void appendChunk(QByteArrayView sseData);
+
+    QPointer<QIODevice> m_socket;
+    SseWriteMode m_mode;
+    QByteArray m_buffer;
+    QTimer m_coalesceTimer;
+    qint64 m_writeCount = 0;
+    qint64 m_eventCount = 0;
 };
@@ -0,0 +1,55 @@
+#include "tls_session_cache.h"
+#include <QSslSocket>
+
+#ifdef SHANGHAOQI_TLS_SESSION_SHARING
+// Qt has no public API for sharing a server-side TLS context; this is the
+// same hook QHttpNetworkConnection uses to share sessions between channels.
+#include <QtNetwork/private/qsslsocket_p.h>
+#endif
+
+TlsSessionCache::TlsSessionCache(int lifetimeSeconds)
+    : m_lifetimeMs(isSupported() ? qint64(qMax(0, lifetimeSeconds)) * 1000 : 0)
+{
+}
+
+TlsSessionCache::~TlsSessionCache() = default;
+
+bool TlsSessionCache::isSupported()
+{
+#ifdef SHANGHAOQI_TLS_SESSION_SHARING
+    // The shared context is an OpenSSL SSL_CTX
+    return QSslSocket::activeBackend() == QStringLiteral("openssl");
+#else
+    return false;
+#endif
+}
+
+void TlsSessionCache::prepare(QSslSocket* socket)
+{
+#ifdef SHANGHAOQI_TLS_SESSION_SHARING
+    if (!m_context) {
+        return;
+    }
+    if (m_contextAge.hasExpired(m_lifetimeMs)) {
+        // The next completed handshake brings a new context and ticket key
+        m_context.reset();
+        return;
+    }
+    QSslSocketPrivate::checkSettingSslContext(socket, m_context);
+#else
+    Q_UNUSED(socket);
+#endif
+}
+
+void TlsSessionCache::handshakeCompleted(QSslSocket* socket)
+{
+#ifdef SHANGHAOQI_TLS_SESSION_SHARING
+    if (!isEnabled() || m_context) {
+        return;
+    }
+    m_context = QSslSocketPrivate::sslContext(socket);
+    m_contextAge.start();
+#else
+    Q_UNUSED(socket);
+#endif
+}
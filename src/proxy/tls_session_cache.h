@@ -0,0 +1,40 @@
+#pragma once
+#include <QElapsedTimer>
+#include <memory>
+
+class QSslContext;
+class QSslSocket;
+
+// Lets the TLS connections of one worker resume each other's sessions.
+//
+// Qt builds a fresh OpenSSL context for every server socket, and with it a
+// fresh session cache and ticket key, so a client reconnecting with a session
+// ID or ticket always got a full handshake. Here the context of the first
+// completed handshake is handed to the worker's following sockets, and
+// OpenSSL resumes sessions from that shared context. The context is replaced
+// once it is older than the configured lifetime, which also rotates the
+// ticket key and drops every session issued from it.
+//
+// Contexts are not shared between workers: Qt mutates a context while
+// creating connections from it, so one context must stay on one thread.
+class TlsSessionCache {
+public:
+    // lifetimeSeconds <= 0 disables sharing
+    explicit TlsSessionCache(int lifetimeSeconds);
+    ~TlsSessionCache();
+
+    // True when this build and the active TLS backend can share contexts
+    static bool isSupported();
+
+    // Call after setSslConfiguration() and before startServerEncryption()
+    void prepare(QSslSocket* socket);
+    // Call from the socket's encrypted() signal
+    void handshakeCompleted(QSslSocket* socket);
+
+    bool isEnabled() const { return m_lifetimeMs > 0; }
+
+private:
+    qint64 m_lifetimeMs;
+    std::shared_ptr<QSslContext> m_context;
+    QElapsedTimer m_contextAge;
+};
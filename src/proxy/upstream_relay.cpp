@@ -0,0 +1,362 @@
+#include "upstream_relay.h"
+#include "dns_resolver.h"
+#include "core/log_manager.h"
+#include "core/metrics.h"
+#include <QElapsedTimer>
+#include <QPointer>
+#include <QRandomGenerator>
+#include <QTcpSocket>
+#include <QTimer>
+#include <QtEndian>
+#include <functional>
+#include <initializer_list>
+
+namespace {
+
+constexpr char kSocksVersion = 0x05;
+constexpr char kAuthVersion = 0x01;
+constexpr char kMethodPassword = 0x02;
+constexpr char kMethodNone = char(0xff);
+constexpr char kCommandConnect = 0x01;
+constexpr char kAddressIPv4 = 0x01;
+constexpr char kAddressDomain = 0x03;
+constexpr char kAddressIPv6 = 0x04;
+constexpr quint8 kReplySucceeded = 0x00;
+constexpr quint8 kReplyHostUnreachable = 0x04;
+constexpr quint8 kReplyCommandNotSupported = 0x07;
+constexpr quint8 kReplyAddressNotSupported = 0x08;
+
+QByteArray bytes(std::initializer_list<char> values)
+{
+    return QByteArray(values.begin(), qsizetype(values.size()));
+}
+
+QByteArray randomToken()
+{
+    QByteArray token(16, Qt::Uninitialized);
+    QRandomGenerator::system()->fillRange(reinterpret_cast<quint32*>(token.data()), 4);
+    return token.toHex();
+}
+
+// Connects to the first of the addresses that accepts. A new attempt starts
+// every kAttemptDelayMs, or at once when one fails, without cancelling the
+// ones still in progress.
+class ConnectionRace : public QObject {
+public:
+    // The socket is null when every attempt failed or the deadline passed
+    using Done = std::function<void(QTcpSocket* socket, const QHostAddress& address)>;
+
+    ConnectionRace(QList<QHostAddress> addresses, quint16 port, int timeoutMs, Done done,
+                   QObject* parent)
+        : QObject(parent)
+        , m_addresses(std::move(addresses))
+        , m_port(port)
+        , m_done(std::move(done))
+    {
+        m_delay.setSingleShot(true);
+        connect(&m_delay, &QTimer::timeout, this, &ConnectionRace::startNext);
+        m_deadline.setSingleShot(true);
+        connect(&m_deadline, &QTimer::timeout, this, [this]() { settle(nullptr, {}); });
+        m_deadline.start(timeoutMs);
+    }
+
+    void startNext()
+    {
+        if (m_settled || m_next >= m_addresses.size())
+            return;
+        const QHostAddress address = m_addresses[m_next++];
+        auto* socket = new QTcpSocket(this);
+        ++m_pending;
+        connect(socket, &QTcpSocket::connected, this, [this, socket, address]() {
+            settle(socket, address);
+        });
+        connect(socket, &QTcpSocket::errorOccurred, this, [this, socket]() {
+            socket->disconnect(this);
+            socket->deleteLater();
+            --m_pending;
+            if (m_next < m_addresses.size())
+                startNext();
+            else if (m_pending == 0)
+                settle(nullptr, {});
+        });
+        m_delay.start(UpstreamRelay::kAttemptDelayMs);
+        socket->connectToHost(address, m_port);
+    }
+
+private:
+    void settle(QTcpSocket* winner, const QHostAddress& address)
+    {
+        if (m_settled)
+            return;
+        m_settled = true;
+        m_delay.stop();
+        m_deadline.stop();
+        for (QTcpSocket* attempt : findChildren<QTcpSocket*>(Qt::FindDirectChildrenOnly)) {
+            if (attempt == winner)
+                continue;
+            attempt->disconnect(this);
+            attempt->abort();
+        }
+        if (winner) {
+            winner->disconnect(this);
+            winner->setParent(nullptr);
+        }
+        deleteLater();
+        m_done(winner, address);
+    }
+
+    QList<QHostAddress> m_addresses;
+    quint16 m_port;
+    Done m_done;
+    QTimer m_delay;
+    QTimer m_deadline;
+    qsizetype m_next = 0;
+    int m_pending = 0;
+    bool m_settled = false;
+};
+
+// Moves what `from` has read to `to`, as far as `to` has room; the read
+// buffer limit then holds back the sender
+void pump(QTcpSocket* from, QTcpSocket* to)
+{
+    const qint64 room = UpstreamRelay::kBufferBytes - to->bytesToWrite();
+    if (room > 0 && from->bytesAvailable() > 0)
+        to->write(from->read(room));
+}
+
+}
+
+struct UpstreamRelay::Client {
+    enum class Stage { Greeting, Auth, Request, Connecting, Relaying };
+
+    QPointer<QTcpSocket> socket;
+    Stage stage = Stage::Greeting;
+    QByteArray buffer;
+    QString host;
+    quint16 port = 0;
+    QElapsedTimer timer;
+    qint64 resolveUs = 0;
+    bool fromCache = false;
+};
+
+UpstreamRelay::UpstreamRelay(DnsResolver& resolver, int connectTimeoutMs, QObject* parent)
+    : QObject(parent)
+    , m_resolver(resolver)
+    , m_connectTimeoutMs(connectTimeoutMs)
+    , m_user(randomToken())
+    , m_password(randomToken())
+{
+    connect(&m_server, &QTcpServer::newConnection, this, &UpstreamRelay::onNewConnection);
+}
+
+UpstreamRelay::~UpstreamRelay() = default;
+
+bool UpstreamRelay::listen()
+{
+    if (!m_server.listen(QHostAddress::LocalHost, 0)) {
+        LOG_ERROR(QStringLiteral("UpstreamRelay: failed to listen - %1").arg(m_server.errorString()));
+        return false;
+    }
+    return true;
+}
+
+QNetworkProxy UpstreamRelay::proxy() const
+{
+    return QNetworkProxy(QNetworkProxy::Socks5Proxy,
+                         QHostAddress(QHostAddress::LocalHost).toString(), port(),
+                         QString::fromLatin1(m_user), QString::fromLatin1(m_password));
+}
+
+void UpstreamRelay::onNewConnection()
+{
+    while (m_server.hasPendingConnections()) {
+        QTcpSocket* socket = m_server.nextPendingConnection();
+        auto client = std::make_shared<Client>();
+        client->socket = socket;
+        client->timer.start();
+        connect(socket, &QTcpSocket::readyRead, socket, [this, client]() {
+            onClientData(client);
+        });
+        connect(socket, &QTcpSocket::disconnected, socket, &QObject::deleteLater);
+    }
+}
+
+void UpstreamRelay::onClientData(const ClientPtr& client)
+{
+    if (client->stage == Client::Stage::Connecting || client->stage == Client::Stage::Relaying)
+        return;
+    QTcpSocket* socket = client->socket;
+    QByteArray& buffer = client->buffer;
+    buffer += socket->readAll();
+    const auto byte = [&buffer](qsizetype i) { return quint8(buffer.at(i)); };
+
+    if (client->stage == Client::Stage::Greeting) {
+        if (buffer.size() < 2 || buffer.size() < 2 + byte(1))
+            return;
+        const bool offered = buffer[0] == kSocksVersion
+                             && buffer.mid(2, byte(1)).contains(kMethodPassword);
+        buffer.remove(0, 2 + byte(1));
+        socket->write(bytes({kSocksVersion, offered ? kMethodPassword : kMethodNone}));
+        if (!offered) {
+            socket->disconnectFromHost();
+            return;
+        }
+        client->stage = Client::Stage::Auth;
+    }
+
+    if (client->stage == Client::Stage::Auth) {
+        if (buffer.size() < 2)
+            return;
+        const qsizetype userLength = byte(1);
+        if (buffer.size() < 3 + userLength || buffer.size() < 3 + userLength + byte(2 + userLength))
+            return;
+        const qsizetype passwordLength = byte(2 + userLength);
+        const bool accepted = buffer[0] == kAuthVersion
+                              && buffer.mid(2, userLength) == m_user
+                              && buffer.mid(3 + userLength, passwordLength) == m_password;
+        buffer.remove(0, 3 + userLength + passwordLength);
+        socket->write(bytes({kAuthVersion, accepted ? char(0) : char(1)}));
+        if (!accepted) {
+            LOG_WARNING(QStringLiteral("UpstreamRelay: rejected a client with wrong credentials"));
+            socket->disconnectFromHost();
+            return;
+        }
+        client->stage = Client::Stage::Request;
+    }
+
+    if (client->stage == Client::Stage::Request) {
+        if (buffer.size() < 5)
+            return;
+        qsizetype addressEnd = 0;
+        switch (buffer[3]) {
+        case kAddressIPv4: addressEnd = 4 + 4; break;
+        case kAddressIPv6: addressEnd = 4 + 16; break;
+        case kAddressDomain: addressEnd = 5 + byte(4); break;
+        default:
+            fail(client, kReplyAddressNotSupported);
+            return;
+        }
+        if (buffer.size() < addressEnd + 2)
+            return;
+        if (buffer[0] != kSocksVersion || buffer[1] != kCommandConnect) {
+            fail(client, kReplyCommandNotSupported);
+            return;
+        }
+
+        if (buffer[3] == kAddressIPv4) {
+            client->host = QHostAddress(qFromBigEndian<quint32>(buffer.constData() + 4)).toString();
+        } else if (buffer[3] == kAddressIPv6) {
+            client->host = QHostAddress(reinterpret_cast<const quint8*>(buffer.constData() + 4)).toString();
+        } else {
+            client->host = QString::fromLatin1(buffer.mid(5, byte(4)));
+        }
+        client->port = qFromBigEndian<quint16>(buffer.constData() + addressEnd);
+        buffer.remove(0, addressEnd + 2);
+        client->stage = Client::Stage::Connecting;
+        connectUpstream(client);
+    }
+}
+
+void UpstreamRelay::connectUpstream(const ClientPtr& client)
+{
+    m_resolver.resolve(client->host, [this, client](const DnsResolver::Resolution& resolution) {
+        if (!client->socket || client->socket->state() != QAbstractSocket::ConnectedState)
+            return;
+        if (!resolution.error.isEmpty()) {
+            metrics::registry().upstreamDnsFailures.add();
+            LOG_WARNING(QStringLiteral("UpstreamRelay: %1").arg(resolution.error));
+            fail(client, kReplyHostUnreachable);
+            return;
+        }
+        client->resolveUs = resolution.elapsedUs;
+        client->fromCache = resolution.fromCache;
+        metrics::registry().upstreamDnsSeconds.observe(double(resolution.elapsedUs) / 1e6);
+
+        client->timer.restart();
+        auto* race = new ConnectionRace(resolution.addresses, client->port, m_connectTimeoutMs,
+                                        [this, client](QTcpSocket* upstream, const QHostAddress& address) {
+            if (!upstream) {
+                LOG_WARNING(QStringLiteral("UpstreamRelay: could not connect to %1:%2")
+                                .arg(client->host)
+                                .arg(client->port));
+                fail(client, kReplyHostUnreachable);
+                return;
+            }
+            startRelaying(client, upstream, address);
+        }, client->socket);
+        race->startNext();
+    });
+}
+
+void UpstreamRelay::startRelaying(const ClientPtr& client, QTcpSocket* upstream,
+                                  const QHostAddress& address)
+{
+    QTcpSocket* socket = client->socket;
+    if (!socket || socket->state() != QAbstractSocket::ConnectedState) {
+        upstream->abort();
+        upstream->deleteLater();
+        return;
+    }
+    upstream->setParent(this);
+
+    const qint64 connectUs = client->timer.nsecsElapsed() / 1000;
+    metrics::registry().upstreamConnectSeconds.observe(double(connectUs) / 1e6);
+    LOG_DEBUG(QStringLiteral("UpstreamRelay: %1:%2 at %3, resolved in %4 ms%5, connected in %6 ms")
+                  .arg(client->host)
+                  .arg(client->port)
+                  .arg(address.toString())
+                  .arg(double(client->resolveUs) / 1000, 0, 'f', 1)
+                  .arg(client->fromCache ? QStringLiteral(" (cached)") : QString())
+                  .arg(double(connectUs) / 1000, 0, 'f', 1));
+
+    client->stage = Client::Stage::Relaying;
+    // Succeeded; the bound address is not used by clients
+    socket->write(bytes({kSocksVersion, char(kReplySucceeded), 0, kAddressIPv4,
+                         0, 0, 0, 0, 0, 0}));
+    if (!client->buffer.isEmpty()) {
+        upstream->write(client->buffer);
+        client->buffer.clear();
+    }
+
+    socket->setReadBufferSize(kBufferBytes);
+    upstream->setReadBufferSize(kBufferBytes);
+    connect(socket, &QTcpSocket::readyRead, upstream, [socket, upstream]() { pump(socket, upstream); });
+    connect(upstream, &QTcpSocket::bytesWritten, socket, [socket, upstream]() { pump(socket, upstream); });
+    connect(upstream, &QTcpSocket::readyRead, socket, [socket, upstream]() { pump(upstream, socket); });
+    connect(socket, &QTcpSocket::bytesWritten, upstream, [socket, upstream]() { pump(upstream, socket); });
+
+    // Either side closing closes the other once what it sent is written
+    const auto closeWith = [](QTcpSocket* closed, QTcpSocket* other) {
+        if (other->state() == QAbstractSocket::ConnectedState) {
+            other->write(closed->readAll());
+            other->disconnectFromHost();
+        }
+    };
+    connect(socket, &QTcpSocket::disconnected, upstream, [closeWith, socket, upstream]() {
+        closeWith(socket, upstream);
+    });
+    connect(upstream, &QTcpSocket::disconnected, socket, [closeWith, socket, upstream]() {
+        closeWith(upstream, socket);
+    });
+    connect(upstream, &QTcpSocket::disconnected, upstream, &QObject::deleteLater);
+    // A reset or timeout may leave the socket closed without disconnected().
+    // The client socket deletes itself once it disconnects, so it may be gone
+    connect(upstream, &QTcpSocket::errorOccurred, upstream,
+            [client = QPointer<QTcpSocket>(socket), upstream](QAbstractSocket::SocketError error) {
+        if (error == QAbstractSocket::RemoteHostClosedError)
+            return;
+        if (client)
+            client->disconnectFromHost();
+        upstream->deleteLater();
+    });
+    pump(socket, upstream);
+}
+
+void UpstreamRelay::fail(const ClientPtr& client, quint8 reply)
+{
+    if (!client->socket)
+        return;
+    client->socket->write(bytes({kSocksVersion, char(reply), 0, kAddressIPv4,
+                                 0, 0, 0, 0, 0, 0}));
+    client->socket->disconnectFromHost();
+}
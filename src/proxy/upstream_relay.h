@@ -0,0 +1,54 @@
+#pragma once
+#include <QByteArray>
+#include <QHostAddress>
+#include <QNetworkProxy>
+#include <QObject>
+#include <QTcpServer>
+#include <memory>
+
+class DnsResolver;
+class QTcpSocket;
+
+// A SOCKS5 endpoint on 127.0.0.1 through which a worker's upstream network
+// managers open their connections, so that DnsResolver decides where they
+// go.
+//
+// QNetworkAccessManager resolves host names itself with no way to plug in
+// a resolver; pointing it at a SOCKS5 proxy makes it hand the host name
+// over instead. The relay resolves it, races the addresses with Happy
+// Eyeballs (RFC 8305: IPv6 and IPv4 alternating, a new attempt every
+// kAttemptDelayMs or as soon as one fails, the first to connect wins) and
+// then copies bytes both ways. TLS, ALPN and HTTP/2 stay end to end between
+// Qt and the upstream.
+//
+// Clients authenticate with credentials generated per relay, so other local
+// processes cannot use it as an open proxy.
+class UpstreamRelay : public QObject {
+public:
+    static constexpr int kAttemptDelayMs = 250;
+    static constexpr qint64 kBufferBytes = 256 * 1024;  // per direction
+
+    UpstreamRelay(DnsResolver& resolver, int connectTimeoutMs, QObject* parent = nullptr);
+    ~UpstreamRelay() override;
+
+    bool listen();
+    quint16 port() const { return m_server.serverPort(); }
+    // Proxy for the network managers, with the relay's credentials
+    QNetworkProxy proxy() const;
+
+private:
+    struct Client;
+    using ClientPtr = std::shared_ptr<Client>;
+
+    void onNewConnection();
+    void onClientData(const ClientPtr& client);
+    void connectUpstream(const ClientPtr& client);
+    void startRelaying(const ClientPtr& client, QTcpSocket* upstream, const QHostAddress& address);
+    void fail(const ClientPtr& client, quint8 reply);
+
+    DnsResolver& m_resolver;
+    int m_connectTimeoutMs;
+    QTcpServer m_server;
+    QByteArray m_user;
+    QByteArray m_password;
+};
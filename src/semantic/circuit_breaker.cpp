@@ -0,0 +1,152 @@
+#include "circuit_breaker.h"
+#include "core/log_manager.h"
+#include "core/metrics.h"
+#include <QMutexLocker>
+
+CircuitBreaker::CircuitBreaker()
+{
+    m_clock.start();
+}
+
+void CircuitBreaker::setThresholds(int failureThreshold, int openMs)
+{
+    QMutexLocker locker(&m_mutex);
+    m_failureThreshold = qMax(0, failureThreshold);
+    m_openMs = qMax(1, openMs);
+    if (m_failureThreshold > 0)
+        return;
+    for (auto it = m_entries.begin(); it != m_entries.end(); ++it) {
+        if (it->state != State::Closed)
+            transition(it.key(), *it, State::Closed, QStringLiteral("circuit breaker turned off"));
+    }
+}
+
+bool CircuitBreaker::enabled() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_failureThreshold > 0;
+}
+
+bool CircuitBreaker::probeDue(const Entry& entry, qint64 nowMs) const
+{
+    switch (entry.state) {
+    case State::Closed:
+        return false;
+    case State::Open:
+        return nowMs - entry.changedMs >= m_openMs;
+    case State::HalfOpen:
+        return entry.probeMs < 0 || nowMs - entry.probeMs >= m_openMs;
+    }
+    return false;
+}
+
+bool CircuitBreaker::allow(const QString& url)
+{
+    QMutexLocker locker(&m_mutex);
+    if (m_failureThreshold <= 0)
+        return true;
+    const auto it = m_entries.find(url);
+    if (it == m_entries.end() || it->state == State::Closed)
+        return true;
+
+    const qint64 now = m_clock.elapsed();
+    if (!probeDue(*it, now))
+        return false;
+    if (it->state == State::Open)
+        transition(url, *it, State::HalfOpen, QStringLiteral("sending a probe request"));
+    it->probeMs = now;
+    return true;
+}
+
+bool CircuitBreaker::available(const QString& url) const
+{
+    QMutexLocker locker(&m_mutex);
+    if (m_failureThreshold <= 0)
+        return true;
+    const auto it = m_entries.constFind(url);
+    return it == m_entries.cend() || it->state == State::Closed || probeDue(*it, m_clock.elapsed());
+}
+
+void CircuitBreaker::recordSuccess(const QString& url)
+{
+    QMutexLocker locker(&m_mutex);
+    if (m_failureThreshold <= 0)
+        return;
+    const auto it = m_entries.find(url);
+    if (it == m_entries.end())
+        return;
+    it->failures = 0;
+    if (it->state != State::Closed)
+        transition(url, *it, State::Closed, QStringLiteral("request succeeded"));
+}
+
+void CircuitBreaker::recordFailure(const QString& url, const DomainFailure& failure)
+{
+    switch (failure.kind) {
+    case ErrorKind::Unavailable:
+    case ErrorKind::Timeout:
+        break;
+    case ErrorKind::Internal:
+        return;
+    default:
+        // The endpoint answered
+        recordSuccess(url);
+        return;
+    }
+
+    QMutexLocker locker(&m_mutex);
+    if (m_failureThreshold <= 0)
+        return;
+    Entry& entry = m_entries[url];
+    switch (entry.state) {
+    case State::Closed:
+        if (++entry.failures >= m_failureThreshold) {
+            transition(url, entry, State::Open,
+                       QStringLiteral("%1 consecutive failures, last: %2")
+                           .arg(entry.failures)
+                           .arg(failure.message));
+        }
+        break;
+    case State::HalfOpen:
+        transition(url, entry, State::Open, QStringLiteral("probe failed: %1").arg(failure.message));
+        break;
+    case State::Open:
+        // Requests sent before it opened
+        break;
+    }
+}
+
+CircuitBreaker::State CircuitBreaker::state(const QString& url) const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_entries.value(url).state;
+}
+
+const char* CircuitBreaker::stateName(State state)
+{
+    switch (state) {
+    case State::Closed:   return "closed";
+    case State::Open:     return "open";
+    case State::HalfOpen: return "half_open";
+    }
+    return "closed";
+}
+
+void CircuitBreaker::transition(const QString& url, Entry& entry, State to, const QString& reason)
+{
+    entry.state = to;
+    entry.changedMs = m_clock.elapsed();
+    entry.probeMs = -1;
+    entry.failures = 0;
+
+    const QString name = QString::fromLatin1(stateName(to));
+    const QString message = QStringLiteral("CircuitBreaker: %1 is now %2 (%3)").arg(url, name, reason);
+    if (to == State::Open)
+        LOG_WARNING(message);
+    else
+        LOG_INFO(message);
+
+    auto& registry = metrics::registry();
+    registry.upstreamCircuitTransitions.add({url, name});
+    registry.upstreamCircuitState.at({url}).store(qint64(to), std::memory_order_relaxed);
+}
@@ -0,0 +1,58 @@
+#pragma once
+#include "failure.h"
+#include <QElapsedTimer>
+#include <QHash>
+#include <QMutex>
+#include <QString>
+
+// A circuit breaker per upstream base URL. After failureThreshold
+// consecutive failures that say the endpoint is down (Unavailable,
+// Timeout) it opens, and requests skip that URL without waiting for a
+// connect or transfer timeout. After openMs it goes half-open and lets one
+// request through as a probe: a success closes it, a failure opens it for
+// another openMs. A probe that never reports back (cancelled) is replaced
+// after openMs.
+//
+// Answers that prove the endpoint is up (rate limits, auth and client
+// errors) count as successes; Internal failures count as neither.
+//
+// Shared by all workers. A threshold of 0 turns it off.
+class CircuitBreaker {
+public:
+    enum class State { Closed, Open, HalfOpen };
+
+    CircuitBreaker();
+
+    void setThresholds(int failureThreshold, int openMs);
+    bool enabled() const;
+
+    // Whether a request may go to url now. Claims the probe of a half-open
+    // breaker, so call it only for a request that is then sent.
+    bool allow(const QString& url);
+    // Like allow() without claiming anything
+    bool available(const QString& url) const;
+
+    void recordSuccess(const QString& url);
+    void recordFailure(const QString& url, const DomainFailure& failure);
+
+    State state(const QString& url) const;
+    static const char* stateName(State state);
+
+private:
+    struct Entry {
+        State state = State::Closed;
+        int failures = 0;      // consecutive, while closed
+        qint64 changedMs = 0;  // entered the current state
+        qint64 probeMs = -1;   // half-open probe sent; -1 for none
+    };
+
+    // Mutex held
+    bool probeDue(const Entry& entry, qint64 nowMs) const;
+    void transition(const QString& url, Entry& entry, State to, const QString& reason);
+
+    mutable QMutex m_mutex;
+    QElapsedTimer m_clock;
+    int m_failureThreshold = 0;
+    int m_openMs = 30 * 1000;
+    QHash<QString, Entry> m_entries;
+};
@@ -0,0 +1,352 @@
+#include "concurrency_limiter.h"
+#include "core/log_manager.h"
+#include "core/metrics.h"
+#include <QMutexLocker>
+#include <QTimer>
+#include <QUrl>
+
+namespace {
+
+const QString kQueueFull = QStringLiteral("upstream_queue_full");
+const QString kQueueTimeout = QStringLiteral("upstream_queue_timeout");
+
+// Not retried here: the other attempts would queue for the same upstream
+DomainFailure queueFailure(const QString& code, const QString& message)
+{
+    DomainFailure failure = DomainFailure::rateLimited(message);
+    failure.code = code;
+    failure.retryable = false;
+    return failure;
+}
+
+int capacity(double limit)
+{
+    return qMax(1, int(limit));
+}
+
+ConcurrencyLimiter::Outcome outcomeOf(int statusCode)
+{
+    return statusCode == 429 || statusCode >= 500 ? ConcurrencyLimiter::Outcome::Overload
+                                                  : ConcurrencyLimiter::Outcome::Success;
+}
+
+ConcurrencyLimiter::Outcome outcomeOf(const DomainFailure& failure)
+{
+    switch (failure.kind) {
+    case ErrorKind::RateLimited:
+    case ErrorKind::Unavailable:
+    case ErrorKind::Timeout:
+        return ConcurrencyLimiter::Outcome::Overload;
+    default:
+        return ConcurrencyLimiter::Outcome::Ignored;
+    }
+}
+
+}
+
+ConcurrencyLimiter::ConcurrencyLimiter()
+{
+    m_clock.start();
+}
+
+void ConcurrencyLimiter::setSettings(const Settings& settings)
+{
+    QMutexLocker locker(&m_mutex);
+    m_settings.initialLimit = qBound(1, settings.initialLimit, kMaxLimit);
+    m_settings.maxQueue = qMax(0, settings.maxQueue);
+    m_settings.queueTimeoutMs = qMax(1, settings.queueTimeoutMs);
+}
+
+bool ConcurrencyLimiter::isQueueFailure(const DomainFailure& failure)
+{
+    return failure.code == kQueueFull || failure.code == kQueueTimeout;
+}
+
+QString ConcurrencyLimiter::keyOf(const QString& adapter, const QString& endpoint)
+{
+    return adapter + QLatin1Char('\n') + endpoint;
+}
+
+ConcurrencyLimiter::Upstream& ConcurrencyLimiter::upstream(const QString& adapter,
+                                                           const QString& endpoint)
+{
+    const QString key = keyOf(adapter, endpoint);
+    auto it = m_upstreams.find(key);
+    if (it == m_upstreams.end()) {
+        Upstream up;
+        up.adapter = adapter;
+        up.endpoint = endpoint;
+        up.limit = m_settings.initialLimit;
+        it = m_upstreams.insert(key, up);
+    }
+    return *it;
+}
+
+ConcurrencyLimiter::Permit ConcurrencyLimiter::takeSlot(const QString& key, Upstream& up)
+{
+    ++up.inFlight;
+    return Permit(nullptr, [this, key](void*) { release(key); });
+}
+
+quint64 ConcurrencyLimiter::acquire(const QString& adapter, const QString& endpoint,
+                                    QObject* context, Granted granted)
+{
+    const QString key = keyOf(adapter, endpoint);
+    QMutexLocker locker(&m_mutex);
+    Upstream& up = upstream(adapter, endpoint);
+    if (up.queue.isEmpty() && up.inFlight < capacity(up.limit)) {
+        Permit permit = takeSlot(key, up);
+        locker.unlock();
+        granted(std::move(permit));
+        return 0;
+    }
+
+    if (up.queue.size() >= m_settings.maxQueue) {
+        const QString message = QStringLiteral("%1 requests already queued for %2")
+                                    .arg(up.queue.size())
+                                    .arg(endpoint);
+        metrics::registry().upstreamQueueRejections.add({adapter, endpoint, QStringLiteral("full")});
+        locker.unlock();
+        granted(std::unexpected(queueFailure(kQueueFull, message)));
+        return 0;
+    }
+
+    const quint64 id = m_nextId++;
+    Waiter waiter;
+    waiter.id = id;
+    waiter.context = context;
+    waiter.granted = std::move(granted);
+    waiter.queued.start();
+    up.queue.append(std::move(waiter));
+    publish(up);
+    const int timeoutMs = m_settings.queueTimeoutMs;
+    locker.unlock();
+
+    QTimer::singleShot(timeoutMs, context, [this, key, id]() { expire(key, id); });
+    return id;
+}
+
+void ConcurrencyLimiter::cancel(const QString& adapter, const QString& endpoint, quint64 id)
+{
+    Granted dropped;
+    QMutexLocker locker(&m_mutex);
+    const auto it = m_upstreams.find(keyOf(adapter, endpoint));
+    if (it == m_upstreams.end())
+        return;
+    for (qsizetype i = 0; i < it->queue.size(); ++i) {
+        if (it->queue.at(i).id == id) {
+            dropped = std::move(it->queue[i].granted);
+            it->queue.removeAt(i);
+            publish(*it);
+            break;
+        }
+    }
+}
+
+void ConcurrencyLimiter::forget(QObject* context)
+{
+    QList<Waiter> dropped;
+    QMutexLocker locker(&m_mutex);
+    for (auto it = m_upstreams.begin(); it != m_upstreams.end(); ++it) {
+        bool changed = false;
+        for (qsizetype i = it->queue.size() - 1; i >= 0; --i) {
+            if (it->queue.at(i).context == context) {
+                dropped.append(it->queue.takeAt(i));
+                changed = true;
+            }
+        }
+        if (changed)
+            publish(*it);
+    }
+}
+
+void ConcurrencyLimiter::release(const QString& key)
+{
+    QMutexLocker locker(&m_mutex);
+    const auto it = m_upstreams.find(key);
+    if (it == m_upstreams.end())
+        return;
+    --it->inFlight;
+    drain(key, *it);
+}
+
+void ConcurrencyLimiter::drain(const QString& key, Upstream& up)
+{
+    while (!up.queue.isEmpty() && up.inFlight < capacity(up.limit)) {
+        Waiter waiter = up.queue.takeFirst();
+        const qint64 waitedMs = waiter.queued.elapsed();
+        metrics::registry().upstreamQueueWait.observe(double(waitedMs) / 1e3);
+        LOG_DEBUG(QStringLiteral("ConcurrencyLimiter: request to %1 (%2) waited %3 ms for a slot")
+                      .arg(up.endpoint, up.adapter)
+                      .arg(waitedMs));
+        // The waiter's context lives until forget() has taken its waiters
+        // out, so the call is always posted; it owns the permit from here
+        QMetaObject::invokeMethod(waiter.context,
+                                  [granted = std::move(waiter.granted),
+                                   permit = takeSlot(key, up)]() mutable {
+            granted(std::move(permit));
+        }, Qt::QueuedConnection);
+    }
+    publish(up);
+}
+
+void ConcurrencyLimiter::expire(const QString& key, quint64 id)
+{
+    QMutexLocker locker(&m_mutex);
+    const auto it = m_upstreams.find(key);
+    if (it == m_upstreams.end())
+        return;
+    for (qsizetype i = 0; i < it->queue.size(); ++i) {
+        if (it->queue.at(i).id != id)
+            continue;
+        Waiter waiter = it->queue.takeAt(i);
+        const qint64 waitedMs = waiter.queued.elapsed();
+        const QString message = QStringLiteral("no free slot for %1 within %2 ms")
+                                    .arg(it->endpoint)
+                                    .arg(waitedMs);
+        auto& registry = metrics::registry();
+        registry.upstreamQueueWait.observe(double(waitedMs) / 1e3);
+        registry.upstreamQueueRejections.add({it->adapter, it->endpoint, QStringLiteral("timeout")});
+        publish(*it);
+        locker.unlock();
+        waiter.granted(std::unexpected(queueFailure(kQueueTimeout, message)));
+        return;
+    }
+}
+
+void ConcurrencyLimiter::record(const QString& adapter, const QString& endpoint, Outcome outcome,
+                                qint64 latencyMs)
+{
+    if (outcome == Outcome::Ignored)
+        return;
+
+    const QString key = keyOf(adapter, endpoint);
+    QMutexLocker locker(&m_mutex);
+    Upstream& up = upstream(adapter, endpoint);
+    if (outcome == Outcome::Overload) {
+        const qint64 now = m_clock.elapsed();
+        if (now - up.decreasedMs < kDecreaseIntervalMs)
+            return;
+        up.decreasedMs = now;
+        up.limit = qMax(1.0, up.limit * kBackoffRatio);
+        LOG_DEBUG(QStringLiteral("ConcurrencyLimiter: %1 (%2) overloaded, limit now %3")
+                      .arg(endpoint, adapter)
+                      .arg(capacity(up.limit)));
+        publish(up);
+        return;
+    }
+
+    const double latency = double(qMax<qint64>(0, latencyMs));
+    const bool usual = up.latencyMs <= 0 || latency <= up.latencyMs * kLatencyTolerance;
+    up.latencyMs = up.latencyMs <= 0 ? latency
+                                     : up.latencyMs + kLatencyAlpha * (latency - up.latencyMs);
+    // Only a limit that is actually used has shown it could be higher
+    if (usual && up.inFlight * 2 >= capacity(up.limit))
+        up.limit = qMin(double(kMaxLimit), up.limit + 1.0 / up.limit);
+    drain(key, up);
+}
+
+ConcurrencyLimiter::Snapshot ConcurrencyLimiter::snapshot(const QString& adapter,
+                                                          const QString& endpoint) const
+{
+    QMutexLocker locker(&m_mutex);
+    const auto it = m_upstreams.constFind(keyOf(adapter, endpoint));
+    if (it == m_upstreams.cend())
+        return {};
+    return {capacity(it->limit), it->inFlight, int(it->queue.size())};
+}
+
+void ConcurrencyLimiter::publish(const Upstream& up) const
+{
+    auto& registry = metrics::registry();
+    registry.upstreamConcurrencyLimit.at({up.adapter, up.endpoint})
+        .store(capacity(up.limit), std::memory_order_relaxed);
+    registry.upstreamQueueDepth.at({up.adapter, up.endpoint})
+        .store(up.queue.size(), std::memory_order_relaxed);
+}
+
+LimitedExecutor::LimitedExecutor(IExecutor* inner, ConcurrencyLimiter* limiter, QObject* parent)
+    : QObject(parent)
+    , m_inner(inner)
+    , m_limiter(limiter)
+{
+}
+
+LimitedExecutor::~LimitedExecutor()
+{
+    m_limiter->forget(this);
+}
+
+std::pair<QString, QString> LimitedExecutor::upstreamOf(const ProviderRequest& request)
+{
+    const QString adapter = request.adapterHint.isEmpty() ? QStringLiteral("default")
+                                                          : request.adapterHint;
+    const QUrl origin = QUrl(request.url).adjusted(QUrl::RemoveUserInfo | QUrl::RemovePath
+                                                   | QUrl::RemoveQuery | QUrl::RemoveFragment);
+    return {adapter, origin.toString()};
+}
+
+void LimitedExecutor::acquire(const ProviderRequest& request,
+                              std::function<void(Result<ConcurrencyLimiter::Permit>)> granted)
+{
+    const auto upstream = upstreamOf(request);
+    const QPointer<QObject> scope = request.cancelScope;
+    const bool scoped = !scope.isNull();
+    auto cancel = std::make_shared<QMetaObject::Connection>();
+    const quint64 id = m_limiter->acquire(upstream.first, upstream.second, this,
+                                          [scope, scoped, cancel,
+                                           granted = std::move(granted)](auto permit) {
+        QObject::disconnect(*cancel);
+        // Abandoned while it waited; dropping the permit frees the slot
+        if (scoped && !scope)
+            return;
+        granted(std::move(permit));
+    });
+    if (id != 0 && scoped) {
+        *cancel = connect(scope.data(), &QObject::destroyed, this,
+                          [limiter = m_limiter, upstream, id]() {
+            limiter->cancel(upstream.first, upstream.second, id);
+        });
+    }
+}
+
+void LimitedExecutor::execute(const ProviderRequest& request, ExecuteCallback done) {
+    acquire(request, [this, request, done = std::move(done)](auto permit) mutable {
+        if (!permit) {
+            done(std::unexpected(permit.error()));
+            return;
+        }
+        QElapsedTimer sent;
+        sent.start();
+        m_inner->execute(request, [limiter = m_limiter, upstream = upstreamOf(request), sent,
+                                   permit = *permit, done = std::move(done)](auto result) mutable {
+            limiter->record(upstream.first, upstream.second,
+                            result ? outcomeOf(result->statusCode) : outcomeOf(result.error()),
+                            sent.elapsed());
+            permit.reset();
+            done(std::move(result));
+        });
+    });
+}
+
+void LimitedExecutor::connectStream(const ProviderRequest& request, ConnectStreamCallback done) {
+    acquire(request, [this, request, done = std::move(done)](auto permit) mutable {
+        if (!permit) {
+            done(std::unexpected(permit.error()));
+            return;
+        }
+        QElapsedTimer sent;
+        sent.start();
+        m_inner->connectStream(request, [limiter = m_limiter, upstream = upstreamOf(request), sent,
+                                         permit = *permit, done = std::move(done)](auto result) mutable {
+            limiter->record(upstream.first, upstream.second,
+                            result ? ConcurrencyLimiter::Outcome::Success : outcomeOf(result.error()),
+                            sent.elapsed());
+            // The stream holds its slot until the reply is gone
+            if (result)
+                QObject::connect(*result, &QObject::destroyed, [permit]() {});
+            permit.reset();
+            done(std::move(result));
+        });
+    });
+}
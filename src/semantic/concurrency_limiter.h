@@ -0,0 +1,131 @@
+#pragma once
+#include "ports.h"
+#include <QElapsedTimer>
+#include <QHash>
+#include <QList>
+#include <QMutex>
+#include <QObject>
+#include <QPointer>
+#include <functional>
+#include <memory>
+
+// An adaptive limit on the requests in flight to each upstream (outbound
+// adapter and base URL origin), with a bounded queue in front of it.
+//
+// The limit follows AIMD. A success within kLatencyTolerance times the
+// upstream's usual latency, while at least half the limit is in use, raises
+// it by 1/limit, so by one per round of requests. A 429, 5xx or timeout cuts
+// it by kBackoffRatio, at most once per kDecreaseIntervalMs so that a burst
+// of failures from requests sent together counts once. Latency far above
+// usual holds the limit, which grows again as latency recovers.
+//
+// Requests over the limit wait first come, first served, up to maxQueue per
+// upstream and for at most queueTimeoutMs.
+//
+// Shared by all workers. A slot freed on one worker's thread goes to a
+// waiter on another through that worker's event loop.
+class ConcurrencyLimiter {
+public:
+    static constexpr int kMaxLimit = 1000;
+    static constexpr double kBackoffRatio = 0.9;
+    static constexpr double kLatencyTolerance = 2.0;
+    static constexpr double kLatencyAlpha = 0.05;  // weight of a new sample
+    static constexpr int kDecreaseIntervalMs = 500;
+
+    struct Settings {
+        int initialLimit = 20;
+        int maxQueue = 100;
+        int queueTimeoutMs = 10 * 1000;
+    };
+
+    enum class Outcome { Success, Overload, Ignored };
+
+    // Holds a slot until the last copy is gone
+    using Permit = std::shared_ptr<void>;
+    using Granted = std::function<void(Result<Permit>)>;
+
+    struct Snapshot {
+        int limit = 0;
+        int inFlight = 0;
+        int queued = 0;
+    };
+
+    ConcurrencyLimiter();
+
+    // Applies to upstreams seen from now on; learned limits are kept
+    void setSettings(const Settings& settings);
+
+    // Calls `granted` at once when there is room or the queue is full.
+    // Otherwise queues it and calls it from context's event loop, with a
+    // slot or after the queue timeout; returns the waiter's id for cancel().
+    // Queued waiters of a context go away with forget(context).
+    quint64 acquire(const QString& adapter, const QString& endpoint, QObject* context,
+                    Granted granted);
+    void cancel(const QString& adapter, const QString& endpoint, quint64 id);
+    void forget(QObject* context);
+
+    // Feedback from a finished request; latency counts for successes
+    void record(const QString& adapter, const QString& endpoint, Outcome outcome, qint64 latencyMs);
+
+    Snapshot snapshot(const QString& adapter, const QString& endpoint) const;
+
+    // A request turned away by the queue, which never reached the upstream
+    static bool isQueueFailure(const DomainFailure& failure);
+
+private:
+    struct Waiter {
+        quint64 id = 0;
+        QObject* context = nullptr;
+        Granted granted;
+        QElapsedTimer queued;
+    };
+    struct Upstream {
+        QString adapter;
+        QString endpoint;
+        double limit = 1;
+        int inFlight = 0;
+        double latencyMs = 0;  // EWMA of successes
+        qint64 decreasedMs = -kDecreaseIntervalMs;
+        QList<Waiter> queue;
+    };
+
+    static QString keyOf(const QString& adapter, const QString& endpoint);
+    // Mutex held for all of these
+    Upstream& upstream(const QString& adapter, const QString& endpoint);
+    Permit takeSlot(const QString& key, Upstream& up);
+    // Hands free slots to waiters, through their contexts' event loops
+    void drain(const QString& key, Upstream& up);
+    void publish(const Upstream& up) const;
+
+    void release(const QString& key);
+    void expire(const QString& key, quint64 id);
+
+    mutable QMutex m_mutex;
+    QElapsedTimer m_clock;
+    Settings m_settings;
+    QHash<QString, Upstream> m_upstreams;
+    quint64 m_nextId = 1;
+};
+
+// Puts a ConcurrencyLimiter in front of another executor. A request takes a
+// slot before it is sent and gives it back when the upstream has answered,
+// or for streams when the reply is gone. A request cancelled while it waits
+// leaves the queue.
+class LimitedExecutor : public QObject, public IExecutor {
+public:
+    LimitedExecutor(IExecutor* inner, ConcurrencyLimiter* limiter, QObject* parent = nullptr);
+    ~LimitedExecutor() override;
+
+    void execute(const ProviderRequest& request, ExecuteCallback done) override;
+    void connectStream(const ProviderRequest& request, ConnectStreamCallback done) override;
+
+    // Adapter hint and scheme://host:port of the request's URL
+    static std::pair<QString, QString> upstreamOf(const ProviderRequest& request);
+
+private:
+    void acquire(const ProviderRequest& request,
+                 std::function<void(Result<ConcurrencyLimiter::Permit>)> granted);
+
+    IExecutor* m_inner;
+    ConcurrencyLimiter* m_limiter;
+};
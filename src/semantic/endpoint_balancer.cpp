@@ -0,0 +1,137 @@
+#include "endpoint_balancer.h"
+#include <QDateTime>
+#include <QFile>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QMutexLocker>
+#include <QRandomGenerator>
+
+namespace {
+
+// A failure costs as much as this much extra latency, scaled by the rate
+constexpr double kFailurePenaltyMs = 10000;
+
+bool isStale(const EndpointBalancer::Stats& stats, qint64 nowMs)
+{
+    return nowMs - stats.updatedMs >= EndpointBalancer::kProbeAfterMs
+           && nowMs - stats.probedMs >= EndpointBalancer::kProbeAfterMs;
+}
+
+}
+
+int EndpointBalancer::pick(const QStringList& urls)
+{
+    if (urls.size() < 2)
+        return 0;
+    auto* random = QRandomGenerator::global();
+    const int first = int(random->bounded(urls.size()));
+    int second = int(random->bounded(urls.size() - 1));
+    if (second >= first)
+        ++second;
+
+    QMutexLocker locker(&m_mutex);
+    const qint64 now = QDateTime::currentMSecsSinceEpoch();
+    const int chosen = cost(urls[first], now) <= cost(urls[second], now) ? first : second;
+    const auto it = m_stats.find(urls[chosen]);
+    if (it != m_stats.end() && it->samples > 0 && isStale(*it, now))
+        it->probedMs = now;
+    return chosen;
+}
+
+double EndpointBalancer::cost(const QString& url, qint64 nowMs) const
+{
+    const auto it = m_stats.constFind(url);
+    if (it == m_stats.cend() || it->samples == 0 || isStale(*it, nowMs))
+        return -1;
+    return (qMax(1.0, it->latencyMs) + it->errorRate * kFailurePenaltyMs) * (1 + it->inFlight);
+}
+
+EndpointBalancer::InFlight EndpointBalancer::begin(const QString& url)
+{
+    {
+        QMutexLocker locker(&m_mutex);
+        ++m_stats[url].inFlight;
+    }
+    return InFlight(this, [url](EndpointBalancer* balancer) {
+        QMutexLocker locker(&balancer->m_mutex);
+        --balancer->m_stats[url].inFlight;
+    });
+}
+
+void EndpointBalancer::recordSuccess(const QString& url, qint64 latencyMs)
+{
+    QMutexLocker locker(&m_mutex);
+    Stats& stats = m_stats[url];
+    // Latency only moves on successes; the first one sets it
+    const double latency = double(qMax<qint64>(0, latencyMs));
+    stats.latencyMs = stats.latencyMs > 0 ? stats.latencyMs + kAlpha * (latency - stats.latencyMs)
+                                          : latency;
+    stats.errorRate = stats.samples > 0 ? stats.errorRate * (1 - kAlpha) : 0;
+    ++stats.samples;
+    stats.updatedMs = QDateTime::currentMSecsSinceEpoch();
+}
+
+void EndpointBalancer::recordFailure(const QString& url)
+{
+    QMutexLocker locker(&m_mutex);
+    Stats& stats = m_stats[url];
+    stats.errorRate = stats.samples > 0 ? stats.errorRate + kAlpha * (1 - stats.errorRate) : 1;
+    ++stats.samples;
+    stats.updatedMs = QDateTime::currentMSecsSinceEpoch();
+}
+
+std::optional<EndpointBalancer::Stats> EndpointBalancer::stats(const QString& url) const
+{
+    QMutexLocker locker(&m_mutex);
+    const auto it = m_stats.constFind(url);
+    if (it == m_stats.cend())
+        return std::nullopt;
+    return *it;
+}
+
+bool EndpointBalancer::load(const QString& path)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly))
+        return false;
+    const QJsonObject endpoints =
+        QJsonDocument::fromJson(file.readAll()).object().value(QStringLiteral("endpoints")).toObject();
+
+    QMutexLocker locker(&m_mutex);
+    for (auto it = endpoints.constBegin(); it != endpoints.constEnd(); ++it) {
+        const QJsonObject saved = it.value().toObject();
+        Stats& stats = m_stats[it.key()];
+        stats.latencyMs = qMax(0.0, saved.value(QStringLiteral("latency_ms")).toDouble());
+        stats.errorRate = qBound(0.0, saved.value(QStringLiteral("error_rate")).toDouble(), 1.0);
+        stats.samples = quint64(qMax<qint64>(0, saved.value(QStringLiteral("samples")).toInteger()));
+        stats.updatedMs = saved.value(QStringLiteral("updated_ms")).toInteger();
+    }
+    return true;
+}
+
+bool EndpointBalancer::save(const QString& path) const
+{
+    QJsonObject endpoints;
+    {
+        QMutexLocker locker(&m_mutex);
+        for (auto it = m_stats.constBegin(); it != m_stats.constEnd(); ++it) {
+            if (it->samples == 0)
+                continue;
+            QJsonObject saved;
+            saved[QStringLiteral("latency_ms")] = it->latencyMs;
+            saved[QStringLiteral("error_rate")] = it->errorRate;
+            saved[QStringLiteral("samples")] = qint64(it->samples);
+            saved[QStringLiteral("updated_ms")] = it->updatedMs;
+            endpoints[it.key()] = saved;
+        }
+    }
+
+    QJsonObject root;
+    root[QStringLiteral("version")] = 1;
+    root[QStringLiteral("endpoints")] = endpoints;
+    QFile file(path);
+    if (!file.open(QIODevice::WriteOnly))
+        return false;
+    file.write(QJsonDocument(root).toJson(QJsonDocument::Indented));
+    return true;
+}
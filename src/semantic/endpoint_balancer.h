@@ -0,0 +1,56 @@
+#pragma once
+#include <QHash>
+#include <QMutex>
+#include <QString>
+#include <QStringList>
+#include <memory>
+#include <optional>
+
+// Chooses which of a request's base URLs to try first, by how each has been
+// doing. Every URL keeps an EWMA of its latency and of its error rate, and
+// a count of requests in flight; a request starts at the cheaper of two
+// URLs picked at random (power of two choices). Load spreads over healthy
+// mirrors and moves away from one that slows down or starts failing,
+// without all of it piling onto the single best.
+//
+// A URL with no samples is tried first. One with no samples for
+// kProbeAfterMs is tried again once when drawn, so a mirror that recovered
+// gets traffic back.
+//
+// Shared by all workers. The statistics are saved to a JSON file and
+// loaded from it on the next start.
+class EndpointBalancer {
+public:
+    static constexpr double kAlpha = 0.2;  // weight of a new sample
+    static constexpr qint64 kProbeAfterMs = 30 * 1000;
+
+    struct Stats {
+        double latencyMs = 0;    // successful requests only
+        double errorRate = 0;
+        quint64 samples = 0;
+        int inFlight = 0;
+        qint64 updatedMs = 0;    // ms since epoch
+        qint64 probedMs = 0;
+    };
+
+    // Keeps a request counted as in flight until the last copy is gone
+    using InFlight = std::shared_ptr<void>;
+
+    // Index into urls to start at; 0 for fewer than two
+    int pick(const QStringList& urls);
+    InFlight begin(const QString& url);
+    void recordSuccess(const QString& url, qint64 latencyMs);
+    void recordFailure(const QString& url);
+    std::optional<Stats> stats(const QString& url) const;
+
+    bool load(const QString& path);
+    bool save(const QString& path) const;
+
+private:
+    // Latency plus 10 s times the error rate, times the requests in flight
+    // plus one. Lower is better; -1 for a URL to try. Mutex held.
+    double cost(const QString& url, qint64 nowMs) const;
+
+    mutable QMutex m_mutex;
+    QHash<QString, Stats> m_stats;
+};
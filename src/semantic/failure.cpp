@@ -1,5 +1,46 @@
 ﻿#include "failure.h"
+#include <QDateTime>
+#include <QHash>
 #include <QJsonDocument>
+#include <QRegularExpression>
+
+namespace {
+
+// Seconds, or an epoch time in seconds for large values
+qint64 secondsToMs(double seconds)
+{
+    if (seconds > 1e9)
+        return qMax<qint64>(0, qint64(seconds * 1000) - QDateTime::currentMSecsSinceEpoch());
+    return seconds >= 0 ? qint64(seconds * 1000) : -1;
+}
+
+// Plain seconds, or durations such as "20ms", "1.5s" and "6m0s"
+qint64 parseDurationMs(const QString& text)
+{
+    bool ok = false;
+    const double seconds = text.toDouble(&ok);
+    if (ok)
+        return secondsToMs(seconds);
+
+    static const QRegularExpression part(QStringLiteral("(\\d+(?:\\.\\d+)?)(ms|s|m|h)"));
+    double total = 0;
+    qsizetype matched = 0;
+    for (auto it = part.globalMatch(text); it.hasNext();) {
+        const QRegularExpressionMatch match = it.next();
+        if (match.capturedStart() != matched)
+            return -1;
+        matched = match.capturedEnd();
+        const QString unit = match.captured(2);
+        const double scale = unit == QLatin1String("ms") ? 1
+                           : unit == QLatin1String("s")  ? 1000
+                           : unit == QLatin1String("m")  ? 60 * 1000
+                                                         : 60 * 60 * 1000;
+        total += match.captured(1).toDouble() * scale;
+    }
+    return matched > 0 && matched == text.size() ? qint64(total) : -1;
+}
+
+}
 
 int DomainFailure::httpStatus() const {
     switch (kind) {
@@ -52,3 +93,39 @@ DomainFailure DomainFailure::rateLimited(const QString& msg) {
 DomainFailure DomainFailure::internal(const QString& msg) {
     return {ErrorKind::Internal, "internal", msg, false, false};
 }
+
+qint64 DomainFailure::retryAfterFromHeaders(const QMap<QString, QString>& headers) {
+    QHash<QString, QString> lower;
+    for (auto it = headers.cbegin(); it != headers.cend(); ++it)
+        lower.insert(it.key().toLower(), it.value().trimmed());
+
+    bool ok = false;
+    const double ms = lower.value(QStringLiteral("retry-after-ms")).toDouble(&ok);
+    if (ok && ms >= 0)
+        return qint64(ms);
+
+    const QString retryAfter = lower.value(QStringLiteral("retry-after"));
+    if (!retryAfter.isEmpty()) {
+        const double seconds = retryAfter.toDouble(&ok);
+        if (ok)
+            return secondsToMs(seconds);
+        const QDateTime at = QDateTime::fromString(retryAfter, Qt::RFC2822Date);
+        if (at.isValid())
+            return qMax<qint64>(0, QDateTime::currentDateTimeUtc().msecsTo(at));
+    }
+
+    // Per limit, e.g. x-ratelimit-reset-requests and -tokens; the one that
+    // ran out is what the upstream waits for
+    const QString resetPrefix = QStringLiteral("x-ratelimit-reset");
+    qint64 wait = -1;
+    for (auto it = lower.cbegin(); it != lower.cend(); ++it) {
+        if (!it.key().startsWith(resetPrefix))
+            continue;
+        const QString remaining =
+            lower.value(QStringLiteral("x-ratelimit-remaining") + it.key().mid(resetPrefix.size()));
+        if (!remaining.isEmpty() && remaining != QLatin1String("0"))
+            continue;
+        wait = qMax(wait, parseDurationMs(it.value()));
+    }
+    return wait;
+}
@@ -1,5 +1,6 @@
 #pragma once
 #include "types.h"
+#include <QMap>
 #include <QString>
 #include <QJsonObject>
 
@@ -9,6 +10,7 @@ struct DomainFailure {
     QString     message;
     bool        retryable = false;
     bool        temporary = false;
+    qint64      retryAfterMs = -1;  // wait the upstream asked for; -1 if it did not
 
     int httpStatus() const;
     QJsonObject toJson() const;
@@ -20,4 +22,10 @@ struct DomainFailure {
     static DomainFailure timeout(const QString& msg);
     static DomainFailure rateLimited(const QString& msg);
     static DomainFailure internal(const QString& msg);
+
+    // The wait a response asks for before the next request, in ms: from
+    // retry-after-ms, Retry-After (seconds or HTTP date), or else the
+    // latest x-ratelimit-reset-* of a limit with nothing remaining. -1 if
+    // there is none.
+    static qint64 retryAfterFromHeaders(const QMap<QString, QString>& headers);
 };
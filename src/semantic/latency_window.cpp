@@ -0,0 +1,21 @@
+#include "latency_window.h"
+#include <algorithm>
+
+void LatencyWindow::add(qint64 ms)
+{
+    m_samples[m_next] = qMax<qint64>(0, ms);
+    m_next = (m_next + 1) % kCapacity;
+    m_size = qMin(m_size + 1, kCapacity);
+}
+
+qint64 LatencyWindow::percentile(int p) const
+{
+    if (m_size == 0)
+        return 0;
+    std::array<qint64, kCapacity> sorted = m_samples;
+    const auto end = sorted.begin() + m_size;
+    // Rank ceil(p/100 * n), 1-based
+    const int rank = qBound(1, (qBound(1, p, 100) * m_size + 99) / 100, m_size);
+    std::nth_element(sorted.begin(), sorted.begin() + (rank - 1), end);
+    return sorted[rank - 1];
+}
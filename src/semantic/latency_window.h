@@ -0,0 +1,20 @@
+#pragma once
+#include <QtGlobal>
+#include <array>
+
+// The most recent upstream latencies of one endpoint, for percentile
+// estimates. Older samples are overwritten once the window is full.
+class LatencyWindow {
+public:
+    static constexpr int kCapacity = 128;
+
+    void add(qint64 ms);
+    int size() const { return m_size; }
+    // Nearest-rank percentile (1-100) of the samples; 0 when there are none
+    qint64 percentile(int p) const;
+
+private:
+    std::array<qint64, kCapacity> m_samples{};
+    int m_next = 0;
+    int m_size = 0;
+};
@@ -1,4 +1,8 @@
 ﻿#include "policy.h"
+#include "circuit_breaker.h"
+#include "core/metrics.h"
+#include <QRandomGenerator>
+#include <algorithm>
 
 VoidResult Policy::preflight(const SemanticRequest& req,
                              const CapabilityProfile& profile) {
@@ -20,6 +24,7 @@ ExecutionPlan Policy::plan(const SemanticRequest& req,
     p.targetModel = req.target.logicalModel;
     const int requestedAttempts = qMax(1, req.target.fallback.maxAttempts);
     p.maxAttempts = qMax(m_defaultMaxAttempts, requestedAttempts);
+    m_retryBudget.recordRequest();
     return p;
 }
 
@@ -33,16 +38,42 @@ RetryDecision Policy::nextRetry(const ExecutionPlan& plan,
 
     for (auto kind : plan.retryableKinds) {
         if (failure.kind == kind) {
+            if (m_circuitBreaker && !plan.endpoints.isEmpty()
+                && std::none_of(plan.endpoints.cbegin(), plan.endpoints.cend(),
+                                [this](const QString& url) { return m_circuitBreaker->available(url); })) {
+                return {false, false, QStringLiteral("circuit open for every endpoint")};
+            }
+            if (failure.retryAfterMs > kMaxRetryAfterMs) {
+                return {false, false, QStringLiteral("upstream asked to wait %1 s")
+                                          .arg(failure.retryAfterMs / 1000)};
+            }
+            if (!m_retryBudget.tryRetry()) {
+                metrics::registry().upstreamRetriesDenied.add();
+                return {false, false, QStringLiteral("retry budget spent")};
+            }
             return {
                 true,
                 true,
                 QStringLiteral("retry %1/%2: %3")
                     .arg(attempt + 2)
                     .arg(maxAttempts)
-                    .arg(failure.message)
+                    .arg(failure.message),
+                backoffMs(attempt, failure)
             };
         }
     }
 
     return {false, false, QStringLiteral("non-retryable failure kind")};
 }
+
+int Policy::backoffMs(int attempt, const DomainFailure& failure) const {
+    const int base = m_baseDelayMs.load(std::memory_order_relaxed);
+    auto* random = QRandomGenerator::global();
+    // Clients told the same Retry-After still spread out a little
+    if (failure.retryAfterMs >= 0)
+        return int(failure.retryAfterMs) + (base > 0 ? int(random->bounded(base + 1)) : 0);
+    if (base <= 0)
+        return 0;
+    const qint64 ceiling = qMin<qint64>(kMaxBackoffMs, qint64(base) << qBound(0, attempt, 20));
+    return int(random->bounded(ceiling + 1));
+}
@@ -1,11 +1,18 @@
 #pragma once
 #include "ports.h"
 #include "capability.h"
+#include "retry_budget.h"
 #include <QList>
+#include <QStringList>
+#include <atomic>
+
+class CircuitBreaker;
 
 struct ExecutionPlan {
     QString targetModel;
     int maxAttempts = 1;
+    // Base URLs the attempts rotate through; empty for the adapter default
+    QStringList endpoints;
     QList<ErrorKind> retryableKinds = {
         ErrorKind::Unavailable,
         ErrorKind::Timeout,
@@ -17,11 +24,26 @@ struct RetryDecision {
     bool retry = false;
     bool switchPath = false;
     QString reason;
+    int delayMs = 0;  // wait before the retry
 };
 
 class Policy {
 public:
+    static constexpr int kMaxBackoffMs = 10 * 1000;
+    // A longer Retry-After is not waited out; the failure goes back instead
+    static constexpr int kMaxRetryAfterMs = 60 * 1000;
+
     void setDefaultMaxAttempts(int attempts) { m_defaultMaxAttempts = qMax(1, attempts); }
+    // Retries wait a random time between 0 and baseDelayMs * 2^attempt,
+    // capped at kMaxBackoffMs (full jitter), or what the upstream asked for
+    // in Retry-After and the like. 0 retries at once unless asked to wait.
+    void setBackoff(int baseDelayMs) { m_baseDelayMs = qMax(0, baseDelayMs); }
+    // Every plan counts as a request and every retry is taken from it
+    RetryBudget& retryBudget() { return m_retryBudget; }
+    // Retries stop early when the breakers of all the plan's endpoints are
+    // open; the Processor also uses it to skip open endpoints
+    void setCircuitBreaker(CircuitBreaker* breaker) { m_circuitBreaker = breaker; }
+    CircuitBreaker* circuitBreaker() const { return m_circuitBreaker; }
 
     VoidResult preflight(const SemanticRequest& req,
                          const CapabilityProfile& profile);
@@ -32,5 +54,10 @@ public:
                             const DomainFailure& failure);
 
 private:
+    int backoffMs(int attempt, const DomainFailure& failure) const;
+
     int m_defaultMaxAttempts = 1;
+    std::atomic<int> m_baseDelayMs{250};
+    CircuitBreaker* m_circuitBreaker = nullptr;
+    RetryBudget m_retryBudget;
 };
@@ -6,9 +6,13 @@
 #include "capability.h"
 #include "target.h"
 #include <expected>
+#include <functional>
 #include <QByteArray>
+#include <QJsonDocument>
+#include <QJsonObject>
 #include <QMap>
 #include <QNetworkReply>
+#include <QPointer>
 
 template<typename T>
 using Result = std::expected<T, DomainFailure>;
@@ -22,6 +26,10 @@ struct ProviderRequest {
     QByteArray body;
     bool stream = false;
     QString adapterHint;
+    // Deleting this object abandons the request (the slower of two hedged
+    // attempts): the executor aborts the upstream call and drops the
+    // callback. Unset for requests that always run to the end.
+    QPointer<QObject> cancelScope;
 };
 
 struct ProviderResponse {
@@ -44,6 +52,15 @@ public:
     virtual Result<SemanticRequest> decodeRequest(
         const QByteArray& body,
         const QMap<QString, QString>& metadata) = 0;
+    // Decodes a body that is already parsed, so wrapping adapters can hand
+    // it on without parsing it again. JSON adapters override this; the
+    // default serializes the object back for decodeRequest().
+    virtual Result<SemanticRequest> decodeParsedRequest(
+        const QJsonObject& root,
+        const QMap<QString, QString>& metadata)
+    {
+        return decodeRequest(QJsonDocument(root).toJson(QJsonDocument::Compact), metadata);
+    }
     virtual Result<QByteArray> encodeResponse(
         const SemanticResponse& response) = 0;
     virtual Result<QByteArray> encodeStreamFrame(
@@ -63,15 +80,25 @@ public:
     virtual Result<StreamFrame> parseChunk(
         const ProviderChunk& chunk) = 0;
     virtual DomainFailure mapFailure(int httpStatus, const QByteArray& body) = 0;
+    // Whether the provider continues a trailing assistant message instead
+    // of answering it
+    virtual bool supportsPrefill(const SemanticRequest&) { return false; }
 };
 
+using ExecuteCallback = std::function<void(Result<ProviderResponse>)>;
+using ConnectStreamCallback = std::function<void(Result<QNetworkReply*>)>;
+
+// Executors never block the calling thread. Each call invokes its callback
+// exactly once, from the caller's event loop, when the upstream has answered
+// (execute) or produced its first bytes (connectStream), or on failure --
+// unless the request's cancelScope is deleted first.
 class IExecutor {
 public:
     virtual ~IExecutor() = default;
-    virtual Result<ProviderResponse> execute(
-        const ProviderRequest& request) = 0;
-    virtual Result<QNetworkReply*> connectStream(
-        const ProviderRequest& request) = 0;
+    virtual void execute(const ProviderRequest& request,
+                         ExecuteCallback done) = 0;
+    virtual void connectStream(const ProviderRequest& request,
+                               ConnectStreamCallback done) = 0;
 };
 
 class ICapabilityResolver {
@@ -1,12 +1,73 @@
 #include "processor.h"
+#include "concurrency_limiter.h"
 #include "validate.h"
 #include "core/log_manager.h"
+#include "core/metrics.h"
+#include <QElapsedTimer>
+#include <QPointer>
+#include <QTimer>
+#include <algorithm>
+
+namespace {
+
+// One attempt of a request sent to up to two base URLs; the first success
+// wins
+struct HedgeRace {
+    struct Leg {
+        QString url;
+        QPointer<QObject> scope;  // deleting it cancels the leg
+        QElapsedTimer started;
+        bool finished = false;
+    };
+    QList<Leg> legs;
+    bool hedged = false;
+    bool settled = false;
+
+    bool pending() const
+    {
+        return std::any_of(legs.cbegin(), legs.cend(), [](const Leg& leg) { return !leg.finished; });
+    }
+    // Cancels unfinished legs; deleting the first leg's scope also stops
+    // the hedge timer
+    void close()
+    {
+        settled = true;
+        for (Leg& leg : legs)
+            delete leg.scope.data();
+    }
+};
+
+QString latencyKey(const QString& url, bool stream)
+{
+    return stream ? QStringLiteral("stream ") + url : url;
+}
+
+int usedTokens(const UsageEntry& usage)
+{
+    return qMax(usage.totalTokens, usage.promptTokens + usage.completionTokens);
+}
+
+DomainFailure circuitOpen(const QStringList& urls)
+{
+    DomainFailure failure = DomainFailure::unavailable(
+        QStringLiteral("Circuit open for every upstream endpoint: %1").arg(urls.join(QStringLiteral(", "))));
+    failure.code = QStringLiteral("circuit_open");
+    return failure;
+}
+
+}
 
 Processor::Processor(QObject* parent)
     : QObject(parent)
 {
 }
 
+void Processor::setHedging(int percentile, int minDelayMs)
+{
+    m_hedgePercentile = qBound(0, percentile, 99);
+    m_hedgeMinDelayMs = qMax(0, minDelayMs);
+}
+
 // ---------------------------------------------------------------------------
 // Effective-pointer helpers: prefer the setter-based private pointer; fall
 // back to the public raw pointer for backward compatibility.
@@ -75,11 +136,247 @@ SemanticRequest Processor::withRouting(const SemanticRequest& req,
     return copy;
 }
 
+template<typename T>
+Processor::AttemptCallback<T> Processor::reportOutcome(const SemanticRequest& request,
+                                                      AttemptCallback<T> done) const
+{
+    const QString url = request.metadata.value(QStringLiteral("provider_base_url"));
+    Policy* pol = effectivePolicy();
+    CircuitBreaker* breaker = pol ? pol->circuitBreaker() : nullptr;
+    if ((!m_balancer && !breaker) || url.isEmpty())
+        return done;
+
+    QElapsedTimer started;
+    started.start();
+    EndpointBalancer::InFlight inFlight = m_balancer ? m_balancer->begin(url) : nullptr;
+    // A cancelled attempt reports nothing; dropping the callback ends it
+    return [balancer = m_balancer, breaker, url, started, inFlight,
+            done = std::move(done)](Result<T> result) mutable {
+        inFlight.reset();
+        // Turned away before it reached the endpoint: says nothing about it
+        if (!result.has_value() && ConcurrencyLimiter::isQueueFailure(result.error())) {
+            done(std::move(result));
+            return;
+        }
+        if (balancer) {
+            if (result.has_value())
+                balancer->recordSuccess(url, started.elapsed());
+            else if (result.error().retryable)
+                balancer->recordFailure(url);
+        }
+        if (breaker) {
+            if (result.has_value())
+                breaker->recordSuccess(url);
+            else
+                breaker->recordFailure(url, result.error());
+        }
+        done(std::move(result));
+    };
+}
+
+bool Processor::skipOpenEndpoints(RetryState& state) const
+{
+    CircuitBreaker* breaker = state.policy ? state.policy->circuitBreaker() : nullptr;
+    AttemptRouting& routing = state.routing;
+    if (!breaker || routing.baseUrls.isEmpty())
+        return true;
+    for (qsizetype i = 0; i < routing.baseUrls.size(); ++i) {
+        if (breaker->allow(routing.currentUrl()))
+            return true;
+        LOG_DEBUG(QStringLiteral("Processor: circuit open for %1, skipping it").arg(routing.currentUrl()));
+        routing.advance();
+    }
+    return false;
+}
+
+bool Processor::delayForRateLimit(RetryState& state, std::function<void()> resume)
+{
+    // The resumed attempt has been paid for
+    if (state.rateReserved) {
+        state.rateReserved = false;
+        return false;
+    }
+    const QString group = state.request.metadata.value(QStringLiteral("config_group"));
+    if (!m_rateLimiter || !m_rateLimiter->limited(group))
+        return false;
+
+    if (state.estimatedTokens < 0)
+        state.estimatedTokens = RateLimiter::estimateTokens(state.request);
+    const qint64 waitMs = m_rateLimiter->reserve(group, state.estimatedTokens);
+    state.rateCharged = true;
+    if (waitMs <= 0)
+        return false;
+
+    LOG_DEBUG(QStringLiteral("Processor: rate limits of group %1 hold the request for %2 ms")
+                  .arg(group)
+                  .arg(waitMs));
+    auto& registry = metrics::registry();
+    registry.rateLimitDelays.add({group});
+    registry.rateLimitWait.observe(waitMs / 1000.0);
+    state.rateReserved = true;
+    QTimer::singleShot(waitMs, this, std::move(resume));
+    return true;
+}
+
+void Processor::settleRateLimit(RetryState& state, const UsageEntry& usage) const
+{
+    if (!state.rateCharged)
+        return;
+    state.rateCharged = false;
+    const int used = usedTokens(usage);
+    if (used > 0) {
+        m_rateLimiter->settle(state.request.metadata.value(QStringLiteral("config_group")),
+                              state.estimatedTokens, used);
+    }
+}
+
+void Processor::refundRateLimit(RetryState& state) const
+{
+    if (!state.rateCharged)
+        return;
+    state.rateCharged = false;
+    m_rateLimiter->settle(state.request.metadata.value(QStringLiteral("config_group")),
+                          state.estimatedTokens, 0);
+}
+
+void Processor::settleRateLimit(RetryState& state, StreamSession* session) const
+{
+    if (!state.rateCharged)
+        return;
+    state.rateCharged = false;
+    auto charge = std::make_shared<StreamCharge>();
+    charge->estimated = state.estimatedTokens;
+    state.streamCharge = charge;
+    // Providers report usage as running totals or in parts (prompt first,
+    // completion at the end); the largest of each is the final count
+    connect(session, &StreamSession::frameReady, session, [charge](const StreamFrame& frame) {
+        UsageEntry& usage = charge->usage;
+        usage.promptTokens = qMax(usage.promptTokens, frame.usageDelta.promptTokens);
+        usage.completionTokens = qMax(usage.completionTokens, frame.usageDelta.completionTokens);
+        usage.totalTokens = qMax(usage.totalTokens, frame.usageDelta.totalTokens);
+    });
+    connect(session, &QObject::destroyed,
+            [limiter = m_rateLimiter, group = state.request.metadata.value(QStringLiteral("config_group")),
+             charge]() {
+        const int used = charge->priorUsed + usedTokens(charge->usage);
+        if (used > 0)
+            limiter->settle(group, charge->estimated, used);
+    });
+}
+
+void Processor::chargeTakeOver(RetryState& state) const
+{
+    if (!state.rateCharged)
+        return;
+    state.rateCharged = false;
+    // Without a session charge (limits set mid-stream) the estimate stands
+    if (StreamCharge* charge = state.streamCharge.get()) {
+        charge->estimated += state.estimatedTokens;
+        charge->priorUsed += usedTokens(charge->usage);
+        charge->usage = {};
+    }
+}
+
 // ---------------------------------------------------------------------------
-// Non-streaming path
+// Hedging
 // ---------------------------------------------------------------------------
 
-Result<SemanticResponse> Processor::process(SemanticRequest request)
+qint64 Processor::hedgeDelayMs(const QString& key) const
+{
+    const auto window = m_latencies.constFind(key);
+    if (window == m_latencies.cend() || window->size() < kHedgeMinSamples)
+        return -1;
+    return qMax<qint64>(m_hedgeMinDelayMs, window->percentile(m_hedgePercentile));
+}
+
+template<typename T>
+void Processor::runHedged(const std::shared_ptr<RetryState>& state, const SemanticRequest& routed,
+                          bool stream, AttemptLauncher<T> launch, AttemptCallback<T> done)
+{
+    const AttemptRouting& routing = state->routing;
+    if (m_hedgePercentile <= 0 || routing.baseUrls.size() < 2) {
+        launch(routed, nullptr, std::move(done));
+        return;
+    }
+
+    auto race = std::make_shared<HedgeRace>();
+    QPointer<Processor> self(this);
+    // Latencies are recorded even before there are enough to hedge on. A
+    // cancelled leg took at least as long as it ran, which still counts.
+    const auto startLeg = [self, state, race, stream, launch, done](const SemanticRequest& request) {
+        const int index = int(race->legs.size());
+        HedgeRace::Leg leg;
+        leg.url = request.metadata.value(QStringLiteral("provider_base_url"));
+        leg.scope = new QObject(self.data());
+        leg.started.start();
+        race->legs.append(leg);
+        QObject* scope = leg.scope.data();
+
+        launch(request, scope, [self, state, race, stream, index, done](Result<T> result) {
+            HedgeRace::Leg& finished = race->legs[index];
+            finished.finished = true;
+            if (race->settled)
+                return;
+            if (!result.has_value()) {
+                if (race->pending())
+                    return;
+                // Both legs failed: the retry goes past the hedge URL too
+                if (race->hedged)
+                    state->routing.advance();
+                race->close();
+                done(std::move(result));
+                return;
+            }
+
+            if (self) {
+                for (const HedgeRace::Leg& other : std::as_const(race->legs)) {
+                    if (&other == &finished || !other.finished)
+                        self->m_latencies[latencyKey(other.url, stream)].add(other.started.elapsed());
+                }
+            }
+            if (race->hedged) {
+                metrics::registry().upstreamHedgeWins.at({finished.url})
+                    .fetch_add(1, std::memory_order_relaxed);
+            }
+            race->close();
+            done(std::move(result));
+        });
+    };
+
+    startLeg(routed);
+    const qint64 delayMs = hedgeDelayMs(latencyKey(routing.currentUrl(), stream));
+    if (delayMs < 0 || race->settled)
+        return;
+
+    SemanticRequest hedge = routed;
+    hedge.metadata[QStringLiteral("provider_base_url")] =
+        routing.baseUrls.value((routing.current + 1) % routing.baseUrls.size());
+    CircuitBreaker* breaker = state->policy ? state->policy->circuitBreaker() : nullptr;
+    auto* timer = new QTimer(race->legs.first().scope.data());
+    timer->setSingleShot(true);
+    QObject::connect(timer, &QTimer::timeout, timer, [race, hedge, startLeg, delayMs, breaker]() {
+        if (race->settled)
+            return;
+        const QString url = hedge.metadata.value(QStringLiteral("provider_base_url"));
+        if (breaker && !breaker->allow(url))
+            return;
+        LOG_DEBUG(QStringLiteral("Processor: no answer from %1 after %2 ms, hedging to %3")
+                      .arg(race->legs.first().url)
+                      .arg(delayMs)
+                      .arg(url));
+        metrics::registry().upstreamHedges.at({url}).fetch_add(1, std::memory_order_relaxed);
+        race->hedged = true;
+        startLeg(hedge);
+    });
+    timer->start(int(delayMs));
+}
+
+// ---------------------------------------------------------------------------
+// Shared preparation: validation, capabilities, policy plan and routing
+// ---------------------------------------------------------------------------
+
+Result<std::shared_ptr<Processor::RetryState>> Processor::prepare(
+    const SemanticRequest& request) const
 {
     // Step 1: Validate the request
     VoidResult valResult = Validate::request(request);
@@ -102,248 +399,471 @@ Result<SemanticResponse> Processor::process(SemanticRequest request)
     const CapabilityProfile& profile = capResult.value();
 
     // Step 4: Policy preflight and plan
-    Policy* pol = effectivePolicy();
-    ExecutionPlan plan;
+    auto state = std::make_shared<RetryState>();
+    state->request = request;
+    state->policy = effectivePolicy();
 
-    if (pol) {
-        VoidResult pf = pol->preflight(request, profile);
+    if (state->policy) {
+        VoidResult pf = state->policy->preflight(request, profile);
         if (!pf.has_value()) {
             return std::unexpected(pf.error());
         }
-        plan = pol->plan(request, profile);
+        state->plan = state->policy->plan(request, profile);
     }
 
     // Step 5: Build routing table
-    AttemptRouting routing = buildRouting(request.metadata);
+    state->routing = buildRouting(request.metadata);
+    if (m_balancer) {
+        state->routing.current = m_balancer->pick(state->routing.baseUrls);
+    }
+    state->plan.endpoints = state->routing.baseUrls;
+    return state;
+}
 
-    // Step 6: Retry loop
-    DomainFailure lastFailure = DomainFailure::internal(
-        QStringLiteral("No attempts were made"));
+// ---------------------------------------------------------------------------
+// Non-streaming path
+// ---------------------------------------------------------------------------
 
-    for (int attempt = 0; attempt < plan.maxAttempts; ++attempt) {
-        SemanticRequest routed = withRouting(request, routing, attempt);
+void Processor::process(SemanticRequest request, ProcessCallback done)
+{
+    auto prepared = prepare(request);
+    if (!prepared.has_value()) {
+        done(std::unexpected(prepared.error()));
+        return;
+    }
+    runAttempt(*prepared, std::move(done));
+}
 
-        LOG_DEBUG(QStringLiteral("Processor::process attempt %1/%2 url=%3")
-                      .arg(attempt + 1)
-                      .arg(plan.maxAttempts)
-                      .arg(routing.currentUrl()));
+void Processor::runAttempt(std::shared_ptr<RetryState> state, ProcessCallback done)
+{
+    // Step 6: One attempt; the retry decision runs in its continuation so no
+    // attempt ever waits on the calling thread.
+    if (state->attempt >= state->plan.maxAttempts) {
+        done(std::unexpected(
+            DomainFailure::internal(QStringLiteral("All retry attempts exhausted"))));
+        return;
+    }
+    // Before the breaker check, which claims half-open probes
+    if (delayForRateLimit(*state, [this, state, done]() { runAttempt(state, done); })) {
+        return;
+    }
+    if (!skipOpenEndpoints(*state)) {
+        refundRateLimit(*state);
+        done(std::unexpected(state->lastFailure.value_or(circuitOpen(state->routing.baseUrls))));
+        return;
+    }
 
-        Result<SemanticResponse> result = processOnce(routed);
+    const int attempt = state->attempt;
+    SemanticRequest routed = withRouting(state->request, state->routing, attempt);
 
+    LOG_DEBUG(QStringLiteral("Processor::process attempt %1/%2 url=%3")
+                  .arg(attempt + 1)
+                  .arg(state->plan.maxAttempts)
+                  .arg(state->routing.currentUrl()));
+
+    AttemptLauncher<SemanticResponse> launch =
+        [this](const SemanticRequest& request, QObject* cancelScope, ProcessCallback legDone) {
+            processOnce(request, std::move(legDone), cancelScope);
+        };
+    runHedged<SemanticResponse>(state, routed, false, std::move(launch),
+                                [this, state, attempt, done](Result<SemanticResponse> result) {
         if (result.has_value()) {
-            return result;
+            settleRateLimit(*state, result->usage);
+            done(std::move(result));
+            return;
         }
+        // The next attempt reserves again
+        refundRateLimit(*state);
 
-        lastFailure = result.error();
+        const DomainFailure lastFailure = result.error();
+        Policy* pol = state->policy;
+        if (!pol) {
+            // No policy means no retries
+            done(std::unexpected(lastFailure));
+            return;
+        }
 
         // Consult retry policy
-        if (pol) {
-            RetryDecision decision = pol->nextRetry(plan, attempt, lastFailure);
-            if (!decision.retry) {
-                LOG_WARNING(QStringLiteral("Processor: not retrying after attempt %1: %2")
-                                .arg(attempt + 1)
-                                .arg(decision.reason));
-                return std::unexpected(lastFailure);
-            }
-            LOG_WARNING(QStringLiteral("Processor: retrying (attempt %1/%2): %3")
-                            .arg(attempt + 2)
-                            .arg(plan.maxAttempts)
+        RetryDecision decision = pol->nextRetry(state->plan, attempt, lastFailure);
+        if (!decision.retry) {
+            LOG_WARNING(QStringLiteral("Processor: not retrying after attempt %1: %2")
+                            .arg(attempt + 1)
                             .arg(decision.reason));
-            if (decision.switchPath) {
-                routing.advance();
-            }
-        } else {
-            // No policy means no retries
-            return std::unexpected(lastFailure);
+            done(std::unexpected(lastFailure));
+            return;
         }
-    }
-
-    return std::unexpected(
-        DomainFailure::internal(QStringLiteral("All retry attempts exhausted")));
+        LOG_WARNING(QStringLiteral("Processor: retrying (attempt %1/%2) in %3 ms: %4")
+                        .arg(attempt + 2)
+                        .arg(state->plan.maxAttempts)
+                        .arg(decision.delayMs)
+                        .arg(decision.reason));
+        if (decision.switchPath) {
+            state->routing.advance();
+        }
+        metrics::registry().upstreamRetries.add();
+        metrics::registry().upstreamRetryDelay.observe(decision.delayMs / 1000.0);
+        state->lastFailure = lastFailure;
+        state->attempt = attempt + 1;
+        if (decision.delayMs <= 0) {
+            runAttempt(state, done);
+            return;
+        }
+        // The worker's event loop keeps serving other requests meanwhile
+        QTimer::singleShot(decision.delayMs, this, [this, state, done]() {
+            runAttempt(state, done);
+        });
+    });
 }
 
-Result<SemanticResponse> Processor::processOnce(const SemanticRequest& request)
+void Processor::processOnce(const SemanticRequest& request, ProcessCallback done,
+                            QObject* cancelScope)
 {
+    done = reportOutcome<SemanticResponse>(request, std::move(done));
     IOutboundAdapter* ob = effectiveOutbound();
     IExecutor* ex = effectiveExecutor();
 
     if (!ob) {
-        return std::unexpected(
-            DomainFailure::internal(QStringLiteral("outbound adapter not set")));
+        done(std::unexpected(
+            DomainFailure::internal(QStringLiteral("outbound adapter not set"))));
+        return;
     }
     if (!ex) {
-        return std::unexpected(
-            DomainFailure::internal(QStringLiteral("executor not set")));
+        done(std::unexpected(
+            DomainFailure::internal(QStringLiteral("executor not set"))));
+        return;
     }
 
     // Build the provider-level request
     Result<ProviderRequest> provReqResult = ob->buildRequest(request);
     if (!provReqResult.has_value()) {
-        return std::unexpected(provReqResult.error());
+        done(std::unexpected(provReqResult.error()));
+        return;
     }
 
     ProviderRequest provReq = provReqResult.value();
+    provReq.cancelScope = cancelScope;
+    const QString requestHint = provReq.adapterHint;
+
+    // Execute the request; the continuation parses the provider response
+    ex->execute(provReq, [ob, requestHint, done](Result<ProviderResponse> provRespResult) {
+        if (!provRespResult.has_value()) {
+            done(std::unexpected(provRespResult.error()));
+            return;
+        }
 
-    // Execute the request
-    Result<ProviderResponse> provRespResult = ex->execute(provReq);
-    if (!provRespResult.has_value()) {
-        return std::unexpected(provRespResult.error());
-    }
-
-    ProviderResponse provResp = provRespResult.value();
-    if (provResp.adapterHint.isEmpty()) {
-        provResp.adapterHint = provReq.adapterHint;
-    }
+        ProviderResponse provResp = std::move(provRespResult.value());
+        if (provResp.adapterHint.isEmpty()) {
+            provResp.adapterHint = requestHint;
+        }
 
-    // Check for HTTP-level errors before parsing
-    if (provResp.statusCode < 200 || provResp.statusCode >= 300) {
-        DomainFailure httpFailure = ob->mapFailure(provResp.statusCode, provResp.body);
-        return std::unexpected(httpFailure);
-    }
+        // Check for HTTP-level errors before parsing
+        if (provResp.statusCode < 200 || provResp.statusCode >= 300) {
+            DomainFailure failure = ob->mapFailure(provResp.statusCode, provResp.body);
+            if (failure.retryAfterMs < 0)
+                failure.retryAfterMs = DomainFailure::retryAfterFromHeaders(provResp.headers);
+            done(std::unexpected(failure));
+            return;
+        }
 
-    // Parse the provider response into a SemanticResponse
-    auto parsed = ob->parseResponse(provResp);
-    if (!parsed.has_value()) {
-        return std::unexpected(parsed.error());
-    }
+        // Parse the provider response into a SemanticResponse
+        auto parsed = ob->parseResponse(provResp);
+        if (!parsed.has_value()) {
+            done(std::unexpected(parsed.error()));
+            return;
+        }
 
-    if (!provResp.adapterHint.isEmpty()) {
-        parsed->extensions.set(QStringLiteral("provider_adapter_hint"), provResp.adapterHint);
-    }
-    return parsed;
+        if (!provResp.adapterHint.isEmpty()) {
+            parsed->extensions.set(QStringLiteral("provider_adapter_hint"), provResp.adapterHint);
+        }
+        done(std::move(parsed));
+    });
 }
 
 // ---------------------------------------------------------------------------
 // Streaming path
 // ---------------------------------------------------------------------------
 
-Result<StreamSession*> Processor::processStream(SemanticRequest request)
+void Processor::processStream(SemanticRequest request, ProcessStreamCallback done)
 {
-    // Step 1: Validate the request
-    VoidResult valResult = Validate::request(request);
-    if (!valResult.has_value()) {
-        return std::unexpected(valResult.error());
+    auto prepared = prepare(request);
+    if (!prepared.has_value()) {
+        done(std::unexpected(prepared.error()));
+        return;
     }
+    runStreamAttempt(*prepared, std::move(done));
+}
 
-    // Step 2: Ensure capability resolver is available
-    ICapabilityResolver* caps = effectiveCapabilities();
-    if (!caps) {
-        return std::unexpected(
-            DomainFailure::internal(QStringLiteral("capabilities resolver not set")));
+void Processor::runStreamAttempt(std::shared_ptr<RetryState> state,
+                                 ProcessStreamCallback done)
+{
+    // Step 6: Retry loop -- for streaming, we only retry on connection-level
+    // failures. Once a StreamSession is created successfully, no more retries
+    // (mid-stream failover aside).
+    if (state->attempt >= state->plan.maxAttempts) {
+        done(std::unexpected(
+            DomainFailure::internal(QStringLiteral("All stream retry attempts exhausted"))));
+        return;
     }
-
-    // Step 3: Resolve capabilities
-    Result<CapabilityProfile> capResult = caps->resolve(request.target);
-    if (!capResult.has_value()) {
-        return std::unexpected(capResult.error());
+    // Before the breaker check, which claims half-open probes
+    if (delayForRateLimit(*state, [this, state, done]() { runStreamAttempt(state, done); })) {
+        return;
     }
-    const CapabilityProfile& profile = capResult.value();
-
-    // Step 4: Policy preflight and plan
-    Policy* pol = effectivePolicy();
-    ExecutionPlan plan;
-
-    if (pol) {
-        VoidResult pf = pol->preflight(request, profile);
-        if (!pf.has_value()) {
-            return std::unexpected(pf.error());
-        }
-        plan = pol->plan(request, profile);
+    if (!skipOpenEndpoints(*state)) {
+        refundRateLimit(*state);
+        done(std::unexpected(state->lastFailure.value_or(circuitOpen(state->routing.baseUrls))));
+        return;
     }
 
-    // Step 5: Build routing table
-    AttemptRouting routing = buildRouting(request.metadata);
-
-    // Step 6: Retry loop -- for streaming, we only retry on connection-level
-    // failures. Once a StreamSession is created successfully, no more retries.
-    DomainFailure lastFailure = DomainFailure::internal(
-        QStringLiteral("No stream attempts were made"));
-
-    for (int attempt = 0; attempt < plan.maxAttempts; ++attempt) {
-        SemanticRequest routed = withRouting(request, routing, attempt);
-        routed.metadata[QStringLiteral("_stream")] = QStringLiteral("true");
-
-        LOG_DEBUG(QStringLiteral("Processor::processStream attempt %1/%2 url=%3")
-                      .arg(attempt + 1)
-                      .arg(plan.maxAttempts)
-                      .arg(routing.currentUrl()));
-
-        Result<StreamSession*> result = processStreamOnce(routed);
-
+    const int attempt = state->attempt;
+    SemanticRequest routed = withRouting(state->request, state->routing, attempt);
+    routed.metadata[QStringLiteral("_stream")] = QStringLiteral("true");
+
+    LOG_DEBUG(QStringLiteral("Processor::processStream attempt %1/%2 url=%3")
+                  .arg(attempt + 1)
+                  .arg(state->plan.maxAttempts)
+                  .arg(state->routing.currentUrl()));
+
+    AttemptLauncher<StreamSession*> launch =
+        [this](const SemanticRequest& request, QObject* cancelScope, ProcessStreamCallback legDone) {
+            processStreamOnce(request, std::move(legDone), cancelScope);
+        };
+    runHedged<StreamSession*>(state, routed, true, std::move(launch),
+                              [this, state, attempt, done](Result<StreamSession*> result) {
         if (result.has_value()) {
-            return result;
+            settleRateLimit(*state, *result);
+            if (m_streamFailover) {
+                armStreamFailover(state, *result);
+            }
+            done(std::move(result));
+            return;
         }
+        refundRateLimit(*state);
 
-        lastFailure = result.error();
+        const DomainFailure lastFailure = result.error();
 
         // Only retry connection-level (retryable) failures
         if (!lastFailure.retryable) {
             LOG_WARNING(QStringLiteral("Processor: stream failure is not retryable: %1")
                             .arg(lastFailure.message));
-            return std::unexpected(lastFailure);
+            done(std::unexpected(lastFailure));
+            return;
         }
 
-        if (pol) {
-            RetryDecision decision = pol->nextRetry(plan, attempt, lastFailure);
-            if (!decision.retry) {
-                LOG_WARNING(QStringLiteral("Processor: not retrying stream after attempt %1: %2")
-                                .arg(attempt + 1)
-                                .arg(decision.reason));
-                return std::unexpected(lastFailure);
-            }
-            LOG_WARNING(QStringLiteral("Processor: retrying stream (attempt %1/%2): %3")
-                            .arg(attempt + 2)
-                            .arg(plan.maxAttempts)
+        Policy* pol = state->policy;
+        if (!pol) {
+            done(std::unexpected(lastFailure));
+            return;
+        }
+
+        RetryDecision decision = pol->nextRetry(state->plan, attempt, lastFailure);
+        if (!decision.retry) {
+            LOG_WARNING(QStringLiteral("Processor: not retrying stream after attempt %1: %2")
+                            .arg(attempt + 1)
                             .arg(decision.reason));
-            if (decision.switchPath) {
-                routing.advance();
-            }
-        } else {
-            return std::unexpected(lastFailure);
+            done(std::unexpected(lastFailure));
+            return;
+        }
+        LOG_WARNING(QStringLiteral("Processor: retrying stream (attempt %1/%2) in %3 ms: %4")
+                        .arg(attempt + 2)
+                        .arg(state->plan.maxAttempts)
+                        .arg(decision.delayMs)
+                        .arg(decision.reason));
+        if (decision.switchPath) {
+            state->routing.advance();
+        }
+        metrics::registry().upstreamRetries.add();
+        metrics::registry().upstreamRetryDelay.observe(decision.delayMs / 1000.0);
+        state->lastFailure = lastFailure;
+        state->attempt = attempt + 1;
+        if (decision.delayMs <= 0) {
+            runStreamAttempt(state, done);
+            return;
+        }
+        // The worker's event loop keeps serving other requests meanwhile
+        QTimer::singleShot(decision.delayMs, this, [this, state, done]() {
+            runStreamAttempt(state, done);
+        });
+    });
+}
+
+// ---------------------------------------------------------------------------
+// Mid-stream failover
+// ---------------------------------------------------------------------------
+
+void Processor::armStreamFailover(const std::shared_ptr<RetryState>& state, StreamSession* session)
+{
+    auto resumer = std::make_shared<StreamResumer>();
+    QPointer<Processor> self(this);
+    QPointer<StreamSession> guard(session);
+    session->setRecovery(
+        [self, state, resumer, guard](const DomainFailure& failure) {
+            return self && self->failOverStream(state, resumer, guard, failure);
+        },
+        [resumer](StreamFrame& frame) { return resumer->admit(frame); });
+}
+
+bool Processor::failOverStream(const std::shared_ptr<RetryState>& state,
+                               const std::shared_ptr<StreamResumer>& resumer,
+                               const QPointer<StreamSession>& session,
+                               const DomainFailure& failure)
+{
+    Policy* pol = state->policy;
+    if (!session || !failure.retryable || !pol) {
+        return false;
+    }
+
+    const int attempt = state->attempt;
+    RetryDecision decision = pol->nextRetry(state->plan, attempt, failure);
+    if (!decision.retry) {
+        LOG_WARNING(QStringLiteral("Processor: not failing over stream after attempt %1: %2")
+                        .arg(attempt + 1)
+                        .arg(decision.reason));
+        return false;
+    }
+    LOG_WARNING(QStringLiteral("Processor: stream from %1 broke off, failing over (attempt %2/%3) in %4 ms: %5")
+                    .arg(state->routing.currentUrl())
+                    .arg(attempt + 2)
+                    .arg(state->plan.maxAttempts)
+                    .arg(decision.delayMs)
+                    .arg(decision.reason));
+    // Away from the URL that broke off, whatever the policy says about paths
+    state->routing.advance();
+    metrics::registry().upstreamRetries.add();
+    metrics::registry().upstreamRetryDelay.observe(decision.delayMs / 1000.0);
+    state->lastFailure = failure;
+    state->attempt = attempt + 1;
+
+    // Called from the session's error handler; the replacement is connected
+    // from the event loop either way
+    QPointer<Processor> self(this);
+    QTimer::singleShot(qMax(0, decision.delayMs), session.data(), [self, state, resumer, session, failure]() {
+        if (!self) {
+            session->fail(failure);
+            return;
         }
+        self->resumeStream(state, resumer, session);
+    });
+    return true;
+}
+
+void Processor::resumeStream(const std::shared_ptr<RetryState>& state,
+                             const std::shared_ptr<StreamResumer>& resumer,
+                             const QPointer<StreamSession>& session)
+{
+    // The client may have gone while the rate limits held the replacement
+    if (!session) {
+        refundRateLimit(*state);
+        return;
+    }
+    // A replacement is a new request to the group, prompt and all
+    if (delayForRateLimit(*state, [this, state, resumer, session]() {
+            resumeStream(state, resumer, session);
+        })) {
+        return;
+    }
+    if (!skipOpenEndpoints(*state)) {
+        refundRateLimit(*state);
+        session->fail(state->lastFailure.value_or(circuitOpen(state->routing.baseUrls)));
+        return;
     }
 
-    return std::unexpected(
-        DomainFailure::internal(QStringLiteral("All stream retry attempts exhausted")));
+    SemanticRequest routed = withRouting(state->request, state->routing, state->attempt);
+    routed.metadata[QStringLiteral("_stream")] = QStringLiteral("true");
+    IOutboundAdapter* ob = effectiveOutbound();
+    const bool prefill = resumer->canPrefill() && ob && ob->supportsPrefill(routed);
+    if (prefill) {
+        routed = resumer->prefilled(routed);
+    }
+    resumer->restart(prefill ? StreamResumer::Mode::Prefill : StreamResumer::Mode::Regenerate);
+    metrics::registry().upstreamStreamFailovers.add(
+        {prefill ? QStringLiteral("prefill") : QStringLiteral("regenerate")});
+
+    LOG_DEBUG(QStringLiteral("Processor: resuming stream at %1 (%2)")
+                  .arg(state->routing.currentUrl(),
+                       prefill ? QStringLiteral("prefill") : QStringLiteral("regenerate")));
+
+    // The session is the cancel scope: a client that goes away meanwhile
+    // abandons the replacement
+    QPointer<Processor> self(this);
+    processStreamOnce(routed, [self, state, resumer, session](Result<StreamSession*> result) {
+        if (!session) {
+            if (result.has_value())
+                (*result)->deleteLater();
+            return;
+        }
+        if (result.has_value()) {
+            if (self)
+                self->chargeTakeOver(*state);
+            session->takeOver(*result);
+            return;
+        }
+        if (self)
+            self->refundRateLimit(*state);
+        if (!self || !self->failOverStream(state, resumer, session, result.error())) {
+            session->fail(result.error());
+        }
+    }, session.data());
 }
 
-Result<StreamSession*> Processor::processStreamOnce(const SemanticRequest& request)
+void Processor::processStreamOnce(const SemanticRequest& request,
+                                  ProcessStreamCallback done,
+                                  QObject* cancelScope)
 {
+    done = reportOutcome<StreamSession*>(request, std::move(done));
     IOutboundAdapter* ob = effectiveOutbound();
     IExecutor* ex = effectiveExecutor();
 
     if (!ob) {
-        return std::unexpected(
-            DomainFailure::internal(QStringLiteral("outbound adapter not set")));
+        done(std::unexpected(
+            DomainFailure::internal(QStringLiteral("outbound adapter not set"))));
+        return;
     }
     if (!ex) {
-        return std::unexpected(
-            DomainFailure::internal(QStringLiteral("executor not set")));
+        done(std::unexpected(
+            DomainFailure::internal(QStringLiteral("executor not set"))));
+        return;
     }
 
     // Build the provider-level request
     Result<ProviderRequest> provReqResult = ob->buildRequest(request);
     if (!provReqResult.has_value()) {
-        return std::unexpected(provReqResult.error());
+        done(std::unexpected(provReqResult.error()));
+        return;
     }
 
     // Force stream flag
     ProviderRequest provReq = provReqResult.value();
     provReq.stream = true;
+    provReq.cancelScope = cancelScope;
+    const QString adapterHint = provReq.adapterHint;
+
+    // Connect the stream via executor -- the continuation gets a live reply
+    QPointer<Processor> self(this);
+    QElapsedTimer sent;
+    sent.start();
+    ex->connectStream(provReq, [self, ob, adapterHint, sent, done](Result<QNetworkReply*> replyResult) {
+        if (!replyResult.has_value()) {
+            done(std::unexpected(replyResult.error()));
+            return;
+        }
 
-    // Connect the stream via executor -- returns a live QNetworkReply
-    Result<QNetworkReply*> replyResult = ex->connectStream(provReq);
-    if (!replyResult.has_value()) {
-        return std::unexpected(replyResult.error());
-    }
-
-    QNetworkReply* reply = replyResult.value();
-    if (!reply) {
-        return std::unexpected(
-            DomainFailure::internal(QStringLiteral("Executor returned null reply")));
-    }
+        QNetworkReply* reply = replyResult.value();
+        if (!reply) {
+            done(std::unexpected(
+                DomainFailure::internal(QStringLiteral("Executor returned null reply"))));
+            return;
+        }
+        if (!self) {
+            reply->abort();
+            reply->deleteLater();
+            done(std::unexpected(
+                DomainFailure::internal(QStringLiteral("Processor destroyed before stream connected"))));
+            return;
+        }
 
-    // Wrap the reply in a StreamSession. The session takes ownership.
-    auto* session = new StreamSession(reply, ob, provReq.adapterHint, this);
-    return session;
+        // Wrap the reply in a StreamSession. The session takes ownership.
+        auto* session = new StreamSession(reply, ob, adapterHint, self.data());
+        session->setRequestTimer(sent);
+        done(session);
+    });
 }
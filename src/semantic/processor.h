@@ -1,10 +1,23 @@
 #pragma once
+#include "circuit_breaker.h"
+#include "endpoint_balancer.h"
+#include "latency_window.h"
 #include "ports.h"
 #include "policy.h"
+#include "rate_limiter.h"
+#include "stream_resumer.h"
 #include "stream_session.h"
 #include "features/stream_aggregator.h"
 #include "features/stream_splitter.h"
+#include <QHash>
 #include <QObject>
+#include <QPointer>
+#include <functional>
+#include <memory>
+#include <optional>
+
+using ProcessCallback = std::function<void(Result<SemanticResponse>)>;
+using ProcessStreamCallback = std::function<void(Result<StreamSession*>)>;
 
 class Processor : public QObject {
     Q_OBJECT
@@ -16,16 +29,45 @@ public:
     void setCapabilities(ICapabilityResolver* cap) { m_capabilities = cap; }
     void setPolicy(Policy* policy) { m_policy = policy; }
 
+    // Hedging across a request's base URLs. When the current URL has not
+    // answered (non-streaming) or sent its first bytes (streaming) within
+    // `percentile` of its recent latencies, and at least minDelayMs, the
+    // same request also goes to the next URL. The first success is used and
+    // the other attempt is cancelled. A URL needs kHedgeMinSamples latencies
+    // before it is hedged. 0 turns hedging off.
+    void setHedging(int percentile, int minDelayMs);
+    static constexpr int kHedgeMinSamples = 20;
+
+    // Starts each request at the base URL the balancer picks, instead of
+    // the primary, and reports every attempt's outcome to it. Null keeps
+    // the configured order.
+    void setBalancer(EndpointBalancer* balancer) { m_balancer = balancer; }
+
+    // Holds each attempt until the rate limits of its config group (the
+    // "config_group" metadata) allow it, and corrects the tokens charged
+    // with the usage the provider reports. Hedged copies are not charged.
+    void setRateLimiter(RateLimiter* limiter) { m_rateLimiter = limiter; }
+
+    // Mid-stream failover. A stream that fails with a retryable error after
+    // its session was handed out goes on at the next base URL, within the
+    // plan's attempts, and the client's stream carries on. Providers that
+    // support prefill continue the text sent so far; otherwise the request
+    // is sent again and what the client already has is dropped from the
+    // new output.
+    void setStreamFailover(bool enabled) { m_streamFailover = enabled; }
+
     IOutboundAdapter*    outbound = nullptr;
     IExecutor*           executor = nullptr;
     ICapabilityResolver* capabilities = nullptr;
     Policy*              policy = nullptr;
 
-    // Non-streaming (synchronous, uses QEventLoop internally if needed)
-    Result<SemanticResponse> process(SemanticRequest request);
+    // Non-streaming. Returns immediately; `done` is invoked once with the
+    // final response or failure after all retry attempts have settled.
+    void process(SemanticRequest request, ProcessCallback done);
 
-    // Streaming (async, returns signal source)
-    Result<StreamSession*> processStream(SemanticRequest request);
+    // Streaming. `done` receives a live StreamSession (signal source) once
+    // an upstream produced its first bytes, or the last connect failure.
+    void processStream(SemanticRequest request, ProcessStreamCallback done);
 
 private:
     IOutboundAdapter*    m_outbound = nullptr;
@@ -33,8 +75,18 @@ private:
     ICapabilityResolver* m_capabilities = nullptr;
     Policy*              m_policy = nullptr;
 
-    Result<SemanticResponse> processOnce(const SemanticRequest& request);
-    Result<StreamSession*>   processStreamOnce(const SemanticRequest& request);
+    EndpointBalancer* m_balancer = nullptr;
+    RateLimiter* m_rateLimiter = nullptr;
+    bool m_streamFailover = false;
+    int m_hedgePercentile = 0;
+    int m_hedgeMinDelayMs = 1000;
+    // Per base URL, separately for streams (time to first bytes)
+    QHash<QString, LatencyWindow> m_latencies;
+
+    void processOnce(const SemanticRequest& request, ProcessCallback done,
+                     QObject* cancelScope = nullptr);
+    void processStreamOnce(const SemanticRequest& request, ProcessStreamCallback done,
+                           QObject* cancelScope = nullptr);
 
     struct AttemptRouting {
         QStringList baseUrls;
@@ -46,9 +98,76 @@ private:
         QString currentUrl() const { return baseUrls.value(current); }
     };
 
+    // Tokens a stream session holds against its group, across failovers:
+    // the estimates charged and the usage of the replies it went through
+    struct StreamCharge {
+        int estimated = 0;
+        int priorUsed = 0;
+        UsageEntry usage;  // of the current reply
+    };
+
+    // Per-call retry state, shared by the continuations of one request.
+    struct RetryState {
+        SemanticRequest request;
+        ExecutionPlan plan;
+        AttemptRouting routing;
+        Policy* policy = nullptr;
+        int attempt = 0;
+        std::optional<DomainFailure> lastFailure;
+        int estimatedTokens = -1;   // charged to the rate limiter per attempt
+        bool rateReserved = false;  // the attempt waited and is paid for
+        bool rateCharged = false;   // the attempt holds estimatedTokens until settled
+        std::shared_ptr<StreamCharge> streamCharge;  // the handed-out session's
+    };
+
     AttemptRouting buildRouting(const QMap<QString, QString>& metadata) const;
     SemanticRequest withRouting(const SemanticRequest& req,
                                 const AttemptRouting& routing, int attempt) const;
+    Result<std::shared_ptr<RetryState>> prepare(const SemanticRequest& request) const;
+    void runAttempt(std::shared_ptr<RetryState> state, ProcessCallback done);
+    void runStreamAttempt(std::shared_ptr<RetryState> state, ProcessStreamCallback done);
+
+    template<typename T>
+    using AttemptCallback = std::function<void(Result<T>)>;
+    template<typename T>
+    using AttemptLauncher = std::function<void(const SemanticRequest& request, QObject* cancelScope,
+                                               AttemptCallback<T> done)>;
+    // Runs one attempt through `launch`, hedged to the next base URL when
+    // hedging applies. `done` gets the first success, or the last failure.
+    template<typename T>
+    void runHedged(const std::shared_ptr<RetryState>& state, const SemanticRequest& routed,
+                   bool stream, AttemptLauncher<T> launch, AttemptCallback<T> done);
+    // -1 while there are too few samples
+    qint64 hedgeDelayMs(const QString& latencyKey) const;
+    // Wraps an attempt's callback to report its outcome to the balancer and
+    // the circuit breaker
+    template<typename T>
+    AttemptCallback<T> reportOutcome(const SemanticRequest& request, AttemptCallback<T> done) const;
+    // Moves the routing past base URLs whose circuit is open; false if
+    // every one is
+    bool skipOpenEndpoints(RetryState& state) const;
+    // Charges the attempt to its group's rate limits. False if it may go
+    // now; otherwise `resume` runs it again once the limits allow.
+    bool delayForRateLimit(RetryState& state, std::function<void()> resume);
+    // Settles the attempt's estimated tokens with the reported usage, for
+    // streams once the session is gone; a response without usage keeps the
+    // estimate. refundRateLimit() hands back the tokens of a failed attempt.
+    // A failover's replacement adds its charge to the session's.
+    void settleRateLimit(RetryState& state, const UsageEntry& usage) const;
+    void settleRateLimit(RetryState& state, StreamSession* session) const;
+    void refundRateLimit(RetryState& state) const;
+    void chargeTakeOver(RetryState& state) const;
+
+    // Mid-stream failover: armStreamFailover() hooks a handed-out session,
+    // failOverStream() decides on a failure and resumeStream() connects the
+    // replacement the session takes over
+    void armStreamFailover(const std::shared_ptr<RetryState>& state, StreamSession* session);
+    bool failOverStream(const std::shared_ptr<RetryState>& state,
+                        const std::shared_ptr<StreamResumer>& resumer,
+                        const QPointer<StreamSession>& session, const DomainFailure& failure);
+    void resumeStream(const std::shared_ptr<RetryState>& state,
+                      const std::shared_ptr<StreamResumer>& resumer,
+                      const QPointer<StreamSession>& session);
 
     // Helper to resolve the effective outbound/executor/capabilities/policy.
     // Supports both the public raw pointers (legacy) and the setter-based
@@ -0,0 +1,113 @@
+#include "rate_limiter.h"
+#include <QJsonDocument>
+#include <QMutexLocker>
+#include <cmath>
+#include <limits>
+
+namespace {
+
+constexpr double kWindowMs = 60 * 1000;
+constexpr int kCharsPerToken = 4;
+
+}
+
+void RateLimiter::Bucket::refill(qint64 nowMs)
+{
+    if (capacity <= 0)
+        return;
+    level = qMin(capacity, level + double(nowMs - updatedMs) * capacity / kWindowMs);
+    updatedMs = nowMs;
+}
+
+qint64 RateLimiter::Bucket::debtMs() const
+{
+    if (capacity <= 0 || level >= 0)
+        return 0;
+    return qint64(std::ceil(-level * kWindowMs / capacity));
+}
+
+RateLimiter::RateLimiter()
+{
+    m_clock.start();
+}
+
+void RateLimiter::setLimits(const QString& group, const Limits& limits)
+{
+    QMutexLocker locker(&m_mutex);
+    if (limits.rpm <= 0 && limits.tpm <= 0) {
+        m_groups.remove(group);
+        return;
+    }
+    const auto it = m_groups.constFind(group);
+    if (it != m_groups.cend() && it->limits.rpm == limits.rpm && it->limits.tpm == limits.tpm)
+        return;
+
+    // Starts with a full minute's worth
+    const qint64 now = m_clock.elapsed();
+    Group entry;
+    entry.limits = limits;
+    entry.requests = {double(qMax(0, limits.rpm)), double(qMax(0, limits.rpm)), now};
+    entry.tokens = {double(qMax(0, limits.tpm)), double(qMax(0, limits.tpm)), now};
+    m_groups.insert(group, entry);
+}
+
+bool RateLimiter::limited(const QString& group) const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_groups.contains(group);
+}
+
+qint64 RateLimiter::reserve(const QString& group, int tokens)
+{
+    QMutexLocker locker(&m_mutex);
+    const auto it = m_groups.find(group);
+    if (it == m_groups.end())
+        return 0;
+
+    const qint64 now = m_clock.elapsed();
+    it->requests.refill(now);
+    it->tokens.refill(now);
+    if (it->requests.capacity > 0)
+        it->requests.level -= 1;
+    // A request larger than the whole limit waits for one full minute
+    if (it->tokens.capacity > 0)
+        it->tokens.level -= qMin(double(qMax(0, tokens)), it->tokens.capacity);
+    return qMax(it->requests.debtMs(), it->tokens.debtMs());
+}
+
+void RateLimiter::settle(const QString& group, int estimated, int actual)
+{
+    if (actual < 0)
+        return;
+    QMutexLocker locker(&m_mutex);
+    const auto it = m_groups.find(group);
+    if (it == m_groups.end() || it->tokens.capacity <= 0)
+        return;
+    Bucket& tokens = it->tokens;
+    tokens.refill(m_clock.elapsed());
+    const double charged = qMin(double(qMax(0, estimated)), tokens.capacity);
+    tokens.level = qMin(tokens.capacity, tokens.level + charged - double(actual));
+}
+
+int RateLimiter::estimateTokens(const SemanticRequest& request)
+{
+    qint64 chars = 0;
+    for (const InteractionItem& message : request.messages) {
+        for (const Segment& segment : message.content) {
+            chars += segment.text.size();
+            if (!segment.structured.isEmpty())
+                chars += QJsonDocument(segment.structured).toJson(QJsonDocument::Compact).size();
+        }
+        for (const ActionCall& call : message.toolCalls)
+            chars += call.name.size() + call.args.size();
+    }
+    for (const ActionSpec& tool : request.tools) {
+        chars += tool.name.size() + tool.description.size()
+                 + QJsonDocument(tool.parameters).toJson(QJsonDocument::Compact).size();
+    }
+
+    qint64 tokens = chars / kCharsPerToken + 1;
+    const ConstraintSet& constraints = request.constraints;
+    tokens += qMax(0, constraints.maxCompletionTokens.value_or(constraints.maxTokens.value_or(0)));
+    return int(qMin<qint64>(tokens, std::numeric_limits<int>::max()));
+}
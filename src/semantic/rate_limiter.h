@@ -0,0 +1,63 @@
+#pragma once
+#include "request.h"
+#include <QElapsedTimer>
+#include <QHash>
+#include <QMutex>
+#include <QString>
+
+// Local requests-per-minute and tokens-per-minute limits per config group,
+// as token buckets that hold a minute's worth and refill continuously.
+//
+// reserve() takes what a request needs at once and returns how long to wait
+// before sending it. A bucket may go into debt; the debt is the wait of the
+// requests behind, so they go out in arrival order and none is sent only to
+// be turned away with a 429.
+//
+// Tokens are charged from an estimate before each attempt and corrected by
+// settle() with the usage the provider reports, or refunded if it failed.
+//
+// Shared by all workers.
+class RateLimiter {
+public:
+    struct Limits {
+        int rpm = 0;  // 0 = no limit
+        int tpm = 0;
+    };
+
+    RateLimiter();
+
+    // Keeps the buckets of a group whose limits did not change
+    void setLimits(const QString& group, const Limits& limits);
+    bool limited(const QString& group) const;
+
+    // Charges a request and `tokens` to the group; returns the ms to wait
+    // before sending it, 0 to send it now
+    qint64 reserve(const QString& group, int tokens);
+    // Replaces a reservation's estimated tokens with the real count; 0
+    // refunds an attempt the provider did not serve
+    void settle(const QString& group, int estimated, int actual);
+
+    // Prompt text at about four characters a token, plus the output the
+    // request allows, which providers count against TPM up front
+    static int estimateTokens(const SemanticRequest& request);
+
+private:
+    struct Bucket {
+        double capacity = 0;  // 0 = no limit
+        double level = 0;
+        qint64 updatedMs = 0;
+
+        void refill(qint64 nowMs);
+        // ms until the level is back to zero
+        qint64 debtMs() const;
+    };
+    struct Group {
+        Limits limits;
+        Bucket requests;
+        Bucket tokens;
+    };
+
+    mutable QMutex m_mutex;
+    QElapsedTimer m_clock;
+    QHash<QString, Group> m_groups;
+};
@@ -0,0 +1,187 @@
+#include "request_coalescer.h"
+#include "core/log_manager.h"
+#include "core/metrics.h"
+#include <QCryptographicHash>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QMutexLocker>
+
+namespace {
+
+// Per-request bookkeeping that does not change the upstream's answer: the
+// client's credentials and path, the inbound protocol and internal markers
+bool keyedMetadata(const QString& name)
+{
+    return !name.startsWith(QLatin1Char('_'))
+           && !name.startsWith(QStringLiteral("inbound."))
+           && name != QStringLiteral("auth_key")
+           && name != QStringLiteral("request_path")
+           && name != QStringLiteral("original_model");
+}
+
+QJsonObject segmentJson(const Segment& segment)
+{
+    QJsonObject out;
+    out["kind"] = int(segment.kind);
+    out["text"] = segment.text;
+    out["mime"] = segment.media.mimeType;
+    out["uri"] = segment.media.uri;
+    if (!segment.media.inlineData.isEmpty()) {
+        out["data"] = QString::fromLatin1(
+            QCryptographicHash::hash(segment.media.inlineData, QCryptographicHash::Sha256).toHex());
+    }
+    out["structured"] = segment.structured;
+    out["intent"] = segment.intentTag;
+    return out;
+}
+
+QJsonValue optionalJson(const std::optional<double>& value)
+{
+    return value ? QJsonValue(*value) : QJsonValue();
+}
+
+QJsonValue optionalJson(const std::optional<int>& value)
+{
+    return value ? QJsonValue(*value) : QJsonValue();
+}
+
+// QJsonObject keeps its keys sorted, so equal requests serialize alike
+QJsonObject canonicalJson(const SemanticRequest& request)
+{
+    QJsonArray messages;
+    for (const InteractionItem& item : request.messages) {
+        QJsonArray content;
+        for (const Segment& segment : item.content)
+            content.append(segmentJson(segment));
+        QJsonArray calls;
+        for (const ActionCall& call : item.toolCalls)
+            calls.append(QJsonArray{call.callId, call.name, call.args});
+        messages.append(QJsonObject{{"role", item.role},
+                                    {"content", content},
+                                    {"tool_calls", calls},
+                                    {"tool_call_id", item.toolCallId}});
+    }
+
+    QJsonArray tools;
+    for (const ActionSpec& tool : request.tools)
+        tools.append(QJsonObject{{"name", tool.name}, {"description", tool.description},
+                                 {"parameters", tool.parameters}});
+
+    const ConstraintSet& c = request.constraints;
+    const QJsonObject constraints{
+        {"temperature", optionalJson(c.temperature)},
+        {"top_p", optionalJson(c.topP)},
+        {"max_tokens", optionalJson(c.maxTokens)},
+        {"max_completion_tokens", optionalJson(c.maxCompletionTokens)},
+        {"seed", optionalJson(c.seed)},
+        {"frequency_penalty", optionalJson(c.frequencyPenalty)},
+        {"presence_penalty", optionalJson(c.presencePenalty)},
+        {"stop", QJsonArray::fromStringList(c.stopSequences)},
+    };
+
+    QJsonObject metadata;
+    for (auto it = request.metadata.cbegin(); it != request.metadata.cend(); ++it) {
+        if (keyedMetadata(it.key()))
+            metadata[it.key()] = it.value();
+    }
+
+    return QJsonObject{
+        {"kind", int(request.kind)},
+        {"model", request.target.logicalModel},
+        {"profiles", QJsonArray::fromStringList(request.target.preferredProfiles)},
+        {"messages", messages},
+        {"constraints", constraints},
+        {"tools", tools},
+        {"metadata", metadata},
+        {"extensions", request.extensions.data},
+    };
+}
+
+}
+
+bool RequestCoalescer::deterministic(const SemanticRequest& request)
+{
+    if (request.kind == TaskKind::Embedding || request.kind == TaskKind::Ranking)
+        return true;
+    const ConstraintSet& constraints = request.constraints;
+    return (constraints.temperature && *constraints.temperature <= 0) || constraints.seed.has_value();
+}
+
+QByteArray RequestCoalescer::keyOf(const SemanticRequest& request)
+{
+    if (!deterministic(request))
+        return {};
+    return QCryptographicHash::hash(QJsonDocument(canonicalJson(request)).toJson(QJsonDocument::Compact),
+                                    QCryptographicHash::Sha256);
+}
+
+quint64 RequestCoalescer::join(const QByteArray& key, QObject* context, Delivered delivered)
+{
+    QMutexLocker locker(&m_mutex);
+    const auto it = m_flights.find(key);
+    if (it != m_flights.end()) {
+        it->waiters.append({context, std::move(delivered)});
+        metrics::registry().coalescedRequests.add();
+        LOG_DEBUG(QStringLiteral("RequestCoalescer: request joins one in flight (%1 waiting)")
+                      .arg(it->waiters.size()));
+        return 0;
+    }
+
+    Flight flight;
+    flight.id = m_nextId++;
+    flight.leader = context;
+    m_flights.insert(key, flight);
+    m_keys.insert(flight.id, key);
+    return flight.id;
+}
+
+void RequestCoalescer::complete(quint64 flight, const Result<SemanticResponse>& result)
+{
+    Flight done;
+    QMutexLocker locker(&m_mutex);
+    const auto key = m_keys.constFind(flight);
+    if (key == m_keys.cend())
+        return;
+    done = m_flights.take(*key);
+    m_keys.erase(key);
+    deliver(done.waiters, result);
+}
+
+void RequestCoalescer::forget(QObject* context)
+{
+    QList<Waiter> dropped;
+    QMutexLocker locker(&m_mutex);
+    for (auto it = m_flights.begin(); it != m_flights.end();) {
+        for (qsizetype i = it->waiters.size() - 1; i >= 0; --i) {
+            if (it->waiters.at(i).context == context)
+                dropped.append(it->waiters.takeAt(i));
+        }
+        if (it->leader != context) {
+            ++it;
+            continue;
+        }
+        deliver(it->waiters, std::unexpected(DomainFailure::unavailable(
+            QStringLiteral("The identical request this one waited for was abandoned"))));
+        m_keys.remove(it->id);
+        it = m_flights.erase(it);
+    }
+}
+
+int RequestCoalescer::inFlight() const
+{
+    QMutexLocker locker(&m_mutex);
+    return int(m_flights.size());
+}
+
+void RequestCoalescer::deliver(QList<Waiter>& waiters, const Result<SemanticResponse>& result)
+{
+    // A waiter's context lives until forget() has taken its waiters out,
+    // so the call is always posted
+    for (Waiter& waiter : waiters) {
+        QMetaObject::invokeMethod(waiter.context,
+                                  [delivered = std::move(waiter.delivered), result]() {
+            delivered(result);
+        }, Qt::QueuedConnection);
+    }
+}
@@ -0,0 +1,61 @@
+#pragma once
+#include "ports.h"
+#include <QByteArray>
+#include <QHash>
+#include <QList>
+#include <QMutex>
+#include <QObject>
+#include <functional>
+
+// Single flight for identical non-streaming requests. The first request
+// with a key goes upstream; identical ones that arrive while it is in
+// flight wait for its result instead of sending their own. Each gets the
+// same response, or the same failure.
+//
+// Only requests that look deterministic are keyed: embeddings and ranking,
+// and generation at temperature 0 or with a seed. Sampled requests are
+// expected to differ.
+//
+// Shared by all workers. A result is handed to waiters on other workers
+// through their event loops.
+class RequestCoalescer {
+public:
+    using Delivered = std::function<void(Result<SemanticResponse>)>;
+
+    // SHA-256 of the request's content, target and config group; empty if
+    // the request should not be coalesced
+    static QByteArray keyOf(const SemanticRequest& request);
+    static bool deterministic(const SemanticRequest& request);
+
+    // Returns a flight id when the caller is the first with `key`: it sends
+    // the request and passes the result to complete(). Returns 0 when an
+    // identical request is in flight; `delivered` is then called from
+    // context's event loop with its result. Waiters of a context go away
+    // with forget(context).
+    quint64 join(const QByteArray& key, QObject* context, Delivered delivered);
+    void complete(quint64 flight, const Result<SemanticResponse>& result);
+    // Also fails the waiters of flights the context leads, which will not
+    // complete
+    void forget(QObject* context);
+
+    int inFlight() const;
+
+private:
+    struct Waiter {
+        QObject* context = nullptr;
+        Delivered delivered;
+    };
+    struct Flight {
+        quint64 id = 0;
+        QObject* leader = nullptr;
+        QList<Waiter> waiters;
+    };
+
+    // Mutex held; takes the waiters' callbacks
+    static void deliver(QList<Waiter>& waiters, const Result<SemanticResponse>& result);
+
+    mutable QMutex m_mutex;
+    QHash<QByteArray, Flight> m_flights;
+    QHash<quint64, QByteArray> m_keys;
+    quint64 m_nextId = 1;
+};
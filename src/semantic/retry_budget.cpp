@@ -0,0 +1,54 @@
+#include "retry_budget.h"
+#include <QMutexLocker>
+
+RetryBudget::RetryBudget()
+{
+    m_clock.start();
+}
+
+void RetryBudget::setPercent(int percent)
+{
+    QMutexLocker locker(&m_mutex);
+    m_percent = qBound(0, percent, 100);
+}
+
+int RetryBudget::percent() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_percent;
+}
+
+RetryBudget::Bucket& RetryBudget::current()
+{
+    const qint64 slot = m_clock.elapsed() / kSlotMs;
+    Bucket& bucket = m_buckets[slot % kBuckets];
+    if (bucket.slot != slot)
+        bucket = Bucket{slot, 0, 0};
+    return bucket;
+}
+
+void RetryBudget::recordRequest()
+{
+    QMutexLocker locker(&m_mutex);
+    ++current().requests;
+}
+
+bool RetryBudget::tryRetry()
+{
+    QMutexLocker locker(&m_mutex);
+    Bucket& now = current();
+    if (m_percent > 0) {
+        int requests = 0;
+        int retries = 0;
+        for (const Bucket& bucket : m_buckets) {
+            if (bucket.slot > now.slot - kBuckets) {
+                requests += bucket.requests;
+                retries += bucket.retries;
+            }
+        }
+        if (retries >= qMax(kMinRetries, requests * m_percent / 100))
+            return false;
+    }
+    ++now.retries;
+    return true;
+}
@@ -0,0 +1,44 @@
+#pragma once
+#include <QElapsedTimer>
+#include <QMutex>
+#include <array>
+
+// Caps retries at a share of the requests over the last kWindowMs, so that
+// an upstream in trouble is not hit with a multiple of the normal load.
+// kMinRetries are always allowed per window, so that a proxy with little
+// traffic can still retry.
+//
+// Process-wide: every worker's Policy counts into the same budget.
+class RetryBudget {
+public:
+    static constexpr int kWindowMs = 10 * 1000;
+    static constexpr int kMinRetries = 10;
+
+    RetryBudget();
+
+    // 0 lets every retry through
+    void setPercent(int percent);
+    int percent() const;
+
+    void recordRequest();
+    // Takes a retry from the budget; false if it is spent
+    bool tryRetry();
+
+private:
+    static constexpr int kBuckets = 10;
+    static constexpr int kSlotMs = kWindowMs / kBuckets;
+
+    struct Bucket {
+        qint64 slot = -1;  // elapsed time / kSlotMs the counts are for
+        int requests = 0;
+        int retries = 0;
+    };
+
+    // Mutex held
+    Bucket& current();
+
+    mutable QMutex m_mutex;
+    QElapsedTimer m_clock;
+    int m_percent = 10;
+    std::array<Bucket, kBuckets> m_buckets;
+};
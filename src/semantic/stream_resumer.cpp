@@ -0,0 +1,135 @@
+#include "stream_resumer.h"
+
+namespace {
+
+qsizetype trimmedLength(const QString& text)
+{
+    qsizetype end = text.size();
+    while (end > 0 && text.at(end - 1).isSpace())
+        --end;
+    return end;
+}
+
+}
+
+bool StreamResumer::admit(StreamFrame& frame)
+{
+    switch (frame.type) {
+    case FrameType::Started:
+        if (m_started)
+            return false;
+        m_started = true;
+        return true;
+    case FrameType::Delta:
+        return admitText(frame);
+    case FrameType::ActionDelta:
+        return admitAction(frame);
+    default:
+        return true;
+    }
+}
+
+bool StreamResumer::admitText(StreamFrame& frame)
+{
+    QString& sent = m_text[frame.candidateIndex];
+    qsizetype& skip = m_textSkip[frame.candidateIndex];
+    bool hadText = false;
+    for (auto it = frame.deltaSegments.begin(); it != frame.deltaSegments.end();) {
+        if (it->kind != SegmentKind::Text) {
+            ++it;
+            continue;
+        }
+        hadText = true;
+        if (skip > 0) {
+            const qsizetype n = qMin(skip, it->text.size());
+            it->text.remove(0, n);
+            skip -= n;
+        }
+        // The provider may repeat the whitespace the prefill ended before
+        if (!m_trimmedTail.isEmpty() && !it->text.isEmpty()) {
+            qsizetype common = 0;
+            while (common < m_trimmedTail.size() && common < it->text.size()
+                   && it->text.at(common) == m_trimmedTail.at(common)) {
+                ++common;
+            }
+            it->text.remove(0, common);
+            m_trimmedTail.clear();
+        }
+        if (it->text.isEmpty()) {
+            it = frame.deltaSegments.erase(it);
+            continue;
+        }
+        sent += it->text;
+        ++it;
+    }
+    // Frames without text (block boundaries, pings) pass as they are
+    return !hadText || !frame.deltaSegments.isEmpty();
+}
+
+bool StreamResumer::admitAction(StreamFrame& frame)
+{
+    ActionDelta& delta = frame.actionDelta;
+    if (!delta.callId.isEmpty() || !delta.name.isEmpty()) {
+        ++m_actionIndex;
+        if (m_actionIndex < m_replayed) {
+            // The client has this call; only new arguments go on
+            m_argsSkip = m_actions.at(m_actionIndex).args.size();
+            delta.callId.clear();
+            delta.name.clear();
+        } else {
+            m_actions.append({delta.callId, delta.name, QString()});
+            m_argsSkip = 0;
+        }
+    }
+    if (m_actionIndex < 0 || m_actionIndex >= m_actions.size())
+        return true;
+
+    if (m_argsSkip > 0) {
+        const qsizetype n = qMin(m_argsSkip, delta.argsPatch.size());
+        delta.argsPatch.remove(0, n);
+        m_argsSkip -= n;
+    }
+    m_actions[m_actionIndex].args += delta.argsPatch;
+    return !delta.callId.isEmpty() || !delta.argsPatch.isEmpty();
+}
+
+bool StreamResumer::canPrefill() const
+{
+    if (!m_actions.isEmpty())
+        return false;
+    for (auto it = m_text.cbegin(); it != m_text.cend(); ++it) {
+        if (it.key() != 0 && !it.value().isEmpty())
+            return false;
+    }
+    return trimmedLength(m_text.value(0)) > 0;
+}
+
+SemanticRequest StreamResumer::prefilled(const SemanticRequest& request) const
+{
+    // Providers reject a prefill that ends in whitespace
+    const QString& text = m_text.value(0);
+    InteractionItem prefix;
+    prefix.role = QStringLiteral("assistant");
+    prefix.content.append(Segment::fromText(text.left(trimmedLength(text))));
+
+    SemanticRequest copy = request;
+    copy.messages.append(prefix);
+    return copy;
+}
+
+void StreamResumer::restart(Mode mode)
+{
+    m_textSkip.clear();
+    m_trimmedTail.clear();
+    m_replayed = m_actions.size();
+    m_actionIndex = -1;
+    m_argsSkip = 0;
+
+    if (mode == Mode::Regenerate) {
+        for (auto it = m_text.cbegin(); it != m_text.cend(); ++it)
+            m_textSkip[it.key()] = it.value().size();
+        return;
+    }
+    const QString& text = m_text.value(0);
+    m_trimmedTail = text.mid(trimmedLength(text));
+}
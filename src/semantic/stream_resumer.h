@@ -0,0 +1,56 @@
+#pragma once
+#include "frame.h"
+#include "request.h"
+#include <QList>
+#include <QMap>
+#include <QString>
+
+// Keeps track of what a stream has sent the client, so that a replacement
+// upstream stream after a mid-stream failure can carry on from there:
+//  - Prefill: the request is re-sent with the text so far as a trailing
+//    assistant message, and the provider continues it.
+//  - Regenerate: the request is re-sent as is, and as much text and tool
+//    call arguments as the client already has are dropped from the new
+//    output. Sampling may differ, so the seam is only exact for
+//    deterministic requests.
+// Either way the replacement's Started frame is dropped, so the client sees
+// one message.
+class StreamResumer {
+public:
+    enum class Mode { Prefill, Regenerate };
+
+    // Filter for frames on their way to the client: records what it lets
+    // through and, after restart(), trims what the client already has.
+    // False to drop the frame.
+    bool admit(StreamFrame& frame);
+
+    // Whether the output so far is plain text of one candidate
+    bool canPrefill() const;
+    // The request with the text so far as the assistant's reply to continue
+    SemanticRequest prefilled(const SemanticRequest& request) const;
+
+    // A replacement upstream stream starts
+    void restart(Mode mode);
+
+private:
+    struct Action {
+        QString callId;
+        QString name;
+        QString args;
+    };
+
+    bool admitText(StreamFrame& frame);
+    bool admitAction(StreamFrame& frame);
+
+    // Sent to the client
+    QMap<int, QString> m_text;  // per candidate
+    QList<Action> m_actions;
+    bool m_started = false;
+
+    // Reading a replacement stream
+    QMap<int, qsizetype> m_textSkip;  // chars of each candidate still to drop
+    QString m_trimmedTail;            // whitespace cut off the prefill
+    qsizetype m_replayed = 0;         // calls the client already has
+    int m_actionIndex = -1;           // call of the current stream being read
+    qsizetype m_argsSkip = 0;         // argument chars of it still to drop
+};
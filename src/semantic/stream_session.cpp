@@ -1,5 +1,6 @@
 #include "stream_session.h"
 #include "core/log_manager.h"
+#include "core/metrics.h"
 
 StreamSession::StreamSession(QNetworkReply* reply,
                              IOutboundAdapter* outbound,
@@ -12,9 +13,18 @@ StreamSession::StreamSession(QNetworkReply* reply,
 {
     Q_ASSERT(m_reply);
     Q_ASSERT(m_outbound);
+    m_sent.start();
 
+    attachReply();
+}
+
+void StreamSession::attachReply()
+{
     // Take ownership of the reply so it is cleaned up with this session
     m_reply->setParent(this);
+    if (m_paused) {
+        m_reply->setReadBufferSize(kPausedReadBufferSize);
+    }
 
     connect(m_reply, &QNetworkReply::readyRead,
             this, &StreamSession::onReadyRead);
@@ -22,10 +32,26 @@ StreamSession::StreamSession(QNetworkReply* reply,
             this, &StreamSession::onReplyFinished);
     connect(m_reply, &QNetworkReply::errorOccurred,
             this, &StreamSession::onReplyError);
+
+    // The executor hands the reply over after its first readyRead, so the
+    // first bytes (or the whole body, if the reply already finished) are
+    // waiting in the reply buffer and will not be signalled again. Drain them
+    // once the caller has connected to our signals.
+    if (m_reply->bytesAvailable() > 0 || m_reply->isFinished()) {
+        QMetaObject::invokeMethod(this, [this, reply = m_reply]() {
+            if (m_reply != reply) return;
+            onReadyRead();
+            if (m_reply && m_reply->isFinished()) {
+                onReplyFinished();
+            }
+        }, Qt::QueuedConnection);
+    }
 }
 
 StreamSession::~StreamSession()
 {
+    // Aborting the reply below reports an error; nobody is left to recover
+    m_recover = nullptr;
     if (m_reply) {
         m_reply->abort();
         m_reply->deleteLater();
@@ -35,14 +61,101 @@ StreamSession::~StreamSession()
 
 void StreamSession::abort()
 {
+    m_recover = nullptr;
     if (m_reply) {
         m_reply->abort();
+    } else if (m_recovering) {
+        fail(DomainFailure::timeout(QStringLiteral("Stream operation was cancelled")));
     }
 }
 
-void StreamSession::onReadyRead()
+void StreamSession::setRecovery(RecoverHandler recover, FrameFilter filter)
+{
+    m_recover = std::move(recover);
+    m_filter = std::move(filter);
+}
+
+void StreamSession::takeOver(StreamSession* replacement)
+{
+    Q_ASSERT(replacement && replacement->m_reply);
+    if (!m_recovering || m_finished) {
+        delete replacement;
+        return;
+    }
+
+    m_reply = replacement->m_reply;
+    replacement->m_reply = nullptr;
+    disconnect(m_reply, nullptr, replacement, nullptr);
+    m_reply->setParent(this);
+    delete replacement;
+
+    m_recovering = false;
+    m_finishDeferred = false;
+    attachReply();
+}
+
+void StreamSession::fail(const DomainFailure& failure)
+{
+    if (m_finished) return;
+    m_recovering = false;
+    LOG_ERROR(QStringLiteral("StreamSession error [%1]: %2")
+                  .arg(failure.code, failure.message));
+    m_finished = true;
+    emit error(failure);
+}
+
+void StreamSession::endWith(const DomainFailure& failure)
+{
+    if (!m_recover || !m_recover(failure)) {
+        fail(failure);
+        return;
+    }
+
+    // Whatever is left of the failed reply is dropped with it
+    LOG_WARNING(QStringLiteral("StreamSession: recovering from [%1]: %2")
+                    .arg(failure.code, failure.message));
+    m_recovering = true;
+    if (m_reply) {
+        QNetworkReply* reply = m_reply;
+        m_reply = nullptr;
+        disconnect(reply, nullptr, this, nullptr);
+        reply->abort();
+        reply->deleteLater();
+    }
+    m_sseBuffer.clear();
+    m_pendingEventType.clear();
+    m_pendingDataLines.clear();
+    m_finishDeferred = false;
+}
+
+void StreamSession::setPaused(bool paused)
 {
+    if (m_paused == paused) return;
+    m_paused = paused;
     if (!m_reply) return;
+
+    if (paused) {
+        m_reply->setReadBufferSize(kPausedReadBufferSize);
+        return;
+    }
+
+    m_reply->setReadBufferSize(0);
+    // Bytes that arrived while paused were not signalled to anyone; drain
+    // them from the event loop, since resuming usually happens inside a
+    // bytesWritten handler of the downstream socket.
+    QMetaObject::invokeMethod(this, [this]() {
+        if (m_paused) return;
+        onReadyRead();
+        if (m_finishDeferred && !m_paused) {
+            m_finishDeferred = false;
+            onReplyFinished();
+        }
+    }, Qt::QueuedConnection);
+}
+
+void StreamSession::onReadyRead()
+{
+    if (!m_reply || m_paused) return;
     m_sseBuffer.append(m_reply->readAll());
     parseSseEvents();
 }
@@ -50,6 +163,14 @@ void StreamSession::onReadyRead()
 void StreamSession::onReplyFinished()
 {
     if (m_finished) return;
+    if (m_paused) {
+        m_finishDeferred = true;
+        return;
+    }
+
+    if (m_reply) {
+        m_sseBuffer.append(m_reply->readAll());
+    }
 
     // Process any remaining data in the buffer by appending a trailing
     // double-newline to flush the last event block if it was incomplete.
@@ -58,7 +179,16 @@ void StreamSession::onReplyFinished()
         parseSseEvents();
     }
 
+    // A frame handler may have paused us with events still buffered
+    if (m_paused && !m_finished) {
+        m_finishDeferred = true;
+        return;
+    }
+    // A bad chunk may have handed the stream to recovery
+    if (m_finished || m_recovering) return;
+
     m_finished = true;
+    recordFinished();
     emit finished();
 }
 
@@ -124,18 +254,14 @@ void StreamSession::onReplyError(QNetworkReply::NetworkError code)
     }
     }
 
-    LOG_ERROR(QStringLiteral("StreamSession error [%1]: %2")
-                  .arg(failure.code, failure.message));
-
-    m_finished = true;
-    emit error(failure);
+    endWith(failure);
 }
 
 bool StreamSession::parseSseEvents()
 {
     bool processed = false;
 
-    while (true) {
+    while (!m_paused) {
         // SSE events are delimited by double newlines.
         // We check for "\r\n\r\n" first (longer delimiter) to avoid partial
         // matches, then fall back to "\n\n".
@@ -231,6 +357,7 @@ void StreamSession::flushPendingEvent()
     if (data == "[DONE]") {
         if (!m_finished) {
             m_finished = true;
+            recordFinished();
             emit finished();
         }
         return;
@@ -254,10 +381,50 @@ void StreamSession::flushPendingEvent()
     Result<StreamFrame> result = m_outbound->parseChunk(chunk);
 
     if (result.has_value()) {
-        emit frameReady(result.value());
+        StreamFrame frame = std::move(result.value());
+        if (m_filter && !m_filter(frame)) {
+            return;
+        }
+        recordFrame(frame);
+        emit frameReady(frame);
     } else {
         LOG_WARNING(QStringLiteral("StreamSession: chunk parse error: %1")
                         .arg(result.error().message));
-        emit error(result.error());
+        if (m_recover) {
+            endWith(result.error());
+        } else {
+            emit error(result.error());
+        }
+    }
+}
+
+void StreamSession::recordFrame(const StreamFrame& frame)
+{
+    m_completionTokens = qMax(m_completionTokens, qint64(frame.usageDelta.completionTokens));
+    if (frame.type != FrameType::Delta && frame.type != FrameType::ActionDelta) {
+        return;
+    }
+
+    auto& registry = metrics::registry();
+    const qint64 now = m_sent.nsecsElapsed();
+    if (m_firstDeltaNs < 0) {
+        m_firstDeltaNs = now;
+        registry.timeToFirstToken.observe(double(now) / 1e9);
+    } else {
+        registry.interTokenGap.observe(double(now - m_lastDeltaNs) / 1e9);
+    }
+    m_lastDeltaNs = now;
+    ++m_deltaFrames;
+}
+
+void StreamSession::recordFinished() const
+{
+    // Decode rate after the first token; providers that report no usage are
+    // measured in delta frames
+    const qint64 spanNs = m_lastDeltaNs - m_firstDeltaNs;
+    if (m_deltaFrames < 2 || spanNs <= 0) {
+        return;
     }
+    const qint64 tokens = m_completionTokens > 0 ? m_completionTokens : m_deltaFrames;
+    metrics::registry().tokensPerSecond.observe(double(tokens) / (double(spanNs) / 1e9));
 }
@@ -1,7 +1,9 @@
 #pragma once
 #include "ports.h"
+#include <QElapsedTimer>
 #include <QObject>
 #include <QNetworkReply>
+#include <functional>
 
 class StreamSession : public QObject {
     Q_OBJECT
@@ -12,8 +14,34 @@ public:
                            QObject* parent = nullptr);
     ~StreamSession() override;
 
+    // Also ends a pending recovery
     void abort();
 
+    // Mid-stream failover. On a failure the handler returns true to take
+    // over: the reply is dropped, the session stays open, and the handler
+    // later calls takeOver() with a replacement or fail(). The filter sees
+    // every frame before it is emitted and returns false to drop it.
+    using RecoverHandler = std::function<bool(const DomainFailure& failure)>;
+    using FrameFilter = std::function<bool(StreamFrame& frame)>;
+    void setRecovery(RecoverHandler recover, FrameFilter filter);
+    // Continues with the reply of `replacement`, which is deleted
+    void takeOver(StreamSession* replacement);
+    void fail(const DomainFailure& failure);
+
+    // Backpressure from the downstream client. While paused no frames are
+    // emitted and the reply's read buffer is capped, so Qt stops reading the
+    // upstream socket once it fills and TCP flow control slows the provider.
+    // Resuming drains whatever was buffered, then reads continue as normal.
+    void setPaused(bool paused);
+    bool isPaused() const { return m_paused; }
+
+    // When the upstream request went out, for time-to-first-token. Defaults
+    // to when the session was created.
+    void setRequestTimer(const QElapsedTimer& sent) { m_sent = sent; }
+
+    // Reply buffer cap applied while paused
+    static constexpr qint64 kPausedReadBufferSize = 64 * 1024;
+
 signals:
     void frameReady(const StreamFrame& frame);
     void finished();
@@ -31,8 +59,24 @@ private:
     QString m_pendingEventType;
     QList<QByteArray> m_pendingDataLines;
     bool m_finished = false;
+    bool m_paused = false;
+    bool m_finishDeferred = false;   // reply finished while paused
     QString m_adapterHint;
+    RecoverHandler m_recover;
+    FrameFilter m_filter;
+    bool m_recovering = false;       // reply dropped, waiting for takeOver()
+
+    // Stream timing for the metrics registry
+    QElapsedTimer m_sent;
+    qint64 m_firstDeltaNs = -1;
+    qint64 m_lastDeltaNs = -1;
+    qint64 m_deltaFrames = 0;
+    qint64 m_completionTokens = 0;
 
+    void attachReply();
+    void endWith(const DomainFailure& failure);
     bool parseSseEvents();
     void flushPendingEvent();
+    void recordFrame(const StreamFrame& frame);
+    void recordFinished() const;
 };
@@ -248,6 +248,24 @@ void ProxyConfigDialog::setupUi() {
     retryLayout->addStretch();
     advLayout->addLayout(retryLayout);
 
+    // Local rate limits
+    auto* rateLayout = new QHBoxLayout();
+    rateLayout->addWidget(new QLabel(QStringLiteral("每分钟请求数:"), this));
+    m_rpmSpin = new QSpinBox(this);
+    m_rpmSpin->setRange(0, 1000000);
+    m_rpmSpin->setSpecialValueText(QStringLiteral("不限"));
+    m_rpmSpin->setToolTip(QStringLiteral("超出时请求在本地排队，等额度恢复后再发出，而不是发给上游被 429 拒绝"));
+    rateLayout->addWidget(m_rpmSpin);
+    rateLayout->addWidget(new QLabel(QStringLiteral("每分钟 token 数:"), this));
+    m_tpmSpin = new QSpinBox(this);
+    m_tpmSpin->setRange(0, 100000000);
+    m_tpmSpin->setSingleStep(1000);
+    m_tpmSpin->setSpecialValueText(QStringLiteral("不限"));
+    m_tpmSpin->setToolTip(QStringLiteral("发送前按请求长度估算 token 数，收到响应后按上游返回的用量校正"));
+    rateLayout->addWidget(m_tpmSpin);
+    rateLayout->addStretch();
+    advLayout->addLayout(rateLayout);
+
     // Hijack domain override
     auto* hijackLayout = new QHBoxLayout();
     hijackLayout->addWidget(new QLabel(QStringLiteral("劫持域名覆盖:"), this));
@@ -362,6 +380,8 @@ void ProxyConfigDialog::populateFields(const ConfigGroup& config) {
 
     // Advanced fields
     m_maxRetrySpin->setValue(config.maxRetryAttempts);
+    m_rpmSpin->setValue(config.rpm);
+    m_tpmSpin->setValue(config.tpm);
     m_hijackDomainEdit->setText(config.hijackDomainOverride);
 
     // Populate custom headers table
@@ -392,6 +412,8 @@ ConfigGroup ProxyConfigDialog::getConfig() const {
     if (g.middleRoute.isEmpty())
         g.middleRoute = "/v1";
     g.maxRetryAttempts = m_maxRetrySpin->value();
+    g.rpm = m_rpmSpin->value();
+    g.tpm = m_tpmSpin->value();
     g.hijackDomainOverride = m_hijackDomainEdit->text().trimmed();
 
     // Read custom headers from table
@@ -722,6 +744,8 @@ void ConfigGroupPanel::onAddConfig() {
         map["api_key"] = config.apiKey;
         map["middle_route"] = config.middleRoute;
         map["max_retry_attempts"] = config.maxRetryAttempts;
+        map["rpm"] = config.rpm;
+        map["tpm"] = config.tpm;
         map["hijack_domain_override"] = config.hijackDomainOverride;
         // custom headers
         QVariantMap headerMap;
@@ -758,6 +782,8 @@ void ConfigGroupPanel::onEditConfig() {
         map["api_key"] = newConfig.apiKey;
         map["middle_route"] = newConfig.middleRoute;
         map["max_retry_attempts"] = newConfig.maxRetryAttempts;
+        map["rpm"] = newConfig.rpm;
+        map["tpm"] = newConfig.tpm;
         map["hijack_domain_override"] = newConfig.hijackDomainOverride;
         // custom headers
         QVariantMap headerMap;
@@ -905,6 +931,8 @@ void ConfigGroupPanel::onExportConfig() {
         obj["api_key"] = m_config->encodeApiKeyForExternal(g.apiKey);
         obj["middle_route"] = g.middleRoute;
         obj["max_retry_attempts"] = g.maxRetryAttempts;
+        obj["rpm"] = g.rpm;
+        obj["tpm"] = g.tpm;
         obj["hijack_domain_override"] = g.hijackDomainOverride;
         // custom_headers
         QJsonObject headersObj;
@@ -961,6 +989,8 @@ void ConfigGroupPanel::onImportConfig() {
         map["api_key"] = apiKey;
         map["middle_route"] = obj["middle_route"].toString("/v1");
         map["max_retry_attempts"] = obj["max_retry_attempts"].toInt(3);
+        map["rpm"] = obj["rpm"].toInt();
+        map["tpm"] = obj["tpm"].toInt();
         map["hijack_domain_override"] = obj["hijack_domain_override"].toString();
         m_config->addGroup(map);
         ++imported;
@@ -53,6 +53,8 @@ private:
 
     QTabWidget*   m_tabWidget;
     QSpinBox*     m_maxRetrySpin;
+    QSpinBox*     m_rpmSpin;
+    QSpinBox*     m_tpmSpin;
     QLineEdit*    m_hijackDomainEdit;
     QTableWidget* m_customHeadersTable;
     QPushButton*  m_btnAddHeader;
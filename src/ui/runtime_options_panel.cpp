@@ -46,10 +46,27 @@ void RuntimeOptionsPanel::setupUi() {
     m_chkConnPool->setChecked(true);
     netLayout->addWidget(m_chkConnPool);
 
+    m_chkBalanceUrls = new QCheckBox(QStringLiteral("在主 URL 与备用 URL 间均衡负载"), this);
+    m_chkBalanceUrls->setToolTip(QStringLiteral("按各 URL 近期的延迟、错误率和并发请求数选择起始 URL，而不是总从主 URL 开始；统计数据在重启后保留；重启代理后生效"));
+    netLayout->addWidget(m_chkBalanceUrls);
+
+    m_chkAdaptiveConcurrency = new QCheckBox(QStringLiteral("按上游自适应限制并发请求"), this);
+    m_chkAdaptiveConcurrency->setToolTip(QStringLiteral("每个上游的并发上限从 20 开始，响应正常时逐步提高，遇到 429、5xx 或超时时降低；超出上限的请求排队等待，最多 10 秒；重启代理后生效"));
+    netLayout->addWidget(m_chkAdaptiveConcurrency);
+
+    m_chkStreamFailover = new QCheckBox(QStringLiteral("流式响应中途断开时切换上游继续"), this);
+    m_chkStreamFailover->setToolTip(QStringLiteral("流式响应开始后上游断开时，改用下一个 URL 接着输出，客户端不会察觉中断；Anthropic 出站从已输出的文本续写，其他出站重新生成并跳过已发送的部分；重启代理后生效"));
+    netLayout->addWidget(m_chkStreamFailover);
+
+    m_chkCoalesce = new QCheckBox(QStringLiteral("合并同时进行的相同请求"), this);
+    m_chkCoalesce->setToolTip(QStringLiteral("非流式请求与正在进行的请求完全相同（内容、模型与配置组一致，且 temperature 为 0 或指定了 seed，或为 embedding/rerank）时，不再单独发往上游，而是共用其响应；重启代理后生效"));
+    netLayout->addWidget(m_chkCoalesce);
+
     auto* poolLayout = new QHBoxLayout();
-    poolLayout->addWidget(new QLabel(QStringLiteral("连接池大小:"), this));
+    poolLayout->addWidget(new QLabel(QStringLiteral("每主机连接数:"), this));
     m_spinPoolSize = new QSpinBox(this);
     m_spinPoolSize->setRange(1, 200);
+    m_spinPoolSize->setToolTip(QStringLiteral("每个上游主机最多的 HTTP/2 连接数，每个连接复用多个请求；重启代理后生效"));
     m_spinPoolSize->setValue(10);
     poolLayout->addWidget(m_spinPoolSize);
     poolLayout->addStretch();
@@ -73,6 +90,18 @@ void RuntimeOptionsPanel::setupUi() {
     m_comboDownstream->addItem(QStringLiteral("强制关闭"), static_cast<int>(StreamMode::ForceOff));
     streamLayout->addRow(QStringLiteral("下游:"), m_comboDownstream);
 
+    m_comboSseWriteMode = new QComboBox(this);
+    m_comboSseWriteMode->addItem(QStringLiteral("低延迟"), static_cast<int>(SseWriteMode::Latency));
+    m_comboSseWriteMode->addItem(QStringLiteral("高吞吐"), static_cast<int>(SseWriteMode::Throughput));
+    m_comboSseWriteMode->setToolTip(QStringLiteral("高吞吐模式会在合并窗口内合并流式事件，减少TLS记录数"));
+    streamLayout->addRow(QStringLiteral("流式写出:"), m_comboSseWriteMode);
+
+    m_spinSseCoalesce = new QSpinBox(this);
+    m_spinSseCoalesce->setRange(5, 20);
+    m_spinSseCoalesce->setSuffix(QStringLiteral(" ms"));
+    m_spinSseCoalesce->setValue(10);
+    streamLayout->addRow(QStringLiteral("合并窗口:"), m_spinSseCoalesce);
+
     mainLayout->addWidget(streamGroup);
 
     // Advanced options
@@ -98,6 +127,96 @@ void RuntimeOptionsPanel::setupUi() {
     m_spinConnectionTimeout->setValue(30000);
     advLayout->addRow(QStringLiteral("连接超时:"), m_spinConnectionTimeout);
 
+    m_spinWorkerThreads = new QSpinBox(this);
+    m_spinWorkerThreads->setRange(0, 64);
+    m_spinWorkerThreads->setSpecialValueText(QStringLiteral("自动"));
+    m_spinWorkerThreads->setToolTip(QStringLiteral("处理客户端连接的线程数，重启代理后生效"));
+    m_spinWorkerThreads->setValue(0);
+    advLayout->addRow(QStringLiteral("工作线程:"), m_spinWorkerThreads);
+
+    m_spinMaxRequestBody = new QSpinBox(this);
+    m_spinMaxRequestBody->setRange(1, 1024);
+    m_spinMaxRequestBody->setSuffix(QStringLiteral(" MB"));
+    m_spinMaxRequestBody->setValue(64);
+    advLayout->addRow(QStringLiteral("请求体上限:"), m_spinMaxRequestBody);
+
+    m_spinTlsSessionLifetime = new QSpinBox(this);
+    m_spinTlsSessionLifetime->setRange(0, 7200);
+    m_spinTlsSessionLifetime->setSuffix(QStringLiteral(" s"));
+    m_spinTlsSessionLifetime->setSingleStep(300);
+    m_spinTlsSessionLifetime->setSpecialValueText(QStringLiteral("关闭"));
+    m_spinTlsSessionLifetime->setToolTip(QStringLiteral("客户端重连时复用TLS会话，省去完整握手；重启代理后生效"));
+    m_spinTlsSessionLifetime->setValue(3600);
+    advLayout->addRow(QStringLiteral("TLS会话有效期:"), m_spinTlsSessionLifetime);
+
+    m_spinModelListCacheTtl = new QSpinBox(this);
+    m_spinModelListCacheTtl->setRange(0, 3600);
+    m_spinModelListCacheTtl->setSuffix(QStringLiteral(" s"));
+    m_spinModelListCacheTtl->setSingleStep(30);
+    m_spinModelListCacheTtl->setSpecialValueText(QStringLiteral("关闭"));
+    m_spinModelListCacheTtl->setToolTip(QStringLiteral("缓存 /v1/models 上游结果，过期后先返回旧列表并在后台刷新；重启代理后生效"));
+    m_spinModelListCacheTtl->setValue(60);
+    advLayout->addRow(QStringLiteral("模型列表缓存:"), m_spinModelListCacheTtl);
+
+    m_spinPoolIdleTimeout = new QSpinBox(this);
+    m_spinPoolIdleTimeout->setRange(0, 3600);
+    m_spinPoolIdleTimeout->setSuffix(QStringLiteral(" s"));
+    m_spinPoolIdleTimeout->setSingleStep(60);
+    m_spinPoolIdleTimeout->setSpecialValueText(QStringLiteral("不关闭"));
+    m_spinPoolIdleTimeout->setToolTip(QStringLiteral("关闭闲置超过该时长的上游连接；保温中的连接不受影响；重启代理后生效"));
+    m_spinPoolIdleTimeout->setValue(300);
+    advLayout->addRow(QStringLiteral("连接空闲回收:"), m_spinPoolIdleTimeout);
+
+    m_spinKeepWarm = new QSpinBox(this);
+    m_spinKeepWarm->setRange(0, 600);
+    m_spinKeepWarm->setSuffix(QStringLiteral(" s"));
+    m_spinKeepWarm->setSingleStep(15);
+    m_spinKeepWarm->setSpecialValueText(QStringLiteral("关闭"));
+    m_spinKeepWarm->setToolTip(QStringLiteral("代理启动时预先连接各配置组的上游；开启后，空闲超过该时长的上游连接会被重新建立，应短于上游的空闲断开时间；重启代理后生效"));
+    m_spinKeepWarm->setValue(0);
+    advLayout->addRow(QStringLiteral("上游保温:"), m_spinKeepWarm);
+
+    m_spinHedgePercentile = new QSpinBox(this);
+    m_spinHedgePercentile->setRange(0, 99);
+    m_spinHedgePercentile->setPrefix(QStringLiteral("P"));
+    m_spinHedgePercentile->setSingleStep(5);
+    m_spinHedgePercentile->setSpecialValueText(QStringLiteral("关闭"));
+    m_spinHedgePercentile->setToolTip(QStringLiteral("配置了备用 URL 时，若当前 URL 超过其近期延迟的该分位数（且至少 1 秒）仍未响应，同时向下一个 URL 发送同一请求，采用先返回的结果；取值 50-99；重启代理后生效"));
+    m_spinHedgePercentile->setValue(0);
+    advLayout->addRow(QStringLiteral("请求对冲:"), m_spinHedgePercentile);
+
+    m_spinCircuitThreshold = new QSpinBox(this);
+    m_spinCircuitThreshold->setRange(0, 100);
+    m_spinCircuitThreshold->setSuffix(QStringLiteral(" 次"));
+    m_spinCircuitThreshold->setSpecialValueText(QStringLiteral("关闭"));
+    m_spinCircuitThreshold->setToolTip(QStringLiteral("某个上游 URL 连续这么多次不可用或超时后熔断，期间请求直接跳过它；30 秒后放行一个探测请求，成功则恢复；重启代理后生效"));
+    m_spinCircuitThreshold->setValue(5);
+    advLayout->addRow(QStringLiteral("熔断阈值:"), m_spinCircuitThreshold);
+
+    m_spinRetryBaseDelay = new QSpinBox(this);
+    m_spinRetryBaseDelay->setRange(0, 10000);
+    m_spinRetryBaseDelay->setSuffix(QStringLiteral(" ms"));
+    m_spinRetryBaseDelay->setSingleStep(50);
+    m_spinRetryBaseDelay->setSpecialValueText(QStringLiteral("立即重试"));
+    m_spinRetryBaseDelay->setToolTip(QStringLiteral("第 n 次重试前随机等待 0 到该值乘 2^(n-1) 毫秒（最多 10 秒）；上游返回 Retry-After 或 x-ratelimit-reset-* 时按其等待；重启代理后生效"));
+    m_spinRetryBaseDelay->setValue(250);
+    advLayout->addRow(QStringLiteral("重试退避:"), m_spinRetryBaseDelay);
+
+    m_spinRetryBudget = new QSpinBox(this);
+    m_spinRetryBudget->setRange(0, 100);
+    m_spinRetryBudget->setSuffix(QStringLiteral(" %"));
+    m_spinRetryBudget->setSpecialValueText(QStringLiteral("不限"));
+    m_spinRetryBudget->setToolTip(QStringLiteral("最近 10 秒内的重试次数最多为请求数的该比例（至少允许 10 次），避免上游故障时重试成倍放大负载；重启代理后生效"));
+    m_spinRetryBudget->setValue(10);
+    advLayout->addRow(QStringLiteral("重试预算:"), m_spinRetryBudget);
+
+    m_spinPlainHttpPort = new QSpinBox(this);
+    m_spinPlainHttpPort->setRange(0, 65535);
+    m_spinPlainHttpPort->setSpecialValueText(QStringLiteral("关闭"));
+    m_spinPlainHttpPort->setToolTip(QStringLiteral("仅监听 127.0.0.1 的明文 HTTP 端口，支持自定义 base URL 的本机工具可跳过 TLS；重启代理后生效"));
+    m_spinPlainHttpPort->setValue(0);
+    advLayout->addRow(QStringLiteral("本机HTTP端口:"), m_spinPlainHttpPort);
+
     mainLayout->addWidget(advGroup);
 
     // Connect signals
@@ -105,6 +224,10 @@ void RuntimeOptionsPanel::setupUi() {
     connect(m_chkDisableSslStrict, &QCheckBox::toggled, this, &RuntimeOptionsPanel::onOptionChanged);
     connect(m_chkHttp2, &QCheckBox::toggled, this, &RuntimeOptionsPanel::onOptionChanged);
     connect(m_chkConnPool, &QCheckBox::toggled, this, &RuntimeOptionsPanel::onOptionChanged);
+    connect(m_chkBalanceUrls, &QCheckBox::toggled, this, &RuntimeOptionsPanel::onOptionChanged);
+    connect(m_chkAdaptiveConcurrency, &QCheckBox::toggled, this, &RuntimeOptionsPanel::onOptionChanged);
+    connect(m_chkStreamFailover, &QCheckBox::toggled, this, &RuntimeOptionsPanel::onOptionChanged);
+    connect(m_chkCoalesce, &QCheckBox::toggled, this, &RuntimeOptionsPanel::onOptionChanged);
     connect(m_spinPoolSize, QOverload<int>::of(&QSpinBox::valueChanged),
             this, &RuntimeOptionsPanel::onOptionChanged);
     connect(m_comboUpstream, QOverload<int>::of(&QComboBox::currentIndexChanged),
@@ -117,6 +240,32 @@ void RuntimeOptionsPanel::setupUi() {
             this, &RuntimeOptionsPanel::onOptionChanged);
     connect(m_spinConnectionTimeout, QOverload<int>::of(&QSpinBox::valueChanged),
             this, &RuntimeOptionsPanel::onOptionChanged);
+    connect(m_spinWorkerThreads, QOverload<int>::of(&QSpinBox::valueChanged),
+            this, &RuntimeOptionsPanel::onOptionChanged);
+    connect(m_spinMaxRequestBody, QOverload<int>::of(&QSpinBox::valueChanged),
+            this, &RuntimeOptionsPanel::onOptionChanged);
+    connect(m_comboSseWriteMode, QOverload<int>::of(&QComboBox::currentIndexChanged),
+            this, &RuntimeOptionsPanel::onOptionChanged);
+    connect(m_spinSseCoalesce, QOverload<int>::of(&QSpinBox::valueChanged),
+            this, &RuntimeOptionsPanel::onOptionChanged);
+    connect(m_spinTlsSessionLifetime, QOverload<int>::of(&QSpinBox::valueChanged),
+            this, &RuntimeOptionsPanel::onOptionChanged);
+    connect(m_spinModelListCacheTtl, QOverload<int>::of(&QSpinBox::valueChanged),
+            this, &RuntimeOptionsPanel::onOptionChanged);
+    connect(m_spinPoolIdleTimeout, QOverload<int>::of(&QSpinBox::valueChanged),
+            this, &RuntimeOptionsPanel::onOptionChanged);
+    connect(m_spinKeepWarm, QOverload<int>::of(&QSpinBox::valueChanged),
+            this, &RuntimeOptionsPanel::onOptionChanged);
+    connect(m_spinHedgePercentile, QOverload<int>::of(&QSpinBox::valueChanged),
+            this, &RuntimeOptionsPanel::onOptionChanged);
+    connect(m_spinCircuitThreshold, QOverload<int>::of(&QSpinBox::valueChanged),
+            this, &RuntimeOptionsPanel::onOptionChanged);
+    connect(m_spinRetryBaseDelay, QOverload<int>::of(&QSpinBox::valueChanged),
+            this, &RuntimeOptionsPanel::onOptionChanged);
+    connect(m_spinRetryBudget, QOverload<int>::of(&QSpinBox::valueChanged),
+            this, &RuntimeOptionsPanel::onOptionChanged);
+    connect(m_spinPlainHttpPort, QOverload<int>::of(&QSpinBox::valueChanged),
+            this, &RuntimeOptionsPanel::onOptionChanged);
 }
 
 void RuntimeOptionsPanel::onOptionChanged() {
@@ -138,11 +287,32 @@ void RuntimeOptionsPanel::loadFromConfig() {
     QSignalBlocker b8(m_spinProxyPort);
     QSignalBlocker b9(m_spinRequestTimeout);
     QSignalBlocker b10(m_spinConnectionTimeout);
+    QSignalBlocker b11(m_spinWorkerThreads);
+    QSignalBlocker b12(m_spinMaxRequestBody);
+    QSignalBlocker b13(m_comboSseWriteMode);
+    QSignalBlocker b14(m_spinSseCoalesce);
+    QSignalBlocker b15(m_spinTlsSessionLifetime);
+    QSignalBlocker b16(m_spinModelListCacheTtl);
+    QSignalBlocker b17(m_spinPlainHttpPort);
+    QSignalBlocker b18(m_spinKeepWarm);
+    QSignalBlocker b19(m_spinPoolIdleTimeout);
+    QSignalBlocker b20(m_spinHedgePercentile);
+    QSignalBlocker b21(m_chkBalanceUrls);
+    QSignalBlocker b22(m_spinCircuitThreshold);
+    QSignalBlocker b23(m_spinRetryBaseDelay);
+    QSignalBlocker b24(m_spinRetryBudget);
+    QSignalBlocker b25(m_chkAdaptiveConcurrency);
+    QSignalBlocker b26(m_chkStreamFailover);
+    QSignalBlocker b27(m_chkCoalesce);
 
     m_chkDebugMode->setChecked(opts.debugMode);
     m_chkDisableSslStrict->setChecked(opts.disableSslStrict);
     m_chkHttp2->setChecked(opts.enableHttp2);
     m_chkConnPool->setChecked(opts.enableConnectionPool);
+    m_chkBalanceUrls->setChecked(opts.balanceBaseUrls);
+    m_chkAdaptiveConcurrency->setChecked(opts.adaptiveConcurrency);
+    m_chkStreamFailover->setChecked(opts.streamFailover);
+    m_chkCoalesce->setChecked(opts.coalesceRequests);
     m_spinPoolSize->setValue(opts.connectionPoolSize);
 
     int upIdx = m_comboUpstream->findData(static_cast<int>(opts.upstreamStreamMode));
@@ -154,6 +324,21 @@ void RuntimeOptionsPanel::loadFromConfig() {
     m_spinProxyPort->setValue(opts.proxyPort);
     m_spinRequestTimeout->setValue(opts.requestTimeout);
     m_spinConnectionTimeout->setValue(opts.connectionTimeout);
+    m_spinWorkerThreads->setValue(opts.workerThreads);
+    m_spinMaxRequestBody->setValue(opts.maxRequestBodyMb);
+
+    int sseIdx = m_comboSseWriteMode->findData(static_cast<int>(opts.sseWriteMode));
+    if (sseIdx >= 0) m_comboSseWriteMode->setCurrentIndex(sseIdx);
+    m_spinSseCoalesce->setValue(opts.sseCoalesceMs);
+    m_spinTlsSessionLifetime->setValue(opts.tlsSessionLifetimeSec);
+    m_spinModelListCacheTtl->setValue(opts.modelListCacheTtlSec);
+    m_spinPoolIdleTimeout->setValue(opts.poolIdleTimeoutSec);
+    m_spinKeepWarm->setValue(opts.keepWarmSec);
+    m_spinHedgePercentile->setValue(opts.hedgePercentile);
+    m_spinCircuitThreshold->setValue(opts.circuitFailureThreshold);
+    m_spinRetryBaseDelay->setValue(opts.retryBaseDelayMs);
+    m_spinRetryBudget->setValue(opts.retryBudgetPercent);
+    m_spinPlainHttpPort->setValue(opts.plainHttpPort);
 }
 
 void RuntimeOptionsPanel::saveToConfig() {
@@ -163,11 +348,28 @@ void RuntimeOptionsPanel::saveToConfig() {
     opts["disable_ssl_strict"] = m_chkDisableSslStrict->isChecked();
     opts["enable_http2"] = m_chkHttp2->isChecked();
     opts["enable_connection_pool"] = m_chkConnPool->isChecked();
+    opts["balance_base_urls"] = m_chkBalanceUrls->isChecked();
+    opts["adaptive_concurrency"] = m_chkAdaptiveConcurrency->isChecked();
+    opts["stream_failover"] = m_chkStreamFailover->isChecked();
+    opts["coalesce_requests"] = m_chkCoalesce->isChecked();
     opts["connection_pool_size"] = m_spinPoolSize->value();
     opts["upstream_stream_mode"] = m_comboUpstream->currentData().toInt();
     opts["downstream_stream_mode"] = m_comboDownstream->currentData().toInt();
     opts["proxy_port"] = m_spinProxyPort->value();
     opts["request_timeout"] = m_spinRequestTimeout->value();
     opts["connection_timeout"] = m_spinConnectionTimeout->value();
+    opts["worker_threads"] = m_spinWorkerThreads->value();
+    opts["max_request_body_mb"] = m_spinMaxRequestBody->value();
+    opts["sse_write_mode"] = m_comboSseWriteMode->currentData().toInt();
+    opts["sse_coalesce_ms"] = m_spinSseCoalesce->value();
+    opts["tls_session_lifetime_sec"] = m_spinTlsSessionLifetime->value();
+    opts["model_list_cache_ttl_sec"] = m_spinModelListCacheTtl->value();
+    opts["pool_idle_timeout_sec"] = m_spinPoolIdleTimeout->value();
+    opts["keep_warm_sec"] = m_spinKeepWarm->value();
+    opts["hedge_percentile"] = m_spinHedgePercentile->value();
+    opts["circuit_failure_threshold"] = m_spinCircuitThreshold->value();
+    opts["retry_base_delay_ms"] = m_spinRetryBaseDelay->value();
+    opts["retry_budget_percent"] = m_spinRetryBudget->value();
+    opts["plain_http_port"] = m_spinPlainHttpPort->value();
     m_config->setRuntimeOptions(opts);
 }
@@ -36,12 +36,29 @@ private:
     QCheckBox* m_chkDisableSslStrict;
     QCheckBox* m_chkHttp2;
     QCheckBox* m_chkConnPool;
+    QCheckBox* m_chkBalanceUrls;
+    QCheckBox* m_chkAdaptiveConcurrency;
+    QCheckBox* m_chkStreamFailover;
+    QCheckBox* m_chkCoalesce;
     QSpinBox*  m_spinPoolSize;
     QComboBox* m_comboUpstream;
     QComboBox* m_comboDownstream;
     QSpinBox*  m_spinProxyPort;
     QSpinBox*  m_spinRequestTimeout;
     QSpinBox*  m_spinConnectionTimeout;
+    QSpinBox*  m_spinWorkerThreads;
+    QSpinBox*  m_spinMaxRequestBody;
+    QComboBox* m_comboSseWriteMode;
+    QSpinBox*  m_spinSseCoalesce;
+    QSpinBox*  m_spinTlsSessionLifetime;
+    QSpinBox*  m_spinModelListCacheTtl;
+    QSpinBox*  m_spinPoolIdleTimeout;
+    QSpinBox*  m_spinKeepWarm;
+    QSpinBox*  m_spinHedgePercentile;
+    QSpinBox*  m_spinCircuitThreshold;
+    QSpinBox*  m_spinRetryBaseDelay;
+    QSpinBox*  m_spinRetryBudget;
+    QSpinBox*  m_spinPlainHttpPort;
 
     ConfigStore* m_config;
 };
@@ -0,0 +1,267 @@
+#include <QTest>
+#include "core/metrics.h"
+#include "semantic/concurrency_limiter.h"
+
+namespace {
+
+const QString kAdapter = QStringLiteral("openai");
+const QString kEndpoint = QStringLiteral("https://api.example.com");
+
+ConcurrencyLimiter::Settings settings(int limit, int maxQueue = 100, int timeoutMs = 10000)
+{
+    return {limit, maxQueue, timeoutMs};
+}
+
+// Records what each acquire() was answered with
+struct Grants {
+    QList<ConcurrencyLimiter::Permit> permits;
+    QList<DomainFailure> failures;
+
+    ConcurrencyLimiter::Granted callback()
+    {
+        return [this](Result<ConcurrencyLimiter::Permit> result) {
+            if (result)
+                permits.append(*result);
+            else
+                failures.append(result.error());
+        };
+    }
+};
+
+// Holds every request until the test answers it
+class HeldExecutor : public IExecutor {
+public:
+    void execute(const ProviderRequest& request, ExecuteCallback done) override
+    {
+        requests.append(request);
+        pending.append(std::move(done));
+    }
+    void connectStream(const ProviderRequest&, ConnectStreamCallback done) override
+    {
+        done(std::unexpected(DomainFailure::internal("not used")));
+    }
+
+    QList<ProviderRequest> requests;
+    QList<ExecuteCallback> pending;
+};
+
+ProviderRequest request(const QString& url)
+{
+    ProviderRequest req;
+    req.url = url;
+    req.adapterHint = kAdapter;
+    return req;
+}
+
+}
+
+class TestConcurrencyLimiter : public QObject {
+    Q_OBJECT
+
+private slots:
+    void testQueuesOverLimit()
+    {
+        ConcurrencyLimiter limiter;
+        limiter.setSettings(settings(2));
+        QObject context;
+        Grants grants;
+
+        QCOMPARE(limiter.acquire(kAdapter, kEndpoint, &context, grants.callback()), quint64(0));
+        QCOMPARE(limiter.acquire(kAdapter, kEndpoint, &context, grants.callback()), quint64(0));
+        QVERIFY(limiter.acquire(kAdapter, kEndpoint, &context, grants.callback()) != 0);
+        QCOMPARE(grants.permits.size(), 2);
+        QCOMPARE(limiter.snapshot(kAdapter, kEndpoint).queued, 1);
+        QCOMPARE(metrics::registry().upstreamQueueDepth.at({kAdapter, kEndpoint}).load(), qint64(1));
+
+        // A freed slot goes to the waiter through the event loop
+        grants.permits.removeFirst();
+        QCOMPARE(limiter.snapshot(kAdapter, kEndpoint).queued, 0);
+        QCOMPARE(grants.permits.size(), 1);
+        QTRY_COMPARE(grants.permits.size(), 2);
+        QCOMPARE(limiter.snapshot(kAdapter, kEndpoint).inFlight, 2);
+
+        grants.permits.clear();
+        QCOMPARE(limiter.snapshot(kAdapter, kEndpoint).inFlight, 0);
+    }
+
+    void testUpstreamsAreSeparate()
+    {
+        ConcurrencyLimiter limiter;
+        limiter.setSettings(settings(1));
+        QObject context;
+        Grants grants;
+
+        limiter.acquire(kAdapter, kEndpoint, &context, grants.callback());
+        QCOMPARE(limiter.acquire(kAdapter, QStringLiteral("https://other.example.com"), &context,
+                                 grants.callback()), quint64(0));
+        QCOMPARE(limiter.acquire(QStringLiteral("claude"), kEndpoint, &context, grants.callback()), quint64(0));
+        QCOMPARE(grants.permits.size(), 3);
+    }
+
+    void testRejectsWhenQueueFull()
+    {
+        ConcurrencyLimiter limiter;
+        limiter.setSettings(settings(1, 1));
+        QObject context;
+        Grants grants;
+
+        limiter.acquire(kAdapter, kEndpoint, &context, grants.callback());
+        limiter.acquire(kAdapter, kEndpoint, &context, grants.callback());
+        QCOMPARE(limiter.acquire(kAdapter, kEndpoint, &context, grants.callback()), quint64(0));
+        QCOMPARE(grants.failures.size(), 1);
+        QCOMPARE(grants.failures[0].code, QStringLiteral("upstream_queue_full"));
+        QCOMPARE(grants.failures[0].kind, ErrorKind::RateLimited);
+        QVERIFY(!grants.failures[0].retryable);
+        QVERIFY(ConcurrencyLimiter::isQueueFailure(grants.failures[0]));
+    }
+
+    void testQueueTimeout()
+    {
+        ConcurrencyLimiter limiter;
+        limiter.setSettings(settings(1, 10, 50));
+        QObject context;
+        Grants grants;
+
+        limiter.acquire(kAdapter, kEndpoint, &context, grants.callback());
+        limiter.acquire(kAdapter, kEndpoint, &context, grants.callback());
+        QTRY_COMPARE(grants.failures.size(), 1);
+        QCOMPARE(grants.failures[0].code, QStringLiteral("upstream_queue_timeout"));
+        QCOMPARE(limiter.snapshot(kAdapter, kEndpoint).queued, 0);
+
+        // The slot it waited for is not handed to anyone
+        grants.permits.clear();
+        QTest::qWait(20);
+        QVERIFY(grants.permits.isEmpty());
+    }
+
+    void testCancelLeavesQueue()
+    {
+        ConcurrencyLimiter limiter;
+        limiter.setSettings(settings(1));
+        QObject context;
+        Grants grants;
+
+        limiter.acquire(kAdapter, kEndpoint, &context, grants.callback());
+        const quint64 id = limiter.acquire(kAdapter, kEndpoint, &context, grants.callback());
+        limiter.cancel(kAdapter, kEndpoint, id);
+        QCOMPARE(limiter.snapshot(kAdapter, kEndpoint).queued, 0);
+
+        grants.permits.clear();
+        QTest::qWait(20);
+        QVERIFY(grants.permits.isEmpty());
+        QVERIFY(grants.failures.isEmpty());
+    }
+
+    void testOverloadDecreasesOncePerInterval()
+    {
+        ConcurrencyLimiter limiter;
+        limiter.setSettings(settings(10));
+        limiter.record(kAdapter, kEndpoint, ConcurrencyLimiter::Outcome::Overload, 0);
+        QCOMPARE(limiter.snapshot(kAdapter, kEndpoint).limit, 9);
+        limiter.record(kAdapter, kEndpoint, ConcurrencyLimiter::Outcome::Overload, 0);
+        QCOMPARE(limiter.snapshot(kAdapter, kEndpoint).limit, 9);
+        QCOMPARE(metrics::registry().upstreamConcurrencyLimit.at({kAdapter, kEndpoint}).load(), qint64(9));
+
+        QTest::qWait(ConcurrencyLimiter::kDecreaseIntervalMs + 50);
+        limiter.record(kAdapter, kEndpoint, ConcurrencyLimiter::Outcome::Overload, 0);
+        QCOMPARE(limiter.snapshot(kAdapter, kEndpoint).limit, 8);
+
+        // Failures that say nothing about load leave it alone
+        limiter.record(kAdapter, kEndpoint, ConcurrencyLimiter::Outcome::Ignored, 0);
+        QCOMPARE(limiter.snapshot(kAdapter, kEndpoint).limit, 8);
+    }
+
+    void testGrowsWhileLatencyIsUsual()
+    {
+        ConcurrencyLimiter limiter;
+        limiter.setSettings(settings(4));
+        QObject context;
+        Grants grants;
+        limiter.acquire(kAdapter, kEndpoint, &context, grants.callback());
+        limiter.acquire(kAdapter, kEndpoint, &context, grants.callback());
+
+        limiter.record(kAdapter, kEndpoint, ConcurrencyLimiter::Outcome::Success, 100);
+        // Far slower than usual: held
+        for (int i = 0; i < 10; ++i)
+            limiter.record(kAdapter, kEndpoint, ConcurrencyLimiter::Outcome::Success, 1000);
+        QCOMPARE(limiter.snapshot(kAdapter, kEndpoint).limit, 4);
+
+        for (int i = 0; i < 20; ++i)
+            limiter.record(kAdapter, kEndpoint, ConcurrencyLimiter::Outcome::Success, 100);
+        QVERIFY(limiter.snapshot(kAdapter, kEndpoint).limit > 4);
+    }
+
+    void testUnusedLimitDoesNotGrow()
+    {
+        ConcurrencyLimiter limiter;
+        limiter.setSettings(settings(10));
+        for (int i = 0; i < 50; ++i)
+            limiter.record(kAdapter, kEndpoint, ConcurrencyLimiter::Outcome::Success, 100);
+        QCOMPARE(limiter.snapshot(kAdapter, kEndpoint).limit, 10);
+    }
+
+    void testExecutorHoldsSlotUntilAnswered()
+    {
+        ConcurrencyLimiter limiter;
+        limiter.setSettings(settings(1));
+        HeldExecutor inner;
+        LimitedExecutor executor(&inner, &limiter);
+
+        QList<int> statuses;
+        auto done = [&statuses](Result<ProviderResponse> result) {
+            statuses.append(result ? result->statusCode : 0);
+        };
+        executor.execute(request(kEndpoint + QStringLiteral("/v1/chat/completions")), done);
+        executor.execute(request(kEndpoint + QStringLiteral("/v1/chat/completions")), done);
+        QCOMPARE(inner.pending.size(), 1);
+        QCOMPARE(limiter.snapshot(kAdapter, kEndpoint).queued, 1);
+
+        ProviderResponse response;
+        response.statusCode = 200;
+        inner.pending.takeFirst()(response);
+        QCOMPARE(statuses, QList<int>{200});
+        QTRY_COMPARE(inner.pending.size(), 1);
+        inner.pending.takeFirst()(response);
+        QCOMPARE(statuses, (QList<int>{200, 200}));
+        QCOMPARE(limiter.snapshot(kAdapter, kEndpoint).inFlight, 0);
+    }
+
+    void testExecutorDropsCancelledWaiter()
+    {
+        ConcurrencyLimiter limiter;
+        limiter.setSettings(settings(1));
+        HeldExecutor inner;
+        LimitedExecutor executor(&inner, &limiter);
+
+        int calls = 0;
+        auto done = [&calls](Result<ProviderResponse>) { ++calls; };
+        executor.execute(request(kEndpoint), done);
+        auto* scope = new QObject;
+        ProviderRequest abandoned = request(kEndpoint);
+        abandoned.cancelScope = scope;
+        executor.execute(abandoned, done);
+        QCOMPARE(limiter.snapshot(kAdapter, kEndpoint).queued, 1);
+
+        delete scope;
+        QCOMPARE(limiter.snapshot(kAdapter, kEndpoint).queued, 0);
+        inner.pending.takeFirst()(ProviderResponse{200, {}, {}, {}});
+        QTest::qWait(20);
+        QCOMPARE(calls, 1);
+        QVERIFY(inner.pending.isEmpty());
+    }
+
+    void testUpstreamIsAdapterAndOrigin()
+    {
+        ProviderRequest req;
+        req.url = QStringLiteral("https://user:pw@api.example.com:8443/v1/messages?beta=1#x");
+        auto upstream = LimitedExecutor::upstreamOf(req);
+        QCOMPARE(upstream.first, QStringLiteral("default"));
+        QCOMPARE(upstream.second, QStringLiteral("https://api.example.com:8443"));
+
+        req.adapterHint = QStringLiteral("claude");
+        QCOMPARE(LimitedExecutor::upstreamOf(req).first, QStringLiteral("claude"));
+    }
+};
+
+QTEST_MAIN(TestConcurrencyLimiter)
+#include "tst_concurrency_limiter.moc"
@@ -0,0 +1,211 @@
+#include <QTest>
+#include <QQueue>
+#include <QThread>
+#include "core/log_manager.h"
+#include "core/metrics.h"
+#include "proxy/connection_pool.h"
+
+namespace {
+
+constexpr int kThreads = 16;
+constexpr int kIterations = 2000;
+
+// The pool before managers were bound to hosts: one FIFO of managers for
+// every upstream, logging each acquire and release.
+class LegacyFifoPool {
+public:
+    explicit LegacyFifoPool(int maxSize) : m_maxSize(maxSize) {}
+
+    ~LegacyFifoPool()
+    {
+        qDeleteAll(m_idle);
+        qDeleteAll(m_active);
+    }
+
+    QNetworkAccessManager* acquire()
+    {
+        QMutexLocker locker(&m_mutex);
+        if (!m_idle.isEmpty()) {
+            QNetworkAccessManager* nam = m_idle.dequeue();
+            m_active.insert(nam);
+            LOG_DEBUG(QStringLiteral("ConnectionPool: reused idle connection (active=%1, idle=%2)")
+                          .arg(m_active.size())
+                          .arg(m_idle.size()));
+            return nam;
+        }
+        auto* nam = new QNetworkAccessManager;
+        m_active.insert(nam);
+        LOG_DEBUG(QStringLiteral("ConnectionPool: created new connection (active=%1, idle=%2)")
+                      .arg(m_active.size())
+                      .arg(m_idle.size()));
+        return nam;
+    }
+
+    void release(QNetworkAccessManager* nam)
+    {
+        QMutexLocker locker(&m_mutex);
+        m_active.remove(nam);
+        if (m_idle.size() + m_active.size() + 1 > m_maxSize) {
+            delete nam;
+        } else {
+            m_idle.enqueue(nam);
+            LOG_DEBUG(QStringLiteral("ConnectionPool: returned connection to idle pool "
+                                     "(active=%1, idle=%2)")
+                          .arg(m_active.size())
+                          .arg(m_idle.size()));
+        }
+    }
+
+private:
+    int m_maxSize;
+    QQueue<QNetworkAccessManager*> m_idle;
+    QSet<QNetworkAccessManager*> m_active;
+    QMutex m_mutex;
+};
+
+QUrl hostUrl(int i)
+{
+    return QUrl(QStringLiteral("https://api%1.example.com/v1/chat").arg(i));
+}
+
+ConnectionPool::HostStats statsFor(const ConnectionPool& pool, const QUrl& url)
+{
+    const QString key = ConnectionPool::hostKey(url);
+    for (const ConnectionPool::HostStats& stats : pool.hostStats()) {
+        if (stats.host == key)
+            return stats;
+    }
+    return {};
+}
+
+}
+
+class TestConnectionPool : public QObject {
+    Q_OBJECT
+
+private slots:
+    void testHitsAndMissesPerHost()
+    {
+        ConnectionPool pool(2);
+        const QUrl url = hostUrl(1);
+        const QString key = ConnectionPool::hostKey(url);
+        auto& lookups = metrics::registry().upstreamPoolLookups;
+        const quint64 hits = lookups.value({key, QStringLiteral("hit")});
+
+        // One miss opens the manager, five more requests share it, the
+        // seventh opens a second one
+        QList<QNetworkAccessManager*> managers;
+        for (int i = 0; i < ConnectionPool::kHttp1RequestsPerManager + 1; ++i)
+            managers.append(pool.acquire(url));
+        for (QNetworkAccessManager* nam : managers)
+            pool.release(nam);
+        pool.release(pool.acquire(url));
+
+        const ConnectionPool::HostStats stats = statsFor(pool, url);
+        QCOMPARE(stats.misses, quint64(2));
+        QCOMPARE(stats.hits, quint64(ConnectionPool::kHttp1RequestsPerManager));
+        QCOMPARE(lookups.value({key, QStringLiteral("hit")}),
+                 hits + ConnectionPool::kHttp1RequestsPerManager);
+    }
+
+    void testIdleLimitPerHost()
+    {
+        ConnectionPool pool(10);
+        pool.setIdleLimits(1, ConnectionPool::kDefaultMaxIdle);
+        const QUrl url = hostUrl(1);
+
+        QList<QNetworkAccessManager*> managers;
+        for (int i = 0; i < ConnectionPool::kHttp1RequestsPerManager * 2; ++i)
+            managers.append(pool.acquire(url));
+        QCOMPARE(statsFor(pool, url).managers, 2);
+        for (QNetworkAccessManager* nam : managers)
+            pool.release(nam);
+
+        QCOMPARE(pool.idleCount(), 1);
+        QCOMPARE(statsFor(pool, url).evictions, quint64(1));
+    }
+
+    void testGlobalLruEviction()
+    {
+        ConnectionPool pool(2);
+        pool.setIdleLimits(ConnectionPool::kDefaultMaxIdlePerHost, 2);
+
+        QNetworkAccessManager* first = pool.acquire(hostUrl(1));
+        pool.release(first);
+        for (int i = 2; i <= 3; ++i) {
+            QThread::msleep(5);
+            pool.release(pool.acquire(hostUrl(i)));
+        }
+
+        // The third idle manager pushed out the one used longest ago
+        QCOMPARE(pool.idleCount(), 2);
+        QCOMPARE(statsFor(pool, hostUrl(1)).managers, 0);
+        QCOMPARE(statsFor(pool, hostUrl(1)).evictions, quint64(1));
+        QCOMPARE(statsFor(pool, hostUrl(3)).managers, 1);
+
+        pool.release(pool.acquire(hostUrl(1)));
+        QCOMPARE(statsFor(pool, hostUrl(1)).misses, quint64(2));
+        QCOMPARE(statsFor(pool, hostUrl(2)).managers, 0);
+    }
+
+    void testReapIdle()
+    {
+        ConnectionPool pool(2);
+        pool.release(pool.acquire(hostUrl(1)));
+        QNetworkAccessManager* busy = pool.acquire(hostUrl(2));
+
+        QCOMPARE(pool.reapIdle(60 * 1000), 0);
+        QThread::msleep(20);
+        // Managers with requests in flight stay, however long ago they started
+        QCOMPARE(pool.reapIdle(10), 1);
+        QCOMPARE(pool.idleCount(), 0);
+        QCOMPARE(pool.activeCount(), 1);
+        QCOMPARE(statsFor(pool, hostUrl(1)).evictions, quint64(1));
+
+        pool.release(busy);
+        QCOMPARE(pool.idleCount(), 1);
+    }
+
+    // Many threads taking and returning managers for a handful of hosts on
+    // one shared pool
+    void benchmarkContention_data()
+    {
+        QTest::addColumn<bool>("keyed");
+        QTest::newRow("legacy-fifo") << false;
+        QTest::newRow("keyed") << true;
+    }
+
+    void benchmarkContention()
+    {
+        QFETCH(bool, keyed);
+        LegacyFifoPool legacy(kThreads);
+        ConnectionPool pool(kThreads);
+        QList<QUrl> hosts;
+        for (int i = 0; i < 8; ++i)
+            hosts.append(hostUrl(i));
+
+        QBENCHMARK {
+            QList<QThread*> threads;
+            for (int t = 0; t < kThreads; ++t) {
+                threads.append(QThread::create([&, t]() {
+                    for (int i = 0; i < kIterations; ++i) {
+                        if (keyed)
+                            pool.release(pool.acquire(hosts[(t + i) % hosts.size()]));
+                        else
+                            legacy.release(legacy.acquire());
+                    }
+                }));
+            }
+            for (QThread* thread : threads)
+                thread->start();
+            for (QThread* thread : threads)
+                QVERIFY(thread->wait(60 * 1000));
+            qDeleteAll(threads);
+        }
+        if (keyed)
+            QCOMPARE(pool.activeCount(), 0);
+    }
+};
+
+QTEST_MAIN(TestConnectionPool)
+#include "tst_connection_pool.moc"
@@ -0,0 +1,352 @@
+#include <QTest>
+#include <QNetworkAccessManager>
+#include <QNetworkDatagram>
+#include <QNetworkReply>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QUdpSocket>
+#include <QtEndian>
+#include "core/metrics.h"
+#include "proxy/dns_resolver.h"
+#include "proxy/upstream_relay.h"
+
+// DNS server on 127.0.0.1 answering A and AAAA queries from a fixed table.
+// Names not in it get NXDOMAIN; a silent server never answers.
+class StubDnsServer : public QObject {
+public:
+    struct Record {
+        QList<QHostAddress> addresses;
+        quint32 ttl = 60;
+    };
+
+    explicit StubDnsServer(bool silent = false)
+        : m_silent(silent)
+    {
+        m_socket.bind(QHostAddress::LocalHost, 0);
+        connect(&m_socket, &QUdpSocket::readyRead, this, &StubDnsServer::onReadyRead);
+    }
+
+    void add(const QString& name, QList<QHostAddress> addresses, quint32 ttl = 60)
+    {
+        m_records.insert(name, {std::move(addresses), ttl});
+    }
+
+    DnsResolver::Server server() const { return {QHostAddress::LocalHost, m_socket.localPort()}; }
+    int queries() const { return m_queries; }
+
+private:
+    void onReadyRead()
+    {
+        while (m_socket.hasPendingDatagrams()) {
+            const QNetworkDatagram datagram = m_socket.receiveDatagram();
+            ++m_queries;
+            if (!m_silent)
+                m_socket.writeDatagram(datagram.makeReply(answer(datagram.data())));
+        }
+    }
+
+    QByteArray answer(const QByteArray& query) const
+    {
+        // Question name as dotted text, and the type after it
+        QStringList labels;
+        qsizetype pos = 12;
+        while (pos < query.size() && query[pos] != 0) {
+            const int length = quint8(query[pos]);
+            labels.append(QString::fromLatin1(query.mid(pos + 1, length)));
+            pos += 1 + length;
+        }
+        const quint16 type = qFromBigEndian<quint16>(query.constData() + pos + 1);
+        const auto record = m_records.constFind(labels.join(QLatin1Char('.')));
+
+        QList<QHostAddress> addresses;
+        if (record != m_records.cend()) {
+            for (const QHostAddress& address : record->addresses) {
+                const bool v6 = address.protocol() == QAbstractSocket::IPv6Protocol;
+                if (v6 == (type == DnsResolver::kTypeAAAA))
+                    addresses.append(address);
+            }
+        }
+
+        QByteArray reply = query.left(pos + 5);  // header and question
+        reply[2] = char(0x81);
+        reply[3] = char(record == m_records.cend() ? 0x83 : 0x80);
+        reply[6] = 0;
+        reply[7] = char(addresses.size());
+        for (const QHostAddress& address : std::as_const(addresses)) {
+            QByteArray rdata;
+            if (type == DnsResolver::kTypeA) {
+                rdata.resize(4);
+                qToBigEndian(address.toIPv4Address(), rdata.data());
+            } else {
+                const Q_IPV6ADDR v6 = address.toIPv6Address();
+                rdata = QByteArray(reinterpret_cast<const char*>(v6.c), 16);
+            }
+            QByteArray rr(12, '\0');
+            rr[0] = char(0xc0);  // pointer to the question name
+            rr[1] = 12;
+            qToBigEndian(type, rr.data() + 2);
+            qToBigEndian(quint16(1), rr.data() + 4);
+            qToBigEndian(record->ttl, rr.data() + 6);
+            qToBigEndian(quint16(rdata.size()), rr.data() + 10);
+            reply += rr + rdata;
+        }
+        return reply;
+    }
+
+    QUdpSocket m_socket;
+    bool m_silent;
+    QHash<QString, Record> m_records;
+    int m_queries = 0;
+};
+
+// Answers every HTTP request on a connection with "ok" and closes it
+class OkHttpServer : public QTcpServer {
+public:
+    OkHttpServer()
+    {
+        connect(this, &QTcpServer::newConnection, this, [this]() {
+            while (hasPendingConnections()) {
+                QTcpSocket* socket = nextPendingConnection();
+                connect(socket, &QTcpSocket::readyRead, socket, [socket]() {
+                    if (!socket->readAll().contains("\r\n\r\n"))
+                        return;
+                    socket->write("HTTP/1.1 200 OK\r\n"
+                                  "Content-Length: 2\r\n"
+                                  "Connection: close\r\n"
+                                  "\r\n"
+                                  "ok");
+                    socket->disconnectFromHost();
+                });
+                connect(socket, &QTcpSocket::disconnected, socket, &QObject::deleteLater);
+            }
+        });
+        listen(QHostAddress::LocalHost, 0);
+    }
+};
+
+namespace {
+
+DnsResolver::Resolution resolveNow(DnsResolver& resolver, const QString& host)
+{
+    DnsResolver::Resolution result;
+    bool done = false;
+    resolver.resolve(host, [&](const DnsResolver::Resolution& resolution) {
+        result = resolution;
+        done = true;
+    });
+    if (!QTest::qWaitFor([&]() { return done; }, 5000))
+        result.error = QStringLiteral("test timed out");
+    return result;
+}
+
+}
+
+class TestDnsResolver : public QObject {
+    Q_OBJECT
+
+private slots:
+    void testIgnoresHostsFile()
+    {
+        // The hosts file maps localhost to the loopback; only the stub counts
+        StubDnsServer stub;
+        stub.add(QStringLiteral("localhost"), {QHostAddress(QStringLiteral("10.1.2.3"))});
+        DnsResolver resolver(QList<DnsResolver::Server>{stub.server()});
+
+        const DnsResolver::Resolution resolution = resolveNow(resolver, QStringLiteral("LocalHost."));
+        QVERIFY2(resolution.error.isEmpty(), qPrintable(resolution.error));
+        QCOMPARE(resolution.addresses, QList<QHostAddress>{QHostAddress(QStringLiteral("10.1.2.3"))});
+        QVERIFY(!resolution.fromCache);
+    }
+
+    void testInterleavesFamilies()
+    {
+        StubDnsServer stub;
+        stub.add(QStringLiteral("api.test"), {QHostAddress(QStringLiteral("192.0.2.1")),
+                                              QHostAddress(QStringLiteral("2001:db8::1")),
+                                              QHostAddress(QStringLiteral("2001:db8::2"))});
+        DnsResolver resolver(QList<DnsResolver::Server>{stub.server()});
+
+        const DnsResolver::Resolution resolution = resolveNow(resolver, QStringLiteral("api.test"));
+        const QList<QHostAddress> expected = {QHostAddress(QStringLiteral("2001:db8::1")),
+                                              QHostAddress(QStringLiteral("192.0.2.1")),
+                                              QHostAddress(QStringLiteral("2001:db8::2"))};
+        QCOMPARE(resolution.addresses, expected);
+    }
+
+    void testCachesForTtl()
+    {
+        StubDnsServer stub;
+        stub.add(QStringLiteral("api.test"), {QHostAddress(QStringLiteral("192.0.2.1"))}, 1);
+        DnsResolver resolver(QList<DnsResolver::Server>{stub.server()});
+
+        QVERIFY(resolveNow(resolver, QStringLiteral("api.test")).error.isEmpty());
+        QCOMPARE(stub.queries(), 2);  // A and AAAA
+
+        const DnsResolver::Resolution cached = resolveNow(resolver, QStringLiteral("api.test"));
+        QVERIFY(cached.fromCache);
+        QCOMPARE(cached.addresses.size(), 1);
+        QCOMPARE(stub.queries(), 2);
+
+        QTest::qWait(1100);
+        QVERIFY(!resolveNow(resolver, QStringLiteral("api.test")).fromCache);
+        QCOMPARE(stub.queries(), 4);
+    }
+
+    void testSharesConcurrentLookups()
+    {
+        StubDnsServer stub;
+        stub.add(QStringLiteral("api.test"), {QHostAddress(QStringLiteral("192.0.2.1"))});
+        DnsResolver resolver(QList<DnsResolver::Server>{stub.server()});
+
+        int answered = 0;
+        for (int i = 0; i < 3; ++i) {
+            resolver.resolve(QStringLiteral("api.test"), [&](const DnsResolver::Resolution& resolution) {
+                QCOMPARE(resolution.addresses.size(), 1);
+                ++answered;
+            });
+        }
+        QTRY_COMPARE_WITH_TIMEOUT(answered, 3, 5000);
+        QCOMPARE(stub.queries(), 2);
+    }
+
+    void testFailsOverToNextServer()
+    {
+        StubDnsServer silent(true);
+        StubDnsServer stub;
+        stub.add(QStringLiteral("api.test"), {QHostAddress(QStringLiteral("192.0.2.1"))});
+        DnsResolver resolver(QList<DnsResolver::Server>{silent.server(), stub.server()});
+        resolver.setTimeout(100);
+
+        const DnsResolver::Resolution resolution = resolveNow(resolver, QStringLiteral("api.test"));
+        QVERIFY2(resolution.error.isEmpty(), qPrintable(resolution.error));
+        QCOMPARE(silent.queries(), 2);
+        QCOMPARE(resolution.addresses.size(), 1);
+    }
+
+    void testNameErrorIsNotCached()
+    {
+        StubDnsServer stub;
+        DnsResolver resolver(QList<DnsResolver::Server>{stub.server()});
+
+        QVERIFY(!resolveNow(resolver, QStringLiteral("missing.test")).error.isEmpty());
+        QVERIFY(!resolveNow(resolver, QStringLiteral("missing.test")).error.isEmpty());
+        QCOMPARE(stub.queries(), 4);
+    }
+
+    void testLiteralsSkipQueries()
+    {
+        DnsResolver resolver(QList<DnsResolver::Server>{});
+        const DnsResolver::Resolution resolution = resolveNow(resolver, QStringLiteral("::1"));
+        QCOMPARE(resolution.addresses, QList<QHostAddress>{QHostAddress(QHostAddress::LocalHostIPv6)});
+    }
+
+    void testWireFormat()
+    {
+        const QByteArray query = DnsResolver::encodeQuery(0x1234, QStringLiteral("api.test"),
+                                                          DnsResolver::kTypeA);
+        QCOMPARE(query.toHex(), QByteArray("123401000001000000000000"
+                                           "03617069" "0474657374" "00"
+                                           "0001" "0001"));
+        QVERIFY(DnsResolver::encodeQuery(1, QStringLiteral("bad..name"), DnsResolver::kTypeA).isEmpty());
+
+        // CNAME, then an A record reached through a compressed name
+        QByteArray reply = query;
+        reply[2] = char(0x81);
+        reply[3] = char(0x80);
+        reply[7] = 2;
+        reply += QByteArray::fromHex("c00c" "0005" "0001" "0000012c" "0006" "03777777c00c");
+        reply += QByteArray::fromHex("c026" "0001" "0001" "0000003c" "0004" "c0000201");
+        QList<QHostAddress> addresses;
+        quint32 ttl = DnsResolver::kMaxTtlSec;
+        QCOMPARE(DnsResolver::decodeReply(reply, &addresses, &ttl), DnsResolver::Reply::Answer);
+        QCOMPARE(addresses, QList<QHostAddress>{QHostAddress(QStringLiteral("192.0.2.1"))});
+        QCOMPARE(ttl, quint32(60));
+
+        addresses.clear();
+        QCOMPARE(DnsResolver::decodeReply(reply.left(reply.size() - 2), &addresses, &ttl),
+                 DnsResolver::Reply::Malformed);
+        reply[3] = char(0x83);
+        QCOMPARE(DnsResolver::decodeReply(reply, &addresses, &ttl), DnsResolver::Reply::NameError);
+        reply[3] = char(0x82);
+        QCOMPARE(DnsResolver::decodeReply(reply, &addresses, &ttl), DnsResolver::Reply::ServerError);
+    }
+
+    void testParseServers()
+    {
+        QStringList invalid;
+        const QList<DnsResolver::Server> servers = DnsResolver::parseServers(
+            {QStringLiteral("1.1.1.1"), QStringLiteral(" 8.8.8.8:5353 "),
+             QStringLiteral("2606:4700:4700::1111"), QStringLiteral("[::1]:53"),
+             QStringLiteral("dns.example"), QStringLiteral("1.1.1.1:0")},
+            &invalid);
+        QCOMPARE(servers.size(), 4);
+        QCOMPARE(servers[1].port, quint16(5353));
+        QCOMPARE(servers[2].address, QHostAddress(QStringLiteral("2606:4700:4700::1111")));
+        QCOMPARE(servers[2].port, quint16(53));
+        QCOMPARE(servers[3].address, QHostAddress(QHostAddress::LocalHostIPv6));
+        QCOMPARE(invalid, (QStringList{QStringLiteral("dns.example"), QStringLiteral("1.1.1.1:0")}));
+    }
+
+    // The name resolves to an IPv6 address nothing listens on, then to the
+    // server's IPv4 one; the relay falls back to the latter
+    void testRelayConnectsThroughResolver()
+    {
+        OkHttpServer http;
+        QVERIFY(http.isListening());
+        StubDnsServer stub;
+        stub.add(QStringLiteral("upstream.test"),
+                 {QHostAddress(QHostAddress::LocalHostIPv6), QHostAddress(QHostAddress::LocalHost)});
+        DnsResolver resolver(QList<DnsResolver::Server>{stub.server()});
+        UpstreamRelay relay(resolver, 5000);
+        QVERIFY(relay.listen());
+
+        auto& registry = metrics::registry();
+        const quint64 connects = registry.upstreamConnectSeconds.count();
+        QNetworkAccessManager nam;
+        nam.setProxy(relay.proxy());
+        QNetworkReply* reply = nam.get(QNetworkRequest(
+            QUrl(QStringLiteral("http://upstream.test:%1/").arg(http.serverPort()))));
+        QTRY_VERIFY_WITH_TIMEOUT(reply->isFinished(), 10000);
+        QCOMPARE(reply->error(), QNetworkReply::NoError);
+        QCOMPARE(reply->readAll(), QByteArray("ok"));
+        QCOMPARE(registry.upstreamConnectSeconds.count(), connects + 1);
+        delete reply;
+    }
+
+    void testRelayReportsUnresolvedHost()
+    {
+        StubDnsServer stub;
+        DnsResolver resolver(QList<DnsResolver::Server>{stub.server()});
+        UpstreamRelay relay(resolver, 5000);
+        QVERIFY(relay.listen());
+
+        auto& registry = metrics::registry();
+        const quint64 failures = registry.upstreamDnsFailures.value();
+        QNetworkAccessManager nam;
+        nam.setProxy(relay.proxy());
+        QNetworkReply* reply = nam.get(QNetworkRequest(QUrl(QStringLiteral("http://missing.test/"))));
+        QTRY_VERIFY_WITH_TIMEOUT(reply->isFinished(), 10000);
+        QVERIFY(reply->error() != QNetworkReply::NoError);
+        QCOMPARE(registry.upstreamDnsFailures.value(), failures + 1);
+        delete reply;
+    }
+
+    void testRelayRejectsOtherCredentials()
+    {
+        DnsResolver resolver(QList<DnsResolver::Server>{});
+        UpstreamRelay relay(resolver, 5000);
+        QVERIFY(relay.listen());
+
+        QNetworkProxy proxy = relay.proxy();
+        proxy.setPassword(QStringLiteral("wrong"));
+        QNetworkAccessManager nam;
+        nam.setProxy(proxy);
+        QNetworkReply* reply = nam.get(QNetworkRequest(QUrl(QStringLiteral("http://127.0.0.1:1/"))));
+        QTRY_VERIFY_WITH_TIMEOUT(reply->isFinished(), 10000);
+        QVERIFY(reply->error() != QNetworkReply::NoError);
+        delete reply;
+    }
+};
+
+QTEST_MAIN(TestDnsResolver)
+#include "tst_dns_resolver.moc"
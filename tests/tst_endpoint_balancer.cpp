@@ -0,0 +1,144 @@
+#include <QTest>
+#include <QFile>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QTemporaryDir>
+#include "semantic/endpoint_balancer.h"
+
+namespace {
+
+const QString kFast = QStringLiteral("https://fast.example.com");
+const QString kSlow = QStringLiteral("https://slow.example.com");
+
+// How often each URL is picked over many draws
+QHash<QString, int> draws(EndpointBalancer& balancer, const QStringList& urls, int times = 200)
+{
+    QHash<QString, int> counts;
+    for (int i = 0; i < times; ++i)
+        ++counts[urls[balancer.pick(urls)]];
+    return counts;
+}
+
+}
+
+class TestEndpointBalancer : public QObject {
+    Q_OBJECT
+
+private slots:
+    void testSingleUrl()
+    {
+        EndpointBalancer balancer;
+        QCOMPARE(balancer.pick({}), 0);
+        QCOMPARE(balancer.pick({kFast}), 0);
+    }
+
+    void testTriesUnknownUrlsFirst()
+    {
+        EndpointBalancer balancer;
+        balancer.recordSuccess(kFast, 10);
+        QCOMPARE(draws(balancer, {kFast, kSlow}).value(kSlow), 200);
+    }
+
+    void testPrefersLowerLatency()
+    {
+        EndpointBalancer balancer;
+        for (int i = 0; i < 10; ++i) {
+            balancer.recordSuccess(kFast, 100);
+            balancer.recordSuccess(kSlow, 1000);
+        }
+        QCOMPARE(draws(balancer, {kFast, kSlow}).value(kFast), 200);
+
+        // With three, the slowest loses to either of the others
+        const QString other = QStringLiteral("https://other.example.com");
+        for (int i = 0; i < 10; ++i)
+            balancer.recordSuccess(other, 500);
+        const QHash<QString, int> counts = draws(balancer, {kFast, kSlow, other}, 600);
+        QCOMPARE(counts.value(kSlow), 0);
+        QVERIFY(counts.value(kFast) > counts.value(other));
+        QVERIFY(counts.value(other) > 0);
+    }
+
+    void testErrorsOutweighLatency()
+    {
+        EndpointBalancer balancer;
+        balancer.recordSuccess(kFast, 100);
+        balancer.recordSuccess(kSlow, 1000);
+        balancer.recordFailure(kFast);
+        balancer.recordFailure(kFast);
+        QVERIFY(balancer.stats(kFast)->errorRate > 0.3);
+        QCOMPARE(draws(balancer, {kFast, kSlow}).value(kSlow), 200);
+
+        // Successes bring it back
+        for (int i = 0; i < 20; ++i)
+            balancer.recordSuccess(kFast, 100);
+        QCOMPARE(draws(balancer, {kFast, kSlow}).value(kFast), 200);
+    }
+
+    void testInFlightSpreadsLoad()
+    {
+        EndpointBalancer balancer;
+        balancer.recordSuccess(kFast, 100);
+        balancer.recordSuccess(kSlow, 150);
+        {
+            const EndpointBalancer::InFlight first = balancer.begin(kFast);
+            const EndpointBalancer::InFlight copy = first;
+            QCOMPARE(balancer.stats(kFast)->inFlight, 1);
+            QCOMPARE(draws(balancer, {kFast, kSlow}).value(kSlow), 200);
+        }
+        QCOMPARE(balancer.stats(kFast)->inFlight, 0);
+        QCOMPARE(draws(balancer, {kFast, kSlow}).value(kFast), 200);
+    }
+
+    void testSaveAndLoad()
+    {
+        QTemporaryDir dir;
+        QVERIFY(dir.isValid());
+        const QString path = dir.filePath(QStringLiteral("endpoint_stats.json"));
+
+        EndpointBalancer saved;
+        saved.recordSuccess(kFast, 120);
+        saved.recordFailure(kSlow);
+        QVERIFY(saved.save(path));
+
+        EndpointBalancer loaded;
+        QVERIFY(loaded.load(path));
+        QCOMPARE(loaded.stats(kFast)->latencyMs, 120.0);
+        QCOMPARE(loaded.stats(kFast)->samples, quint64(1));
+        QCOMPARE(loaded.stats(kSlow)->errorRate, 1.0);
+        QCOMPARE(loaded.stats(kSlow)->inFlight, 0);
+        QCOMPARE(draws(loaded, {kFast, kSlow}).value(kFast), 200);
+
+        QVERIFY(!loaded.load(dir.filePath(QStringLiteral("missing.json"))));
+    }
+
+    // A URL without samples for a while is tried once, then judged again
+    void testProbesStaleUrl()
+    {
+        QTemporaryDir dir;
+        QVERIFY(dir.isValid());
+        const QString path = dir.filePath(QStringLiteral("endpoint_stats.json"));
+        QJsonObject slow;
+        slow[QStringLiteral("latency_ms")] = 5000;
+        slow[QStringLiteral("error_rate")] = 0;
+        slow[QStringLiteral("samples")] = 50;
+        slow[QStringLiteral("updated_ms")] = 0;
+        QJsonObject endpoints;
+        endpoints[kSlow] = slow;
+        QJsonObject root;
+        root[QStringLiteral("endpoints")] = endpoints;
+        QFile file(path);
+        QVERIFY(file.open(QIODevice::WriteOnly));
+        file.write(QJsonDocument(root).toJson());
+        file.close();
+
+        EndpointBalancer balancer;
+        QVERIFY(balancer.load(path));
+        balancer.recordSuccess(kFast, 100);
+        const QStringList urls = {kFast, kSlow};
+        QCOMPARE(urls[balancer.pick(urls)], kSlow);
+        QCOMPARE(draws(balancer, urls).value(kFast), 200);
+    }
+};
+
+QTEST_MAIN(TestEndpointBalancer)
+#include "tst_endpoint_balancer.moc"
@@ -0,0 +1,329 @@
+#include <QTest>
+#include <QBuffer>
+#include <QSignalSpy>
+#include "proxy/hpack.h"
+#include "proxy/http2_connection.h"
+
+namespace {
+
+struct Frame {
+    quint8 type = 0;
+    quint8 flags = 0;
+    quint32 streamId = 0;
+    QByteArray payload;
+};
+
+constexpr quint8 kData = 0x0;
+constexpr quint8 kHeaders = 0x1;
+constexpr quint8 kRstStream = 0x3;
+constexpr quint8 kSettings = 0x4;
+constexpr quint8 kGoAway = 0x7;
+constexpr quint8 kWindowUpdate = 0x8;
+constexpr quint8 kEndStream = 0x1;
+constexpr quint8 kEndHeaders = 0x4;
+
+QByteArray frame(quint8 type, quint8 flags, quint32 streamId, const QByteArray& payload = {})
+{
+    QByteArray out;
+    const int length = payload.size();
+    out.append(char(length >> 16)).append(char(length >> 8)).append(char(length));
+    out.append(char(type)).append(char(flags));
+    out.append(char(streamId >> 24)).append(char(streamId >> 16))
+       .append(char(streamId >> 8)).append(char(streamId));
+    return out + payload;
+}
+
+QByteArray uint32(quint32 value)
+{
+    QByteArray out;
+    out.append(char(value >> 24)).append(char(value >> 16)).append(char(value >> 8)).append(char(value));
+    return out;
+}
+
+QByteArray settings(quint16 id, quint32 value)
+{
+    QByteArray payload;
+    payload.append(char(id >> 8)).append(char(id));
+    return frame(kSettings, 0, 0, payload + uint32(value));
+}
+
+QByteArray requestHeaders(quint32 streamId, const QByteArray& method, const QByteArray& path,
+                          bool endStream)
+{
+    QByteArray block;
+    HpackEncoder().encode({{":method", method},
+                           {":scheme", "https"},
+                           {":path", path},
+                           {":authority", "api.openai.com"},
+                           {"authorization", "Bearer sk-test"}},
+                          block);
+    return frame(kHeaders, kEndHeaders | (endStream ? kEndStream : 0), streamId, block);
+}
+
+QByteArray clientPreface(const QByteArray& settingsFrames = frame(kSettings, 0, 0))
+{
+    return QByteArray("PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n") + settingsFrames;
+}
+
+// Splits everything the server wrote so far into frames
+QList<Frame> takeFrames(QBuffer& output)
+{
+    const QByteArray data = output.data();
+    output.buffer().clear();
+    output.seek(0);
+
+    QList<Frame> frames;
+    qsizetype pos = 0;
+    while (data.size() - pos >= 9) {
+        const auto* h = reinterpret_cast<const uchar*>(data.constData() + pos);
+        const qsizetype length = (h[0] << 16) | (h[1] << 8) | h[2];
+        Frame f;
+        f.type = h[3];
+        f.flags = h[4];
+        f.streamId = ((h[5] & 0x7f) << 24) | (h[6] << 16) | (h[7] << 8) | h[8];
+        f.payload = data.mid(pos + 9, length);
+        frames.append(f);
+        pos += 9 + length;
+    }
+    return frames;
+}
+
+QList<Frame> dataFrames(const QList<Frame>& frames)
+{
+    QList<Frame> out;
+    for (const Frame& f : frames) {
+        if (f.type == kData) out.append(f);
+    }
+    return out;
+}
+
+}
+
+class TestHttp2 : public QObject {
+    Q_OBJECT
+
+private slots:
+    // RFC 7541 appendix C.4: requests with Huffman coding, sharing one table
+    void testHpackRfcVectors()
+    {
+        HpackDecoder decoder;
+        HpackHeaderList first;
+        QVERIFY(decoder.decode(QByteArray::fromHex("828684418cf1e3c2e5f23a6ba0ab90f4ff"), first));
+        QCOMPARE(first.size(), 4);
+        QCOMPARE(first[0].name, QByteArray(":method"));
+        QCOMPARE(first[0].value, QByteArray("GET"));
+        QCOMPARE(first[3].name, QByteArray(":authority"));
+        QCOMPARE(first[3].value, QByteArray("www.example.com"));
+        QCOMPARE(decoder.dynamicTableSize(), qsizetype(57));
+
+        HpackHeaderList second;
+        QVERIFY(decoder.decode(QByteArray::fromHex("828684be5886a8eb10649cbf"), second));
+        QCOMPARE(second.size(), 5);
+        QCOMPARE(second[3].value, QByteArray("www.example.com"));
+        QCOMPARE(second[4].name, QByteArray("cache-control"));
+        QCOMPARE(second[4].value, QByteArray("no-cache"));
+        QCOMPARE(decoder.dynamicTableSize(), qsizetype(110));
+
+        HpackHeaderList third;
+        QVERIFY(decoder.decode(
+            QByteArray::fromHex("828785bf408825a849e95ba97d7f8925a849e95bb8e8b4bf"), third));
+        QCOMPARE(third.size(), 5);
+        QCOMPARE(third[2].value, QByteArray("/index.html"));
+        QCOMPARE(third[4].name, QByteArray("custom-key"));
+        QCOMPARE(third[4].value, QByteArray("custom-value"));
+        QCOMPARE(decoder.dynamicTableSize(), qsizetype(164));
+    }
+
+    void testHpackEncoderRoundTrip()
+    {
+        const HpackHeaderList headers = {
+            {":status", "200"},                     // full static match
+            {"content-type", "text/event-stream"},  // static name
+            {"x-request-id", QByteArray(300, 'r')}, // new name, multi-byte length
+        };
+        QByteArray block;
+        HpackEncoder().encode(headers, block);
+
+        HpackDecoder decoder;
+        HpackHeaderList decoded;
+        QVERIFY(decoder.decode(block, decoded));
+        QCOMPARE(decoded.size(), headers.size());
+        for (qsizetype i = 0; i < headers.size(); ++i) {
+            QCOMPARE(decoded[i].name, headers[i].name);
+            QCOMPARE(decoded[i].value, headers[i].value);
+        }
+        // Nothing was indexed
+        QCOMPARE(decoder.dynamicTableSize(), qsizetype(0));
+    }
+
+    void testHpackRejectsInvalidInput()
+    {
+        QByteArray out;
+        // "0" is 00000; the remaining three zero bits are not valid padding
+        QVERIFY(!hpack::huffmanDecode(QByteArray::fromHex("00"), out));
+
+        HpackDecoder decoder;
+        HpackHeaderList headers;
+        QVERIFY(!decoder.decode(QByteArray::fromHex("80"), headers));      // index 0
+        QVERIFY(!decoder.decode(QByteArray::fromHex("be"), headers));      // index 62, empty table
+        QVERIFY(!decoder.decode(QByteArray::fromHex("3fe21f"), headers));  // table size 4097
+        QVERIFY(!decoder.decode(QByteArray::fromHex("4003616263"), headers));  // value missing
+    }
+
+    void testRequestAndResponse()
+    {
+        QBuffer output;
+        output.open(QIODevice::WriteOnly);
+        Http2Connection connection(&output);
+        QList<Http2Request> requests;
+        connect(&connection, &Http2Connection::requestReceived,
+                this, [&requests](const Http2Request& request) { requests.append(request); });
+
+        connection.start();
+        connection.receive(clientPreface()
+                           + requestHeaders(1, "POST", "/v1/chat/completions", false)
+                           + frame(kData, 0, 1, "{\"model\":")
+                           + frame(kData, kEndStream, 1, "\"gpt\"}"));
+        QCOMPARE(requests.count(), 1);
+        const Http2Request& request = requests.first();
+        QCOMPARE(request.streamId, 1u);
+        QCOMPARE(request.method, QByteArray("POST"));
+        QCOMPARE(request.path, QByteArray("/v1/chat/completions"));
+        QCOMPARE(request.header("Authorization"), QByteArrayView("Bearer sk-test"));
+        QVERIFY(request.header("x-api-key").isNull());
+        QCOMPARE(request.body, QByteArray("{\"model\":\"gpt\"}"));
+
+        takeFrames(output);
+        connection.sendResponse(1, 200, {{"content-type", "application/json"}}, "{}");
+        const QList<Frame> frames = takeFrames(output);
+        QCOMPARE(frames.size(), 2);
+        QCOMPARE(frames[0].type, kHeaders);
+        QCOMPARE(frames[0].flags, kEndHeaders);
+        QCOMPARE(frames[1].type, kData);
+        QCOMPARE(frames[1].flags, kEndStream);
+        QCOMPARE(frames[1].payload, QByteArray("{}"));
+        QVERIFY(!connection.isStreamOpen(1));
+
+        HpackHeaderList responseHeaders;
+        QVERIFY(HpackDecoder().decode(frames[0].payload, responseHeaders));
+        QCOMPARE(responseHeaders[0].name, QByteArray(":status"));
+        QCOMPARE(responseHeaders[0].value, QByteArray("200"));
+    }
+
+    void testStreamFlowControl()
+    {
+        QBuffer output;
+        output.open(QIODevice::WriteOnly);
+        Http2Connection connection(&output);
+        connection.start();
+        // SETTINGS_INITIAL_WINDOW_SIZE = 10 for every stream
+        connection.receive(clientPreface(settings(0x4, 10))
+                           + requestHeaders(1, "GET", "/a", true)
+                           + requestHeaders(3, "GET", "/b", true));
+        takeFrames(output);
+
+        for (quint32 streamId : {1u, 3u}) {
+            connection.sendHeaders(streamId, 200, {}, false);
+            connection.sendData(streamId, QByteArray(25, 'x'), true);
+        }
+        QList<Frame> frames = dataFrames(takeFrames(output));
+        QCOMPARE(frames.size(), 2);
+        QCOMPARE(frames[0].payload.size(), 10);
+        QCOMPARE(frames[1].payload.size(), 10);
+        QCOMPARE(connection.pendingBytes(1), qint64(15));
+        QCOMPARE(connection.pendingBytes(3), qint64(15));
+
+        // Credit for stream 1 only releases stream 1
+        connection.receive(frame(kWindowUpdate, 0, 1, uint32(100)));
+        frames = dataFrames(takeFrames(output));
+        QCOMPARE(frames.size(), 1);
+        QCOMPARE(frames[0].streamId, 1u);
+        QCOMPARE(frames[0].payload.size(), 15);
+        QCOMPARE(frames[0].flags, kEndStream);
+        QVERIFY(!connection.isStreamOpen(1));
+        QCOMPARE(connection.pendingBytes(3), qint64(15));
+    }
+
+    void testStreamsInterleaveWhenBlocked()
+    {
+        QBuffer output;
+        output.open(QIODevice::WriteOnly);
+        Http2Connection connection(&output);
+        connection.start();
+        connection.receive(clientPreface(settings(0x4, 1024 * 1024))
+                           + requestHeaders(1, "GET", "/a", true)
+                           + requestHeaders(3, "GET", "/b", true));
+
+        // Stream 1 uses up the 65535-byte connection window on its own
+        for (quint32 streamId : {1u, 3u}) {
+            connection.sendHeaders(streamId, 200, {}, false);
+            connection.sendData(streamId, QByteArray(100 * 1024, 'x'), true);
+        }
+        takeFrames(output);
+
+        connection.receive(frame(kWindowUpdate, 0, 0, uint32(4 * 16384)));
+        const QList<Frame> frames = dataFrames(takeFrames(output));
+        QCOMPARE(frames.size(), 4);
+        QCOMPARE(frames[0].streamId, 1u);
+        QCOMPARE(frames[1].streamId, 3u);
+        QCOMPARE(frames[2].streamId, 1u);
+        QCOMPARE(frames[3].streamId, 3u);
+    }
+
+    void testClientResetAndLimits()
+    {
+        QBuffer output;
+        output.open(QIODevice::WriteOnly);
+        Http2Limits limits;
+        limits.maxBodyBytes = 8;
+        Http2Connection connection(&output, limits);
+        QSignalSpy resets(&connection, &Http2Connection::streamReset);
+        connection.start();
+
+        connection.receive(clientPreface() + requestHeaders(1, "POST", "/a", false));
+        QVERIFY(connection.isStreamOpen(1));
+        connection.receive(frame(kRstStream, 0, 1, uint32(0x8)));
+        QCOMPARE(resets.count(), 1);
+        QVERIFY(!connection.isStreamOpen(1));
+
+        // Too large a body is answered with 413 and the upload is cut short
+        takeFrames(output);
+        connection.receive(requestHeaders(3, "POST", "/b", false)
+                           + frame(kData, 0, 3, QByteArray(16, 'x')));
+        const QList<Frame> frames = takeFrames(output);
+        HpackHeaderList headers;
+        bool sawRst = false;
+        for (const Frame& f : frames) {
+            if (f.type == kHeaders) QVERIFY(HpackDecoder().decode(f.payload, headers));
+            if (f.type == kRstStream) sawRst = f.streamId == 3;
+        }
+        QVERIFY(!headers.isEmpty());
+        QCOMPARE(headers[0].value, QByteArray("413"));
+        QVERIFY(sawRst);
+        QVERIFY(!connection.hasFailed());
+    }
+
+    void testConnectionErrors()
+    {
+        const QList<QByteArray> inputs = {
+            "GET / HTTP/1.1\r\n\r\n",                                         // not a preface
+            clientPreface({}) + requestHeaders(1, "GET", "/", true),           // no SETTINGS first
+            clientPreface() + requestHeaders(2, "GET", "/", true),             // even stream id
+            clientPreface() + frame(kData, kEndStream, 5, "x"),                // DATA on idle stream
+        };
+        for (const QByteArray& input : inputs) {
+            QBuffer output;
+            output.open(QIODevice::WriteOnly);
+            Http2Connection connection(&output);
+            QSignalSpy failed(&connection, &Http2Connection::failed);
+            connection.start();
+            connection.receive(input);
+            QCOMPARE(failed.count(), 1);
+            QVERIFY(connection.hasFailed());
+            QCOMPARE(takeFrames(output).last().type, kGoAway);
+        }
+    }
+};
+
+QTEST_MAIN(TestHttp2)
+#include "tst_http2.moc"
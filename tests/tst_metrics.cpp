@@ -0,0 +1,90 @@
+#include <QTest>
+#include "core/metrics.h"
+
+class TestMetrics : public QObject {
+    Q_OBJECT
+
+private slots:
+    void testHistogramBuckets()
+    {
+        metrics::Histogram histogram("test_seconds", "Test", {0.1, 1, 10});
+        histogram.observe(0.05);
+        histogram.observe(0.1);  // bounds are inclusive
+        histogram.observe(0.5);
+        histogram.observe(60);
+        histogram.observe(-1);   // clamped to zero
+
+        QCOMPARE(histogram.count(), quint64(5));
+        QCOMPARE(histogram.sum(), 60.65);
+
+        QByteArray out;
+        histogram.render(out);
+        QCOMPARE(out,
+                 QByteArray("# HELP test_seconds Test\n"
+                            "# TYPE test_seconds histogram\n"
+                            "test_seconds_bucket{le=\"0.1\"} 3\n"
+                            "test_seconds_bucket{le=\"1\"} 4\n"
+                            "test_seconds_bucket{le=\"10\"} 4\n"
+                            "test_seconds_bucket{le=\"+Inf\"} 5\n"
+                            "test_seconds_sum 60.65\n"
+                            "test_seconds_count 5\n"));
+    }
+
+    void testCounterAndGauge()
+    {
+        metrics::Counter counter("test_total", "Test counter");
+        counter.add();
+        counter.add(41);
+        metrics::Gauge gauge("test_open", "Test gauge");
+        gauge.add(3);
+        gauge.sub(5);
+
+        QByteArray out;
+        counter.render(out);
+        gauge.render(out);
+        QVERIFY(out.contains("# TYPE test_total counter\ntest_total 42\n"));
+        QVERIFY(out.contains("# TYPE test_open gauge\ntest_open -2\n"));
+    }
+
+    void testLabeledCounter()
+    {
+        metrics::LabeledCounter requests("test_requests_total", "Test",
+                                         {QStringLiteral("inbound"), QStringLiteral("outbound")});
+        requests.add({QStringLiteral("openai"), QStringLiteral("anthropic")});
+        requests.add({QStringLiteral("openai"), QStringLiteral("anthropic")});
+        requests.add({QStringLiteral("gemini"), QStringLiteral("a\"b\\c")}, 5);
+
+        // The reference stays valid and is the same series
+        std::atomic<quint64>& series = requests.at({QStringLiteral("openai"), QStringLiteral("anthropic")});
+        series.fetch_add(1);
+        QCOMPARE(requests.value({QStringLiteral("openai"), QStringLiteral("anthropic")}), quint64(3));
+        QCOMPARE(requests.value({QStringLiteral("none"), QStringLiteral("none")}), quint64(0));
+
+        QByteArray out;
+        requests.render(out);
+        QCOMPARE(out,
+                 QByteArray("# HELP test_requests_total Test\n"
+                            "# TYPE test_requests_total counter\n"
+                            "test_requests_total{inbound=\"gemini\",outbound=\"a\\\"b\\\\c\"} 5\n"
+                            "test_requests_total{inbound=\"openai\",outbound=\"anthropic\"} 3\n"));
+    }
+
+    void testRegistryRendersCollectors()
+    {
+        auto& registry = metrics::registry();
+        const int id = registry.addCollector([](QByteArray& out) {
+            metrics::appendSample(out, "test_collected", "gauge", "Collected", 7);
+        });
+        QByteArray out = registry.render();
+        QVERIFY(out.contains("# TYPE shanghaoqi_upstream_latency_seconds histogram\n"));
+        QVERIFY(out.contains("# TYPE shanghaoqi_requests_total counter\n"));
+        QVERIFY(out.contains("\ntest_collected 7\n"));
+
+        registry.removeCollector(id);
+        out = registry.render();
+        QVERIFY(!out.contains("test_collected"));
+    }
+};
+
+QTEST_MAIN(TestMetrics)
+#include "tst_metrics.moc"
@@ -0,0 +1,101 @@
+#include <QTest>
+#include "proxy/model_list_cache.h"
+
+namespace {
+
+ModelListCache::Response okResponse(const QByteArray& tag)
+{
+    ModelListCache::Response response;
+    response.status = 200;
+    response.openAiBody = "openai:" + tag;
+    response.anthropicBody = "anthropic:" + tag;
+    return response;
+}
+
+}
+
+class TestModelListCache : public QObject {
+    Q_OBJECT
+
+private slots:
+    void testConcurrentMissesShareOneFetch()
+    {
+        ModelListCache cache(60000);
+        QList<QByteArray> answered;
+        auto waiter = [&answered](bool anthropic) {
+            return [&answered, anthropic](const ModelListCache::Response& response) {
+                answered.append(response.body(anthropic));
+            };
+        };
+
+        QCOMPARE(cache.lookup(QStringLiteral("k"), nullptr), ModelListCache::State::Missing);
+        QVERIFY(cache.join(QStringLiteral("k"), waiter(false)));
+        QVERIFY(!cache.join(QStringLiteral("k"), waiter(true)));
+        QVERIFY(!cache.join(QStringLiteral("k"), waiter(false)));
+        // Another key fetches on its own
+        QVERIFY(cache.join(QStringLiteral("other"), nullptr));
+        QCOMPARE(cache.fetches(), qint64(2));
+
+        cache.complete(QStringLiteral("k"), okResponse("v1"));
+        QCOMPARE(answered, (QList<QByteArray>{"openai:v1", "anthropic:v1", "openai:v1"}));
+
+        ModelListCache::Response cached;
+        QCOMPARE(cache.lookup(QStringLiteral("k"), &cached), ModelListCache::State::Fresh);
+        QCOMPARE(cached.anthropicBody, QByteArray("anthropic:v1"));
+        // The fetch is over, so the next miss starts a new one
+        QVERIFY(cache.join(QStringLiteral("k"), nullptr));
+    }
+
+    void testStaleListIsServedUntilRefreshed()
+    {
+        ModelListCache cache(20);
+        QVERIFY(cache.join(QStringLiteral("k"), nullptr));
+        cache.complete(QStringLiteral("k"), okResponse("v1"));
+
+        QTest::qWait(40);
+        ModelListCache::Response cached;
+        QCOMPARE(cache.lookup(QStringLiteral("k"), &cached), ModelListCache::State::Stale);
+        QCOMPARE(cached.openAiBody, QByteArray("openai:v1"));
+
+        // A failed refresh keeps the stale list
+        QVERIFY(cache.join(QStringLiteral("k"), nullptr));
+        ModelListCache::Response failure;
+        failure.status = 502;
+        cache.complete(QStringLiteral("k"), failure);
+        QCOMPARE(cache.lookup(QStringLiteral("k"), &cached), ModelListCache::State::Stale);
+        QCOMPARE(cached.status, 200);
+
+        QVERIFY(cache.join(QStringLiteral("k"), nullptr));
+        cache.complete(QStringLiteral("k"), okResponse("v2"));
+        QCOMPARE(cache.lookup(QStringLiteral("k"), &cached), ModelListCache::State::Fresh);
+        QCOMPARE(cached.openAiBody, QByteArray("openai:v2"));
+    }
+
+    void testErrorsAreNotCached()
+    {
+        ModelListCache cache(60000);
+        int status = 0;
+        QVERIFY(cache.join(QStringLiteral("k"), [&status](const ModelListCache::Response& r) {
+            status = r.status;
+        }));
+        ModelListCache::Response failure;
+        failure.status = 401;
+        cache.complete(QStringLiteral("k"), failure);
+
+        QCOMPARE(status, 401);
+        QCOMPARE(cache.lookup(QStringLiteral("k"), nullptr), ModelListCache::State::Missing);
+    }
+
+    void testDisabledCacheStillSharesFetches()
+    {
+        ModelListCache cache(0);
+        QVERIFY(!cache.isEnabled());
+        QVERIFY(cache.join(QStringLiteral("k"), nullptr));
+        QVERIFY(!cache.join(QStringLiteral("k"), nullptr));
+        cache.complete(QStringLiteral("k"), okResponse("v1"));
+        QCOMPARE(cache.lookup(QStringLiteral("k"), nullptr), ModelListCache::State::Missing);
+    }
+};
+
+QTEST_MAIN(TestModelListCache)
+#include "tst_model_list_cache.moc"
@@ -1,8 +1,14 @@
 #include <QTest>
+#include <QDateTime>
+#include <QSet>
 #include "semantic/policy.h"
 #include "semantic/request.h"
 #include "semantic/capability.h"
 #include "semantic/failure.h"
+#include "semantic/latency_window.h"
+#include "semantic/circuit_breaker.h"
+#include "semantic/rate_limiter.h"
+#include "core/metrics.h"
 
 class TestPolicy : public QObject {
     Q_OBJECT
@@ -90,6 +96,259 @@ private slots:
         auto decision = policy.nextRetry(plan, 1, failure);
         QVERIFY(!decision.retry);
     }
+
+    void testRetrySkipsOpenEndpoints() {
+        CircuitBreaker breaker;
+        breaker.setThresholds(1, 60 * 1000);
+        Policy policy;
+        policy.setCircuitBreaker(&breaker);
+
+        ExecutionPlan plan;
+        plan.maxAttempts = 3;
+        plan.endpoints = { QStringLiteral("https://a.example.com"), QStringLiteral("https://b.example.com") };
+
+        auto failure = DomainFailure::unavailable(QStringLiteral("service down"));
+        breaker.recordFailure(plan.endpoints[0], failure);
+        QVERIFY(policy.nextRetry(plan, 0, failure).retry);
+
+        // Nothing left to try
+        breaker.recordFailure(plan.endpoints[1], failure);
+        auto decision = policy.nextRetry(plan, 0, failure);
+        QVERIFY(!decision.retry);
+        QCOMPARE(decision.reason, QStringLiteral("circuit open for every endpoint"));
+    }
+
+    void testCircuitBreakerOpensAndProbes() {
+        const QString url = QStringLiteral("https://breaker.example.com");
+        auto& registry = metrics::registry();
+        const quint64 opened = registry.upstreamCircuitTransitions.value({url, QStringLiteral("open")});
+        const quint64 probed = registry.upstreamCircuitTransitions.value({url, QStringLiteral("half_open")});
+        const quint64 closed = registry.upstreamCircuitTransitions.value({url, QStringLiteral("closed")});
+
+        CircuitBreaker breaker;
+        breaker.setThresholds(2, 100);
+        const auto down = DomainFailure::unavailable(QStringLiteral("connection refused"));
+        breaker.recordFailure(url, down);
+        // The endpoint answered, so the failures are no longer consecutive
+        breaker.recordFailure(url, DomainFailure::rateLimited(QStringLiteral("slow down")));
+        breaker.recordFailure(url, down);
+        breaker.recordFailure(url, DomainFailure::internal(QStringLiteral("parse error")));
+        QCOMPARE(breaker.state(url), CircuitBreaker::State::Closed);
+        QVERIFY(breaker.allow(url));
+
+        breaker.recordFailure(url, DomainFailure::timeout(QStringLiteral("request timeout")));
+        QCOMPARE(breaker.state(url), CircuitBreaker::State::Open);
+        QVERIFY(!breaker.available(url));
+        QVERIFY(!breaker.allow(url));
+        QCOMPARE(registry.upstreamCircuitState.value({url}), qint64(1));
+
+        // One probe at a time; a failed one opens it again
+        QTRY_VERIFY(breaker.available(url));
+        QVERIFY(breaker.allow(url));
+        QCOMPARE(breaker.state(url), CircuitBreaker::State::HalfOpen);
+        QVERIFY(!breaker.allow(url));
+        breaker.recordFailure(url, down);
+        QCOMPARE(breaker.state(url), CircuitBreaker::State::Open);
+        QVERIFY(!breaker.allow(url));
+
+        QTRY_VERIFY(breaker.allow(url));
+        breaker.recordSuccess(url);
+        QCOMPARE(breaker.state(url), CircuitBreaker::State::Closed);
+        QVERIFY(breaker.allow(url));
+
+        QCOMPARE(registry.upstreamCircuitTransitions.value({url, QStringLiteral("open")}), opened + 2);
+        QCOMPARE(registry.upstreamCircuitTransitions.value({url, QStringLiteral("half_open")}), probed + 2);
+        QCOMPARE(registry.upstreamCircuitTransitions.value({url, QStringLiteral("closed")}), closed + 1);
+        QCOMPARE(registry.upstreamCircuitState.value({url}), qint64(0));
+
+        // Turned off, it lets everything through
+        breaker.setThresholds(0, 100);
+        for (int i = 0; i < 5; ++i)
+            breaker.recordFailure(url, down);
+        QVERIFY(breaker.allow(url));
+        QCOMPARE(breaker.state(url), CircuitBreaker::State::Closed);
+    }
+
+    void testRetryAfterFromHeaders() {
+        using Headers = QMap<QString, QString>;
+        QCOMPARE(DomainFailure::retryAfterFromHeaders({}), qint64(-1));
+        QCOMPARE(DomainFailure::retryAfterFromHeaders(Headers{{QStringLiteral("Retry-After"), QStringLiteral("2")}}),
+                 qint64(2000));
+        QCOMPARE(DomainFailure::retryAfterFromHeaders(Headers{{QStringLiteral("retry-after-ms"), QStringLiteral("150")},
+                                                              {QStringLiteral("retry-after"), QStringLiteral("1")}}),
+                 qint64(150));
+
+        const QString date = QDateTime::currentDateTimeUtc().addSecs(30).toString(Qt::RFC2822Date);
+        const qint64 untilDate =
+            DomainFailure::retryAfterFromHeaders(Headers{{QStringLiteral("Retry-After"), date}});
+        QVERIFY2(untilDate > 28 * 1000 && untilDate <= 30 * 1000, qPrintable(QString::number(untilDate)));
+
+        // The limit that ran out decides
+        const Headers limits = {
+            {QStringLiteral("x-ratelimit-remaining-requests"), QStringLiteral("5")},
+            {QStringLiteral("x-ratelimit-reset-requests"), QStringLiteral("6m0s")},
+            {QStringLiteral("x-ratelimit-remaining-tokens"), QStringLiteral("0")},
+            {QStringLiteral("x-ratelimit-reset-tokens"), QStringLiteral("1.5s")},
+        };
+        QCOMPARE(DomainFailure::retryAfterFromHeaders(limits), qint64(1500));
+        QCOMPARE(DomainFailure::retryAfterFromHeaders(Headers{{QStringLiteral("X-RateLimit-Reset"), QStringLiteral("1m20ms")}}),
+                 qint64(60020));
+        QCOMPARE(DomainFailure::retryAfterFromHeaders(Headers{{QStringLiteral("x-ratelimit-reset-tokens"), QStringLiteral("soon")}}),
+                 qint64(-1));
+    }
+
+    void testRetryBackoff() {
+        Policy policy;
+        policy.retryBudget().setPercent(0);
+        policy.setBackoff(100);
+
+        ExecutionPlan plan;
+        plan.maxAttempts = 20;
+        const auto failure = DomainFailure::unavailable(QStringLiteral("service down"));
+
+        // Full jitter: anywhere from 0 up to the doubled, capped ceiling
+        for (int attempt = 0; attempt < 10; ++attempt) {
+            const int ceiling = qMin(Policy::kMaxBackoffMs, 100 << attempt);
+            QSet<int> delays;
+            for (int i = 0; i < 50; ++i) {
+                const auto decision = policy.nextRetry(plan, attempt, failure);
+                QVERIFY(decision.retry);
+                QVERIFY(decision.delayMs >= 0 && decision.delayMs <= ceiling);
+                delays.insert(decision.delayMs);
+            }
+            QVERIFY(delays.size() > 1);
+        }
+
+        // Retry-After is a minimum
+        auto throttled = DomainFailure::rateLimited(QStringLiteral("slow down"));
+        throttled.retryAfterMs = 2000;
+        const auto decision = policy.nextRetry(plan, 0, throttled);
+        QVERIFY(decision.retry);
+        QVERIFY(decision.delayMs >= 2000 && decision.delayMs <= 2100);
+
+        throttled.retryAfterMs = Policy::kMaxRetryAfterMs + 1;
+        QVERIFY(!policy.nextRetry(plan, 0, throttled).retry);
+
+        policy.setBackoff(0);
+        QCOMPARE(policy.nextRetry(plan, 5, failure).delayMs, 0);
+    }
+
+    void testRetryBudget() {
+        RetryBudget budget;
+        QCOMPARE(budget.percent(), 10);
+        for (int i = 0; i < RetryBudget::kMinRetries; ++i)
+            QVERIFY(budget.tryRetry());
+        QVERIFY(!budget.tryRetry());
+
+        // 10% of 200 requests
+        for (int i = 0; i < 200; ++i)
+            budget.recordRequest();
+        for (int i = RetryBudget::kMinRetries; i < 20; ++i)
+            QVERIFY(budget.tryRetry());
+        QVERIFY(!budget.tryRetry());
+
+        budget.setPercent(0);
+        QVERIFY(budget.tryRetry());
+
+        // Through the policy
+        Policy policy;
+        policy.retryBudget().setPercent(10);
+        ExecutionPlan plan;
+        plan.maxAttempts = 3;
+        const auto failure = DomainFailure::unavailable(QStringLiteral("service down"));
+        for (int i = 0; i < RetryBudget::kMinRetries; ++i)
+            QVERIFY(policy.nextRetry(plan, 0, failure).retry);
+        const quint64 denied = metrics::registry().upstreamRetriesDenied.value();
+        const auto decision = policy.nextRetry(plan, 0, failure);
+        QVERIFY(!decision.retry);
+        QCOMPARE(decision.reason, QStringLiteral("retry budget spent"));
+        QCOMPARE(metrics::registry().upstreamRetriesDenied.value(), denied + 1);
+    }
+
+    void testRateLimiterRequests() {
+        RateLimiter limiter;
+        limiter.setLimits(QStringLiteral("g"), {2, 0});
+        QVERIFY(limiter.limited(QStringLiteral("g")));
+        QVERIFY(!limiter.limited(QStringLiteral("other")));
+        QCOMPARE(limiter.reserve(QStringLiteral("other"), 1000), qint64(0));
+
+        // A minute's worth up front, then one every 30 s
+        QCOMPARE(limiter.reserve(QStringLiteral("g"), 0), qint64(0));
+        QCOMPARE(limiter.reserve(QStringLiteral("g"), 0), qint64(0));
+        const qint64 wait = limiter.reserve(QStringLiteral("g"), 0);
+        QVERIFY2(wait > 29000 && wait <= 30000, qPrintable(QString::number(wait)));
+        // The one behind waits for its own slot too
+        QVERIFY(limiter.reserve(QStringLiteral("g"), 0) > 59000);
+
+        // Unchanged limits keep the debt; new ones start afresh
+        limiter.setLimits(QStringLiteral("g"), {2, 0});
+        QVERIFY(limiter.reserve(QStringLiteral("g"), 0) > 89000);
+        limiter.setLimits(QStringLiteral("g"), {3, 0});
+        QCOMPARE(limiter.reserve(QStringLiteral("g"), 0), qint64(0));
+        limiter.setLimits(QStringLiteral("g"), {0, 0});
+        QVERIFY(!limiter.limited(QStringLiteral("g")));
+    }
+
+    void testRateLimiterTokens() {
+        RateLimiter limiter;
+        limiter.setLimits(QStringLiteral("g"), {0, 6000});  // 100 tokens a second
+        QCOMPARE(limiter.reserve(QStringLiteral("g"), 6000), qint64(0));
+        qint64 wait = limiter.reserve(QStringLiteral("g"), 600);
+        QVERIFY2(wait > 5500 && wait <= 6000, qPrintable(QString::number(wait)));
+
+        // The first request used half its estimate
+        limiter.settle(QStringLiteral("g"), 6000, 3000);
+        QCOMPARE(limiter.reserve(QStringLiteral("g"), 600), qint64(0));
+        // ... and one used far more than estimated
+        limiter.settle(QStringLiteral("g"), 600, 6600);
+        wait = limiter.reserve(QStringLiteral("g"), 0);
+        QVERIFY2(wait > 41000 && wait <= 42000, qPrintable(QString::number(wait)));
+        // A failed attempt is refunded its estimate
+        limiter.settle(QStringLiteral("g"), 600, 0);
+        wait = limiter.reserve(QStringLiteral("g"), 0);
+        QVERIFY2(wait > 35000 && wait <= 36000, qPrintable(QString::number(wait)));
+        // A negative count is no count
+        limiter.settle(QStringLiteral("g"), 600, -1);
+        QVERIFY(limiter.reserve(QStringLiteral("g"), 0) > 35000);
+
+        // Larger than the limit: waits for at most a full minute of tokens
+        RateLimiter fresh;
+        fresh.setLimits(QStringLiteral("g"), {0, 6000});
+        QCOMPARE(fresh.reserve(QStringLiteral("g"), 1000000), qint64(0));
+        QVERIFY(fresh.reserve(QStringLiteral("g"), 1000000) <= 60000);
+    }
+
+    void testEstimateTokens() {
+        SemanticRequest req;
+        InteractionItem item;
+        item.role = QStringLiteral("user");
+        item.content.append(Segment::fromText(QString(400, QLatin1Char('x'))));
+        req.messages.append(item);
+        QCOMPARE(RateLimiter::estimateTokens(req), 101);
+
+        req.constraints.maxTokens = 100;
+        QCOMPARE(RateLimiter::estimateTokens(req), 201);
+        req.constraints.maxCompletionTokens = 50;
+        QCOMPARE(RateLimiter::estimateTokens(req), 151);
+    }
+
+    void testLatencyWindowPercentile() {
+        LatencyWindow window;
+        QCOMPARE(window.percentile(95), qint64(0));
+
+        for (int ms = 100; ms >= 1; --ms)
+            window.add(ms);
+        QCOMPARE(window.size(), 100);
+        QCOMPARE(window.percentile(50), qint64(50));
+        QCOMPARE(window.percentile(95), qint64(95));
+        QCOMPARE(window.percentile(100), qint64(100));
+
+        // Only the newest kCapacity samples count
+        for (int i = 0; i < LatencyWindow::kCapacity; ++i)
+            window.add(1000);
+        QCOMPARE(window.size(), LatencyWindow::kCapacity);
+        QCOMPARE(window.percentile(1), qint64(1000));
+    }
 };
 
 QTEST_MAIN(TestPolicy)
@@ -0,0 +1,501 @@
+#include <QTest>
+#include <QElapsedTimer>
+#include <QEventLoop>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QLocalSocket>
+#include <QNetworkAccessManager>
+#include <QNetworkReply>
+#include <QProcess>
+#include <QSslSocket>
+#include <QTcpServer>
+#include <QTemporaryDir>
+#include <QThread>
+#include "adapters/capability/static_resolver.h"
+#include "adapters/inbound/openai_chat.h"
+#include "adapters/outbound/openai.h"
+#include "pipeline/pipeline.h"
+#include "proxy/proxy_server.h"
+#include "proxy/tls_session_cache.h"
+
+// Answers every upstream call from the event loop with a canned completion,
+// so the benchmark measures the proxy itself rather than a network peer.
+class CannedExecutor : public QObject, public IExecutor {
+public:
+    CannedExecutor(QByteArray body, QObject* parent)
+        : QObject(parent)
+        , m_body(std::move(body))
+    {
+    }
+
+    void execute(const ProviderRequest&, ExecuteCallback done) override
+    {
+        QMetaObject::invokeMethod(this, [body = m_body, done]() {
+            ProviderResponse resp;
+            resp.statusCode = 200;
+            resp.body = body;
+            done(resp);
+        }, Qt::QueuedConnection);
+    }
+
+    void connectStream(const ProviderRequest&, ConnectStreamCallback done) override
+    {
+        QMetaObject::invokeMethod(this, [done]() {
+            done(std::unexpected(DomainFailure::internal(QStringLiteral("not streamed"))));
+        }, Qt::QueuedConnection);
+    }
+
+private:
+    QByteArray m_body;
+};
+
+// Where a load client connects: the TLS port, the plain HTTP port or the
+// Unix socket
+struct Endpoint {
+    ClientTransport transport = ClientTransport::Tls;
+    quint16 port = 0;
+    QString path;
+};
+
+// Keep-alive client that sends `requests` requests back to back and counts
+// the 200 responses.
+class LoadConnection : public QObject {
+public:
+    LoadConnection(const Endpoint& endpoint, const QByteArray& request, int requests,
+                   std::function<void()> onDone)
+        : m_request(request)
+        , m_remaining(requests)
+        , m_onDone(std::move(onDone))
+    {
+        if (endpoint.transport == ClientTransport::Unix) {
+            auto* socket = new QLocalSocket(this);
+            connect(socket, &QLocalSocket::connected, this, [this]() { sendNext(); });
+            connect(socket, &QLocalSocket::disconnected, this, [this]() { finish(); });
+            connect(socket, &QLocalSocket::errorOccurred, this, [this]() { finish(); });
+            m_device = socket;
+            socket->connectToServer(endpoint.path);
+        } else {
+            auto* socket = new QSslSocket(this);
+            socket->setPeerVerifyMode(QSslSocket::VerifyNone);
+            if (endpoint.transport == ClientTransport::Tls) {
+                connect(socket, &QSslSocket::encrypted, this, [this]() { sendNext(); });
+            } else {
+                connect(socket, &QSslSocket::connected, this, [this]() { sendNext(); });
+            }
+            connect(socket, &QSslSocket::disconnected, this, [this]() { finish(); });
+            connect(socket, &QSslSocket::errorOccurred, this, [this]() { finish(); });
+            m_device = socket;
+            if (endpoint.transport == ClientTransport::Tls) {
+                socket->connectToHostEncrypted(QStringLiteral("127.0.0.1"), endpoint.port);
+            } else {
+                socket->connectToHost(QStringLiteral("127.0.0.1"), endpoint.port);
+            }
+        }
+        connect(m_device, &QIODevice::readyRead, this, [this]() { onReadyRead(); });
+    }
+
+    int succeeded() const { return m_succeeded; }
+
+private:
+    void sendNext()
+    {
+        m_device->write(m_request);
+    }
+
+    void onReadyRead()
+    {
+        m_buffer += m_device->readAll();
+        for (;;) {
+            const int headerEnd = m_buffer.indexOf("\r\n\r\n");
+            if (headerEnd < 0) return;
+
+            int contentLength = 0;
+            for (const QByteArray& line : m_buffer.left(headerEnd).split('\n')) {
+                if (line.toLower().startsWith("content-length:"))
+                    contentLength = line.mid(15).trimmed().toInt();
+            }
+            const int total = headerEnd + 4 + contentLength;
+            if (m_buffer.size() < total) return;
+
+            if (m_buffer.startsWith("HTTP/1.1 200")) ++m_succeeded;
+            m_buffer.remove(0, total);
+
+            if (--m_remaining > 0) {
+                sendNext();
+            } else {
+                finish();
+                return;
+            }
+        }
+    }
+
+    void finish()
+    {
+        if (m_finished) return;
+        m_finished = true;
+        m_device->close();
+        m_onDone();
+    }
+
+    QIODevice* m_device = nullptr;  // child
+    QByteArray m_request;
+    QByteArray m_buffer;
+    int m_remaining;
+    int m_succeeded = 0;
+    bool m_finished = false;
+    std::function<void()> m_onDone;
+};
+
+namespace {
+
+constexpr int kClientThreads = 4;
+constexpr int kConnectionsPerClientThread = 8;
+constexpr int kRequestsPerConnection = 40;
+
+QByteArray chatRequestBody()
+{
+    // A realistic multi-turn prompt (~16 KB) so decode/encode work dominates
+    QJsonArray messages;
+    for (int i = 0; i < 40; ++i) {
+        QJsonObject msg;
+        msg[QStringLiteral("role")] = (i % 2 == 0) ? QStringLiteral("user") : QStringLiteral("assistant");
+        msg[QStringLiteral("content")] = QStringLiteral("turn %1: ").arg(i) + QString(360, QLatin1Char('x'));
+        messages.append(msg);
+    }
+    QJsonObject body;
+    body[QStringLiteral("model")] = QStringLiteral("bench-model");
+    body[QStringLiteral("messages")] = messages;
+    return QJsonDocument(body).toJson(QJsonDocument::Compact);
+}
+
+QByteArray completionBody()
+{
+    return R"({"id":"chatcmpl-1","object":"chat.completion","model":"bench-model",)"
+           R"("choices":[{"index":0,"message":{"role":"assistant","content":"ok"},)"
+           R"("finish_reason":"stop"}],"usage":{"prompt_tokens":10,"completion_tokens":1,"total_tokens":11}})";
+}
+
+QByteArray httpRequest(const QByteArray& body)
+{
+    return "POST /v1/chat/completions HTTP/1.1\r\n"
+           "Host: localhost\r\n"
+           "Content-Type: application/json\r\n"
+           "Content-Length: " + QByteArray::number(body.size()) + "\r\n"
+           "\r\n" + body;
+}
+
+// Drives kClientThreads threads of keep-alive connections; returns the
+// number of successful responses.
+int runLoad(const Endpoint& endpoint)
+{
+    const QByteArray request = httpRequest(chatRequestBody());
+    std::atomic<int> succeeded{0};
+
+    QList<QThread*> threads;
+    for (int t = 0; t < kClientThreads; ++t) {
+        threads.append(QThread::create([&endpoint, &request, &succeeded]() {
+            QEventLoop loop;
+            int pending = kConnectionsPerClientThread;
+            std::vector<std::unique_ptr<LoadConnection>> connections;
+            for (int i = 0; i < kConnectionsPerClientThread; ++i) {
+                connections.push_back(std::make_unique<LoadConnection>(
+                    endpoint, request, kRequestsPerConnection, [&]() {
+                        if (--pending == 0) loop.quit();
+                    }));
+            }
+            loop.exec();
+            for (const auto& connection : connections)
+                succeeded += connection->succeeded();
+        }));
+    }
+    for (QThread* thread : threads) thread->start();
+    for (QThread* thread : threads) {
+        thread->wait();
+        delete thread;
+    }
+    return succeeded.load();
+}
+
+// Runs runLoad() off this thread, which keeps accepting meanwhile; returns
+// requests per second
+double measureLoad(const Endpoint& endpoint, int* succeeded)
+{
+    QElapsedTimer timer;
+    timer.start();
+    QThread* load = QThread::create([&]() { *succeeded = runLoad(endpoint); });
+    QEventLoop loop;
+    QObject::connect(load, &QThread::finished, &loop, &QEventLoop::quit);
+    load->start();
+    loop.exec();
+    delete load;
+    const qint64 elapsed = qMax<qint64>(1, timer.elapsed());
+    return *succeeded * 1000.0 / elapsed;
+}
+
+quint16 freeLocalPort()
+{
+    QTcpServer probe;
+    if (!probe.listen(QHostAddress::LocalHost, 0))
+        return 0;
+    return probe.serverPort();
+}
+
+}
+
+class TestProxyWorkers : public QObject {
+    Q_OBJECT
+
+private:
+    QTemporaryDir m_dir;
+    QString m_certPath;
+    QString m_keyPath;
+
+    std::unique_ptr<OpenAIChatAdapter> m_inbound;
+    std::unique_ptr<OpenAIOutbound> m_outbound;
+    std::unique_ptr<StaticCapabilityResolver> m_capabilities;
+
+    ProxyConfig makeConfig(int workerThreads, bool localListeners = false) const
+    {
+        ProxyConfig config;
+        config.certPath = m_certPath;
+        config.keyPath = m_keyPath;
+        config.runtime.proxyPort = 0;
+        config.runtime.workerThreads = workerThreads;
+        if (localListeners) {
+            config.runtime.plainHttpPort = freeLocalPort();
+#ifdef Q_OS_UNIX
+            config.runtime.unixSocketPath = m_dir.filePath(QStringLiteral("proxy.sock"));
+#endif
+        }
+
+        ConfigGroup group;
+        group.name = QStringLiteral("bench");
+        group.provider = QStringLiteral("openai");
+        group.baseUrl = QStringLiteral("https://upstream.invalid");
+        group.modelId = QStringLiteral("bench-model");
+        group.apiKey = QStringLiteral("sk-bench");
+        config.groups.append(group);
+        return config;
+    }
+
+    void startServer(ProxyServer& server, int workerThreads, bool localListeners = false)
+    {
+        // The worker's network executor is ignored in favour of a canned one
+        server.setPipelineFactory([this](IExecutor*, const ProxyConfig&, QObject* parent) {
+            auto* executor = new CannedExecutor(completionBody(), parent);
+            return new Pipeline(m_inbound.get(), m_outbound.get(), executor,
+                                m_capabilities.get(), parent);
+        });
+        QVERIFY(server.start(makeConfig(workerThreads, localListeners)));
+    }
+
+private slots:
+    void initTestCase()
+    {
+        QVERIFY(m_dir.isValid());
+        m_certPath = m_dir.filePath(QStringLiteral("cert.pem"));
+        m_keyPath = m_dir.filePath(QStringLiteral("key.pem"));
+
+        QProcess openssl;
+        openssl.start(QStringLiteral("openssl"),
+                      {QStringLiteral("req"), QStringLiteral("-x509"),
+                       QStringLiteral("-newkey"), QStringLiteral("rsa:2048"),
+                       QStringLiteral("-nodes"), QStringLiteral("-days"), QStringLiteral("1"),
+                       QStringLiteral("-subj"), QStringLiteral("/CN=localhost"),
+                       QStringLiteral("-keyout"), m_keyPath,
+                       QStringLiteral("-out"), m_certPath});
+        if (!openssl.waitForFinished(30000) || openssl.exitCode() != 0)
+            QSKIP("openssl CLI is required to generate a test certificate");
+
+        m_inbound = std::make_unique<OpenAIChatAdapter>();
+        m_outbound = std::make_unique<OpenAIOutbound>();
+        m_capabilities = std::make_unique<StaticCapabilityResolver>();
+    }
+
+    void testWorkerCountFollowsConfig()
+    {
+        ProxyServer server;
+        startServer(server, 3);
+        QCOMPARE(server.workerCount(), 3);
+        server.stop();
+        QCOMPARE(server.workerCount(), 0);
+
+        QVERIFY(ProxyServer::resolveWorkerThreads(0) >= 1);
+        QVERIFY(ProxyServer::resolveWorkerThreads(0) <= 8);
+        QCOMPARE(ProxyServer::resolveWorkerThreads(5), 5);
+    }
+
+    void testKeepAliveRequestsAreServed()
+    {
+        ProxyServer server;
+        startServer(server, 2);
+
+        const QByteArray request = httpRequest(chatRequestBody());
+        bool done = false;
+        LoadConnection connection({ClientTransport::Tls, server.listeningPort(), {}}, request, 3,
+                                  [&]() { done = true; });
+        QTRY_VERIFY_WITH_TIMEOUT(done, 10000);
+        QCOMPARE(connection.succeeded(), 3);
+    }
+
+    void testHttp2StreamsShareOneConnection()
+    {
+        ProxyServer server;
+        startServer(server, 2);
+
+        QSslConfiguration ssl = QSslConfiguration::defaultConfiguration();
+        ssl.setPeerVerifyMode(QSslSocket::VerifyNone);
+        QNetworkRequest request(QUrl(QStringLiteral("https://127.0.0.1:%1/v1/chat/completions")
+                                         .arg(server.listeningPort())));
+        request.setHeader(QNetworkRequest::ContentTypeHeader, QStringLiteral("application/json"));
+        request.setAttribute(QNetworkRequest::Http2AllowedAttribute, true);
+        request.setSslConfiguration(ssl);
+
+        // QNAM multiplexes concurrent h2 requests to one host over one connection
+        QNetworkAccessManager manager;
+        const QByteArray body = chatRequestBody();
+        QList<QNetworkReply*> replies;
+        for (int i = 0; i < 6; ++i)
+            replies.append(manager.post(request, body));
+
+        for (QNetworkReply* reply : replies) {
+            QTRY_VERIFY_WITH_TIMEOUT(reply->isFinished(), 10000);
+            QCOMPARE(reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt(), 200);
+            QVERIFY(reply->attribute(QNetworkRequest::Http2WasUsedAttribute).toBool());
+            QVERIFY(reply->readAll().contains("chatcmpl-1"));
+            reply->deleteLater();
+        }
+    }
+
+    void testTlsSessionsAreResumed()
+    {
+        if (!TlsSessionCache::isSupported())
+            QSKIP("TLS session sharing needs QtNetwork's private API and the OpenSSL backend");
+
+        // One worker: with several, a reconnect racing the server-side close
+        // of the first connection may be dispatched to another worker
+        ProxyServer server;
+        startServer(server, 1);
+
+        QSslConfiguration ssl = QSslConfiguration::defaultConfiguration();
+        ssl.setPeerVerifyMode(QSslSocket::VerifyNone);
+        ssl.setSslOption(QSsl::SslOptionDisableSessionPersistence, false);
+
+        QSslSocket first;
+        first.setSslConfiguration(ssl);
+        first.connectToHostEncrypted(QStringLiteral("127.0.0.1"), server.listeningPort());
+        QVERIFY(first.waitForEncrypted(10000));
+        // TLS 1.3 tickets arrive after the handshake
+        QTRY_VERIFY_WITH_TIMEOUT(!first.sslConfiguration().sessionTicket().isEmpty(), 5000);
+        ssl.setSessionTicket(first.sslConfiguration().sessionTicket());
+        first.disconnectFromHost();
+
+        QSslSocket second;
+        second.setSslConfiguration(ssl);
+        second.connectToHostEncrypted(QStringLiteral("127.0.0.1"), server.listeningPort());
+        QVERIFY(second.waitForEncrypted(10000));
+
+        QTRY_COMPARE_WITH_TIMEOUT(server.handshakeStats().resumedHandshakes, quint64(1), 5000);
+        const TlsHandshakeStats stats = server.handshakeStats();
+        QCOMPARE(stats.fullHandshakes, quint64(1));
+        qInfo("full handshake %llu us, resumed %llu us",
+              static_cast<unsigned long long>(stats.fullHandshakeUs),
+              static_cast<unsigned long long>(stats.resumedHandshakeUs));
+    }
+
+    void benchmarkThroughput_data()
+    {
+        QTest::addColumn<int>("workerThreads");
+        QTest::newRow("1 thread") << 1;
+        QTest::newRow("2 threads") << 2;
+        QTest::newRow("4 threads") << 4;
+        QTest::newRow("8 threads") << 8;
+    }
+
+    // Requests/second over TLS keep-alive connections. Scaling is reported
+    // rather than asserted; it depends on the cores available to the run.
+    void benchmarkThroughput()
+    {
+        QFETCH(int, workerThreads);
+
+        ProxyServer server;
+        startServer(server, workerThreads);
+        const int expected = kClientThreads * kConnectionsPerClientThread * kRequestsPerConnection;
+
+        int succeeded = 0;
+        double rate = 0;
+        QBENCHMARK_ONCE {
+            rate = measureLoad({ClientTransport::Tls, server.listeningPort(), {}}, &succeeded);
+        }
+
+        QCOMPARE(succeeded, expected);
+        qInfo("%d worker thread(s): %d requests, %.0f req/s", workerThreads, expected, rate);
+    }
+
+    void testLocalListenersServeRequests()
+    {
+        ProxyServer server;
+        startServer(server, 2, true);
+        QVERIFY(server.plainListeningPort() != 0);
+
+        QList<Endpoint> endpoints{{ClientTransport::Plain, server.plainListeningPort(), {}}};
+#ifdef Q_OS_UNIX
+        QVERIFY(!server.unixSocketPath().isEmpty());
+        endpoints.append({ClientTransport::Unix, 0, server.unixSocketPath()});
+#endif
+        const QByteArray request = httpRequest(chatRequestBody());
+        for (const Endpoint& endpoint : endpoints) {
+            bool done = false;
+            LoadConnection connection(endpoint, request, 3, [&]() { done = true; });
+            QTRY_VERIFY_WITH_TIMEOUT(done, 10000);
+            QCOMPARE(connection.succeeded(), 3);
+        }
+        QCOMPARE(server.handshakeStats().fullHandshakes, quint64(0));
+
+        server.stop();
+        QCOMPARE(server.plainListeningPort(), quint16(0));
+        QVERIFY(server.unixSocketPath().isEmpty());
+    }
+
+    void benchmarkLocalListeners_data()
+    {
+        QTest::addColumn<int>("transport");
+        QTest::newRow("tls") << int(ClientTransport::Tls);
+        QTest::newRow("plain") << int(ClientTransport::Plain);
+#ifdef Q_OS_UNIX
+        QTest::newRow("unix") << int(ClientTransport::Unix);
+#endif
+    }
+
+    // Requests/second for the same load over each listener. New connections
+    // pay for a TLS handshake only on the TLS listener; kept-alive ones still
+    // pay for record encryption.
+    void benchmarkLocalListeners()
+    {
+        QFETCH(int, transport);
+
+        ProxyServer server;
+        startServer(server, 2, true);
+        Endpoint endpoint{ClientTransport(transport), 0, {}};
+        if (endpoint.transport == ClientTransport::Tls)
+            endpoint.port = server.listeningPort();
+        else if (endpoint.transport == ClientTransport::Plain)
+            endpoint.port = server.plainListeningPort();
+        else
+            endpoint.path = server.unixSocketPath();
+        const int expected = kClientThreads * kConnectionsPerClientThread * kRequestsPerConnection;
+
+        int succeeded = 0;
+        double rate = 0;
+        QBENCHMARK_ONCE {
+            rate = measureLoad(endpoint, &succeeded);
+        }
+
+        QCOMPARE(succeeded, expected);
+        qInfo("%s: %d requests, %.0f req/s", QTest::currentDataTag(), expected, rate);
+    }
+};
+
+QTEST_MAIN(TestProxyWorkers)
+#include "tst_proxy_workers.moc"
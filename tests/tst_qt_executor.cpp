@@ -0,0 +1,835 @@
+#include <QTest>
+#include <QElapsedTimer>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QNetworkReply>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QTimer>
+#include "adapters/executor/qt_executor.h"
+#include "adapters/capability/static_resolver.h"
+#include "core/metrics.h"
+#include "proxy/connection_pool.h"
+#include "semantic/circuit_breaker.h"
+#include "semantic/processor.h"
+#include "semantic/stream_session.h"
+
+// Plain HTTP/1.1 server that answers every request after a fixed delay.
+// Each connection is handled independently so concurrent clients overlap.
+class SlowHttpServer : public QTcpServer {
+public:
+    SlowHttpServer(int delayMs, QByteArray response, QObject* parent = nullptr)
+        : QTcpServer(parent)
+        , m_delayMs(delayMs)
+        , m_response(std::move(response))
+    {
+        connect(this, &QTcpServer::newConnection, this, [this]() {
+            while (hasPendingConnections()) {
+                QTcpSocket* socket = nextPendingConnection();
+                connect(socket, &QTcpSocket::readyRead, socket, [this, socket]() {
+                    QByteArray& buffer = m_buffers[socket];
+                    buffer += socket->readAll();
+                    const int headerEnd = buffer.indexOf("\r\n\r\n");
+                    if (headerEnd < 0) return;
+
+                    int contentLength = 0;
+                    for (const QByteArray& line : buffer.left(headerEnd).split('\n')) {
+                        if (line.toLower().startsWith("content-length:"))
+                            contentLength = line.mid(15).trimmed().toInt();
+                    }
+                    if (buffer.size() < headerEnd + 4 + contentLength) return;
+                    buffer.clear();
+
+                    QTimer::singleShot(m_delayMs, socket, [this, socket]() {
+                        socket->write(m_response);
+                        if (m_closeDelayMs <= 0) {
+                            socket->disconnectFromHost();
+                            return;
+                        }
+                        QTimer::singleShot(m_closeDelayMs, socket, [socket]() { socket->disconnectFromHost(); });
+                    });
+                });
+                connect(socket, &QTcpSocket::disconnected, socket, &QObject::deleteLater);
+            }
+        });
+    }
+
+    void setDelay(int delayMs) { m_delayMs = delayMs; }
+    // Keeps the connection open this long after the response
+    void setCloseDelay(int delayMs) { m_closeDelayMs = delayMs; }
+
+    QString url() const
+    {
+        return QStringLiteral("http://127.0.0.1:%1/v1/test").arg(serverPort());
+    }
+
+private:
+    int m_delayMs;
+    int m_closeDelayMs = 0;
+    QByteArray m_response;
+    QMap<QTcpSocket*, QByteArray> m_buffers;
+};
+
+namespace {
+
+QByteArray jsonResponse(const QByteArray& body = R"({"ok":true})")
+{
+    return "HTTP/1.1 200 OK\r\n"
+           "Content-Type: application/json\r\n"
+           "Content-Length: " + QByteArray::number(body.size()) + "\r\n"
+           "Connection: close\r\n"
+           "\r\n" + body;
+}
+
+QByteArray sseResponse()
+{
+    return "HTTP/1.1 200 OK\r\n"
+           "Content-Type: text/event-stream\r\n"
+           "Connection: close\r\n"
+           "\r\n"
+           "data: {\"delta\":\"hi\"}\n\n"
+           "data: [DONE]\n\n";
+}
+
+// An SSE body far larger than the paused read buffer
+QByteArray largeSseResponse(int events)
+{
+    QByteArray response = "HTTP/1.1 200 OK\r\n"
+                          "Content-Type: text/event-stream\r\n"
+                          "Connection: close\r\n"
+                          "\r\n";
+    const QByteArray event = "data: {\"delta\":\"" + QByteArray(200, 'x') + "\"}\n\n";
+    for (int i = 0; i < events; ++i)
+        response += event;
+    return response + "data: [DONE]\n\n";
+}
+
+SemanticRequest chatRequest()
+{
+    SemanticRequest req;
+    req.target.logicalModel = QStringLiteral("test-model");
+    InteractionItem item;
+    item.role = QStringLiteral("user");
+    item.content.append(Segment::fromText(QStringLiteral("hi")));
+    req.messages.append(item);
+    return req;
+}
+
+ProviderRequest makeRequest(const QString& url)
+{
+    ProviderRequest req;
+    req.method = QStringLiteral("POST");
+    req.url = url;
+    req.body = "{}";
+    return req;
+}
+
+}
+
+class EchoOutbound : public IOutboundAdapter {
+public:
+    explicit EchoOutbound(QString url) : m_url(std::move(url)) {}
+
+    QString adapterId() const override { return QStringLiteral("echo"); }
+
+    // Sent to the routed base URL when there is one
+    Result<ProviderRequest> buildRequest(const SemanticRequest& request) override
+    {
+        return makeRequest(request.metadata.value(QStringLiteral("provider_base_url"), m_url));
+    }
+
+    Result<SemanticResponse> parseResponse(const ProviderResponse& response) override
+    {
+        SemanticResponse resp;
+        resp.modelUsed = QString::fromUtf8(response.body);
+        return resp;
+    }
+
+    Result<StreamFrame> parseChunk(const ProviderChunk&) override
+    {
+        return StreamFrame{};
+    }
+
+    DomainFailure mapFailure(int httpStatus, const QByteArray&) override
+    {
+        return DomainFailure::unavailable(QStringLiteral("HTTP %1").arg(httpStatus));
+    }
+
+private:
+    QString m_url;
+};
+
+// Streams the "delta" of each event as text
+class TextStreamOutbound : public EchoOutbound {
+public:
+    using EchoOutbound::EchoOutbound;
+
+    Result<StreamFrame> parseChunk(const ProviderChunk& chunk) override
+    {
+        StreamFrame frame;
+        const QString delta = QJsonDocument::fromJson(chunk.data).object().value(QStringLiteral("delta")).toString();
+        frame.deltaSegments.append(Segment::fromText(delta));
+        return frame;
+    }
+};
+
+class TestQtExecutor : public QObject {
+    Q_OBJECT
+
+private:
+    static constexpr int kDelayMs = 400;
+    static constexpr int kConcurrent = 8;
+
+private slots:
+    void testConcurrentExecuteOverlaps()
+    {
+        SlowHttpServer server(kDelayMs, jsonResponse());
+        QVERIFY(server.listen(QHostAddress::LocalHost));
+
+        ConnectionPool pool(kConcurrent);
+        QtExecutor executor(pool, QSslConfiguration::defaultConfiguration());
+
+        int completed = 0;
+        int succeeded = 0;
+        QElapsedTimer timer;
+        timer.start();
+        for (int i = 0; i < kConcurrent; ++i) {
+            executor.execute(makeRequest(server.url()), [&](Result<ProviderResponse> result) {
+                ++completed;
+                if (result && result->statusCode == 200) ++succeeded;
+            });
+        }
+        // Nothing may complete synchronously: execute() must not block
+        QCOMPARE(completed, 0);
+
+        QTRY_COMPARE_WITH_TIMEOUT(completed, kConcurrent, kDelayMs * kConcurrent * 2);
+        const qint64 elapsed = timer.elapsed();
+        QCOMPARE(succeeded, kConcurrent);
+
+        // Serialized execution would take ~kDelayMs * kConcurrent
+        QVERIFY2(elapsed < kDelayMs * 3,
+                 qPrintable(QStringLiteral("elapsed %1 ms").arg(elapsed)));
+    }
+
+    void testConcurrentConnectStreamOverlaps()
+    {
+        SlowHttpServer server(kDelayMs, sseResponse());
+        QVERIFY(server.listen(QHostAddress::LocalHost));
+
+        ConnectionPool pool(kConcurrent);
+        QtExecutor executor(pool, QSslConfiguration::defaultConfiguration());
+
+        int completed = 0;
+        int connected = 0;
+        QElapsedTimer timer;
+        timer.start();
+        for (int i = 0; i < kConcurrent; ++i) {
+            executor.connectStream(makeRequest(server.url()), [&](Result<QNetworkReply*> result) {
+                ++completed;
+                if (result) {
+                    ++connected;
+                    (*result)->deleteLater();
+                }
+            });
+        }
+        QCOMPARE(completed, 0);
+
+        QTRY_COMPARE_WITH_TIMEOUT(completed, kConcurrent, kDelayMs * kConcurrent * 2);
+        const qint64 elapsed = timer.elapsed();
+        QCOMPARE(connected, kConcurrent);
+        QVERIFY2(elapsed < kDelayMs * 3,
+                 qPrintable(QStringLiteral("elapsed %1 ms").arg(elapsed)));
+    }
+
+    // Replies are deleted before the manager they came from, which the
+    // release may delete at once
+    void testExecuteWithPoolDisabled()
+    {
+        SlowHttpServer server(0, jsonResponse());
+        QVERIFY(server.listen(QHostAddress::LocalHost));
+
+        ConnectionPool pool(kConcurrent);
+        pool.setEnabled(false);
+        QtExecutor executor(pool, QSslConfiguration::defaultConfiguration());
+
+        int succeeded = 0;
+        for (int i = 0; i < 3; ++i) {
+            executor.execute(makeRequest(server.url()), [&](Result<ProviderResponse> result) {
+                if (result && result->statusCode == 200) ++succeeded;
+            });
+        }
+        QTRY_COMPARE_WITH_TIMEOUT(succeeded, 3, kDelayMs * 10);
+        QTRY_COMPARE(pool.activeCount(), 0);
+    }
+
+    void testExecuteMoreRequestsThanPoolSize()
+    {
+        constexpr int kRequests = 3 * ConnectionPool::kHttp1RequestsPerManager;
+        SlowHttpServer server(kDelayMs / 4, jsonResponse());
+        QVERIFY(server.listen(QHostAddress::LocalHost));
+
+        ConnectionPool pool(2);
+        QtExecutor executor(pool, QSslConfiguration::defaultConfiguration());
+
+        int succeeded = 0;
+        for (int i = 0; i < kRequests; ++i) {
+            executor.execute(makeRequest(server.url()), [&](Result<ProviderResponse> result) {
+                if (result && result->statusCode == 200) ++succeeded;
+            });
+        }
+        // Managers over the new limit are closed as their requests finish
+        pool.resize(1);
+        QTRY_COMPARE_WITH_TIMEOUT(succeeded, kRequests, kDelayMs * 20);
+        QTRY_COMPARE(pool.activeCount(), 0);
+        QVERIFY(pool.idleCount() <= 1);
+    }
+
+    void testProcessorRequestsOverlap()
+    {
+        SlowHttpServer server(kDelayMs, jsonResponse());
+        QVERIFY(server.listen(QHostAddress::LocalHost));
+
+        ConnectionPool pool(kConcurrent);
+        QtExecutor executor(pool, QSslConfiguration::defaultConfiguration());
+        EchoOutbound outbound(server.url());
+        StaticCapabilityResolver capabilities;
+
+        Processor processor;
+        processor.setOutbound(&outbound);
+        processor.setExecutor(&executor);
+        processor.setCapabilities(&capabilities);
+
+        SemanticRequest req;
+        req.target.logicalModel = QStringLiteral("test-model");
+        InteractionItem item;
+        item.role = QStringLiteral("user");
+        item.content.append(Segment::fromText(QStringLiteral("hi")));
+        req.messages.append(item);
+
+        int completed = 0;
+        int succeeded = 0;
+        QElapsedTimer timer;
+        timer.start();
+        for (int i = 0; i < kConcurrent; ++i) {
+            processor.process(req, [&](Result<SemanticResponse> result) {
+                ++completed;
+                if (result && result->modelUsed == QStringLiteral(R"({"ok":true})")) ++succeeded;
+            });
+        }
+        QCOMPARE(completed, 0);
+
+        QTRY_COMPARE_WITH_TIMEOUT(completed, kConcurrent, kDelayMs * kConcurrent * 2);
+        const qint64 elapsed = timer.elapsed();
+        QCOMPARE(succeeded, kConcurrent);
+        QVERIFY2(elapsed < kDelayMs * 3,
+                 qPrintable(QStringLiteral("elapsed %1 ms").arg(elapsed)));
+    }
+
+    void testPoolBindsManagersToHosts()
+    {
+        ConnectionPool pool(2);
+        const QUrl a(QStringLiteral("https://api.example.com/v1/chat"));
+        const QUrl sameHost(QStringLiteral("https://API.example.com:443/v1/models"));
+        const QUrl b(QStringLiteral("https://other.example.com/v1/chat"));
+        QCOMPARE(ConnectionPool::hostKey(sameHost), QStringLiteral("https://api.example.com:443"));
+
+        // Until the host is known to speak HTTP/2, a manager takes as many
+        // requests as Qt runs in parallel over HTTP/1.1
+        QList<QNetworkAccessManager*> first;
+        for (int i = 0; i < ConnectionPool::kHttp1RequestsPerManager; ++i)
+            first.append(pool.acquire(i % 2 ? a : sameHost));
+        for (QNetworkAccessManager* nam : first)
+            QCOMPARE(nam, first.first());
+        QNetworkAccessManager* second = pool.acquire(a);
+        QVERIFY(second != first.first());
+        QNetworkAccessManager* other = pool.acquire(b);
+        QVERIFY(other != first.first() && other != second);
+
+        // Later requests go to the least loaded manager of the host
+        QCOMPARE(pool.acquire(a), second);
+
+        // HTTP/2 hosts multiplex onto the managers they have
+        pool.noteProtocol(other, true);
+        for (int i = 0; i < 20; ++i)
+            QCOMPARE(pool.acquire(b), other);
+
+        const auto stats = pool.hostStats();
+        QCOMPARE(stats.size(), 2);
+        for (const ConnectionPool::HostStats& host : stats) {
+            if (host.host == ConnectionPool::hostKey(a)) {
+                QCOMPARE(host.managers, 2);
+                QCOMPARE(host.streams, ConnectionPool::kHttp1RequestsPerManager + 2);
+                QVERIFY(!host.http2);
+            } else {
+                QCOMPARE(host.managers, 1);
+                QCOMPARE(host.streams, 21);
+                QCOMPARE(host.peakStreams, 21);
+                QVERIFY(host.http2);
+            }
+        }
+        QCOMPARE(pool.activeCount(), 3);
+
+        // Released managers stay bound to their host, idle
+        for (int i = 0; i < 21; ++i)
+            pool.release(other);
+        QCOMPARE(pool.idleCount(), 1);
+        QCOMPARE(pool.acquire(b), other);
+    }
+
+    void testPoolWarmsHostsAhead()
+    {
+        QTcpServer server;
+        QVERIFY(server.listen(QHostAddress::LocalHost));
+        const QUrl url(QStringLiteral("http://127.0.0.1:%1/v1").arg(server.serverPort()));
+        const QSslConfiguration ssl = QSslConfiguration::defaultConfiguration();
+        auto& registry = metrics::registry();
+        const quint64 warmups = registry.upstreamWarmups.value();
+        const quint64 hits = registry.upstreamWarmHits.value();
+        const quint64 coldStarts = registry.upstreamColdStarts.value();
+
+        // The connection opens before any request is sent
+        ConnectionPool pool(2);
+        QVERIFY(pool.warm(url, ssl));
+        QTRY_VERIFY(server.hasPendingConnections());
+        QCOMPARE(registry.upstreamWarmups.value(), warmups + 1);
+        QCOMPARE(pool.idleCount(), 1);
+
+        // Keep-warm passes skip managers used recently or busy
+        QVERIFY(!pool.warm(url, ssl, 60 * 1000));
+        QNetworkAccessManager* nam = pool.acquire(url);
+        QCOMPARE(registry.upstreamWarmHits.value(), hits + 1);
+        QVERIFY(!pool.warm(url, ssl, 1));
+        pool.release(nam);
+
+        // A host nobody warmed starts cold
+        pool.release(pool.acquire(QUrl(QStringLiteral("http://127.0.0.1:1/v1"))));
+        QCOMPARE(registry.upstreamColdStarts.value(), coldStarts + 1);
+
+        pool.setEnabled(false);
+        QVERIFY(!pool.warm(url, ssl));
+    }
+
+    void testExecuteTimeoutIsAsynchronous()
+    {
+        SlowHttpServer server(kDelayMs * 5, jsonResponse());
+        QVERIFY(server.listen(QHostAddress::LocalHost));
+
+        ConnectionPool pool(2);
+        QtExecutor executor(pool, QSslConfiguration::defaultConfiguration());
+        executor.setRequestTimeout(kDelayMs / 2);
+
+        bool done = false;
+        ErrorKind kind = ErrorKind::Internal;
+        executor.execute(makeRequest(server.url()), [&](Result<ProviderResponse> result) {
+            done = true;
+            if (!result) kind = result.error().kind;
+        });
+        QVERIFY(!done);
+        QTRY_VERIFY_WITH_TIMEOUT(done, kDelayMs * 4);
+        QCOMPARE(kind, ErrorKind::Timeout);
+    }
+
+    void testCancelledExecuteDropsCallback()
+    {
+        SlowHttpServer server(kDelayMs, jsonResponse());
+        QVERIFY(server.listen(QHostAddress::LocalHost));
+
+        ConnectionPool pool(2);
+        QtExecutor executor(pool, QSslConfiguration::defaultConfiguration());
+        auto* scope = new QObject;
+        ProviderRequest request = makeRequest(server.url());
+        request.cancelScope = scope;
+
+        bool called = false;
+        executor.execute(request, [&](Result<ProviderResponse>) { called = true; });
+        QTest::qWait(kDelayMs / 4);
+        delete scope;
+        QTRY_COMPARE_WITH_TIMEOUT(pool.activeCount(), 0, kDelayMs);
+        QTest::qWait(kDelayMs);
+        QVERIFY(!called);
+    }
+
+    // Once the primary URL has a latency history, a request it is slow to
+    // answer also goes to the candidate, whose response is used
+    void testProcessorHedgesSlowPrimary()
+    {
+        SlowHttpServer primary(0, jsonResponse(R"({"from":"primary"})"));
+        SlowHttpServer candidate(0, jsonResponse(R"({"from":"candidate"})"));
+        QVERIFY(primary.listen(QHostAddress::LocalHost));
+        QVERIFY(candidate.listen(QHostAddress::LocalHost));
+
+        ConnectionPool pool(kConcurrent);
+        QtExecutor executor(pool, QSslConfiguration::defaultConfiguration());
+        EchoOutbound outbound(primary.url());
+        StaticCapabilityResolver capabilities;
+        Processor processor;
+        processor.setOutbound(&outbound);
+        processor.setExecutor(&executor);
+        processor.setCapabilities(&capabilities);
+        processor.setHedging(90, 50);
+
+        SemanticRequest req = chatRequest();
+        req.metadata[QStringLiteral("provider_base_url")] = primary.url();
+        req.metadata[QStringLiteral("provider_base_url_candidates")] = candidate.url();
+
+        auto& registry = metrics::registry();
+        const quint64 hedges = registry.upstreamHedges.value({candidate.url()});
+        const quint64 wins = registry.upstreamHedgeWins.value({candidate.url()});
+        QString answeredBy;
+        const auto send = [&]() {
+            answeredBy.clear();
+            processor.process(req, [&](Result<SemanticResponse> result) {
+                answeredBy = result ? result->modelUsed : QStringLiteral("failed");
+            });
+            QTRY_VERIFY_WITH_TIMEOUT(!answeredBy.isEmpty(), kDelayMs * 10);
+        };
+
+        // Nothing is hedged until the primary has a latency history
+        for (int i = 0; i < Processor::kHedgeMinSamples; ++i) {
+            send();
+            QCOMPARE(answeredBy, QStringLiteral(R"({"from":"primary"})"));
+        }
+        QCOMPARE(registry.upstreamHedges.value({candidate.url()}), hedges);
+
+        primary.setDelay(kDelayMs * 5);
+        QElapsedTimer timer;
+        timer.start();
+        send();
+        QCOMPARE(answeredBy, QStringLiteral(R"({"from":"candidate"})"));
+        QVERIFY2(timer.elapsed() < kDelayMs * 2,
+                 qPrintable(QStringLiteral("elapsed %1 ms").arg(timer.elapsed())));
+        QCOMPARE(registry.upstreamHedges.value({candidate.url()}), hedges + 1);
+        QCOMPARE(registry.upstreamHedgeWins.value({candidate.url()}), wins + 1);
+        // The primary's request was cancelled
+        QTRY_COMPARE_WITH_TIMEOUT(pool.activeCount(), 0, kDelayMs);
+    }
+
+    // Once the primary's breaker opens, requests go straight to the
+    // candidate; with no candidate they fail without trying
+    void testProcessorSkipsOpenCircuit()
+    {
+        QTcpServer closed;
+        QVERIFY(closed.listen(QHostAddress::LocalHost));
+        const QString down = QStringLiteral("http://127.0.0.1:%1/v1/test").arg(closed.serverPort());
+        closed.close();
+        SlowHttpServer candidate(0, jsonResponse(R"({"from":"candidate"})"));
+        QVERIFY(candidate.listen(QHostAddress::LocalHost));
+
+        ConnectionPool pool(kConcurrent);
+        QtExecutor executor(pool, QSslConfiguration::defaultConfiguration());
+        EchoOutbound outbound(down);
+        StaticCapabilityResolver capabilities;
+        CircuitBreaker breaker;
+        breaker.setThresholds(2, 60 * 1000);
+        Policy policy;
+        policy.setDefaultMaxAttempts(2);
+        policy.setCircuitBreaker(&breaker);
+        Processor processor;
+        processor.setOutbound(&outbound);
+        processor.setExecutor(&executor);
+        processor.setCapabilities(&capabilities);
+        processor.setPolicy(&policy);
+
+        SemanticRequest req = chatRequest();
+        req.metadata[QStringLiteral("provider_base_url")] = down;
+        req.metadata[QStringLiteral("provider_base_url_candidates")] = candidate.url();
+
+        auto& registry = metrics::registry();
+        std::optional<Result<SemanticResponse>> outcome;
+        const auto send = [&](const SemanticRequest& request) {
+            outcome.reset();
+            processor.process(request, [&](Result<SemanticResponse> result) { outcome = result; });
+            QTRY_VERIFY_WITH_TIMEOUT(outcome.has_value(), kDelayMs * 10);
+        };
+
+        // Refused connections are retried on the candidate until the
+        // breaker opens
+        for (int i = 0; i < 2; ++i) {
+            const quint64 retries = registry.upstreamRetries.value();
+            send(req);
+            QVERIFY(outcome->has_value());
+            QCOMPARE(registry.upstreamRetries.value(), retries + 1);
+        }
+        QCOMPARE(breaker.state(down), CircuitBreaker::State::Open);
+
+        const quint64 retries = registry.upstreamRetries.value();
+        send(req);
+        QVERIFY(outcome->has_value());
+        QCOMPARE((*outcome)->modelUsed, QStringLiteral(R"({"from":"candidate"})"));
+        QCOMPARE(registry.upstreamRetries.value(), retries);
+
+        SemanticRequest alone = chatRequest();
+        alone.metadata[QStringLiteral("provider_base_url")] = down;
+        send(alone);
+        QVERIFY(!outcome->has_value());
+        QCOMPARE(outcome->error().code, QStringLiteral("circuit_open"));
+        QCOMPARE(outcome->error().kind, ErrorKind::Unavailable);
+    }
+
+    // A throttled attempt is retried after Retry-After, on a timer: the
+    // call returns at once and the event loop keeps running
+    void testProcessorWaitsRetryAfter()
+    {
+        SlowHttpServer throttled(0, "HTTP/1.1 429 Too Many Requests\r\n"
+                                    "Retry-After: 1\r\n"
+                                    "Content-Length: 0\r\n"
+                                    "Connection: close\r\n"
+                                    "\r\n");
+        SlowHttpServer candidate(0, jsonResponse(R"({"from":"candidate"})"));
+        QVERIFY(throttled.listen(QHostAddress::LocalHost));
+        QVERIFY(candidate.listen(QHostAddress::LocalHost));
+
+        ConnectionPool pool(kConcurrent);
+        QtExecutor executor(pool, QSslConfiguration::defaultConfiguration());
+        EchoOutbound outbound(throttled.url());
+        StaticCapabilityResolver capabilities;
+        Policy policy;
+        policy.setDefaultMaxAttempts(2);
+        policy.setBackoff(0);
+        Processor processor;
+        processor.setOutbound(&outbound);
+        processor.setExecutor(&executor);
+        processor.setCapabilities(&capabilities);
+        processor.setPolicy(&policy);
+
+        SemanticRequest req = chatRequest();
+        req.metadata[QStringLiteral("provider_base_url")] = throttled.url();
+        req.metadata[QStringLiteral("provider_base_url_candidates")] = candidate.url();
+
+        const quint64 delays = metrics::registry().upstreamRetryDelay.count();
+        QString answeredBy;
+        QElapsedTimer timer;
+        timer.start();
+        processor.process(req, [&](Result<SemanticResponse> result) {
+            answeredBy = result ? result->modelUsed : result.error().message;
+        });
+        QVERIFY(answeredBy.isEmpty());
+        QVERIFY(timer.elapsed() < kDelayMs);
+
+        bool ticked = false;
+        QTimer::singleShot(kDelayMs, this, [&]() { ticked = true; });
+        QTRY_VERIFY_WITH_TIMEOUT(!answeredBy.isEmpty(), kDelayMs * 10);
+        QCOMPARE(answeredBy, QStringLiteral(R"({"from":"candidate"})"));
+        QVERIFY2(timer.elapsed() >= 1000, qPrintable(QStringLiteral("elapsed %1 ms").arg(timer.elapsed())));
+        QVERIFY(ticked);
+        QCOMPARE(metrics::registry().upstreamRetryDelay.count(), delays + 1);
+    }
+
+    void testProcessorHoldsRequestsOverRateLimit()
+    {
+        SlowHttpServer server(0, jsonResponse());
+        QVERIFY(server.listen(QHostAddress::LocalHost));
+
+        ConnectionPool pool(kConcurrent);
+        QtExecutor executor(pool, QSslConfiguration::defaultConfiguration());
+        EchoOutbound outbound(server.url());
+        StaticCapabilityResolver capabilities;
+        RateLimiter limiter;
+        limiter.setLimits(QStringLiteral("limited"), {0, 60000});  // 1000 tokens a second
+        Processor processor;
+        processor.setOutbound(&outbound);
+        processor.setExecutor(&executor);
+        processor.setCapabilities(&capabilities);
+        processor.setRateLimiter(&limiter);
+
+        // The first takes the whole minute's tokens, the second waits ~1 s
+        SemanticRequest first = chatRequest();
+        first.metadata[QStringLiteral("config_group")] = QStringLiteral("limited");
+        first.constraints.maxTokens = 60000;
+        SemanticRequest second = first;
+        second.constraints.maxTokens = 1000;
+
+        const quint64 delays = metrics::registry().rateLimitDelays.value({QStringLiteral("limited")});
+        QElapsedTimer timer;
+        timer.start();
+        qint64 firstMs = -1;
+        qint64 secondMs = -1;
+        processor.process(first, [&](Result<SemanticResponse> result) {
+            QVERIFY(result.has_value());
+            firstMs = timer.elapsed();
+        });
+        processor.process(second, [&](Result<SemanticResponse> result) {
+            QVERIFY(result.has_value());
+            secondMs = timer.elapsed();
+        });
+
+        QTRY_VERIFY_WITH_TIMEOUT(secondMs >= 0, kDelayMs * 10);
+        QVERIFY2(firstMs < kDelayMs, qPrintable(QStringLiteral("first %1 ms").arg(firstMs)));
+        QVERIFY2(secondMs >= 1000, qPrintable(QStringLiteral("second %1 ms").arg(secondMs)));
+        QCOMPARE(metrics::registry().rateLimitDelays.value({QStringLiteral("limited")}), delays + 1);
+    }
+
+    // A stream that breaks off goes on at the candidate; the client gets
+    // the text once, in one stream
+    void testProcessorFailsOverMidStream()
+    {
+        // Promises more than it sends, so closing is an error
+        SlowHttpServer broken(0, "HTTP/1.1 200 OK\r\n"
+                                 "Content-Type: text/event-stream\r\n"
+                                 "Content-Length: 100000\r\n"
+                                 "\r\n"
+                                 "data: {\"delta\":\"Hello\"}\n\n");
+        broken.setCloseDelay(100);
+        SlowHttpServer candidate(0, "HTTP/1.1 200 OK\r\n"
+                                    "Content-Type: text/event-stream\r\n"
+                                    "Connection: close\r\n"
+                                    "\r\n"
+                                    "data: {\"delta\":\"Hel\"}\n\n"
+                                    "data: {\"delta\":\"lo wor\"}\n\n"
+                                    "data: {\"delta\":\"ld\"}\n\n"
+                                    "data: [DONE]\n\n");
+        QVERIFY(broken.listen(QHostAddress::LocalHost));
+        QVERIFY(candidate.listen(QHostAddress::LocalHost));
+
+        ConnectionPool pool(kConcurrent);
+        QtExecutor executor(pool, QSslConfiguration::defaultConfiguration());
+        TextStreamOutbound outbound(broken.url());
+        StaticCapabilityResolver capabilities;
+        Policy policy;
+        policy.setDefaultMaxAttempts(2);
+        policy.setBackoff(0);
+        Processor processor;
+        processor.setOutbound(&outbound);
+        processor.setExecutor(&executor);
+        processor.setCapabilities(&capabilities);
+        processor.setPolicy(&policy);
+        processor.setStreamFailover(true);
+
+        SemanticRequest req = chatRequest();
+        req.metadata[QStringLiteral("provider_base_url")] = broken.url();
+        req.metadata[QStringLiteral("provider_base_url_candidates")] = candidate.url();
+
+        const quint64 failovers =
+            metrics::registry().upstreamStreamFailovers.value({QStringLiteral("regenerate")});
+        QString text;
+        bool finished = false;
+        std::optional<DomainFailure> failure;
+        processor.processStream(req, [&](Result<StreamSession*> result) {
+            QVERIFY(result.has_value());
+            StreamSession* session = *result;
+            connect(session, &StreamSession::frameReady, session, [&](const StreamFrame& frame) {
+                for (const Segment& segment : frame.deltaSegments)
+                    text += segment.text;
+            });
+            connect(session, &StreamSession::finished, session, [&]() { finished = true; });
+            connect(session, &StreamSession::error, session, [&](const DomainFailure& f) { failure = f; });
+        });
+
+        QTRY_VERIFY_WITH_TIMEOUT(finished || failure.has_value(), kDelayMs * 10);
+        QVERIFY2(!failure.has_value(), qPrintable(failure ? failure->message : QString()));
+        QCOMPARE(text, QStringLiteral("Hello world"));
+        QCOMPARE(metrics::registry().upstreamStreamFailovers.value({QStringLiteral("regenerate")}),
+                 failovers + 1);
+    }
+
+    // The replacement is a new request to the group and waits its turn
+    void testStreamFailoverWaitsForRateLimit()
+    {
+        SlowHttpServer broken(0, "HTTP/1.1 200 OK\r\n"
+                                 "Content-Type: text/event-stream\r\n"
+                                 "Content-Length: 100000\r\n"
+                                 "\r\n"
+                                 "data: {\"delta\":\"Hello\"}\n\n");
+        broken.setCloseDelay(100);
+        SlowHttpServer candidate(0, "HTTP/1.1 200 OK\r\n"
+                                    "Content-Type: text/event-stream\r\n"
+                                    "Connection: close\r\n"
+                                    "\r\n"
+                                    "data: {\"delta\":\"Hello world\"}\n\n"
+                                    "data: [DONE]\n\n");
+        QVERIFY(broken.listen(QHostAddress::LocalHost));
+        QVERIFY(candidate.listen(QHostAddress::LocalHost));
+
+        ConnectionPool pool(kConcurrent);
+        QtExecutor executor(pool, QSslConfiguration::defaultConfiguration());
+        TextStreamOutbound outbound(broken.url());
+        StaticCapabilityResolver capabilities;
+        Policy policy;
+        policy.setDefaultMaxAttempts(2);
+        policy.setBackoff(0);
+        RateLimiter limiter;
+        limiter.setLimits(QStringLiteral("limited"), {0, 60000});  // 1000 tokens a second
+        Processor processor;
+        processor.setOutbound(&outbound);
+        processor.setExecutor(&executor);
+        processor.setCapabilities(&capabilities);
+        processor.setPolicy(&policy);
+        processor.setRateLimiter(&limiter);
+        processor.setStreamFailover(true);
+
+        // Estimated at 1000 tokens: the first connect takes what is left of
+        // the minute, the replacement waits ~1 s for its own
+        SemanticRequest req = chatRequest();
+        req.metadata[QStringLiteral("config_group")] = QStringLiteral("limited");
+        req.metadata[QStringLiteral("provider_base_url")] = broken.url();
+        req.metadata[QStringLiteral("provider_base_url_candidates")] = candidate.url();
+        req.constraints.maxTokens = 999;
+        QCOMPARE(RateLimiter::estimateTokens(req), 1000);
+        QCOMPARE(limiter.reserve(QStringLiteral("limited"), 59000), qint64(0));
+
+        const quint64 delays = metrics::registry().rateLimitDelays.value({QStringLiteral("limited")});
+        QElapsedTimer timer;
+        timer.start();
+        QString text;
+        qint64 finishedMs = -1;
+        std::optional<DomainFailure> failure;
+        processor.processStream(req, [&](Result<StreamSession*> result) {
+            QVERIFY(result.has_value());
+            StreamSession* session = *result;
+            connect(session, &StreamSession::frameReady, session, [&](const StreamFrame& frame) {
+                for (const Segment& segment : frame.deltaSegments)
+                    text += segment.text;
+            });
+            connect(session, &StreamSession::finished, session, [&]() { finishedMs = timer.elapsed(); });
+            connect(session, &StreamSession::error, session, [&](const DomainFailure& f) { failure = f; });
+        });
+
+        QTRY_VERIFY_WITH_TIMEOUT(finishedMs >= 0 || failure.has_value(), kDelayMs * 10);
+        QVERIFY2(!failure.has_value(), qPrintable(failure ? failure->message : QString()));
+        QCOMPARE(text, QStringLiteral("Hello world"));
+        QVERIFY2(finishedMs >= 800, qPrintable(QStringLiteral("finished after %1 ms").arg(finishedMs)));
+        QCOMPARE(metrics::registry().rateLimitDelays.value({QStringLiteral("limited")}), delays + 1);
+    }
+
+    void testPausedStreamStopsReadingUpstream()
+    {
+        constexpr int kEvents = 20000;  // ~4 MB
+        SlowHttpServer server(0, largeSseResponse(kEvents));
+        QVERIFY(server.listen(QHostAddress::LocalHost));
+
+        ConnectionPool pool(2);
+        QtExecutor executor(pool, QSslConfiguration::defaultConfiguration());
+        EchoOutbound outbound(server.url());
+
+        StreamSession* session = nullptr;
+        QNetworkReply* reply = nullptr;
+        int frames = 0;
+        bool finished = false;
+        executor.connectStream(makeRequest(server.url()), [&](Result<QNetworkReply*> result) {
+            QVERIFY(result.has_value());
+            reply = *result;
+            session = new StreamSession(reply, &outbound, QStringLiteral("echo"));
+            // Paused before the first buffered bytes are drained
+            session->setPaused(true);
+            connect(session, &StreamSession::frameReady, session, [&]() { ++frames; });
+            connect(session, &StreamSession::finished, session, [&]() { finished = true; });
+        });
+        QTRY_VERIFY(session != nullptr);
+
+        QTest::qWait(300);
+        QCOMPARE(frames, 0);
+        QVERIFY(!finished);
+        // Reads stop once the capped buffer is full instead of pulling the
+        // whole body into memory
+        QVERIFY2(reply->bytesAvailable() < 1024 * 1024,
+                 qPrintable(QStringLiteral("buffered %1 bytes").arg(reply->bytesAvailable())));
+
+        session->setPaused(false);
+        QTRY_VERIFY_WITH_TIMEOUT(finished, 10000);
+        QCOMPARE(frames, kEvents);
+        delete session;
+    }
+};
+
+QTEST_MAIN(TestQtExecutor)
+#include "tst_qt_executor.moc"
@@ -0,0 +1,151 @@
+#include <QTest>
+#include "core/metrics.h"
+#include "semantic/request_coalescer.h"
+
+namespace {
+
+SemanticRequest deterministicRequest(const QString& prompt = QStringLiteral("classify: hello"))
+{
+    SemanticRequest req;
+    req.target.logicalModel = QStringLiteral("test-model");
+    req.constraints.temperature = 0;
+    InteractionItem item;
+    item.role = QStringLiteral("user");
+    item.content.append(Segment::fromText(prompt));
+    req.messages.append(item);
+    req.metadata[QStringLiteral("config_group")] = QStringLiteral("default");
+    return req;
+}
+
+SemanticResponse response(const QString& model)
+{
+    SemanticResponse resp;
+    resp.modelUsed = model;
+    return resp;
+}
+
+// Records what each waiter was answered with
+struct Answers {
+    QList<Result<SemanticResponse>> results;
+
+    RequestCoalescer::Delivered callback()
+    {
+        return [this](Result<SemanticResponse> result) { results.append(result); };
+    }
+};
+
+}
+
+class TestRequestCoalescer : public QObject {
+    Q_OBJECT
+
+private slots:
+    void testOnlyDeterministicRequestsAreKeyed()
+    {
+        SemanticRequest sampled = deterministicRequest();
+        sampled.constraints.temperature = 0.7;
+        QVERIFY(RequestCoalescer::keyOf(sampled).isEmpty());
+        sampled.constraints.temperature.reset();
+        QVERIFY(RequestCoalescer::keyOf(sampled).isEmpty());
+
+        sampled.constraints.seed = 42;
+        QVERIFY(!RequestCoalescer::keyOf(sampled).isEmpty());
+
+        SemanticRequest embedding;
+        embedding.kind = TaskKind::Embedding;
+        QVERIFY(RequestCoalescer::deterministic(embedding));
+    }
+
+    void testKeyIgnoresClientBookkeeping()
+    {
+        SemanticRequest first = deterministicRequest();
+        first.metadata[QStringLiteral("auth_key")] = QStringLiteral("Bearer a");
+        first.metadata[QStringLiteral("inbound.format")] = QStringLiteral("openai");
+        first.metadata[QStringLiteral("_inbound_protocol")] = QStringLiteral("openai");
+        SemanticRequest second = deterministicRequest();
+        second.metadata[QStringLiteral("auth_key")] = QStringLiteral("Bearer b");
+        second.metadata[QStringLiteral("inbound.format")] = QStringLiteral("anthropic");
+        second.metadata[QStringLiteral("request_path")] = QStringLiteral("/v1/messages");
+        QCOMPARE(RequestCoalescer::keyOf(first), RequestCoalescer::keyOf(second));
+
+        // Content, parameters and group all count
+        QVERIFY(RequestCoalescer::keyOf(first) != RequestCoalescer::keyOf(deterministicRequest(QStringLiteral("other"))));
+        SemanticRequest longer = deterministicRequest();
+        longer.constraints.maxTokens = 10;
+        QVERIFY(RequestCoalescer::keyOf(first) != RequestCoalescer::keyOf(longer));
+        SemanticRequest otherGroup = deterministicRequest();
+        otherGroup.metadata[QStringLiteral("config_group")] = QStringLiteral("backup");
+        QVERIFY(RequestCoalescer::keyOf(first) != RequestCoalescer::keyOf(otherGroup));
+    }
+
+    void testDuplicatesShareTheResult()
+    {
+        RequestCoalescer coalescer;
+        QObject leader;
+        QObject follower;
+        Answers answers;
+        const QByteArray key = RequestCoalescer::keyOf(deterministicRequest());
+
+        const quint64 coalesced = metrics::registry().coalescedRequests.value();
+        const quint64 flight = coalescer.join(key, &leader, answers.callback());
+        QVERIFY(flight != 0);
+        QCOMPARE(coalescer.join(key, &follower, answers.callback()), quint64(0));
+        QCOMPARE(coalescer.join(key, &follower, answers.callback()), quint64(0));
+        QCOMPARE(metrics::registry().coalescedRequests.value(), coalesced + 2);
+
+        // Waiters are answered through the event loop
+        coalescer.complete(flight, response(QStringLiteral("m")));
+        QVERIFY(answers.results.isEmpty());
+        QTRY_COMPARE(answers.results.size(), 2);
+        for (const auto& result : std::as_const(answers.results)) {
+            QVERIFY(result.has_value());
+            QCOMPARE(result->modelUsed, QStringLiteral("m"));
+        }
+
+        // Done flights are not joined again
+        QCOMPARE(coalescer.inFlight(), 0);
+        QVERIFY(coalescer.join(key, &leader, answers.callback()) != 0);
+    }
+
+    void testFailuresAreShared()
+    {
+        RequestCoalescer coalescer;
+        QObject context;
+        Answers answers;
+        const QByteArray key = RequestCoalescer::keyOf(deterministicRequest());
+
+        const quint64 flight = coalescer.join(key, &context, answers.callback());
+        coalescer.join(key, &context, answers.callback());
+        coalescer.complete(flight, std::unexpected(DomainFailure::timeout(QStringLiteral("slow"))));
+        QTRY_COMPARE(answers.results.size(), 1);
+        QVERIFY(!answers.results[0].has_value());
+        QCOMPARE(answers.results[0].error().kind, ErrorKind::Timeout);
+    }
+
+    void testForgetDropsWaitersAndFailsLedFlights()
+    {
+        RequestCoalescer coalescer;
+        QObject leader;
+        QObject follower;
+        auto* gone = new QObject;
+        Answers answers;
+        const QByteArray key = RequestCoalescer::keyOf(deterministicRequest());
+
+        coalescer.join(key, &leader, answers.callback());
+        coalescer.join(key, gone, answers.callback());
+        coalescer.join(key, &follower, answers.callback());
+        coalescer.forget(gone);
+        delete gone;
+
+        // The leader's pipeline goes away before its request completes
+        coalescer.forget(&leader);
+        QCOMPARE(coalescer.inFlight(), 0);
+        QTRY_COMPARE(answers.results.size(), 1);
+        QVERIFY(!answers.results[0].has_value());
+        QTest::qWait(20);
+        QCOMPARE(answers.results.size(), 1);
+    }
+};
+
+QTEST_MAIN(TestRequestCoalescer)
+#include "tst_request_coalescer.moc"
@@ -0,0 +1,249 @@
+#include <QTest>
+#include <QElapsedTimer>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include "adapters/inbound/anthropic.h"
+#include "adapters/inbound/claudecode.h"
+#include "adapters/inbound/codex.h"
+#include "adapters/inbound/openai_chat.h"
+#include "adapters/inbound/openai_responses.h"
+#include "proxy/json_sniffer.h"
+
+namespace {
+
+QString filler(int bytes, QChar fill)
+{
+    // Escapes and non-ASCII keep the parser off its fast path, as real
+    // source files and tool output do
+    QString text;
+    text.reserve(bytes);
+    const QString line = QStringLiteral("    if (x < 10) { print(\"value: \\t\" + x); } // 注释\n");
+    while (text.size() < bytes)
+        text += line;
+    text[0] = fill;
+    return text;
+}
+
+QJsonObject textBlock(const QString& type, const QString& text)
+{
+    QJsonObject block;
+    block[QStringLiteral("type")] = type;
+    block[QStringLiteral("text")] = text;
+    return block;
+}
+
+// An agent turn late in a Claude Code session: a long system prompt, tool
+// schemas and many tool_use/tool_result rounds
+QByteArray claudeCodeCapture(int targetBytes)
+{
+    QJsonObject root;
+    root[QStringLiteral("model")] = QStringLiteral("claude-sonnet-4-5");
+    root[QStringLiteral("max_tokens")] = 32000;
+    root[QStringLiteral("stream")] = true;
+    root[QStringLiteral("system")] = QJsonArray{textBlock(QStringLiteral("text"),
+                                                          filler(16 * 1024, u'S'))};
+
+    QJsonArray tools;
+    for (int i = 0; i < 16; ++i) {
+        QJsonObject schema{{QStringLiteral("type"), QStringLiteral("object")},
+                           {QStringLiteral("properties"),
+                            QJsonObject{{QStringLiteral("path"),
+                                         QJsonObject{{QStringLiteral("type"), QStringLiteral("string")}}}}}};
+        tools.append(QJsonObject{{QStringLiteral("name"), QStringLiteral("Tool%1").arg(i)},
+                                 {QStringLiteral("description"), filler(1024, u'D')},
+                                 {QStringLiteral("input_schema"), schema}});
+    }
+    root[QStringLiteral("tools")] = tools;
+
+    QJsonArray messages;
+    messages.append(QJsonObject{{QStringLiteral("role"), QStringLiteral("user")},
+                                {QStringLiteral("content"),
+                                 QJsonArray{textBlock(QStringLiteral("text"), filler(2048, u'U'))}}});
+    qsizetype size = 40 * 1024;
+    for (int turn = 0; size < targetBytes; ++turn) {
+        const QString id = QStringLiteral("toolu_%1").arg(turn);
+        QJsonObject use{{QStringLiteral("type"), QStringLiteral("tool_use")},
+                        {QStringLiteral("id"), id},
+                        {QStringLiteral("name"), QStringLiteral("Read")},
+                        {QStringLiteral("input"),
+                         QJsonObject{{QStringLiteral("path"), QStringLiteral("src/file%1.cpp").arg(turn)}}}};
+        messages.append(QJsonObject{{QStringLiteral("role"), QStringLiteral("assistant")},
+                                    {QStringLiteral("content"),
+                                     QJsonArray{textBlock(QStringLiteral("text"), filler(256, u'A')), use}}});
+        QJsonObject result{{QStringLiteral("type"), QStringLiteral("tool_result")},
+                           {QStringLiteral("tool_use_id"), id},
+                           {QStringLiteral("content"), filler(6 * 1024, u'R')}};
+        messages.append(QJsonObject{{QStringLiteral("role"), QStringLiteral("user")},
+                                    {QStringLiteral("content"), QJsonArray{result}}});
+        size += 7 * 1024;
+    }
+    root[QStringLiteral("messages")] = messages;
+    return QJsonDocument(root).toJson(QJsonDocument::Compact);
+}
+
+// A Codex (Responses API) turn with shell calls and their output
+QByteArray codexCapture(int targetBytes)
+{
+    QJsonObject root;
+    root[QStringLiteral("model")] = QStringLiteral("gpt-5-codex");
+    root[QStringLiteral("stream")] = true;
+    root[QStringLiteral("instructions")] = filler(12 * 1024, u'I');
+
+    QJsonArray input;
+    input.append(QJsonObject{{QStringLiteral("type"), QStringLiteral("message")},
+                             {QStringLiteral("role"), QStringLiteral("user")},
+                             {QStringLiteral("content"),
+                              QJsonArray{textBlock(QStringLiteral("input_text"), filler(2048, u'U'))}}});
+    qsizetype size = 16 * 1024;
+    for (int call = 0; size < targetBytes; ++call) {
+        const QString id = QStringLiteral("call_%1").arg(call);
+        input.append(QJsonObject{{QStringLiteral("type"), QStringLiteral("function_call")},
+                                 {QStringLiteral("name"), QStringLiteral("shell")},
+                                 {QStringLiteral("call_id"), id},
+                                 {QStringLiteral("arguments"),
+                                  QStringLiteral(R"({"command":["rg","-n","TODO","src/%1"]})").arg(call)}});
+        input.append(QJsonObject{{QStringLiteral("type"), QStringLiteral("function_call_output")},
+                                 {QStringLiteral("call_id"), id},
+                                 {QStringLiteral("output"), filler(8 * 1024, u'O')}});
+        size += 8 * 1024 + 128;
+    }
+    root[QStringLiteral("input")] = input;
+    return QJsonDocument(root).toJson(QJsonDocument::Compact);
+}
+
+template<typename Fn>
+double msPerRun(int runs, Fn&& fn)
+{
+    QElapsedTimer timer;
+    timer.start();
+    for (int i = 0; i < runs; ++i)
+        fn();
+    return double(timer.nsecsElapsed()) / 1e6 / runs;
+}
+
+}
+
+class TestRequestDecode : public QObject {
+    Q_OBJECT
+
+private slots:
+    void testSniffStreamFlag_data()
+    {
+        QTest::addColumn<QByteArray>("body");
+        QTest::addColumn<int>("expected");  // -1 = no boolean "stream" field
+
+        QTest::newRow("true") << QByteArray(R"({"stream":true})") << 1;
+        QTest::newRow("false, spaced") << QByteArray(" {\n \"model\" : \"m\" ,\r\n \"stream\" : false }") << 0;
+        QTest::newRow("after nested") << QByteArray(R"({"messages":[{"stream":false,"c":"}]\"{"}],"stream":true})") << 1;
+        QTest::newRow("nested only") << QByteArray(R"({"messages":[{"stream":true}]})") << -1;
+        QTest::newRow("inside string") << QByteArray(R"({"text":"\"stream\":true"})") << -1;
+        QTest::newRow("escaped backslash") << QByteArray(R"({"a":"x\\","stream":true})") << 1;
+        QTest::newRow("not boolean") << QByteArray(R"({"n":-1.5e3,"b":null,"stream":"true"})") << -1;
+        QTest::newRow("empty object") << QByteArray("{}") << -1;
+        QTest::newRow("array") << QByteArray(R"([{"stream":true}])") << -1;
+        QTest::newRow("truncated") << QByteArray(R"({"messages":[{"a":1},)") << -1;
+        QTest::newRow("duplicate, last wins") << QByteArray(R"({"stream":true,"n":1,"stream":false})") << 0;
+        QTest::newRow("duplicate, last not boolean") << QByteArray(R"({"stream":true,"stream":null})") << -1;
+    }
+
+    void testSniffStreamFlag()
+    {
+        QFETCH(QByteArray, body);
+        QFETCH(int, expected);
+
+        const std::optional<bool> sniffed = json_sniffer::topLevelBool(body, "stream");
+        QCOMPARE(sniffed.has_value() ? int(*sniffed) : -1, expected);
+    }
+
+    void testSniffMatchesParser()
+    {
+        // QJsonDocument keeps the last of a duplicated key
+        const QByteArray duplicate(R"({"stream":true,"model":"m","stream":false})");
+        for (const QByteArray& body : {claudeCodeCapture(64 * 1024), codexCapture(64 * 1024), duplicate}) {
+            const QJsonObject root = QJsonDocument::fromJson(body).object();
+            QVERIFY(json_sniffer::topLevelBool(body, "stream")
+                    == std::optional<bool>(root.value(QStringLiteral("stream")).toBool()));
+        }
+    }
+
+    void testParsedDecodeMatchesBytes()
+    {
+        OpenAIChatAdapter chat;
+        OpenAIResponsesAdapter responses;
+        CodexAdapter codex(&chat, &responses);
+
+        const QByteArray body = codexCapture(32 * 1024);
+        const QMap<QString, QString> meta;
+        const auto fromBytes = codex.decodeRequest(body, meta);
+        const auto fromParsed = codex.decodeParsedRequest(QJsonDocument::fromJson(body).object(), meta);
+        QVERIFY(fromBytes.has_value());
+        QVERIFY(fromParsed.has_value());
+        QCOMPARE(fromParsed->target.logicalModel, fromBytes->target.logicalModel);
+        QCOMPARE(fromParsed->messages.size(), fromBytes->messages.size());
+        QCOMPARE(fromParsed->metadata.value(QStringLiteral("_codex_delegate")),
+                 QStringLiteral("openai.responses"));
+
+        // Invalid bodies still fail in the adapter, not in the sniffer
+        const auto invalid = codex.decodeRequest(QByteArrayLiteral("{\"input\":"), meta);
+        QVERIFY(!invalid.has_value());
+        QCOMPARE(invalid.error().code, QStringLiteral("invalid_json"));
+    }
+
+    // Per-request CPU for body handling on large agent contexts. "before"
+    // repeats the parses the proxy used to do: the worker parsed the body for
+    // "stream", Codex parsed it again to pick a delegate, and the delegate
+    // parsed it a third time. "after" sniffs "stream" and parses once.
+    void benchmarkDecode_data()
+    {
+        QTest::addColumn<QString>("client");
+        QTest::addColumn<int>("bytes");
+        QTest::newRow("claudecode-512k") << QStringLiteral("claudecode") << 512 * 1024;
+        QTest::newRow("claudecode-2m") << QStringLiteral("claudecode") << 2 * 1024 * 1024;
+        QTest::newRow("codex-512k") << QStringLiteral("codex") << 512 * 1024;
+        QTest::newRow("codex-2m") << QStringLiteral("codex") << 2 * 1024 * 1024;
+    }
+
+    void benchmarkDecode()
+    {
+        QFETCH(QString, client);
+        QFETCH(int, bytes);
+        constexpr int kRuns = 10;
+
+        AnthropicAdapter anthropic;
+        ClaudeCodeAdapter claudeCode(&anthropic);
+        OpenAIChatAdapter chat;
+        OpenAIResponsesAdapter responses;
+        CodexAdapter codex(&chat, &responses);
+
+        const bool isCodex = client == QStringLiteral("codex");
+        const QByteArray body = isCodex ? codexCapture(bytes) : claudeCodeCapture(bytes);
+        const QMap<QString, QString> meta;
+
+        const double before = msPerRun(kRuns, [&]() {
+            const QJsonDocument workerDoc = QJsonDocument::fromJson(body);
+            QVERIFY(workerDoc.object().value(QStringLiteral("stream")).toBool());
+            if (isCodex) {
+                const QJsonDocument selectorDoc = QJsonDocument::fromJson(body);
+                QVERIFY(selectorDoc.object().contains(QStringLiteral("input")));
+                QVERIFY(responses.decodeRequest(body, meta).has_value());
+            } else {
+                QVERIFY(claudeCode.decodeRequest(body, meta).has_value());
+            }
+        });
+        const double sniffOnly = msPerRun(kRuns, [&]() {
+            QVERIFY(json_sniffer::topLevelBool(body, "stream").value_or(false));
+        });
+        const double after = msPerRun(kRuns, [&]() {
+            QVERIFY(json_sniffer::topLevelBool(body, "stream").value_or(false));
+            IInboundAdapter& adapter = isCodex ? static_cast<IInboundAdapter&>(codex) : claudeCode;
+            QVERIFY(adapter.decodeRequest(body, meta).has_value());
+        });
+
+        qInfo("%s: %lld KB body, before %.2f ms, after %.2f ms (stream sniff %.3f ms)",
+              QTest::currentDataTag(), qint64(body.size() / 1024), before, after, sniffOnly);
+    }
+};
+
+QTEST_MAIN(TestRequestDecode)
+#include "tst_request_decode.moc"
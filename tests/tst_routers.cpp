@@ -93,6 +93,10 @@ class TestRouters : public QObject {
 private slots:
     void requestRouter_methodNormalized();
     void requestRouter_wildcardPath();
+    void requestRouter_pathParameters();
+    void requestRouter_precedenceAndBacktracking();
+    void requestRouter_configRouteReplacesDefault();
+    void requestRouter_rejectsMalformedPatterns();
     void inboundMultiRouter_caseInsensitiveProtocol();
     void outboundMultiRouter_caseInsensitiveResolution();
 };
@@ -118,6 +122,94 @@ void TestRouters::requestRouter_wildcardPath()
     QCOMPARE(route->inboundProtocol, QStringLiteral("gemini"));
 }
 
+void TestRouters::requestRouter_pathParameters()
+{
+    RequestRouter router;
+    router.registerDefaults();
+
+    const auto found = router.lookup("POST",
+                                     "/gemini/v1beta/models/gemini-2.5-pro:streamGenerateContent?alt=sse");
+    QVERIFY(found.has_value());
+    QCOMPARE(found->route->inboundProtocol, QStringLiteral("gemini"));
+    QCOMPARE(found->params.size(), 2);
+    QCOMPARE(found->params.at(0).first, QStringLiteral("model"));
+    QCOMPARE(found->params.at(0).second, QStringLiteral("gemini-2.5-pro"));
+    QCOMPARE(found->params.at(1).first, QStringLiteral("action"));
+    QCOMPARE(found->params.at(1).second, QStringLiteral("streamGenerateContent"));
+
+    // Values are percent-decoded
+    router.addRoute({QStringLiteral("/v1/files/{name}"), QStringLiteral("openai"), QString(),
+                     QStringLiteral("GET")});
+    const auto file = router.lookup("get", "/v1/files/a%20b");
+    QVERIFY(file.has_value());
+    QCOMPARE(file->params.at(0).second, QStringLiteral("a b"));
+
+    // Without the ":" the template does not match and "*" takes the path
+    const auto plain = router.lookup("POST", "/gemini/v1beta/models/gemini-2.5-pro");
+    QVERIFY(plain.has_value());
+    QCOMPARE(plain->route->pathPattern, QStringLiteral("/gemini/v1beta/models/*"));
+    QVERIFY(plain->params.isEmpty());
+
+    // "*" needs at least one more segment, and methods must agree
+    QVERIFY(!router.lookup("POST", "/gemini/v1beta/models").has_value());
+    QVERIFY(!router.lookup("GET", "/v1/chat/completions").has_value());
+    QVERIFY(!router.lookup("POST", "/v1/models").has_value());
+    QVERIFY(!router.lookup("POST", "v1/messages").has_value());
+}
+
+void TestRouters::requestRouter_precedenceAndBacktracking()
+{
+    RequestRouter router;
+    router.addRoute({QStringLiteral("/api/{version}/chat"), QStringLiteral("templated"), QString()});
+    router.addRoute({QStringLiteral("/api/v1/models"), QStringLiteral("literal"), QString()});
+    router.addRoute({QStringLiteral("/api/*"), QStringLiteral("rest"), QString(),
+                     QStringLiteral("*")});
+
+    // The literal "v1" child has no ".../chat" route, so the template is tried next
+    auto found = router.lookup("POST", "/api/v1/chat");
+    QVERIFY(found.has_value());
+    QCOMPARE(found->route->inboundProtocol, QStringLiteral("templated"));
+    QCOMPARE(found->params.at(0).second, QStringLiteral("v1"));
+
+    found = router.lookup("POST", "/api/v1/models");
+    QVERIFY(found.has_value());
+    QCOMPARE(found->route->inboundProtocol, QStringLiteral("literal"));
+
+    // Neither branch matches the method; "*" accepts any
+    found = router.lookup("DELETE", "/api/v1/models");
+    QVERIFY(found.has_value());
+    QCOMPARE(found->route->inboundProtocol, QStringLiteral("rest"));
+    QVERIFY(found->params.isEmpty());
+}
+
+void TestRouters::requestRouter_configRouteReplacesDefault()
+{
+    RequestRouter router;
+    router.registerDefaults();
+    const qsizetype defaults = router.routeCount();
+
+    QVERIFY(router.addRoute({QStringLiteral("/v1/messages"), QStringLiteral("openai"), QString(),
+                             QStringLiteral("post"), QStringLiteral("backup")}));
+    QCOMPARE(router.routeCount(), defaults);
+
+    const auto route = router.match(QStringLiteral("POST"), QStringLiteral("/v1/messages"));
+    QVERIFY(route.has_value());
+    QCOMPARE(route->inboundProtocol, QStringLiteral("openai"));
+    QCOMPARE(route->group, QStringLiteral("backup"));
+}
+
+void TestRouters::requestRouter_rejectsMalformedPatterns()
+{
+    RequestRouter router;
+    QVERIFY(!router.addRoute({QStringLiteral("v1/chat"), QStringLiteral("openai"), QString()}));
+    QVERIFY(!router.addRoute({QStringLiteral("/v1/*/chat"), QStringLiteral("openai"), QString()}));
+    QVERIFY(!router.addRoute({QStringLiteral("/v1/{a}{b}"), QStringLiteral("openai"), QString()}));
+    QVERIFY(!router.addRoute({QStringLiteral("/v1/{model"), QStringLiteral("openai"), QString()}));
+    QVERIFY(!router.addRoute({QStringLiteral("/v1/chat"), QStringLiteral("openai"), QString(),
+                              QStringLiteral("TRACE")}));
+    QCOMPARE(router.routeCount(), qsizetype(0));
+}
+
 void TestRouters::inboundMultiRouter_caseInsensitiveProtocol()
 {
     InboundMultiRouter router;
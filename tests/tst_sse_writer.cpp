@@ -0,0 +1,252 @@
+#include <QTest>
+#include <QFile>
+#include <QProcess>
+#include <QSslKey>
+#include <QSslSocket>
+#include <QTcpServer>
+#include <QTemporaryDir>
+#include <QTimer>
+#include <ctime>
+#include "proxy/sse_writer.h"
+
+// Records every write separately, so tests can count what would have been
+// individual TLS records on a socket.
+class RecordingDevice : public QIODevice {
+public:
+    RecordingDevice() { open(QIODevice::WriteOnly); }
+
+    QByteArray data;
+    QList<QByteArray> writes;
+
+protected:
+    qint64 readData(char*, qint64) override { return -1; }
+    qint64 writeData(const char* bytes, qint64 size) override
+    {
+        writes.append(QByteArray(bytes, size));
+        data.append(bytes, size);
+        return size;
+    }
+};
+
+// TLS listener for the benchmark; the accepted socket encrypts with the
+// given certificate.
+class TlsServer : public QTcpServer {
+public:
+    TlsServer(QSslCertificate certificate, QSslKey key)
+        : m_certificate(std::move(certificate))
+        , m_key(std::move(key))
+    {
+    }
+
+    QSslSocket* accepted = nullptr;
+
+protected:
+    void incomingConnection(qintptr handle) override
+    {
+        auto* socket = new QSslSocket(this);
+        socket->setSocketDescriptor(handle);
+        socket->setLocalCertificate(m_certificate);
+        socket->setPrivateKey(m_key);
+        socket->startServerEncryption();
+        accepted = socket;
+    }
+
+private:
+    QSslCertificate m_certificate;
+    QSslKey m_key;
+};
+
+namespace {
+
+const QByteArray kToken = R"({"choices":[{"index":0,"delta":{"content":"tok"}}]})";
+
+QByteArray chunk(const QByteArray& payload)
+{
+    return QByteArray::number(payload.size(), 16) + "\r\n" + payload + "\r\n";
+}
+
+}
+
+class TestSseWriter : public QObject {
+    Q_OBJECT
+
+private slots:
+    void testLatencyModeWritesEachEvent()
+    {
+        RecordingDevice device;
+        SseWriter writer(&device, SseWriteMode::Latency, 10);
+
+        writer.sendEvent(kToken);
+        writer.sendEvent(kToken);
+        QCOMPARE(device.writes.size(), 2);
+        QCOMPARE(device.writes.at(0), chunk("data: " + kToken + "\n\n"));
+
+        writer.finish();
+        QCOMPARE(device.writes.size(), 3);
+        QCOMPARE(device.writes.at(2), chunk("data: [DONE]\n\n") + "0\r\n\r\n");
+        QCOMPARE(writer.eventCount(), qint64(2));
+        QCOMPARE(writer.writeCount(), qint64(3));
+    }
+
+    void testPreformattedEventsPassThrough()
+    {
+        RecordingDevice device;
+        SseWriter writer(&device, SseWriteMode::Latency, 10);
+
+        const QByteArray event = "event: message_start\ndata: {}\n\n";
+        writer.sendEvent(event);
+        QCOMPARE(device.data, chunk(event));
+
+        // Chunk sizes are lowercase hex
+        device.data.clear();
+        writer.sendEvent(QByteArray(300, 'x'));
+        QVERIFY(device.data.startsWith("134\r\ndata: xxx"));
+    }
+
+    void testThroughputModeCoalescesWithinWindow()
+    {
+        RecordingDevice device;
+        SseWriter writer(&device, SseWriteMode::Throughput, 10);
+
+        for (int i = 0; i < 5; ++i)
+            writer.sendEvent(kToken);
+        QCOMPARE(device.writes.size(), 0);
+        QCOMPARE(writer.bufferedBytes(), qint64(5 * chunk("data: " + kToken + "\n\n").size()));
+
+        QTRY_COMPARE_WITH_TIMEOUT(device.writes.size(), 1, 1000);
+        QByteArray expected;
+        for (int i = 0; i < 5; ++i)
+            expected += chunk("data: " + kToken + "\n\n");
+        QCOMPARE(device.data, expected);
+        QCOMPARE(writer.bufferedBytes(), qint64(0));
+    }
+
+    void testThroughputModeFlushesFullRecords()
+    {
+        RecordingDevice device;
+        SseWriter writer(&device, SseWriteMode::Throughput, 20);
+
+        // A full TLS record's worth goes out without waiting for the timer
+        writer.sendEvent(QByteArray(17 * 1024, 'x'));
+        QCOMPARE(device.writes.size(), 1);
+    }
+
+    void testFinishFlushesCoalescedEvents()
+    {
+        RecordingDevice device;
+        SseWriter writer(&device, SseWriteMode::Throughput, 20);
+
+        writer.writeStreamHeader();
+        QCOMPARE(device.writes.size(), 1);
+        QVERIFY(device.writes.at(0).contains("Transfer-Encoding: chunked"));
+
+        writer.sendEvent(kToken);
+        writer.finish();
+        QCOMPARE(device.writes.size(), 2);
+        QCOMPARE(device.writes.at(1),
+                 chunk("data: " + kToken + "\n\n") + chunk("data: [DONE]\n\n") + "0\r\n\r\n");
+
+        // Nothing is left for the timer to write after the response ended
+        QTest::qWait(40);
+        QCOMPARE(device.writes.size(), 2);
+    }
+
+    // Streams tokens over a loopback TLS connection at ~500 tokens/s and
+    // reports TLS records and process CPU per token for each mode.
+    void benchmarkStreamModes_data()
+    {
+        QTest::addColumn<int>("mode");
+        QTest::addColumn<int>("windowMs");
+        QTest::newRow("latency") << int(SseWriteMode::Latency) << 0;
+        QTest::newRow("throughput-5ms") << int(SseWriteMode::Throughput) << 5;
+        QTest::newRow("throughput-20ms") << int(SseWriteMode::Throughput) << 20;
+    }
+
+    void benchmarkStreamModes()
+    {
+        QFETCH(int, mode);
+        QFETCH(int, windowMs);
+        constexpr int kTokens = 500;
+
+        if (!ensureCertificate())
+            QSKIP("openssl CLI is required to generate a test certificate");
+
+        TlsServer server(m_certificate, m_key);
+        QVERIFY(server.listen(QHostAddress::LocalHost));
+
+        QSslSocket client;
+        client.setPeerVerifyMode(QSslSocket::VerifyNone);
+        QByteArray received;
+        connect(&client, &QSslSocket::readyRead, &client, [&]() { received += client.readAll(); });
+        client.connectToHostEncrypted(QStringLiteral("127.0.0.1"), server.serverPort());
+        QTRY_VERIFY(client.isEncrypted() && server.accepted && server.accepted->isEncrypted());
+
+        SseWriter writer(server.accepted, SseWriteMode(mode), windowMs);
+        writer.writeStreamHeader();
+
+        const std::clock_t cpuStart = std::clock();
+        int sent = 0;
+        QTimer producer;
+        producer.setTimerType(Qt::PreciseTimer);
+        producer.setInterval(2);
+        connect(&producer, &QTimer::timeout, &producer, [&]() {
+            writer.sendEvent(kToken);
+            if (++sent == kTokens) {
+                producer.stop();
+                writer.finish();
+            }
+        });
+        producer.start();
+        QTRY_VERIFY_WITH_TIMEOUT(received.endsWith("0\r\n\r\n"), 20000);
+        const double cpuUs = double(std::clock() - cpuStart) * 1e6 / CLOCKS_PER_SEC;
+
+        // The header went out as its own record
+        const qint64 records = writer.writeCount() - 1;
+        qInfo("%s: %d tokens, %lld records (%.2f tokens/record), %.1f us CPU/token",
+              QTest::currentDataTag(), kTokens, records,
+              double(kTokens) / double(records), cpuUs / kTokens);
+
+        // One record per token, plus the closing [DONE] write
+        if (SseWriteMode(mode) == SseWriteMode::Latency)
+            QCOMPARE(records, qint64(kTokens + 1));
+        else
+            QVERIFY(records < kTokens * 2 / 3);
+    }
+
+private:
+    bool ensureCertificate()
+    {
+        if (!m_certificate.isNull())
+            return true;
+        if (!m_dir.isValid())
+            return false;
+
+        const QString certPath = m_dir.filePath(QStringLiteral("cert.pem"));
+        const QString keyPath = m_dir.filePath(QStringLiteral("key.pem"));
+        QProcess openssl;
+        openssl.start(QStringLiteral("openssl"),
+                      {QStringLiteral("req"), QStringLiteral("-x509"),
+                       QStringLiteral("-newkey"), QStringLiteral("rsa:2048"),
+                       QStringLiteral("-nodes"), QStringLiteral("-days"), QStringLiteral("1"),
+                       QStringLiteral("-subj"), QStringLiteral("/CN=localhost"),
+                       QStringLiteral("-keyout"), keyPath,
+                       QStringLiteral("-out"), certPath});
+        if (!openssl.waitForFinished(30000) || openssl.exitCode() != 0)
+            return false;
+
+        QFile certFile(certPath);
+        QFile keyFile(keyPath);
+        if (!certFile.open(QIODevice::ReadOnly) || !keyFile.open(QIODevice::ReadOnly))
+            return false;
+        m_certificate = QSslCertificate(certFile.readAll(), QSsl::Pem);
+        m_key = QSslKey(keyFile.readAll(), QSsl::Rsa, QSsl::Pem);
+        return !m_certificate.isNull() && !m_key.isNull();
+    }
+
+    QTemporaryDir m_dir;
+    QSslCertificate m_certificate;
+    QSslKey m_key;
+};
+
+QTEST_MAIN(TestSseWriter)
+#include "tst_sse_writer.moc"
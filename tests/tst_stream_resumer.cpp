@@ -0,0 +1,129 @@
+#include <QTest>
+#include "semantic/stream_resumer.h"
+
+namespace {
+
+StreamFrame started()
+{
+    StreamFrame frame;
+    frame.type = FrameType::Started;
+    return frame;
+}
+
+StreamFrame text(const QString& delta, int candidate = 0)
+{
+    StreamFrame frame;
+    frame.candidateIndex = candidate;
+    frame.deltaSegments.append(Segment::fromText(delta));
+    return frame;
+}
+
+StreamFrame action(const QString& callId, const QString& name, const QString& args)
+{
+    StreamFrame frame;
+    frame.type = FrameType::ActionDelta;
+    frame.actionDelta.callId = callId;
+    frame.actionDelta.name = name;
+    frame.actionDelta.argsPatch = args;
+    return frame;
+}
+
+// The text of the frames the resumer lets through
+QString admitted(StreamResumer& resumer, QList<StreamFrame> frames)
+{
+    QString out;
+    for (StreamFrame& frame : frames) {
+        if (!resumer.admit(frame))
+            continue;
+        for (const Segment& segment : frame.deltaSegments)
+            out += segment.text;
+    }
+    return out;
+}
+
+}
+
+class TestStreamResumer : public QObject {
+    Q_OBJECT
+
+private slots:
+    void testRegenerateSkipsSentText()
+    {
+        StreamResumer resumer;
+        StreamFrame first = started();
+        QVERIFY(resumer.admit(first));
+        QCOMPARE(admitted(resumer, {text(QStringLiteral("Hel")), text(QStringLiteral("lo"))}),
+                 QStringLiteral("Hello"));
+
+        resumer.restart(StreamResumer::Mode::Regenerate);
+        StreamFrame again = started();
+        QVERIFY(!resumer.admit(again));
+        QCOMPARE(admitted(resumer, {text(QStringLiteral("He")), text(QStringLiteral("llo wo")),
+                                    text(QStringLiteral("rld"))}),
+                 QStringLiteral(" world"));
+
+        // Frames without text pass
+        StreamFrame finished;
+        finished.type = FrameType::Finished;
+        QVERIFY(resumer.admit(finished));
+        StreamFrame empty;
+        QVERIFY(resumer.admit(empty));
+    }
+
+    void testRegenerateSkipsSentToolCalls()
+    {
+        StreamResumer resumer;
+        QList<StreamFrame> before = {action(QStringLiteral("call_1"), QStringLiteral("search"), QString()),
+                                     action(QString(), QString(), QStringLiteral(R"({"q":)"))};
+        for (StreamFrame& frame : before)
+            QVERIFY(resumer.admit(frame));
+        QVERIFY(!resumer.canPrefill());
+
+        resumer.restart(StreamResumer::Mode::Regenerate);
+        StreamFrame start = action(QStringLiteral("call_9"), QStringLiteral("search"), QString());
+        QVERIFY(!resumer.admit(start));
+        StreamFrame args = action(QString(), QString(), QStringLiteral(R"({"q":"x"})"));
+        QVERIFY(resumer.admit(args));
+        QVERIFY(args.actionDelta.callId.isEmpty());
+        QCOMPARE(args.actionDelta.argsPatch, QStringLiteral(R"("x"})"));
+
+        // A call the client has not seen goes through whole
+        StreamFrame next = action(QStringLiteral("call_10"), QStringLiteral("fetch"), QStringLiteral("{}"));
+        QVERIFY(resumer.admit(next));
+        QCOMPARE(next.actionDelta.callId, QStringLiteral("call_10"));
+        QCOMPARE(next.actionDelta.argsPatch, QStringLiteral("{}"));
+    }
+
+    void testPrefillContinuesTrimmedText()
+    {
+        StreamResumer resumer;
+        QCOMPARE(admitted(resumer, {text(QStringLiteral("The answer is "))}), QStringLiteral("The answer is "));
+        QVERIFY(resumer.canPrefill());
+
+        SemanticRequest request;
+        InteractionItem user;
+        user.role = QStringLiteral("user");
+        user.content.append(Segment::fromText(QStringLiteral("?")));
+        request.messages.append(user);
+        const SemanticRequest prefilled = resumer.prefilled(request);
+        QCOMPARE(prefilled.messages.size(), 2);
+        QCOMPARE(prefilled.messages.last().role, QStringLiteral("assistant"));
+        QCOMPARE(prefilled.messages.last().content.first().text, QStringLiteral("The answer is"));
+
+        // The provider repeats the space the prefill was cut before
+        resumer.restart(StreamResumer::Mode::Prefill);
+        QCOMPARE(admitted(resumer, {text(QStringLiteral(" 42")), text(QStringLiteral(" "))}),
+                 QStringLiteral("42 "));
+    }
+
+    void testPrefillNeedsOneCandidate()
+    {
+        StreamResumer resumer;
+        QVERIFY(!resumer.canPrefill());
+        admitted(resumer, {text(QStringLiteral("a")), text(QStringLiteral("b"), 1)});
+        QVERIFY(!resumer.canPrefill());
+    }
+};
+
+QTEST_MAIN(TestStreamResumer)
+#include "tst_stream_resumer.moc"